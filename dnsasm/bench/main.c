@@ -0,0 +1,917 @@
+/*
+ * DNSASM Bench - Corpus-Driven Kernel Benchmark
+ *
+ * Usage:
+ *   dnsasm-bench [options] [file ...]
+ *
+ * Loads DNS messages from pcap captures or hex files (see
+ * tools/corpus.h), or builds a synthetic mix when no file is given, and
+ * times every public hot-path function on every message, under every
+ * kernel implementation this CPU can run.
+ *
+ * Cost is counted per call in CPU cycles: from a user-space readable
+ * perf_event cycle counter when the kernel allows one, otherwise from
+ * the TSC (reference cycles at a constant rate). Each message is timed
+ * over a short run of back-to-back calls, minus the cost of the same
+ * run through an empty function, and keeps its best run across rounds;
+ * the distribution over messages is reported per message class as
+ * min/median/p99. Throughput is a separate streaming pass over the
+ * whole sample, one message after another, on one core.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "dnsasm.h"
+#include "corpus.h"
+
+#define MAX_IMPLS       8
+#define MAX_RR          256
+
+/* ============================================================================
+ * Cycle counters
+ * ============================================================================ */
+
+enum { COUNTER_PERF, COUNTER_TSC, COUNTER_CLOCK };
+
+static const char *const counter_names[] = {"perf", "tsc", "clock"};
+static const char *const counter_units[] = {
+    "core cycles", "reference cycles", "nanoseconds",
+};
+
+static int counter = COUNTER_CLOCK;
+static double ticks_per_ns = 1.0;
+
+#if defined(__linux__) && defined(__x86_64__)
+static volatile struct perf_event_mmap_page *pmc;
+
+/* The seqlock read the perf_event_mmap_page comment describes */
+static inline uint64_t perf_cycles(void) {
+    uint32_t seq;
+    uint64_t count;
+    do {
+        seq = pmc->lock;
+        __asm__ __volatile__("" ::: "memory");
+        uint32_t idx = pmc->index;
+        count = pmc->offset;
+        if (idx != 0) {
+            uint64_t v = __builtin_ia32_rdpmc((int)idx - 1);
+            unsigned shift = 64 - pmc->pmc_width;
+            count += (uint64_t)((int64_t)(v << shift) >> shift);
+        }
+        __asm__ __volatile__("" ::: "memory");
+    } while (pmc->lock != seq);
+    return count;
+}
+
+static int perf_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    void *page = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    pmc = page;
+    if (!pmc->cap_user_rdpmc || pmc->index == 0) {
+        munmap(page, (size_t)sysconf(_SC_PAGESIZE));
+        close(fd);
+        pmc = NULL;
+        return -1;
+    }
+    return 0;                       /* fd stays open for the process */
+}
+#endif
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Serialized reads: the timed calls can't drift across either edge */
+static inline uint64_t ticks_begin(void) {
+#if defined(__linux__) && defined(__x86_64__)
+    if (counter == COUNTER_PERF) {
+        _mm_lfence();
+        return perf_cycles();
+    }
+#endif
+#if defined(__x86_64__)
+    if (counter == COUNTER_TSC) {
+        _mm_lfence();
+        return __rdtsc();
+    }
+#endif
+    return clock_ns();
+}
+
+static inline uint64_t ticks_end(void) {
+#if defined(__linux__) && defined(__x86_64__)
+    if (counter == COUNTER_PERF) {
+        uint64_t t = perf_cycles();
+        _mm_lfence();
+        return t;
+    }
+#endif
+#if defined(__x86_64__)
+    if (counter == COUNTER_TSC) {
+        unsigned aux;
+        uint64_t t = __rdtscp(&aux);
+        _mm_lfence();
+        return t;
+    }
+#endif
+    return clock_ns();
+}
+
+/* Pick the best counter available and measure its rate against the clock */
+static void counter_init(const char *want) {
+    counter = COUNTER_CLOCK;
+#if defined(__linux__) && defined(__x86_64__)
+    if ((want == NULL || strcmp(want, "perf") == 0) && perf_open() == 0) {
+        counter = COUNTER_PERF;
+    } else
+#endif
+#if defined(__x86_64__)
+    if (want == NULL || strcmp(want, "tsc") == 0 || strcmp(want, "perf") == 0) {
+        counter = COUNTER_TSC;
+    }
+#endif
+    if (want != NULL && strcmp(want, counter_names[counter]) != 0) {
+        fprintf(stderr, "dnsasm-bench: counter '%s' unavailable, using %s\n",
+                want, counter_names[counter]);
+    }
+
+    /* A busy spin, so a frequency-scaled core has ramped up */
+    uint64_t n0 = clock_ns(), t0 = ticks_begin();
+    volatile uint64_t spin = 0;
+    while (clock_ns() - n0 < 100000000ULL) {
+        spin++;
+    }
+    uint64_t t1 = ticks_end(), n1 = clock_ns();
+    ticks_per_ns = (double)(t1 - t0) / (double)(n1 - n0);
+}
+
+/* ============================================================================
+ * Samples and classes
+ * ============================================================================ */
+
+enum {
+    CLASS_QUERY,
+    CLASS_QUERY_EDNS,
+    CLASS_LONG_NAME,
+    CLASS_RESPONSE,
+    CLASS_RESPONSE_COMPRESSED,
+    CLASS_MALFORMED,
+    CLASS_COUNT,
+};
+
+static const char *const class_names[CLASS_COUNT] = {
+    "query", "query-edns", "long-name", "response", "response-compressed", "malformed",
+};
+
+#define LONG_NAME       64          /* Wire length from which a qname is long */
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t len;
+    uint16_t question_end;          /* Where dnsasm_parse_edns starts */
+    uint8_t  cls;
+    uint8_t  _pad;
+    uint32_t names;                 /* First entry in name_offs */
+    uint32_t name_count;
+} sample_t;
+
+static uint16_t *name_offs;
+static size_t name_offs_len, name_offs_cap;
+
+static int push_name(uint16_t off) {
+    if (name_offs_len == name_offs_cap) {
+        size_t cap = name_offs_cap ? name_offs_cap * 2 : 4096;
+        uint16_t *p = realloc(name_offs, cap * sizeof(*p));
+        if (p == NULL) {
+            return -1;
+        }
+        name_offs = p;
+        name_offs_cap = cap;
+    }
+    name_offs[name_offs_len++] = off;
+    return 0;
+}
+
+/* Index a message once up front: class, EDNS start and owner names */
+static int prepare(sample_t *s, const uint8_t *data, size_t len) {
+    static dnsasm_rr_index_t rr[MAX_RR];
+    dnsasm_header_t h;
+    dnsasm_msg_t msg;
+
+    memset(s, 0, sizeof(*s));
+    s->data = data;
+    s->len = (uint32_t)(len < UINT16_MAX ? len : UINT16_MAX);
+    s->question_end = 12;
+    s->names = (uint32_t)name_offs_len;
+
+    int herr = dnsasm_parse_header(data, s->len, &h);
+    int merr = herr == DNSASM_OK ? dnsasm_parse_message(data, s->len, &msg, rr, MAX_RR) : herr;
+    if (herr != DNSASM_OK) {
+        s->cls = CLASS_MALFORMED;
+        return 0;
+    }
+
+    /* Entries before an error are still valid */
+    size_t n = msg.total;
+    int compressed = 0;
+    uint16_t qname_len = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t name[DNS_MAX_NAME_LEN + 1];
+        uint16_t name_len = 0;
+        dnsasm_result_t r = dnsasm_decompress_name(data, s->len, rr[i].name_off, name, &name_len);
+        if (r.error == DNSASM_OK && r.offset - rr[i].name_off < name_len) {
+            compressed = 1;
+        }
+        if (i == 0) {
+            qname_len = name_len;
+        }
+        if (push_name(rr[i].name_off) != 0) {
+            return -1;
+        }
+    }
+    s->name_count = (uint32_t)n;
+    size_t qd = msg.count[DNSASM_SECTION_QUESTION];
+    if (qd > 0 && qd <= n) {
+        s->question_end = qd < n ? rr[qd].name_off : (uint16_t)msg.end;
+    }
+
+    dnsasm_edns_t edns;
+    if (merr != DNSASM_OK && merr != DNSASM_ERR_SPACE) {
+        s->cls = CLASS_MALFORMED;
+    } else if (qname_len >= LONG_NAME) {
+        s->cls = CLASS_LONG_NAME;
+    } else if (!h.qr) {
+        int edns_ok = dnsasm_parse_edns(data, s->len, s->question_end, &edns) == DNSASM_OK;
+        s->cls = edns_ok && edns.present ? CLASS_QUERY_EDNS : CLASS_QUERY;
+    } else {
+        s->cls = compressed ? CLASS_RESPONSE_COMPRESSED : CLASS_RESPONSE;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Functions under test
+ * ============================================================================ */
+
+static const dnsasm_hash_key_t hash_key = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+
+static uint64_t run_noop(const sample_t *s) {
+    __asm__ __volatile__("" : : "r"(s) : "memory");
+    return 0;
+}
+
+static uint64_t run_header(const sample_t *s) {
+    dnsasm_header_t h;
+    return (uint64_t)dnsasm_parse_header(s->data, s->len, &h) + h.id;
+}
+
+static uint64_t run_question(const sample_t *s) {
+    dnsasm_question_t q;
+    dnsasm_result_t r = dnsasm_parse_question(s->data, s->len, 12, &q);
+    return r.offset + (uint64_t)r.error;
+}
+
+static uint64_t run_question_keyed(const sample_t *s) {
+    dnsasm_question_t q;
+    uint64_t hash = 0;
+    dnsasm_result_t r = dnsasm_parse_question_keyed(s->data, s->len, 12, 0, &hash_key, &q, &hash);
+    return hash + r.offset;
+}
+
+static uint64_t run_message(const sample_t *s) {
+    static dnsasm_rr_index_t rr[MAX_RR];
+    dnsasm_msg_t msg;
+    return (uint64_t)dnsasm_parse_message(s->data, s->len, &msg, rr, MAX_RR) + msg.end;
+}
+
+static uint64_t run_names(const sample_t *s) {
+    uint8_t name[DNS_MAX_NAME_LEN + 1];
+    uint64_t acc = 0;
+    for (uint32_t i = 0; i < s->name_count; i++) {
+        uint16_t len;
+        dnsasm_result_t r = dnsasm_decompress_name(s->data, s->len, name_offs[s->names + i],
+                                                   name, &len);
+        acc += r.offset + len;
+    }
+    return acc;
+}
+
+static uint64_t run_edns(const sample_t *s) {
+    dnsasm_edns_t e;
+    return (uint64_t)dnsasm_parse_edns(s->data, s->len, s->question_end, &e) + e.udp_size;
+}
+
+static uint64_t run_classify(const sample_t *s) {
+    dnsasm_query_class_t c;
+    return dnsasm_classify_query(s->data, s->len, &c);
+}
+
+typedef struct {
+    const char *name;
+    uint64_t (*run)(const sample_t *s);
+} bench_fn_t;
+
+static const bench_fn_t functions[] = {
+    {"header",         run_header},
+    {"question",       run_question},
+    {"question_keyed", run_question_keyed},
+    {"message",        run_message},
+    {"names",          run_names},
+    {"edns",           run_edns},
+    {"classify",       run_classify},
+};
+
+#define FN_COUNT (sizeof(functions) / sizeof(functions[0]))
+
+/* Results leak into here so no call is optimized away */
+static volatile uint64_t sink;
+
+/* ============================================================================
+ * Synthetic corpus
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t *p;
+    size_t len;
+} wbuf_t;
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t rand32(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static void put8(wbuf_t *b, uint8_t v) {
+    b->p[b->len++] = v;
+}
+
+static void put16(wbuf_t *b, uint16_t v) {
+    put8(b, (uint8_t)(v >> 8));
+    put8(b, (uint8_t)v);
+}
+
+static void put32(wbuf_t *b, uint32_t v) {
+    put16(b, (uint16_t)(v >> 16));
+    put16(b, (uint16_t)v);
+}
+
+/* Random lowercase labels, then the root */
+static void put_random_name(wbuf_t *b, int labels, int min_len, int max_len) {
+    for (int i = 0; i < labels; i++) {
+        int n = min_len + (int)(rand32() % (unsigned)(max_len - min_len + 1));
+        put8(b, (uint8_t)n);
+        for (int k = 0; k < n; k++) {
+            put8(b, (uint8_t)('a' + rand32() % 26));
+        }
+    }
+    put8(b, 0);
+}
+
+static void put_header(wbuf_t *b, uint16_t flags, uint16_t qd, uint16_t an, uint16_t ns,
+                       uint16_t ar) {
+    put16(b, (uint16_t)rand32());
+    put16(b, flags);
+    put16(b, qd);
+    put16(b, an);
+    put16(b, ns);
+    put16(b, ar);
+}
+
+static void put_opt(wbuf_t *b, int cookie) {
+    put8(b, 0);
+    put16(b, 41);                   /* OPT */
+    put16(b, 1232);
+    put32(b, 0x00008000);           /* DO */
+    put16(b, cookie ? 28 : 0);
+    if (cookie) {
+        put16(b, 10);
+        put16(b, 24);
+        for (int i = 0; i < 24; i++) {
+            put8(b, (uint8_t)rand32());
+        }
+    }
+}
+
+/*
+ * A mix in the shape of recursive-server traffic: plain and EDNS
+ * queries, long names, responses with CNAME chains and compressed
+ * owners, and a tail of malformed messages (pointer loops, forward
+ * pointers, truncation).
+ */
+static int build_synthetic(corpus_t *c, size_t count) {
+    uint8_t *arena = malloc(count * 512);
+    if (arena == NULL || corpus_adopt(c, arena, count * 512) != 0) {
+        free(arena);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        wbuf_t b = {arena + i * 512, 0};
+        unsigned kind = rand32() % 100;
+        uint16_t qtype = rand32() % 2 ? 1 : 28;
+
+        if (kind < 30) {                            /* Plain query */
+            put_header(&b, 0x0100, 1, 0, 0, 0);
+            put_random_name(&b, 2 + (int)(rand32() % 3), 3, 12);
+            put16(&b, qtype);
+            put16(&b, 1);
+        } else if (kind < 55) {                     /* EDNS query, maybe a cookie */
+            put_header(&b, 0x0100, 1, 0, 0, 1);
+            put_random_name(&b, 2 + (int)(rand32() % 3), 3, 12);
+            put16(&b, qtype);
+            put16(&b, 1);
+            put_opt(&b, rand32() % 2);
+        } else if (kind < 65) {                     /* Long name */
+            put_header(&b, 0x0100, 1, 0, 0, 1);
+            put_random_name(&b, 8 + (int)(rand32() % 6), 10, 20);
+            put16(&b, qtype);
+            put16(&b, 1);
+            put_opt(&b, 0);
+        } else if (kind < 95) {                     /* CNAME chain response */
+            int chain = 1 + (int)(rand32() % 3);
+            int addrs = 1 + (int)(rand32() % 4);
+            put_header(&b, 0x8180, 1, (uint16_t)(chain + addrs), 1, 1);
+            size_t qname = b.len;
+            put_random_name(&b, 3, 3, 10);
+            put16(&b, qtype);
+            put16(&b, 1);
+            size_t owner = qname;
+            for (int k = 0; k < chain; k++) {
+                put16(&b, (uint16_t)(0xc000 | owner));
+                put16(&b, 5);               /* CNAME */
+                put16(&b, 1);
+                put32(&b, 300);
+                size_t rdlen_at = b.len;
+                put16(&b, 0);
+                owner = b.len;
+                /* A new first label over the previous owner's parent */
+                put8(&b, 6);
+                for (int j = 0; j < 6; j++) {
+                    put8(&b, (uint8_t)('a' + rand32() % 26));
+                }
+                put16(&b, (uint16_t)(0xc000 | (qname + 1 + arena[i * 512 + qname])));
+                b.p[rdlen_at] = 0;
+                b.p[rdlen_at + 1] = (uint8_t)(b.len - rdlen_at - 2);
+            }
+            for (int k = 0; k < addrs; k++) {
+                put16(&b, (uint16_t)(0xc000 | owner));
+                put16(&b, qtype);
+                put16(&b, 1);
+                put32(&b, 60);
+                put16(&b, qtype == 1 ? 4 : 16);
+                for (int j = 0; j < (qtype == 1 ? 4 : 16); j++) {
+                    put8(&b, (uint8_t)rand32());
+                }
+            }
+            put16(&b, (uint16_t)(0xc000 | (qname + 1 + arena[i * 512 + qname])));
+            put16(&b, 2);                   /* NS */
+            put16(&b, 1);
+            put32(&b, 86400);
+            put16(&b, 6);
+            put8(&b, 3);
+            put8(&b, 'n');
+            put8(&b, 's');
+            put8(&b, '1');
+            put16(&b, (uint16_t)(0xc000 | qname));
+            put_opt(&b, 0);
+        } else {                                    /* Malformed */
+            put_header(&b, 0x0100, 1, 0, 0, 0);
+            unsigned shape = rand32() % 3;
+            if (shape == 2) {
+                put_random_name(&b, 3, 3, 12);
+                b.len -= 3;                 /* Cut inside the name */
+            } else {
+                put16(&b, shape == 0 ? 0xc00c : 0xc040);   /* Self or forward */
+                put16(&b, 1);
+                put16(&b, 1);
+            }
+        }
+        if (corpus_add(c, b.p, b.len, CORPUS_HEX) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Measurement
+ * ============================================================================ */
+
+typedef struct {
+    size_t n;
+    double min, median, p99, mean;
+} stats_t;
+
+typedef struct {
+    stats_t cls[CLASS_COUNT + 1];   /* Last is every message */
+    double mpps;                    /* Streaming throughput, one core */
+} fn_result_t;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static stats_t summarize(double *v, size_t n) {
+    stats_t s = {0};
+    if (n == 0) {
+        return s;
+    }
+    qsort(v, n, sizeof(*v), cmp_double);
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += v[i];
+    }
+    s.n = n;
+    s.min = v[0];
+    s.median = v[n / 2];
+    s.p99 = v[(99 * n + 99) / 100 - 1];
+    s.mean = sum / (double)n;
+    return s;
+}
+
+static uint64_t time_run(const bench_fn_t *f, const sample_t *s, int reps) {
+    uint64_t acc = 0;
+    uint64_t t0 = ticks_begin();
+    for (int k = 0; k < reps; k++) {
+        acc += f->run(s);
+    }
+    uint64_t t1 = ticks_end();
+    sink += acc;
+    return t1 - t0;
+}
+
+/* Fixed cost of a timed run: the counter reads and the call loop */
+static double run_overhead(const sample_t *s, int reps) {
+    static const bench_fn_t noop = {"noop", run_noop};
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t t = time_run(&noop, s, reps);
+        if (t < best) {
+            best = t;
+        }
+    }
+    return (double)best;
+}
+
+static void measure(const bench_fn_t *f, const sample_t *samples, size_t n, int rounds,
+                    int reps, double overhead, double *best, double *scratch,
+                    fn_result_t *out) {
+    for (size_t i = 0; i < n; i++) {
+        best[i] = INFINITY;
+    }
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            double t = ((double)time_run(f, &samples[i], reps) - overhead) / reps;
+            if (t < best[i]) {
+                best[i] = t < 0 ? 0 : t;
+            }
+        }
+    }
+
+    for (int c = 0; c <= CLASS_COUNT; c++) {
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (c == CLASS_COUNT || samples[i].cls == c) {
+                scratch[m++] = best[i];
+            }
+        }
+        out->cls[c] = summarize(scratch, m);
+    }
+
+    /* Streaming: every message once per pass, best pass wins */
+    uint64_t best_ns = UINT64_MAX;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t acc = 0, t0 = clock_ns();
+        for (size_t i = 0; i < n; i++) {
+            acc += f->run(&samples[i]);
+        }
+        uint64_t dt = clock_ns() - t0;
+        sink += acc;
+        if (dt < best_ns) {
+            best_ns = dt;
+        }
+    }
+    out->mpps = best_ns ? (double)n * 1e3 / (double)best_ns : 0;
+}
+
+/* ============================================================================
+ * Reports
+ * ============================================================================ */
+
+static void print_text(const char *const *impls, size_t impl_count,
+                       fn_result_t (*res)[FN_COUNT], const size_t *class_count,
+                       size_t n, const corpus_t *c, int synthetic, int rounds, int reps) {
+    printf("\n═══════════════════════════════════════════════════════════\n");
+    printf("                 DNSASM Corpus Benchmark\n");
+    printf("═══════════════════════════════════════════════════════════\n\n");
+    if (synthetic) {
+        printf("Corpus:   %zu synthetic messages\n", n);
+    } else {
+        printf("Corpus:   %zu messages sampled of %zu (%zu frames, %zu fragments and "
+               "%zu others skipped)\n", n, c->count, c->frames, c->skipped_fragment,
+               c->skipped_other);
+        if (c->truncated > 0) {
+            printf("          %zu capture(s) cut off mid-record; the partial record was "
+                   "dropped\n", c->truncated);
+        }
+    }
+    printf("Counter:  %s, %s (%.2f per ns)\n", counter_names[counter], counter_units[counter],
+           ticks_per_ns);
+    printf("Method:   best of %d rounds of %d back-to-back calls per message\n", rounds, reps);
+    printf("Classes: ");
+    for (int k = 0; k < CLASS_COUNT; k++) {
+        printf(" %s %zu%s", class_names[k], class_count[k], k + 1 < CLASS_COUNT ? "," : "\n");
+    }
+
+    for (size_t m = 0; m < impl_count; m++) {
+        printf("\n[%s]\n", impls[m]);
+        printf("  %-15s %-20s %8s %9s %9s %9s %10s\n", "function", "class", "n", "min",
+               "median", "p99", "Mpps/core");
+        for (size_t f = 0; f < FN_COUNT; f++) {
+            for (int k = CLASS_COUNT; k >= 0; k--) {
+                const stats_t *s = &res[m][f].cls[k];
+                if (s->n == 0) {
+                    continue;
+                }
+                if (k == CLASS_COUNT) {
+                    printf("  %-15s %-20s %8zu %9.1f %9.1f %9.1f %10.2f\n", functions[f].name,
+                           "all", s->n, s->min, s->median, s->p99, res[m][f].mpps);
+                } else {
+                    printf("  %-15s %-20s %8zu %9.1f %9.1f %9.1f\n", "", class_names[k],
+                           s->n, s->min, s->median, s->p99);
+                }
+            }
+        }
+    }
+
+    printf("\nSide by side: median %s over all messages (Mpps/core)\n", counter_units[counter]);
+    printf("  %-15s", "function");
+    for (size_t m = 0; m < impl_count; m++) {
+        printf(" %18s", impls[m]);
+    }
+    printf("\n");
+    for (size_t f = 0; f < FN_COUNT; f++) {
+        printf("  %-15s", functions[f].name);
+        for (size_t m = 0; m < impl_count; m++) {
+            printf(" %9.1f (%6.2f)", res[m][f].cls[CLASS_COUNT].median, res[m][f].mpps);
+        }
+        printf("\n");
+    }
+    printf("\n═══════════════════════════════════════════════════════════\n");
+}
+
+static void print_stats_json(const stats_t *s) {
+    printf("{\"n\": %zu, \"min\": %.2f, \"median\": %.2f, \"p99\": %.2f, \"mean\": %.2f}",
+           s->n, s->min, s->median, s->p99, s->mean);
+}
+
+static void print_json(const char *const *impls, size_t impl_count,
+                       fn_result_t (*res)[FN_COUNT], const size_t *class_count, size_t n,
+                       const corpus_t *c, int synthetic, int rounds, int reps) {
+    printf("{\n  \"counter\": \"%s\",\n  \"unit\": \"%s\",\n  \"ticks_per_ns\": %.4f,\n",
+           counter_names[counter], counter_units[counter], ticks_per_ns);
+    printf("  \"rounds\": %d,\n  \"reps\": %d,\n", rounds, reps);
+    printf("  \"corpus\": {\"synthetic\": %s, \"messages\": %zu, \"sampled\": %zu, "
+           "\"frames\": %zu, \"skipped_fragment\": %zu, \"skipped_other\": %zu, "
+           "\"truncated\": %zu},\n",
+           synthetic ? "true" : "false", c->count, n, c->frames, c->skipped_fragment,
+           c->skipped_other, c->truncated);
+    printf("  \"classes\": {");
+    for (int k = 0; k < CLASS_COUNT; k++) {
+        printf("%s\"%s\": %zu", k ? ", " : "", class_names[k], class_count[k]);
+    }
+    printf("},\n  \"results\": [\n");
+    for (size_t m = 0; m < impl_count; m++) {
+        for (size_t f = 0; f < FN_COUNT; f++) {
+            printf("    {\"impl\": \"%s\", \"function\": \"%s\", \"mpps\": %.3f, \"all\": ",
+                   impls[m], functions[f].name, res[m][f].mpps);
+            print_stats_json(&res[m][f].cls[CLASS_COUNT]);
+            printf(", \"classes\": {");
+            int first = 1;
+            for (int k = 0; k < CLASS_COUNT; k++) {
+                if (res[m][f].cls[k].n == 0) {
+                    continue;
+                }
+                printf("%s\"%s\": ", first ? "" : ", ", class_names[k]);
+                print_stats_json(&res[m][f].cls[k]);
+                first = 0;
+            }
+            printf("}}%s\n", m + 1 == impl_count && f + 1 == FN_COUNT ? "" : ",");
+        }
+    }
+    printf("  ]\n}\n");
+}
+
+/* ============================================================================
+ * Main
+ * ============================================================================ */
+
+static void usage(const char *argv0) {
+    printf("Usage: %s [options] [file ...]\n\n", argv0);
+    printf("Files are pcap captures or hex text (one message per line). Without\n");
+    printf("files a synthetic mix is used.\n\n");
+    printf("  --json           Machine-readable output\n");
+    printf("  --impl NAME      Only this implementation (repeatable)\n");
+    printf("  --counter NAME   perf, tsc or clock (default: best available)\n");
+    printf("  --rounds N       Timed passes per function (default 5)\n");
+    printf("  --reps N         Back-to-back calls per timed run (default 8)\n");
+    printf("  --max N          Sample at most N messages (default 200000)\n");
+    printf("  --synthetic N    Synthetic messages when no file is given (default 20000)\n");
+    printf("  --port N         Capture port filter, 0 for any (default 53)\n");
+    printf("  --cpu N          Pin to CPU N\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *impls[MAX_IMPLS];
+    size_t impl_count = 0;
+    const char *want_counter = NULL;
+    int json = 0, rounds = 5, reps = 8, cpu = -1;
+    size_t max = 200000, synthetic_count = 20000;
+    long port = 53;
+    const char *files[256];
+    size_t file_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else if (strcmp(a, "--json") == 0) {
+            json = 1;
+        } else if (a[0] == '-' && a[1] == '-' && v == NULL) {
+            fprintf(stderr, "dnsasm-bench: %s needs a value\n", a);
+            return 2;
+        } else if (strcmp(a, "--impl") == 0 && impl_count < MAX_IMPLS) {
+            impls[impl_count++] = v;
+            i++;
+        } else if (strcmp(a, "--counter") == 0) {
+            want_counter = v;
+            i++;
+        } else if (strcmp(a, "--rounds") == 0) {
+            rounds = atoi(v);
+            i++;
+        } else if (strcmp(a, "--reps") == 0) {
+            reps = atoi(v);
+            i++;
+        } else if (strcmp(a, "--max") == 0) {
+            max = strtoul(v, NULL, 10);
+            i++;
+        } else if (strcmp(a, "--synthetic") == 0) {
+            synthetic_count = strtoul(v, NULL, 10);
+            i++;
+        } else if (strcmp(a, "--port") == 0) {
+            port = strtol(v, NULL, 10);
+            i++;
+        } else if (strcmp(a, "--cpu") == 0) {
+            cpu = atoi(v);
+            i++;
+        } else if (a[0] == '-') {
+            fprintf(stderr, "dnsasm-bench: unknown option %s\n", a);
+            return 2;
+        } else if (file_count < sizeof(files) / sizeof(files[0])) {
+            files[file_count++] = a;
+        }
+    }
+    if (rounds < 1 || reps < 1 || max == 0 || port < 0 || port > 65535) {
+        fprintf(stderr, "dnsasm-bench: bad option value\n");
+        return 2;
+    }
+
+    if (cpu >= 0) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            perror("dnsasm-bench: sched_setaffinity");
+            return 1;
+        }
+#else
+        fprintf(stderr, "dnsasm-bench: --cpu is only supported on Linux\n");
+        return 2;
+#endif
+    }
+
+    /* Implementations: the named ones, or every one this CPU runs */
+    if (impl_count == 0) {
+        impl_count = dnsasm_impl_names(impls, MAX_IMPLS);
+    }
+    for (size_t m = 0; m < impl_count; m++) {
+        if (dnsasm_select_impl(impls[m]) != 0) {
+            fprintf(stderr, "dnsasm-bench: implementation '%s' not available\n", impls[m]);
+            return 1;
+        }
+    }
+
+    corpus_t corpus;
+    corpus_init(&corpus, (uint16_t)port);
+    for (size_t i = 0; i < file_count; i++) {
+        char err[256];
+        if (corpus_load(&corpus, files[i], err, sizeof(err)) != 0) {
+            fprintf(stderr, "dnsasm-bench: %s: %s\n", files[i], err);
+            corpus_free(&corpus);
+            return 1;
+        }
+    }
+    int synthetic = file_count == 0;
+    if (synthetic && build_synthetic(&corpus, synthetic_count) != 0) {
+        fprintf(stderr, "dnsasm-bench: out of memory\n");
+        return 1;
+    }
+    if (corpus.count == 0) {
+        fprintf(stderr, "dnsasm-bench: no DNS messages found\n");
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    /* An even stride through the corpus when it is bigger than max */
+    size_t n = corpus.count < max ? corpus.count : max;
+    sample_t *samples = calloc(n, sizeof(*samples));
+    double *best = malloc(n * sizeof(*best));
+    double *scratch = malloc(n * sizeof(*scratch));
+    fn_result_t (*res)[FN_COUNT] = calloc(impl_count, sizeof(*res));
+    size_t class_count[CLASS_COUNT] = {0};
+    if (samples == NULL || best == NULL || scratch == NULL || res == NULL) {
+        fprintf(stderr, "dnsasm-bench: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const corpus_packet_t *p = &corpus.packets[i * corpus.count / n];
+        if (prepare(&samples[i], p->data, p->len) != 0) {
+            fprintf(stderr, "dnsasm-bench: out of memory\n");
+            return 1;
+        }
+        class_count[samples[i].cls]++;
+    }
+
+    counter_init(want_counter);
+    double overhead = run_overhead(&samples[0], reps);
+
+    for (size_t m = 0; m < impl_count; m++) {
+        dnsasm_select_impl(impls[m]);
+        if (!json) {
+            fprintf(stderr, "dnsasm-bench: timing %s...\n", impls[m]);
+        }
+        for (size_t f = 0; f < FN_COUNT; f++) {
+            for (size_t i = 0; i < n; i++) {
+                sink += functions[f].run(&samples[i]);      /* Warm up */
+            }
+            measure(&functions[f], samples, n, rounds, reps, overhead, best, scratch,
+                    &res[m][f]);
+        }
+    }
+
+    if (json) {
+        print_json(impls, impl_count, res, class_count, n, &corpus, synthetic, rounds, reps);
+    } else {
+        print_text(impls, impl_count, res, class_count, n, &corpus, synthetic, rounds, reps);
+    }
+
+    free(res);
+    free(scratch);
+    free(best);
+    free(samples);
+    free(name_offs);
+    corpus_free(&corpus);
+    return 0;
+}
@@ -7,16 +7,25 @@
  *   dnsasm-console --bench           - Run benchmarks
  *   dnsasm-console --parse <hexdata> - Parse hex-encoded DNS packet
  *   dnsasm-console --query <domain>  - Build and parse a query
+ *   dnsasm-console --pcap <file>     - Replay a capture through the parser
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 
 #include "dnsasm.h"
+#include "corpus.h"
 
 /* ANSI color codes */
 #define COLOR_RESET   "\033[0m"
@@ -77,6 +86,11 @@ static uint64_t get_time_ns(void) {
     return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
+/* Read a big-endian 16-bit field */
+static uint16_t load16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
 /* Print hex dump */
 static void hexdump(const uint8_t *data, size_t len) {
     for (size_t i = 0; i < len; i++) {
@@ -111,38 +125,143 @@ static void print_header(const dnsasm_header_t *h) {
     printf("  ARCOUNT:  %d\n", h->arcount);
 }
 
-/* Print parsed question */
-static void print_question(const dnsasm_question_t *q) {
-    printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
-    printf(COLOR_BOLD "Question Section\n" COLOR_RESET);
-    printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
-    
-    /* Convert wire format name to dotted notation */
-    char dotted[256];
+/* Convert a decompressed wire format name to dotted notation */
+static void name_to_dotted(const uint8_t *name, size_t name_len, char dotted[256]) {
     size_t di = 0;
     size_t i = 0;
-    while (i < q->name_len && q->name[i] != 0) {
-        uint8_t label_len = q->name[i];
+    while (i < name_len && name[i] != 0) {
+        uint8_t label_len = name[i];
         if (di > 0) dotted[di++] = '.';
-        memcpy(dotted + di, q->name + i + 1, label_len);
+        memcpy(dotted + di, name + i + 1, label_len);
         di += label_len;
         i += label_len + 1;
     }
+    if (di == 0) dotted[di++] = '.';
     dotted[di] = '\0';
+}
+
+static const char *type_name(uint16_t type) {
+    return type == 1 ? "A" :
+           type == 28 ? "AAAA" :
+           type == 5 ? "CNAME" :
+           type == 15 ? "MX" :
+           type == 2 ? "NS" :
+           type == 6 ? "SOA" :
+           type == 12 ? "PTR" :
+           type == 33 ? "SRV" :
+           type == 41 ? "OPT" :
+           type == 16 ? "TXT" : "OTHER";
+}
+
+static const char *error_name(int err) {
+    switch (err) {
+    case DNSASM_OK:           return "OK";
+    case DNSASM_ERR_SHORT:    return "SHORT";
+    case DNSASM_ERR_NAME:     return "NAME";
+    case DNSASM_ERR_POINTER:  return "POINTER";
+    case DNSASM_ERR_LOOP:     return "LOOP";
+    case DNSASM_ERR_OVERFLOW: return "OVERFLOW";
+    case DNSASM_ERR_SPACE:    return "SPACE";
+    case DNSASM_ERR_EDNS:     return "EDNS";
+    case DNSASM_ERR_RDATA:    return "RDATA";
+    case DNSASM_ERR_FORMAT:   return "FORMAT";
+    default:                  return "UNKNOWN";
+    }
+}
+
+/* Print parsed question */
+static void print_question(const dnsasm_question_t *q) {
+    printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
+    printf(COLOR_BOLD "Question Section\n" COLOR_RESET);
+    printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
+    
+    char dotted[256];
+    name_to_dotted(q->name, q->name_len, dotted);
     
     printf("  Name:     %s\n", dotted);
-    printf("  Type:     %d (%s)\n", q->qtype,
-           q->qtype == 1 ? "A" :
-           q->qtype == 28 ? "AAAA" :
-           q->qtype == 5 ? "CNAME" :
-           q->qtype == 15 ? "MX" :
-           q->qtype == 2 ? "NS" :
-           q->qtype == 16 ? "TXT" : "OTHER");
+    printf("  Type:     %d (%s)\n", q->qtype, type_name(q->qtype));
     printf("  Class:    %d (%s)\n", q->qclass,
            q->qclass == 1 ? "IN" : "OTHER");
     printf("  Wire len: %d bytes\n", q->wire_len);
 }
 
+/* Print a resource record on one line */
+static void print_rr(const char *section, const dnsasm_rr_t *rr) {
+    char dotted[256];
+    name_to_dotted(rr->name, rr->name_len, dotted);
+    printf("  %-10s %-32s %-6s class %-5u ttl %-8u rdlen %u\n", section, dotted,
+           type_name(rr->rtype), rr->rclass, rr->ttl, rr->rdlength);
+}
+
+/* Parse and print every section of a packet */
+static void print_message(const uint8_t *packet, size_t len) {
+    static const char *const sections[] = {"Answer", "Authority", "Additional"};
+    dnsasm_header_t h;
+    int err = dnsasm_parse_header(packet, len, &h);
+    if (err != 0) {
+        printf(COLOR_RED "Error parsing header: %s\n" COLOR_RESET, error_name(err));
+        return;
+    }
+    print_header(&h);
+
+    size_t off = 12;
+    for (int i = 0; i < h.qdcount; i++) {
+        dnsasm_question_t q;
+        dnsasm_result_t res = dnsasm_parse_question(packet, len, off, &q);
+        if (res.error != 0) {
+            printf(COLOR_RED "Error parsing question %d: %s\n" COLOR_RESET, i, error_name(res.error));
+            return;
+        }
+        print_question(&q);
+        off = res.offset;
+    }
+
+    const uint16_t counts[3] = {h.ancount, h.nscount, h.arcount};
+    int printed = 0;
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < counts[s]; i++) {
+            dnsasm_rr_t rr;
+            dnsasm_result_t res = dnsasm_parse_rr(packet, len, off, &rr);
+            if (res.error != 0) {
+                printf(COLOR_RED "Error parsing %s record %d: %s\n" COLOR_RESET,
+                       sections[s], i, error_name(res.error));
+                return;
+            }
+            if (!printed) {
+                printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
+                printf(COLOR_BOLD "Records\n" COLOR_RESET);
+                printf(COLOR_CYAN "───────────────────────────────────────────────────────────\n" COLOR_RESET);
+                printed = 1;
+            }
+            print_rr(sections[s], &rr);
+            off = res.offset;
+        }
+    }
+    if (off < len) {
+        printf(COLOR_YELLOW "%zu trailing bytes after the last record\n" COLOR_RESET, len - off);
+    }
+}
+
+/* Random labels, pointers and junk after a real header; returns the length */
+static size_t random_name_packet(uint32_t *seed, uint8_t pkt[320]) {
+    uint32_t x = *seed;
+    size_t len = 12 + (x % 300);
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        pkt[i] = (uint8_t)x;
+    }
+    for (size_t pos = 12; pos < len; ) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint8_t l = (uint8_t)(x % 64);
+        if (x % 11 == 0) { pkt[pos] = 0xc0; break; }
+        pkt[pos] = (x % 7 == 0) ? 0 : l;
+        if (pkt[pos] == 0) break;
+        pos += 1 + l;
+    }
+    *seed = x;
+    return len;
+}
+
 /* Run test suite */
 static int run_tests(void) {
     int passed = 0, failed = 0;
@@ -164,53 +283,1443 @@ static int run_tests(void) {
                    ret, h.id, h.qr, h.rd, h.qdcount);
             failed++;
         }
-    }
-    
-    /* Test 2: Parse response header */
-    {
-        printf("Test 2: Parse response header... ");
-        dnsasm_header_t h;
-        int ret = dnsasm_parse_header(sample_response, sizeof(sample_response), &h);
-        if (ret == 0 && h.id == 0x1234 && h.qr == 1 && h.ra == 1 && h.ancount == 1) {
+    }
+    
+    /* Test 2: Parse response header */
+    {
+        printf("Test 2: Parse response header... ");
+        dnsasm_header_t h;
+        int ret = dnsasm_parse_header(sample_response, sizeof(sample_response), &h);
+        if (ret == 0 && h.id == 0x1234 && h.qr == 1 && h.ra == 1 && h.ancount == 1) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (ret=%d, id=0x%04x, qr=%d, ra=%d, ancount=%d)\n" COLOR_RESET,
+                   ret, h.id, h.qr, h.ra, h.ancount);
+            failed++;
+        }
+    }
+    
+    /* Test 3: Parse question */
+    {
+        printf("Test 3: Parse question section... ");
+        dnsasm_question_t q;
+        dnsasm_result_t res = dnsasm_parse_question(sample_query, sizeof(sample_query), 12, &q);
+        if (res.error == 0 && q.qtype == 1 && q.qclass == 1) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (error=%d, qtype=%d, qclass=%d)\n" COLOR_RESET,
+                   res.error, q.qtype, q.qclass);
+            failed++;
+        }
+    }
+    
+    /* Test 4: Handle short packet */
+    {
+        printf("Test 4: Handle short packet... ");
+        uint8_t short_pkt[] = {0x12, 0x34};
+        dnsasm_header_t h;
+        int ret = dnsasm_parse_header(short_pkt, sizeof(short_pkt), &h);
+        if (ret == DNSASM_ERR_SHORT) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (expected %d, got %d)\n" COLOR_RESET, DNSASM_ERR_SHORT, ret);
+            failed++;
+        }
+    }
+    
+    /* Test 5: Batch parse */
+    {
+        printf("Test 5: Batch parse... ");
+        static const uint8_t ptr_query[] = {
+            0xab, 0xcd, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00,
+            0xc0, 0x00,             /* Compressed qname: not allowed */
+            0x00, 0x01, 0x00, 0x01
+        };
+        uint8_t short_pkt[] = {0x12, 0x34};
+        const uint8_t *pkts[4] = {sample_query, short_pkt, ptr_query, sample_query};
+        uint16_t lens[4] = {sizeof(sample_query), sizeof(short_pkt),
+                            sizeof(ptr_query), sizeof(sample_query)};
+        static dnsasm_batch_t b;
+        size_t ok = dnsasm_parse_batch(pkts, lens, 4, &b);
+        if (ok == 2 && b.count == 4 &&
+            b.error[0] == DNSASM_OK && b.id[0] == 0x1234 && b.qtype[0] == 1 &&
+            b.qclass[0] == 1 && b.name_off[0] == 12 && b.name_len[0] == 17 &&
+            b.error[1] == DNSASM_ERR_SHORT &&
+            b.error[2] == DNSASM_ERR_POINTER && b.id[2] == 0xabcd &&
+            b.error[3] == DNSASM_OK && b.qdcount[3] == 1) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (ok=%zu, err=%d/%d/%d/%d, name_len=%d)\n" COLOR_RESET,
+                   ok, b.error[0], b.error[1], b.error[2], b.error[3], b.name_len[0]);
+            failed++;
+        }
+    }
+
+    /* Test 6: Message index */
+    {
+        printf("Test 6: Message index... ");
+        dnsasm_msg_t m;
+        dnsasm_rr_index_t rr[4];
+        uint8_t name[DNS_MAX_NAME_LEN + 1];
+        uint16_t name_len = 0;
+        int ret = dnsasm_parse_message(sample_response, sizeof(sample_response), &m, rr, 4);
+        int ok = ret == 0 && m.total == 2 && m.end == sizeof(sample_response) &&
+                 m.count[DNSASM_SECTION_QUESTION] == 1 &&
+                 m.count[DNSASM_SECTION_ANSWER] == 1 &&
+                 m.start[DNSASM_SECTION_ANSWER] == 1 &&
+                 rr[0].name_off == 12 && rr[0].type == DNS_TYPE_A &&
+                 rr[1].name_off == 33 && rr[1].ttl_off == 39 &&
+                 rr[1].rdata_off == 45 && rr[1].rdlength == 4;
+        if (ok) {
+            dnsasm_result_t res = dnsasm_decompress_name(sample_response, sizeof(sample_response),
+                                                         rr[1].name_off, name, &name_len);
+            ok = res.error == 0 && name_len == 17 && memcmp(name, sample_query + 12, 17) == 0;
+        }
+        int space = dnsasm_parse_message(sample_response, sizeof(sample_response), &m, rr, 1);
+        if (ok && space == DNSASM_ERR_SPACE && m.total == 1 && m.end == 33) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (ret=%d, total=%d, end=%u, space=%d)\n" COLOR_RESET,
+                   ret, m.total, m.end, space);
+            failed++;
+        }
+    }
+
+    /* Test 7: Name decompression edge cases */
+    {
+        printf("Test 7: Name decompression edge cases... ");
+        /* "cdn" + pointer to www.example.com at 12, then an unterminated name */
+        uint8_t pkt[64];
+        memcpy(pkt, sample_query, 29);
+        const uint8_t tail[] = {0x03, 'c', 'd', 'n', 0xc0, 0x0c, 0x03, 'a', 'b', 'c'};
+        memcpy(pkt + 29, tail, sizeof(tail));
+        size_t len = 29 + sizeof(tail);
+        uint8_t name[DNS_MAX_NAME_LEN + 1];
+        uint16_t name_len = 0;
+        dnsasm_result_t r1 = dnsasm_decompress_name(pkt, len, 29, name, &name_len);
+        int ok = r1.error == 0 && r1.offset == 6 && name_len == 21 &&
+                 memcmp(name, tail, 4) == 0 && memcmp(name + 4, sample_query + 12, 17) == 0;
+        dnsasm_result_t r2 = dnsasm_decompress_name(pkt, len, 35, name, &name_len);
+        if (ok && r2.error == DNSASM_ERR_SHORT) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (err=%d/%d, wire=%u, name_len=%d)\n" COLOR_RESET,
+                   r1.error, r2.error, r1.offset, name_len);
+            failed++;
+        }
+    }
+
+    /* Test 8: Every implementation matches the C reference */
+    {
+        printf("Test 8: Implementations agree with C reference... ");
+        const char *names[8];
+        size_t n_impls = dnsasm_impl_names(names, 8);
+        const char *prev = dnsasm_active_impl();
+        int mismatches = 0;
+        uint32_t seed = 0x9e3779b9;
+
+        for (int iter = 0; iter < 20000; iter++) {
+            uint8_t pkt[320];
+            size_t len = random_name_packet(&seed, pkt);
+
+            uint8_t ref[DNS_MAX_NAME_LEN + 1], got[DNS_MAX_NAME_LEN + 1];
+            uint16_t ref_len = 0, got_len = 0;
+            dnsasm_select_impl("c");
+            dnsasm_result_t r = dnsasm_decompress_name(pkt, len, 12, ref, &ref_len);
+            for (size_t k = 0; k < n_impls; k++) {
+                dnsasm_select_impl(names[k]);
+                dnsasm_result_t g = dnsasm_decompress_name(pkt, len, 12, got, &got_len);
+                if (g.error != r.error ||
+                    (r.error == 0 && (g.offset != r.offset || got_len != ref_len ||
+                                      memcmp(got, ref, ref_len) != 0))) {
+                    mismatches++;
+                }
+            }
+        }
+        dnsasm_select_impl(prev);
+
+        if (n_impls >= 1 && mismatches == 0 && dnsasm_select_impl("nope") == -1) {
+            printf(COLOR_GREEN "PASSED" COLOR_RESET " (%zu impls, active: %s)\n",
+                   n_impls, dnsasm_active_impl());
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (%d mismatches over %zu impls)\n" COLOR_RESET,
+                   mismatches, n_impls);
+            failed++;
+        }
+    }
+
+    /* Test 9: Keyed question hash */
+    {
+        printf("Test 9: Keyed question hash... ");
+        /* SipHash-1-3 with key 00..0f over "www.example.com" A IN, no bits */
+        const dnsasm_hash_key_t key = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+        uint8_t mixed[sizeof(sample_query)];
+        memcpy(mixed, sample_query, sizeof(mixed));
+        mixed[13] = 'W';
+        mixed[17] = 'E';
+        mixed[25] = 'C';
+        dnsasm_question_t q1, q2, q3;
+        uint64_t h1 = 0, h2 = 0, h3 = 0;
+        dnsasm_result_t r1 = dnsasm_parse_question_keyed(sample_query, sizeof(sample_query), 12,
+                                                         0, &key, &q1, &h1);
+        dnsasm_result_t r2 = dnsasm_parse_question_keyed(mixed, sizeof(mixed), 12,
+                                                         0, &key, &q2, &h2);
+        dnsasm_parse_question_keyed(sample_query, sizeof(sample_query), 12,
+                                    DNSASM_HASH_DO, &key, &q3, &h3);
+        if (r1.error == 0 && r2.error == 0 && r1.offset == sizeof(sample_query) &&
+            h1 == 0x7aededfcb247961eULL && h1 == h2 && h1 != h3 &&
+            memcmp(q2.name, sample_query + 12, 17) == 0 &&
+            dnsasm_hash_name(&key, mixed + 12, 17, 1, 1, 0) == h1) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (err=%d/%d, hash=%016llx)\n" COLOR_RESET,
+                   r1.error, r2.error, (unsigned long long)h1);
+            failed++;
+        }
+    }
+
+    /* Test 10: EDNS OPT after another additional record */
+    {
+        printf("Test 10: EDNS OPT parse... ");
+        uint8_t pkt[96];
+        memcpy(pkt, sample_query, sizeof(sample_query));
+        pkt[11] = 2;                                    /* ARCOUNT */
+        const uint8_t additional[] = {
+            0x01, 'k', 0x00, 0x00, 0x01, 0x00, 0x01,    /* k. A IN */
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 10, 0, 0, 1,
+            0x00, 0x00, 0x29, 0x04, 0xd0,               /* . OPT 1232 */
+            0x00, 0x00, 0x80, 0x00, 0x00, 0x10,         /* DO, rdlength 16 */
+            0x00, 0x0a, 0x00, 0x08, 1, 2, 3, 4, 5, 6, 7, 8,
+            0x00, 0x0b, 0x00, 0x00                      /* Keepalive, empty */
+        };
+        memcpy(pkt + sizeof(sample_query), additional, sizeof(additional));
+        size_t len = sizeof(sample_query) + sizeof(additional);
+        dnsasm_edns_t e;
+        int ret = dnsasm_parse_edns(pkt, len, sizeof(sample_query), &e);
+        int ok = ret == 0 && e.present && e.udp_size == 1232 && e.dnssec_ok &&
+                 e.version == 0 && e.rr_off == 50 && e.option_count == 2 &&
+                 e.cookie.off == 65 && e.cookie.len == 8 &&
+                 e.keepalive.off == 77 && e.keepalive.len == 0 &&
+                 e.ecs.off == 0 && e.padding.off == 0;
+        /* Plain query: no OPT, no error */
+        int none = dnsasm_parse_edns(sample_query, sizeof(sample_query),
+                                     sizeof(sample_query), &e);
+        ok = ok && none == 0 && !e.present;
+        /* Two OPT records (the second without options) */
+        pkt[11] = 3;
+        memcpy(pkt + len, additional + 17, 9);
+        pkt[len + 9] = 0;
+        pkt[len + 10] = 0;
+        int dup = dnsasm_parse_edns(pkt, len + 11, sizeof(sample_query), &e);
+        if (ok && dup == DNSASM_ERR_EDNS) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (ret=%d, none=%d, dup=%d)\n" COLOR_RESET,
+                   ret, none, dup);
+            failed++;
+        }
+    }
+
+    /* Test 11: Query classification */
+    {
+        printf("Test 11: Query classification... ");
+        uint8_t pkt[64];
+        dnsasm_query_class_t c;
+        int ok = 1;
+
+        /* Plain query */
+        uint32_t v = dnsasm_classify_query(sample_query, sizeof(sample_query), &c);
+        ok &= v == DNSASM_CLASS_FAST && c.id == 0x1234 && c.qtype == 1 &&
+              c.qname_len == 17 && c.question_end == sizeof(sample_query) &&
+              c.end == sizeof(sample_query);
+
+        /* Same query with an OPT RR, DO set */
+        const uint8_t opt[] = {0x00, 0x00, 0x29, 0x04, 0xd0, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00};
+        memcpy(pkt, sample_query, sizeof(sample_query));
+        memcpy(pkt + sizeof(sample_query), opt, sizeof(opt));
+        pkt[11] = 1;
+        v = dnsasm_classify_query(pkt, sizeof(sample_query) + sizeof(opt), &c);
+        ok &= v == (DNSASM_CLASS_FAST | DNSASM_CLASS_EDNS | DNSASM_CLASS_DO) &&
+              c.edns.udp_size == 1232;
+
+        /* Trailing byte: legal but slow */
+        v = dnsasm_classify_query(pkt, sizeof(sample_query) + sizeof(opt) + 1, &c);
+        ok &= (v & DNSASM_CLASS_ACTION) == DNSASM_CLASS_SLOW && (v & DNSASM_CLASS_TRAILING);
+
+        /* A second OPT is FORMERR, and neither is reported */
+        memcpy(pkt + sizeof(sample_query) + sizeof(opt), opt, sizeof(opt));
+        pkt[11] = 2;
+        v = dnsasm_classify_query(pkt, sizeof(sample_query) + 2 * sizeof(opt), &c);
+        ok &= (v & DNSASM_CLASS_ACTION) == DNSASM_CLASS_FORMERR &&
+              (v & DNSASM_CLASS_BAD_OPT) && c.error == DNSASM_ERR_EDNS && !c.edns.present;
+        uint8_t formerr[64];
+        int r = dnsasm_reply_error(formerr, sizeof(formerr), pkt,
+                                   sizeof(sample_query) + 2 * sizeof(opt), &c, DNS_RCODE_FORMERR, 0);
+        ok &= r == (int)sizeof(sample_query) && load16(formerr + 10) == 0;
+
+        /* Response, runt, STATUS opcode, QDCOUNT=2 with one question */
+        v = dnsasm_classify_query(sample_response, sizeof(sample_response), &c);
+        ok &= v == (DNSASM_CLASS_DROP | DNSASM_CLASS_RESPONSE);
+        v = dnsasm_classify_query(sample_query, 5, &c);
+        ok &= v == (DNSASM_CLASS_DROP | DNSASM_CLASS_SHORT);
+        memcpy(pkt, sample_query, sizeof(sample_query));
+        pkt[2] = DNS_OPCODE_STATUS << 3;
+        v = dnsasm_classify_query(pkt, sizeof(sample_query), &c);
+        ok &= (v & DNSASM_CLASS_ACTION) == DNSASM_CLASS_NOTIMP;
+        pkt[2] = 0x01;
+        pkt[5] = 2;
+        v = dnsasm_classify_query(pkt, sizeof(sample_query), &c);
+        ok &= (v & DNSASM_CLASS_ACTION) == DNSASM_CLASS_FORMERR &&
+              (v & DNSASM_CLASS_MALFORMED) && c.error == DNSASM_ERR_SHORT;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (last verdict=0x%x)\n" COLOR_RESET, v);
+            failed++;
+        }
+    }
+
+    /* Test 12: Typed RDATA decoders */
+    {
+        printf("Test 12: Typed RDATA decoders... ");
+        /* example.com MX response: MX, A, AAAA, TXT, SOA, SRV, DS, RRSIG,
+         * CNAME, all owned by a pointer to the qname */
+        static const uint8_t pkt[] = {
+            0xbe, 0xef, 0x81, 0x80, 0x00, 0x01, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00,
+            0x07, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d,
+            0x00, 0x00, 0x0f, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x0f, 0x00, 0x01, 0x00,
+            0x00, 0x01, 0x2c, 0x00, 0x04, 0x00, 0x0a, 0xc0, 0x0c, 0xc0, 0x0c, 0x00,
+            0x01, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x04, 0xc0, 0x00, 0x02,
+            0x01, 0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00,
+            0x10, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x10, 0x00, 0x01, 0x00,
+            0x00, 0x01, 0x2c, 0x00, 0x0c, 0x05, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x05,
+            0x77, 0x6f, 0x72, 0x6c, 0x64, 0xc0, 0x0c, 0x00, 0x06, 0x00, 0x01, 0x00,
+            0x00, 0x01, 0x2c, 0x00, 0x27, 0x03, 0x6e, 0x73, 0x31, 0xc0, 0x0c, 0x0a,
+            0x68, 0x6f, 0x73, 0x74, 0x6d, 0x61, 0x73, 0x74, 0x65, 0x72, 0xc0, 0x0c,
+            0x78, 0xa3, 0xf1, 0x75, 0x00, 0x00, 0x1c, 0x20, 0x00, 0x00, 0x0e, 0x10,
+            0x00, 0x12, 0x75, 0x00, 0x00, 0x00, 0x01, 0x2c, 0xc0, 0x0c, 0x00, 0x21,
+            0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x0c, 0x00, 0x01, 0x00, 0x02,
+            0x01, 0xbb, 0x03, 0x77, 0x77, 0x77, 0xc0, 0x0c, 0xc0, 0x0c, 0x00, 0x2b,
+            0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x08, 0x30, 0x39, 0x08, 0x02,
+            0xde, 0xad, 0xbe, 0xef, 0xc0, 0x0c, 0x00, 0x2e, 0x00, 0x01, 0x00, 0x00,
+            0x01, 0x2c, 0x00, 0x23, 0x00, 0x01, 0x08, 0x02, 0x00, 0x00, 0x0e, 0x10,
+            0x65, 0x53, 0xf1, 0x00, 0x64, 0xbb, 0x5a, 0x80, 0x30, 0x39, 0x07, 0x65,
+            0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d, 0x00, 0x01,
+            0x02, 0x03, 0x04, 0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x01,
+            0x2c, 0x00, 0x06, 0x03, 0x77, 0x77, 0x77, 0xc0, 0x0c
+        };
+        dnsasm_msg_t m;
+        dnsasm_rr_index_t rr[10];
+        int ok = dnsasm_parse_message(pkt, sizeof(pkt), &m, rr, 10) == 0 && m.total == 10;
+        const uint8_t example[] = {7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+#define RD(i) pkt, sizeof(pkt), rr[i].rdata_off, rr[i].rdlength
+
+        dnsasm_rdata_mx_t mx;
+        ok = ok && dnsasm_rdata_mx(RD(1), &mx) == 0 && mx.preference == 10 &&
+             mx.exchange_len == 13 && memcmp(mx.exchange, example, 13) == 0;
+        uint8_t a[4], aaaa[16];
+        ok = ok && dnsasm_rdata_a(RD(2), a) == 0 && a[0] == 192 && a[3] == 1 &&
+             dnsasm_rdata_aaaa(RD(3), aaaa) == 0 && aaaa[0] == 0x20 && aaaa[15] == 1 &&
+             dnsasm_rdata_a(RD(3), a) == DNSASM_ERR_RDATA;
+
+        dnsasm_rdata_iter_t it;
+        uint16_t str_off = 0;
+        uint8_t str_len = 0;
+        /* The last record, with the packet cut one byte short */
+        ok = ok && dnsasm_rdata_iter_init(&it, sizeof(pkt) - 1, rr[9].rdata_off,
+                                          rr[9].rdlength) == DNSASM_ERR_RDATA &&
+             dnsasm_txt_next(pkt, &it, &str_off, &str_len) == 0;
+        ok = ok && dnsasm_rdata_iter_init(&it, sizeof(pkt), rr[4].rdata_off, rr[4].rdlength) == 0 &&
+             dnsasm_txt_next(pkt, &it, &str_off, &str_len) == 1 && str_len == 5 &&
+             memcmp(pkt + str_off, "hello", 5) == 0 &&
+             dnsasm_txt_next(pkt, &it, &str_off, &str_len) == 1 &&
+             memcmp(pkt + str_off, "world", 5) == 0 &&
+             dnsasm_txt_next(pkt, &it, &str_off, &str_len) == 0;
+
+        dnsasm_rdata_soa_t soa;
+        ok = ok && dnsasm_rdata_soa(RD(5), &soa) == 0 && soa.mname_len == 17 &&
+             soa.rname_len == 24 && soa.serial == 2024010101 && soa.minimum == 300;
+        dnsasm_rdata_srv_t srv;
+        ok = ok && dnsasm_rdata_srv(RD(6), &srv) == 0 && srv.port == 443 &&
+             srv.weight == 2 && srv.target_len == 17;
+        dnsasm_rdata_ds_t ds;
+        ok = ok && dnsasm_rdata_ds(RD(7), &ds) == 0 && ds.key_tag == 12345 &&
+             ds.digest_type == 2 && ds.digest_len == 4 && pkt[ds.digest_off] == 0xde;
+        dnsasm_rdata_rrsig_t sig;
+        ok = ok && dnsasm_rdata_rrsig(RD(8), &sig) == 0 && sig.type_covered == 1 &&
+             sig.labels == 2 && sig.expiration == 1700000000 && sig.key_tag == 12345 &&
+             sig.signer_len == 13 && sig.sig_len == 4 && pkt[sig.sig_off] == 1;
+        dnsasm_rdata_name_t cname;
+        ok = ok && dnsasm_rdata_name(RD(9), &cname) == 0 && cname.name_len == 17;
+        /* A name target that claims less RDATA than it uses */
+        ok = ok && dnsasm_rdata_name(pkt, sizeof(pkt), rr[9].rdata_off, 4, &cname) == DNSASM_ERR_RDATA;
+#undef RD
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 13: Compressing response writer */
+    {
+        printf("Test 13: Compressing response writer... ");
+        static const uint8_t www[] = {3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        static const uint8_t web[] = {3, 'W', 'E', 'B', 7, 'E', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'C', 'O', 'M', 0};
+        static const uint8_t mail[] = {4, 'm', 'a', 'i', 'l', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        const uint8_t *example = www + 4;
+        uint8_t buf[512];
+        dnsasm_writer_t w;
+        dnsasm_rdata_soa_t soa = {0};
+        memcpy(soa.mname, "\x03" "ns1", 4);
+        memcpy(soa.mname + 4, example, 13);
+        soa.mname_len = 17;
+        memcpy(soa.rname, "\x0a" "hostmaster", 11);
+        memcpy(soa.rname + 11, example, 13);
+        soa.rname_len = 24;
+        soa.serial = 2024010101;
+        soa.minimum = 300;
+        const uint8_t a[4] = {192, 0, 2, 1};
+
+        dnsasm_writer_init(&w, buf, sizeof(buf));
+        int ok = dnsasm_writer_header(&w, 0xbeef, 0x8180) == 0 &&
+                 dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN) == 0 &&
+                 dnsasm_writer_name_rr(&w, www, sizeof(www), DNS_TYPE_CNAME, 300, web, sizeof(web)) == 0 &&
+                 dnsasm_writer_a(&w, web, sizeof(web), 300, a) == 0 &&
+                 dnsasm_writer_mx(&w, example, 13, 300, 10, mail, sizeof(mail)) == 0 &&
+                 dnsasm_writer_txt(&w, example, 13, 300, (const uint8_t *)"hello", 5) == 0 &&
+                 dnsasm_writer_section(&w, DNSASM_SECTION_AUTHORITY) == 0 &&
+                 dnsasm_writer_soa(&w, example, 13, 300, &soa) == 0 &&
+                 dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN) == DNSASM_ERR_OVERFLOW &&
+                 dnsasm_writer_section(&w, DNSASM_SECTION_ANSWER) == DNSASM_ERR_OVERFLOW &&
+                 dnsasm_writer_opt(&w, 1232, 0, 0, DNS_EDNS_FLAG_DO, NULL, 0) == 0;
+        size_t n = dnsasm_writer_finish(&w);
+
+        /* Every owner after the question is a pointer; WEB.Example.COM
+         * reuses example.com case-insensitively */
+        ok = ok && buf[33] == 0xc0 && buf[34] == 0x0c && buf[45] == 3 &&
+             buf[46] == 'W' && buf[49] == 0xc0 && buf[50] == 0x10;
+
+        dnsasm_msg_t m;
+        dnsasm_rr_index_t rr[8];
+        ok = ok && dnsasm_parse_message(buf, n, &m, rr, 8) == 0 && m.total == 7 &&
+             m.count[1] == 4 && m.count[2] == 1 && m.count[3] == 1 && m.end == n;
+#define RD(i) buf, n, rr[i].rdata_off, rr[i].rdlength
+        dnsasm_rdata_name_t target;
+        dnsasm_rdata_mx_t mx;
+        dnsasm_rdata_soa_t soa2;
+        uint8_t a2[4];
+        ok = ok && dnsasm_rdata_name(RD(1), &target) == 0 && target.name_len == 17 &&
+             dnsasm_rdata_a(RD(2), a2) == 0 && memcmp(a, a2, 4) == 0 &&
+             dnsasm_rdata_mx(RD(3), &mx) == 0 && mx.preference == 10 &&
+             mx.exchange_len == sizeof(mail) && memcmp(mx.exchange, mail, sizeof(mail)) == 0 &&
+             dnsasm_rdata_soa(RD(5), &soa2) == 0 && soa2.serial == soa.serial &&
+             memcmp(soa2.rname, soa.rname, soa.rname_len) == 0 &&
+             rr[6].type == DNS_TYPE_OPT && rr[6].rclass == 1232;
+#undef RD
+
+        /* A record that does not fit is rolled back whole */
+        dnsasm_writer_init(&w, buf, 50);
+        ok = ok && dnsasm_writer_header(&w, 1, 0x8180) == 0 &&
+             dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN) == 0 &&
+             dnsasm_writer_a(&w, www, sizeof(www), 60, a) == 0 &&
+             dnsasm_writer_a(&w, mail, sizeof(mail), 60, a) == DNSASM_ERR_SPACE &&
+             dnsasm_writer_finish(&w) == 49 && buf[7] == 1 &&
+             dnsasm_writer_a(&w, www + 4, 3, 60, a) == DNSASM_ERR_NAME;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 14: Cached response aging and patching */
+    {
+        printf("Test 14: Cached response aging... ");
+        static const uint8_t www[] = {3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        const uint8_t a[4] = {192, 0, 2, 1};
+        uint8_t buf[128];
+        dnsasm_writer_t w;
+
+        dnsasm_writer_init(&w, buf, sizeof(buf));
+        dnsasm_writer_header(&w, 0xbeef, 0x8180);
+        dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN);
+        dnsasm_writer_a(&w, www, sizeof(www), 300, a);
+        dnsasm_writer_a(&w, www, sizeof(www), 20, a);
+        dnsasm_writer_opt(&w, 1232, 0, 0, DNS_EDNS_FLAG_DO, NULL, 0);
+        size_t n = dnsasm_writer_finish(&w);
+
+        dnsasm_msg_t m;
+        dnsasm_rr_index_t rr[4];
+        int ok = dnsasm_parse_message(buf, n, &m, rr, 4) == 0 && m.total == 4;
+#define TTL(i) (((uint32_t)buf[rr[i].ttl_off] << 24) | ((uint32_t)buf[rr[i].ttl_off + 1] << 16) | \
+                ((uint32_t)buf[rr[i].ttl_off + 2] << 8) | buf[rr[i].ttl_off + 3])
+        /* Aged by 100 s; the 20 s TTL is already under the floor */
+        ok = ok && dnsasm_age_ttls(buf, n, 100, 30) == 0 &&
+             TTL(1) == 200 && TTL(2) == 20 && TTL(3) == DNS_EDNS_FLAG_DO;
+        ok = ok && dnsasm_age_ttls(buf, n, 1000, 30) == 0 && TTL(1) == 30 &&
+             dnsasm_age_ttls(buf, n - 1, 0, 0) == DNSASM_ERR_SHORT;
+#undef TTL
+
+        /* Client's ID and 0x20 casing come back; other names are refused */
+        static const uint8_t mixed[] = {3, 'W', 'w', 'W', 7, 'E', 'x', 'A', 'm', 'P', 'l', 'E', 3, 'c', 'O', 'm', 0};
+        uint8_t query[64];
+        dnsasm_writer_init(&w, query, sizeof(query));
+        dnsasm_writer_header(&w, 0x1234, 0x0100);
+        dnsasm_writer_question(&w, mixed, sizeof(mixed), DNS_TYPE_A, DNS_CLASS_IN);
+        size_t qlen = dnsasm_writer_finish(&w);
+        ok = ok && dnsasm_patch_response(buf, n, query, qlen) == 0 &&
+             buf[0] == 0x12 && buf[1] == 0x34 && memcmp(buf + 12, query + 12, 17) == 0;
+        query[13] = 'x';
+        query[0] = 0x56;
+        ok = ok && dnsasm_patch_response(buf, n, query, qlen) == DNSASM_ERR_NAME &&
+             buf[0] == 0x56 && buf[13] == 'W';
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 15: RRset-aware truncation */
+    {
+        printf("Test 15: RRset-aware truncation... ");
+        static const uint8_t www[] = {3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        static const uint8_t ns1[] = {3, 'n', 's', '1', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        static const uint8_t ns2[] = {3, 'n', 's', '2', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0};
+        const uint8_t a[4] = {192, 0, 2, 1};
+        const uint8_t aaaa[16] = {0x20, 0x01, 0x0d, 0xb8};
+        uint8_t orig[512], buf[512];
+        dnsasm_writer_t w;
+
+        /* 3 A + 2 AAAA, 2 NS, glue for both, OPT */
+        dnsasm_writer_init(&w, orig, sizeof(orig));
+        dnsasm_writer_header(&w, 1, 0x8180);
+        dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN);
+        size_t qend = w.len;
+        for (int i = 0; i < 3; i++) {
+            dnsasm_writer_a(&w, www, sizeof(www), 300, a);
+        }
+        size_t aaaa_at = w.len;
+        dnsasm_writer_aaaa(&w, www, sizeof(www), 300, aaaa);
+        dnsasm_writer_aaaa(&w, www, sizeof(www), 300, aaaa);
+        dnsasm_writer_section(&w, DNSASM_SECTION_AUTHORITY);
+        dnsasm_writer_name_rr(&w, www + 4, 13, DNS_TYPE_NS, 300, ns1, sizeof(ns1));
+        dnsasm_writer_name_rr(&w, www + 4, 13, DNS_TYPE_NS, 300, ns2, sizeof(ns2));
+        dnsasm_writer_section(&w, DNSASM_SECTION_ADDITIONAL);
+        dnsasm_writer_a(&w, ns1, sizeof(ns1), 300, a);
+        size_t glue2_at = w.len;
+        dnsasm_writer_a(&w, ns2, sizeof(ns2), 300, a);
+        dnsasm_writer_opt(&w, 1232, 0, 0, 0, NULL, 0);
+        size_t n = dnsasm_writer_finish(&w);
+        const size_t opt_len = 11;
+
+        memcpy(buf, orig, n);
+        int ok = dnsasm_truncate(buf, n, n) == (int)n && memcmp(buf, orig, n) == 0;
+
+        /* One byte over: the last glue record goes, OPT moves up, no TC */
+        dnsasm_msg_t m;
+        dnsasm_rr_index_t rr[12];
+        dnsasm_edns_t e;
+        int r = dnsasm_truncate(buf, n, n - 1);
+        ok = ok && r == (int)(glue2_at + opt_len) && !(buf[2] & 0x02) &&
+             dnsasm_parse_message(buf, r, &m, rr, 12) == 0 && m.end == (uint32_t)r &&
+             m.count[1] == 5 && m.count[2] == 2 && m.count[3] == 2 &&
+             dnsasm_parse_edns(buf, r, qend, &e) == 0 && e.udp_size == 1232;
+
+        /* AAAA does not fit: cut before its RRset, drop the rest, set TC */
+        memcpy(buf, orig, n);
+        r = dnsasm_truncate(buf, n, aaaa_at + opt_len + 20);
+        ok = ok && r == (int)(aaaa_at + opt_len) && (buf[2] & 0x02) &&
+             dnsasm_parse_message(buf, r, &m, rr, 12) == 0 &&
+             m.count[1] == 3 && m.count[2] == 0 && m.count[3] == 1 &&
+             rr[4].type == DNS_TYPE_OPT;
+
+        /* Room for the question only; OPT is dropped last */
+        memcpy(buf, orig, n);
+        r = dnsasm_truncate(buf, n, qend + 5);
+        ok = ok && r == (int)qend && (buf[2] & 0x02) && buf[11] == 0;
+        memcpy(buf, orig, n);
+        ok = ok && dnsasm_truncate(buf, n, qend - 1) == DNSASM_ERR_SPACE;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 16: Error and slip responses */
+    {
+        printf("Test 16: Error and slip responses... ");
+        static const uint8_t www[] = {3, 'W', 'w', 'W', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'O', 'm', 0};
+        const size_t qlen = sizeof(www) + 4;
+        uint8_t req[64], plain[64], out[300], out2[300];
+        dnsasm_writer_t w;
+        dnsasm_query_class_t qc;
+
+        /* RD+CD query with OPT, DO set */
+        dnsasm_writer_init(&w, req, sizeof(req));
+        dnsasm_writer_header(&w, 0xbeef, DNS_FLAG_RD | DNS_FLAG_CD);
+        dnsasm_writer_question(&w, www, sizeof(www), DNS_TYPE_A, DNS_CLASS_IN);
+        size_t plain_len = w.len;
+        dnsasm_writer_opt(&w, 4096, 0, 0, DNS_EDNS_FLAG_DO, NULL, 0);
+        size_t n = dnsasm_writer_finish(&w);
+        memcpy(plain, req, plain_len);
+        plain[11] = 0;
+        dnsasm_classify_query(req, n, &qc);
+
+        int r = dnsasm_reply_error(out, sizeof(out), req, n, &qc, DNS_RCODE_FORMERR, 0);
+        const uint8_t *opt = out + 12 + qlen;
+        int ok = r == (int)(12 + qlen + 11) && out[0] == 0xbe && out[1] == 0xef &&
+                 load16(out + 2) == (DNS_FLAG_QR | DNS_FLAG_RD | DNS_FLAG_CD | DNS_RCODE_FORMERR) &&
+                 load16(out + 4) == 1 && load16(out + 6) == 0 && load16(out + 8) == 0 &&
+                 load16(out + 10) == 1 && memcmp(out + 12, req + 12, qlen) == 0 &&
+                 opt[0] == 0 && load16(opt + 1) == DNS_TYPE_OPT &&
+                 load16(opt + 3) == DNSASM_REPLY_UDP_SIZE && opt[5] == 0 &&
+                 load16(opt + 7) == DNS_EDNS_FLAG_DO && load16(opt + 9) == 0;
+
+        /* Without a classification the reply is the same */
+        ok = ok && dnsasm_reply_error(out2, sizeof(out2), req, n, NULL, DNS_RCODE_FORMERR, 0) == r &&
+             memcmp(out, out2, r) == 0;
+
+        /* Slip, and BADVERS through the extended rcode */
+        r = dnsasm_reply_error(out, sizeof(out), req, n, &qc, DNS_RCODE_NOERROR, DNS_FLAG_TC);
+        ok = ok && r == (int)(12 + qlen + 11) && (load16(out + 2) & DNS_FLAG_TC) &&
+             (out[3] & 0x0F) == 0;
+        r = dnsasm_reply_error(out, sizeof(out), req, n, &qc, 16, 0);
+        ok = ok && (out[3] & 0x0F) == 0 && opt[5] == 1;
+
+        /* No OPT in, none out */
+        r = dnsasm_reply_error(out, sizeof(out), plain, plain_len, NULL, DNS_RCODE_REFUSED, 0);
+        ok = ok && r == (int)plain_len && load16(out + 10) == 0 && (out[3] & 0x0F) == DNS_RCODE_REFUSED;
+
+        /* A compressed or cut-off question is not echoed */
+        plain[12] = 0xc0;
+        plain[13] = 0x0c;
+        r = dnsasm_reply_error(out, sizeof(out), plain, plain_len, NULL, DNS_RCODE_FORMERR, 0);
+        ok = ok && r == 12 && load16(out + 4) == 0;
+        r = dnsasm_reply_error(out, sizeof(out), req, 20, NULL, DNS_RCODE_FORMERR, 0);
+        ok = ok && r == 12 && load16(out + 4) == 0;
+
+        ok = ok && dnsasm_reply_error(out, sizeof(out), req, 11, NULL, 1, 0) == DNSASM_ERR_SHORT &&
+             dnsasm_reply_error(out, 20, req, n, &qc, 1, 0) == DNSASM_ERR_SPACE;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 17: Name equality kernels and canonical order */
+    {
+        printf("Test 17: Name equality and canonical order... ");
+        const char *names[8];
+        size_t n_impls = dnsasm_impl_names(names, 8);
+        const char *prev = dnsasm_active_impl();
+        int mismatches = 0;
+        uint32_t seed = 0x2545f491;
+
+        /* Every length, random case flips and single-byte edits */
+        for (int iter = 0; iter < 20000; iter++) {
+            uint8_t a[DNS_MAX_NAME_LEN], b[DNS_MAX_NAME_LEN];
+            seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+            size_t len = seed % (DNS_MAX_NAME_LEN + 1);
+            for (size_t i = 0; i < len; i++) {
+                seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+                a[i] = (seed & 1) ? (uint8_t)('A' + (seed >> 8) % 26) : (uint8_t)(seed >> 8);
+                b[i] = a[i];
+                if ((seed >> 20) % 3 == 0 && (uint8_t)((a[i] | 0x20) - 'a') < 26) {
+                    b[i] ^= 0x20;
+                }
+            }
+            if (len > 0 && iter % 2) {
+                b[(seed >> 4) % len] ^= (uint8_t)(1u << ((seed >> 12) % 8));
+            }
+
+            dnsasm_select_impl("c");
+            int ref = dnsasm_name_equal(a, len, b, len) == 0;
+            for (size_t k = 0; k < n_impls; k++) {
+                dnsasm_select_impl(names[k]);
+                if ((dnsasm_name_equal(a, len, b, len) == 0) != ref ||
+                    (len > 0 && dnsasm_name_equal(a, len, b, len - 1) == 0)) {
+                    mismatches++;
+                }
+            }
+        }
+        dnsasm_select_impl(prev);
+
+        /* RFC 4034 6.1 example, already in canonical order */
+        static const uint8_t n0[] = {7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n1[] = {1, 'a', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n2[] = {8, 'y', 'l', 'j', 'k', 'j', 'l', 'j', 'k', 1, 'a', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n3[] = {1, 'Z', 1, 'a', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n4[] = {4, 'z', 'A', 'B', 'C', 1, 'a', 7, 'E', 'X', 'A', 'M', 'P', 'L', 'E', 0};
+        static const uint8_t n5[] = {1, 'z', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n6[] = {1, 0x01, 1, 'z', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n7[] = {1, '*', 1, 'z', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        static const uint8_t n8[] = {1, 0xc8, 1, 'z', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        const uint8_t *order[] = {n0, n1, n2, n3, n4, n5, n6, n7, n8};
+        const size_t order_len[] = {sizeof(n0), sizeof(n1), sizeof(n2), sizeof(n3), sizeof(n4),
+                                    sizeof(n5), sizeof(n6), sizeof(n7), sizeof(n8)};
+        int misordered = 0;
+        for (int i = 0; i < 9; i++) {
+            for (int j = 0; j < 9; j++) {
+                int c = dnsasm_name_compare(order[i], order_len[i], order[j], order_len[j]);
+                if ((i < j && c >= 0) || (i == j && c != 0) || (i > j && c <= 0)) {
+                    misordered++;
+                }
+            }
+        }
+        /* Case never matters */
+        misordered += dnsasm_name_compare(n3, sizeof(n3), n1, sizeof(n1)) <= 0;
+        static const uint8_t n3_lower[] = {1, 'z', 1, 'A', 7, 'E', 'x', 'a', 'm', 'p', 'l', 'e', 0};
+        misordered += dnsasm_name_compare(n3, sizeof(n3), n3_lower, sizeof(n3_lower)) != 0;
+
+        if (mismatches == 0 && misordered == 0) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED (%d mismatches, %d misordered)\n" COLOR_RESET,
+                   mismatches, misordered);
+            failed++;
+        }
+    }
+
+    /* Test 18: Hashed name set */
+    {
+        printf("Test 18: Hashed name set... ");
+        enum { N = 20000 };
+        static uint8_t list[N * 32];
+        static uint8_t set_buf[2 << 20] __attribute__((aligned(64)));
+        static uint8_t copy[2 << 20] __attribute__((aligned(64)));
+        const dnsasm_hash_key_t key = {0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL};
+        size_t len = 0;
+
+        /* h<i>.example.com for every i, each also again in upper case */
+        for (int i = 0; i < N; i++) {
+            uint8_t *p = list + len;
+            int l = snprintf((char *)p + 1, 16, "h%d", i);
+            p[0] = (uint8_t)l;
+            memcpy(p + 1 + l, "\x07" "example" "\x03" "com", 13);
+            len += 14 + l;
+            if (i % 4 == 0) {
+                memcpy(list + len, p, 14 + l);
+                list[len + 1] = 'H';
+                len += 14 + l;
+            }
+        }
+
+        size_t need = dnsasm_nameset_size(list, len);
+        int ok = need > 0 && need <= sizeof(set_buf) &&
+                 dnsasm_nameset_build(list, len, &key, set_buf, need) == 0;
+        const dnsasm_nameset_t *set = (const dnsasm_nameset_t *)set_buf;
+        ok = ok && set->count == N;
+
+        int misses = 0;
+        for (int i = 0; ok && i < N; i++) {
+            uint8_t name[32];
+            int l = snprintf((char *)name + 1, 16, "%c%d", i % 3 ? 'h' : 'H', i);
+            name[0] = (uint8_t)l;
+            memcpy(name + 1 + l, "\x07" "EXAMPLE" "\x03" "com", 13);
+            misses += !dnsasm_nameset_contains(set, name, 14 + l);
+            misses += dnsasm_nameset_contains(set, name, 13 + l);
+            name[1] = 'x';
+            misses += dnsasm_nameset_contains(set, name, 14 + l);
+        }
+        ok = ok && misses == 0;
+
+        /* The buffer is the serialized form */
+        const dnsasm_nameset_t *opened;
+        memcpy(copy, set_buf, set->size);
+        ok = ok && dnsasm_nameset_open(copy, set->size, &opened) == 0 &&
+             dnsasm_nameset_contains(opened, list, list[0] + 14) &&
+             dnsasm_nameset_open(copy, set->size - 1, &opened) == DNSASM_ERR_SHORT &&
+             dnsasm_nameset_open(copy + 1, set->size - 1, &opened) == DNSASM_ERR_FORMAT;
+        copy[0] ^= 1;
+        ok = ok && dnsasm_nameset_open(copy, set->size, &opened) == DNSASM_ERR_FORMAT;
+
+        /* Names must be plain wire format */
+        static const uint8_t bad[] = {3, 'w', 'w', 'w', 0xc0, 0x0c};
+        ok = ok && dnsasm_nameset_size(bad, sizeof(bad)) == 0 &&
+             dnsasm_nameset_build(bad, sizeof(bad), &key, set_buf, sizeof(set_buf)) == DNSASM_ERR_NAME &&
+             dnsasm_nameset_build(list, len, &key, set_buf, need - 1) == DNSASM_ERR_SPACE;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 19: Suffix trie */
+    {
+        printf("Test 19: Suffix trie longest match... ");
+        /* Canonical order: root, com, example.com, sub.example.com, example.net */
+        static const uint8_t list[] =
+            "\x00"
+            "\x03" "com" "\x00"
+            "\x07" "Example" "\x03" "com" "\x00"
+            "\x03" "sub" "\x07" "example" "\x03" "com" "\x00"
+            "\x07" "example" "\x03" "net" "\x00";
+        static const uint32_t values[] = {10, 11, 12, 13, 14};
+        static uint8_t trie_buf[1024] __attribute__((aligned(64)));
+        static uint8_t copy[1024] __attribute__((aligned(64)));
+        const size_t len = sizeof(list) - 1;
+
+        size_t need = dnsasm_trie_size(list, len);
+        int ok = need > 0 && need <= sizeof(trie_buf) &&
+                 dnsasm_trie_build(list, len, values, trie_buf, need) == 0;
+        const dnsasm_trie_t *trie = (const dnsasm_trie_t *)trie_buf;
+        ok = ok && trie->count == 5 && trie->node_count == 6 && trie->size < need;
+
+        static const struct {
+            const char *name;
+            size_t len;
+            int off;
+            uint32_t value;
+        } cases[] = {
+            {"\x03" "www" "\x03" "SUB" "\x07" "example" "\x03" "com", 21, 4, 13},
+            {"\x03" "sub" "\x07" "example" "\x03" "com", 17, 0, 13},
+            {"\x01" "a" "\x07" "example" "\x03" "com", 15, 2, 12},
+            {"\x03" "foo" "\x03" "com", 9, 4, 11},
+            {"\x03" "www" "\x07" "example" "\x03" "net", 17, 4, 14},
+            {"\x03" "net", 5, 4, 10},
+            {"\x06" "exampl" "\x03" "com", 12, 7, 11},
+        };
+        for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++) {
+            uint32_t v = 0;
+            ok = dnsasm_trie_match(trie, (const uint8_t *)cases[i].name, cases[i].len, &v) ==
+                     cases[i].off && v == cases[i].value;
+        }
+
+        /* The buffer is the serialized form */
+        const dnsasm_trie_t *opened;
+        uint32_t v = 0;
+        memcpy(copy, trie_buf, trie->size);
+        ok = ok && dnsasm_trie_open(copy, trie->size, &opened) == 0 &&
+             dnsasm_trie_match(opened, list + 1, 5, &v) == 0 && v == 11 &&
+             dnsasm_trie_open(copy, trie->size - 1, &opened) == DNSASM_ERR_SHORT &&
+             dnsasm_trie_open(copy + 1, trie->size - 1, &opened) == DNSASM_ERR_FORMAT;
+        copy[sizeof(dnsasm_trie_t) + 4] = 0;   /* Root's first child points at itself */
+        ok = ok && dnsasm_trie_open(copy, trie->size, &opened) == DNSASM_ERR_FORMAT;
+
+        /* Unsorted or malformed input, truncated name */
+        ok = ok && dnsasm_trie_build(list + 1, len - 14, NULL, trie_buf, sizeof(trie_buf)) == 0 &&
+             dnsasm_trie_match(trie, (const uint8_t *)cases[0].name, cases[0].len, &v) == 4 &&
+             v == 2 &&
+             dnsasm_trie_match(trie, (const uint8_t *)cases[0].name, cases[0].len - 1, &v) == -1;
+        static const uint8_t unsorted[] = "\x03" "net" "\x00" "\x03" "com";
+        static const uint8_t bad[] = {3, 'w', 'w', 'w', 0xc0, 0x0c};
+        ok = ok && dnsasm_trie_build(unsorted, sizeof(unsorted), NULL, trie_buf,
+                                     sizeof(trie_buf)) == DNSASM_ERR_FORMAT &&
+             dnsasm_trie_size(bad, sizeof(bad)) == 0 &&
+             dnsasm_trie_build(list, len, values, trie_buf, need - 1) == DNSASM_ERR_SPACE;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 20: Blocked Bloom name filter */
+    {
+        printf("Test 20: Name filter over suffixes... ");
+        enum { N = 10000, PROBES = 100000 };
+        static uint8_t filter_buf[64 << 10] __attribute__((aligned(64)));
+        static uint8_t copy[64 << 10] __attribute__((aligned(64)));
+        const dnsasm_hash_key_t key = {0x1122334455667788ULL, 0x99aabbccddeeff00ULL};
+        size_t need = dnsasm_filter_size(N);
+        int ok = need > 0 && need <= sizeof(filter_buf) &&
+                 dnsasm_filter_init(filter_buf, need, N, &key) == 0;
+        dnsasm_filter_t *f = (dnsasm_filter_t *)filter_buf;
+
+        /* bad<i>.example */
+        uint8_t name[64];
+        for (int i = 0; ok && i < N; i++) {
+            int l = snprintf((char *)name + 1, 16, "bad%d", i);
+            name[0] = (uint8_t)l;
+            memcpy(name + 1 + l, "\x07" "example", 9);
+            ok = dnsasm_filter_add(f, name, 10 + l) == 0;
+        }
+        ok = ok && f->count == N && dnsasm_filter_add(f, name, 10 + name[0]) == DNSASM_ERR_SPACE;
+
+        /* No false negatives for members or their subdomains, in any case */
+        int misses = 0, false_hits = 0;
+        for (int i = 0; ok && i < N; i++) {
+            memcpy(name, "\x03" "WWW", 4);
+            int l = snprintf((char *)name + 5, 16, "BAD%d", i);
+            name[4] = (uint8_t)l;
+            memcpy(name + 5 + l, "\x07" "EXAMPLE", 9);
+            misses += dnsasm_filter_match(f, name, 14 + l) < 0;
+        }
+        for (int i = 0; ok && i < PROBES; i++) {
+            int l = snprintf((char *)name + 1, 16, "good%d", i);
+            name[0] = (uint8_t)l;
+            memcpy(name + 1 + l, "\x03" "org", 5);
+            false_hits += dnsasm_filter_match(f, name, 6 + l) >= 0;
+        }
+        ok = ok && misses == 0 && false_hits < PROBES / 200;
+
+        /* Serialized form, malformed names */
+        const dnsasm_filter_t *opened;
+        memcpy(copy, filter_buf, f->size);
+        ok = ok && dnsasm_filter_open(copy, f->size, &opened) == 0 &&
+             dnsasm_filter_match(opened, (const uint8_t *)"\x04" "bad7" "\x07" "example", 14) == 0 &&
+             dnsasm_filter_open(copy, f->size - 1, &opened) == DNSASM_ERR_SHORT &&
+             dnsasm_filter_match(f, (const uint8_t *)"\x04" "bad7" "\x07" "example", 13) == -1 &&
+             dnsasm_filter_add(f, (const uint8_t *)"\x03" "www" "\xc0\x0c", 6) == DNSASM_ERR_NAME;
+        copy[0] ^= 1;
+        ok = ok && dnsasm_filter_open(copy, f->size, &opened) == DNSASM_ERR_FORMAT;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 21: Longest-prefix-match table */
+    {
+        printf("Test 21: Prefix table lookups... ");
+        static uint8_t lpm_buf[1 << 20] __attribute__((aligned(64)));
+        static uint8_t copy[1 << 20] __attribute__((aligned(64)));
+        dnsasm_lpm_entry_t e[8];
+        const struct { int family; const char *addr; int len; uint32_t value; } spec[8] = {
+            {4, "0.0.0.0", 0, 9},
+            {4, "10.0.0.0", 8, 1},
+            {4, "10.1.0.0", 16, 2},
+            {4, "10.1.2.77", 24, 3},   /* Host bits ignored */
+            {4, "10.1.2.3", 32, 4},
+            {6, "2001:db8::", 32, 5},
+            {6, "2001:db8::1", 128, 6},
+            {4, "192.168.0.0", 17, 7},
+        };
+        memset(e, 0, sizeof(e));
+        for (int i = 0; i < 8; i++) {
+            inet_pton(spec[i].family == 4 ? AF_INET : AF_INET6, spec[i].addr, e[i].addr);
+            e[i].family = (uint8_t)spec[i].family;
+            e[i].prefix_len = (uint8_t)spec[i].len;
+            e[i].value = spec[i].value;
+        }
+        size_t need = dnsasm_lpm_size(e, 8);
+        int ok = need > 0 && need <= sizeof(lpm_buf) && dnsasm_lpm_build(e, 8, lpm_buf, need) == 0;
+        const dnsasm_lpm_t *lpm = (const dnsasm_lpm_t *)lpm_buf;
+
+        const struct { const char *addr; uint32_t want; } v4[] = {
+            {"10.1.2.3", 4}, {"10.1.2.4", 3}, {"10.1.3.3", 2}, {"10.2.0.0", 1},
+            {"11.0.0.0", 9}, {"192.168.127.1", 7}, {"192.168.128.1", 9},
+        };
+        for (size_t i = 0; ok && i < sizeof(v4) / sizeof(v4[0]); i++) {
+            struct sockaddr_in sin = {.sin_family = AF_INET};
+            inet_pton(AF_INET, v4[i].addr, &sin.sin_addr);
+            ok = dnsasm_lpm_lookup_sockaddr(lpm, &sin, sizeof(sin)) == v4[i].want;
+        }
+        const struct { const char *addr; uint32_t want; } v6[] = {
+            {"2001:db8::1", 6}, {"2001:db8::2", 5}, {"2001:db9::1", DNSASM_LPM_NONE},
+            {"::ffff:10.1.2.3", 4},
+        };
+        for (size_t i = 0; ok && i < sizeof(v6) / sizeof(v6[0]); i++) {
+            struct sockaddr_in6 sin6 = {.sin6_family = AF_INET6};
+            inet_pton(AF_INET6, v6[i].addr, &sin6.sin6_addr);
+            ok = dnsasm_lpm_lookup_sockaddr(lpm, &sin6, sizeof(sin6)) == v6[i].want &&
+                 dnsasm_lpm_lookup_sockaddr(lpm, &sin6, sizeof(sin6) - 1) == DNSASM_LPM_NONE;
+        }
+
+        /* Later entries win: a short prefix painted last overrides longer ones */
+        e[7] = e[1];
+        e[7].value = 8;
+        ok = ok && dnsasm_lpm_build(e, 8, lpm_buf, sizeof(lpm_buf)) == 0 &&
+             dnsasm_lpm_lookup4(lpm, (const uint8_t *)"\x0a\x01\x02\x03") == 8 &&
+             dnsasm_lpm_lookup4(lpm, (const uint8_t *)"\x0b\x01\x02\x03") == 9;
+
+        /* Bad entries, serialized form, corrupt chunk index */
+        const dnsasm_lpm_t *opened;
+        e[0].prefix_len = 33;
+        ok = ok && dnsasm_lpm_size(e, 8) == 0 &&
+             dnsasm_lpm_build(e, 8, lpm_buf, sizeof(lpm_buf)) == DNSASM_ERR_FORMAT;
+        memcpy(copy, lpm_buf, lpm->size);
+        ok = ok && dnsasm_lpm_open(copy, lpm->size, &opened) == 0 &&
+             dnsasm_lpm_lookup4(opened, (const uint8_t *)"\x0a\x01\x02\x03") == 8 &&
+             dnsasm_lpm_open(copy, lpm->size - 1, &opened) == DNSASM_ERR_SHORT;
+        uint32_t *root = (uint32_t *)(copy + sizeof(dnsasm_lpm_t));
+        root[0] = 0x80000000u | lpm->chunk_count;
+        ok = ok && dnsasm_lpm_open(copy, lpm->size, &opened) == DNSASM_ERR_FORMAT;
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 22: RFC 9018 server cookies */
+    {
+        printf("Test 22: DNS cookies (RFC 9018)... ");
+        static const uint8_t secret1[16] = {
+            0xe5, 0xe9, 0x73, 0xe5, 0xa6, 0xb2, 0xa4, 0x3f,
+            0x48, 0xe7, 0xdc, 0x84, 0x9e, 0x37, 0xbf, 0xcf,
+        };
+        static const uint8_t secret2[16] = {
+            0xdd, 0x3b, 0xdf, 0x93, 0x44, 0xb6, 0x78, 0xb1,
+            0x85, 0xa6, 0xf5, 0xcb, 0x60, 0xfc, 0xa7, 0x15,
+        };
+        dnsasm_cookie_secrets_t secrets = {0};
+        memcpy(&secrets.current, secret1, 16);      /* Little-endian host */
+        const uint8_t v4[4] = {198, 51, 100, 100};
+        uint8_t v6[16];
+        inet_pton(AF_INET6, "2001:db8:220:1:59de:d0f4:8769:82b8", v6);
+        uint8_t mapped[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 198, 51, 100, 100};
+        uint8_t out[16], reply[16];
+
+        /* A.1: new cookie; A.2: renewed after 40 minutes */
+        uint8_t opt[24];
+        memcpy(opt, "\x24\x64\xc4\xab\xcf\x10\xc9\x57", 8);
+        int ok = dnsasm_cookie_make(&secrets.current, opt, v4, 4, 1559731985, out) == 0 &&
+                 memcmp(out, "\x01\x00\x00\x00\x5c\xf7\x9f\x11\x1f\x81\x30\xc3\xee\xe2\x94\x80", 16) == 0 &&
+                 dnsasm_cookie_check(&secrets, opt, 8, mapped, 16, 1559731985, reply) == DNSASM_COOKIE_CLIENT &&
+                 memcmp(reply, out, 16) == 0;
+        memcpy(opt + 8, out, 16);
+        ok = ok && dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559731985 + 60, reply) == DNSASM_COOKIE_VALID &&
+             memcmp(reply, out, 16) == 0 &&
+             dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559734385, reply) == DNSASM_COOKIE_RENEW &&
+             memcmp(reply, "\x01\x00\x00\x00\x5c\xf7\xa8\x71\xd4\xa5\x64\xa1\x44\x2a\xca\x77", 16) == 0 &&
+             dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559731985 + 3601, reply) == DNSASM_COOKIE_EXPIRED &&
+             dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559731985 - 301, reply) == DNSASM_COOKIE_EXPIRED &&
+             dnsasm_cookie_check(&secrets, opt, 20, v4, 4, 1559731985, reply) == DNSASM_COOKIE_BAD &&
+             dnsasm_cookie_check(&secrets, opt, 12, v4, 4, 1559731985, reply) == DNSASM_COOKIE_FORMERR &&
+             dnsasm_cookie_check(&secrets, opt, 24, v4, 3, 1559731985, reply) == DNSASM_ERR_FORMAT;
+        opt[23] ^= 1;
+        ok = ok && dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559731985, reply) == DNSASM_COOKIE_BAD;
+        opt[23] ^= 1;
+
+        /* After a rotation the old secret still validates, as RENEW */
+        secrets.previous = secrets.current;
+        secrets.has_previous = 1;
+        memcpy(&secrets.current, secret2, 16);
+        ok = ok && dnsasm_cookie_check(&secrets, opt, 24, v4, 4, 1559731985, reply) == DNSASM_COOKIE_RENEW;
+
+        /* IPv6 clients round-trip under either secret */
+        ok = ok && dnsasm_cookie_make(&secrets.previous, opt, v6, 16, 1559741817, opt + 8) == 0 &&
+             dnsasm_cookie_check(&secrets, opt, 24, v6, 16, 1559741817, reply) == DNSASM_COOKIE_RENEW &&
+             dnsasm_cookie_make(&secrets.current, opt, v6, 16, 1559741817, opt + 8) == 0 &&
+             dnsasm_cookie_check(&secrets, opt, 24, v6, 16, 1559741817, reply) == DNSASM_COOKIE_VALID &&
+             memcmp(reply, opt + 8, 16) == 0 &&
+             dnsasm_cookie_check(&secrets, opt, 24, mapped, 16, 1559741817, reply) == DNSASM_COOKIE_BAD;
+
+        /* A mixed batch agrees with one-at-a-time checks */
+        enum { N = 77 };
+        static dnsasm_cookie_req_t reqs[N];
+        static uint8_t opts[N][24];
+        for (int i = 0; ok && i < N; i++) {
+            memset(&reqs[i], 0, sizeof(reqs[i]));
+            for (int k = 0; k < 8; k++) {
+                opts[i][k] = (uint8_t)(i * 7 + k);
+            }
+            reqs[i].addr_len = (i % 3 == 0) ? 16 : 4;
+            memcpy(reqs[i].addr, (i % 3 == 0) ? v6 : v4, reqs[i].addr_len);
+            reqs[i].addr[reqs[i].addr_len - 1] ^= (uint8_t)i;
+            dnsasm_cookie_make(i % 2 ? &secrets.current : &secrets.previous, opts[i],
+                               reqs[i].addr, reqs[i].addr_len, 1559731985 - (uint32_t)i * 50, opts[i] + 8);
+            if (i % 5 == 0) {
+                opts[i][20] ^= 0x40;
+            }
+            reqs[i].option = opts[i];
+            reqs[i].option_len = (i % 11 == 0) ? 8 : 24;
+        }
+        ok = ok && dnsasm_cookie_check_batch(&secrets, reqs, N, 1559731985) == 0;
+        int kinds[6] = {0};
+        for (int i = 0; ok && i < N; i++) {
+            int want = dnsasm_cookie_check(&secrets, reqs[i].option, reqs[i].option_len,
+                                           reqs[i].addr, reqs[i].addr_len, 1559731985, reply);
+            ok = reqs[i].status == want && memcmp(reqs[i].reply, reply, 16) == 0;
+            kinds[want]++;
+        }
+        ok = ok && kinds[DNSASM_COOKIE_CLIENT] && kinds[DNSASM_COOKIE_VALID] &&
+             kinds[DNSASM_COOKIE_RENEW] && kinds[DNSASM_COOKIE_BAD] && kinds[DNSASM_COOKIE_EXPIRED];
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 23: Hot-path counters */
+    {
+        printf("Test 23: Per-thread statistics (%s)... ",
+               dnsasm_stats_enabled() ? "STATS=1" : "disabled");
+        /* A chain of backward pointers: 6 hops from entry 5, too many from 130 */
+        uint8_t chain[13 + 2 * 131] = {0};
+        for (int i = 0; i < 131; i++) {
+            size_t at = 13 + 2 * (size_t)i;
+            size_t to = i == 0 ? 12 : at - 2;
+            chain[at] = (uint8_t)(0xC0 | (to >> 8));
+            chain[at + 1] = (uint8_t)to;
+        }
+        const char *impl = dnsasm_active_impl();
+        dnsasm_select_impl("c");    /* The asm decompressor counts no hops */
+
+        dnsasm_stats_t before, after;
+        dnsasm_stats_snapshot(&before);
+        dnsasm_question_t q;
+        dnsasm_rr_t rr;
+        uint8_t name[DNS_MAX_NAME_LEN + 1];
+        uint16_t name_len;
+        int ok = dnsasm_parse_question(sample_response, sizeof(sample_response), 12, &q).error == 0;
+        ok = ok && dnsasm_parse_rr(sample_response, sizeof(sample_response),
+                                   12 + q.wire_len, &rr).error == 0;
+        ok = ok && dnsasm_decompress_name(chain, sizeof(chain), 13 + 2 * 5, name, &name_len).error == 0;
+        ok = ok && dnsasm_decompress_name(chain, sizeof(chain), 13 + 2 * 130, name,
+                                          &name_len).error == DNSASM_ERR_LOOP;
+        ok = ok && dnsasm_parse_header(sample_query, 5, &(dnsasm_header_t){0}) == DNSASM_ERR_SHORT;
+        dnsasm_stats_snapshot(&after);
+        dnsasm_select_impl(impl);
+
+        if (dnsasm_stats_enabled()) {
+            ok = ok && after.names - before.names == 3 &&
+                 after.pointer_hops - before.pointer_hops == 1 + 6 + 127 &&
+                 after.errors[-DNSASM_ERR_LOOP] - before.errors[-DNSASM_ERR_LOOP] == 1 &&
+                 after.errors[-DNSASM_ERR_SHORT] - before.errors[-DNSASM_ERR_SHORT] == 1 &&
+                 after.qtype[DNS_TYPE_A] - before.qtype[DNS_TYPE_A] == 1 &&
+                 after.name_len[17 / 16] - before.name_len[17 / 16] == 2 &&
+                 after.name_len[0] - before.name_len[0] == 1 && after.threads >= 1;
+        } else {
+            static const dnsasm_stats_t zero;
+            ok = ok && memcmp(&after, &zero, sizeof(zero)) == 0;
+        }
+
+        if (ok) {
+            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
+            passed++;
+        } else {
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
+            failed++;
+        }
+    }
+
+    /* Test 24: Batched socket I/O over loopback */
+    {
+        printf("Test 24: recvmmsg/sendmmsg socket ring... ");
+        static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+        dnsasm_io_config_t cfg = { .batch = 4, .rx_size = 64, .timeout_ms = 1000 };
+        dnsasm_io_t *io = dnsasm_io_open(loopback, 4, 0, &cfg);
+        int client = socket(AF_INET, SOCK_DGRAM, 0);
+        int ok = io != NULL && client >= 0;
+
+        struct sockaddr_in to = { .sin_family = AF_INET };
+        memcpy(&to.sin_addr, loopback, 4);
+        to.sin_port = htons(ok ? dnsasm_io_port(io) : 0);
+        uint8_t big[100] = {0};
+        int n = 0;
+        if (ok) {
+            /* Six datagrams: one too long for a slot, two left for a second batch */
+            for (int i = 0; i < 6; i++) {
+                const uint8_t *d = i == 2 ? big : sample_query;
+                size_t len = i == 2 ? sizeof(big) : sizeof(sample_query);
+                sendto(client, d, len, 0, (struct sockaddr *)&to, sizeof(to));
+            }
+            n = dnsasm_io_recv(io);
+        }
+        ok = ok && n == 4;
+
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        if (ok) {
+            const uint8_t *const *pkts = dnsasm_io_packets(io);
+            const uint16_t *lens = dnsasm_io_lens(io);
+            const dnsasm_io_peer_t *peers = dnsasm_io_peers(io);
+            getsockname(client, (struct sockaddr *)&from, &from_len);
+            dnsasm_batch_t batch;
+            ok = dnsasm_parse_batch(pkts, lens, (size_t)n, &batch) == 3 &&
+                 lens[2] == 0 && lens[0] == sizeof(sample_query) &&
+                 peers[1].addr_len == 4 && memcmp(peers[1].addr, loopback, 4) == 0 &&
+                 peers[1].port == ntohs(from.sin_port);
+            /* Echo the slot index back in the ID */
+            for (uint32_t i = 0; i < 4 && ok; i++) {
+                uint8_t resp[sizeof(sample_query)];
+                memcpy(resp, sample_query, sizeof(resp));
+                resp[1] = (uint8_t)i;
+                ok = dnsasm_io_queue(io, i, resp, sizeof(resp)) == 0;
+            }
+            ok = ok && dnsasm_io_queue(io, 4, sample_query, sizeof(sample_query)) == DNSASM_ERR_FORMAT &&
+                 dnsasm_io_queue(io, 0, big, 5000) == DNSASM_ERR_SPACE;
+            ok = ok && dnsasm_io_recv(io) == 2;     /* Flushes the four first */
+        }
+        for (int i = 0; i < 4 && ok; i++) {
+            uint8_t resp[64];
+            ok = recv(client, resp, sizeof(resp), 0) == (ssize_t)sizeof(sample_query) &&
+                 resp[1] == i;
+        }
+
+        dnsasm_io_counters_t c = {0};
+        if (io != NULL) {
+            dnsasm_io_counters(io, &c);
+            dnsasm_io_shutdown(io);
+            ok = ok && dnsasm_io_recv(io) == -1;
+            dnsasm_io_close(io);
+        }
+        ok = ok && c.recv_calls == 2 && c.received == 6 && c.truncated == 1 &&
+             c.sent == 4 && c.send_calls == 1 && c.send_errors == 0;
+        ok = ok && dnsasm_io_open(loopback, 5, 0, NULL) == NULL;
+        if (client >= 0) {
+            close(client);
+        }
+
+        if (ok) {
             printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
             passed++;
         } else {
-            printf(COLOR_RED "FAILED (ret=%d, id=0x%04x, qr=%d, ra=%d, ancount=%d)\n" COLOR_RESET,
-                   ret, h.id, h.qr, h.ra, h.ancount);
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
             failed++;
         }
     }
-    
-    /* Test 3: Parse question */
+
+    /* Test 25: io_uring backend and TCP listener over loopback */
     {
-        printf("Test 3: Parse question section... ");
-        dnsasm_question_t q;
-        dnsasm_result_t res = dnsasm_parse_question(sample_query, sizeof(sample_query), 12, &q);
-        if (res.error == 0 && q.qtype == 1 && q.qclass == 1) {
+        printf("Test 25: io_uring socket ring and listener... ");
+        static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+        dnsasm_io_config_t cfg = { .batch = 4, .rx_size = 64, .timeout_ms = 1000,
+                                   .flags = DNSASM_IO_URING };
+        dnsasm_io_t *io = dnsasm_io_open(loopback, 4, 0, &cfg);
+        int client = socket(AF_INET, SOCK_DGRAM, 0);
+        int ok = io != NULL && client >= 0;
+        /* Kernels without it keep recvmmsg; the round trip is the same */
+        ok = ok && (strcmp(dnsasm_io_backend(io), "io_uring") == 0 ||
+                    strcmp(dnsasm_io_backend(io), "recvmmsg") == 0);
+
+        struct sockaddr_in to = { .sin_family = AF_INET };
+        memcpy(&to.sin_addr, loopback, 4);
+        to.sin_port = htons(ok ? dnsasm_io_port(io) : 0);
+        uint8_t big[100] = {0};
+        int got = 0, answered = 0;
+        if (ok) {
+            for (int i = 0; i < 6; i++) {
+                const uint8_t *d = i == 2 ? big : sample_query;
+                size_t len = i == 2 ? sizeof(big) : sizeof(sample_query);
+                sendto(client, d, len, 0, (struct sockaddr *)&to, sizeof(to));
+            }
+            /* Answer every slot, echoing the arrival order in the ID */
+            while (ok && got < 6) {
+                int n = dnsasm_io_recv(io);
+                ok = n > 0 && n <= 4;
+                const uint16_t *lens = dnsasm_io_lens(io);
+                const uint8_t *const *pkts = dnsasm_io_packets(io);
+                for (int i = 0; i < n && ok; i++, got++) {
+                    if (got == 2) {
+                        ok = lens[i] == 0;
+                        continue;
+                    }
+                    uint8_t resp[sizeof(sample_query)];
+                    ok = lens[i] == sizeof(sample_query) &&
+                         memcmp(pkts[i], sample_query, sizeof(sample_query)) == 0;
+                    memcpy(resp, sample_query, sizeof(resp));
+                    resp[1] = (uint8_t)got;
+                    ok = ok && dnsasm_io_queue(io, (uint32_t)i, resp, sizeof(resp)) == 0;
+                    answered++;
+                }
+            }
+            ok = ok && dnsasm_io_flush(io) >= 0;
+        }
+        for (int i = 0; i < 6 && ok; i++) {
+            uint8_t resp[64];
+            if (i == 2) {
+                continue;
+            }
+            ok = recv(client, resp, sizeof(resp), 0) == (ssize_t)sizeof(sample_query) &&
+                 resp[1] == i;
+        }
+
+        dnsasm_io_counters_t c = {0};
+        if (io != NULL) {
+            dnsasm_io_counters(io, &c);
+            dnsasm_io_shutdown(io);
+            ok = ok && dnsasm_io_recv(io) == -1;
+            dnsasm_io_close(io);
+        }
+        ok = ok && answered == 5 && c.received == 6 && c.truncated == 1 && c.sent == 5 &&
+             c.send_errors == 0;
+        if (client >= 0) {
+            close(client);
+        }
+
+        /* Three connections, taken in as few accepts as they arrive in */
+        dnsasm_io_listener_t *l = ok ? dnsasm_io_listen(loopback, 4, 0, &cfg) : NULL;
+        ok = ok && l != NULL;
+        int conns[3] = { -1, -1, -1 };
+        int accepted = 0;
+        if (ok) {
+            to.sin_port = htons(dnsasm_io_listener_port(l));
+            for (int i = 0; i < 3 && ok; i++) {
+                conns[i] = socket(AF_INET, SOCK_STREAM, 0);
+                ok = connect(conns[i], (struct sockaddr *)&to, sizeof(to)) == 0;
+            }
+            int fds[8];
+            while (ok && accepted < 3) {
+                int n = dnsasm_io_accept(l, fds, 8);
+                ok = n > 0;
+                for (int i = 0; i < n; i++) {
+                    close(fds[i]);
+                }
+                accepted += n > 0 ? n : 0;
+            }
+            dnsasm_io_listener_shutdown(l);
+            ok = ok && accepted == 3 && dnsasm_io_accept(l, fds, 8) == -1;
+        }
+        dnsasm_io_listener_close(l);
+        for (int i = 0; i < 3; i++) {
+            if (conns[i] >= 0) {
+                close(conns[i]);
+            }
+        }
+
+        if (ok) {
             printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
             passed++;
         } else {
-            printf(COLOR_RED "FAILED (error=%d, qtype=%d, qclass=%d)\n" COLOR_RESET,
-                   res.error, q.qtype, q.qclass);
+            printf(COLOR_RED "FAILED\n" COLOR_RESET);
             failed++;
         }
     }
-    
-    /* Test 4: Handle short packet */
+
+    /* Test 26: The hand-written decompressor against the C reference */
     {
-        printf("Test 4: Handle short packet... ");
-        uint8_t short_pkt[] = {0x12, 0x34};
-        dnsasm_header_t h;
-        int ret = dnsasm_parse_header(short_pkt, sizeof(short_pkt), &h);
-        if (ret == DNSASM_ERR_SHORT) {
-            printf(COLOR_GREEN "PASSED\n" COLOR_RESET);
-            passed++;
+        printf("Test 26: asm decompressor matches C... ");
+        const char *prev = dnsasm_active_impl();
+        if (dnsasm_select_impl("asm") != 0) {
+            printf(COLOR_YELLOW "SKIPPED (built without USE_ASM=1)\n" COLOR_RESET);
         } else {
-            printf(COLOR_RED "FAILED (expected %d, got %d)\n" COLOR_RESET, DNSASM_ERR_SHORT, ret);
-            failed++;
+            /* Edge cases first: loops, hop limits, overlong names, bad labels */
+            static uint8_t edge[24][320];
+            size_t edge_len[24], edge_off[24];
+            size_t n_edge = 0;
+            const uint8_t *const simple[] = {
+                (const uint8_t *)"\xc0\x0c",                     /* Points at itself */
+                (const uint8_t *)"\x01" "a" "\xc0\x0c",          /* a -> a -> ... */
+                (const uint8_t *)"\x40" "abc\x00",                /* Reserved label types */
+                (const uint8_t *)"\x80" "abc\x00",
+                (const uint8_t *)"\x03" "ab",                      /* Cut off */
+                (const uint8_t *)"\xc0",
+            };
+            const size_t simple_len[] = { 2, 4, 5, 5, 3, 1 };
+            for (size_t k = 0; k < 6; k++) {
+                memset(edge[n_edge], 0, 12);
+                memcpy(edge[n_edge] + 12, simple[k], simple_len[k]);
+                edge_len[n_edge] = 12 + simple_len[k];
+                edge_off[n_edge++] = 12;
+            }
+            /* Pointer chains around the 127-hop limit */
+            const size_t hops[] = { 126, 127, 128 };
+            for (size_t k = 0; k < 3; k++) {
+                uint8_t *p = edge[n_edge];
+                memset(p, 0, 14);
+                for (size_t h = 0; h < hops[k]; h++) {
+                    size_t at = 12 + 2 * h;
+                    p[14 + 2 * h] = (uint8_t)(0xc0 | (at >> 8));
+                    p[15 + 2 * h] = (uint8_t)at;
+                }
+                edge_len[n_edge] = 14 + 2 * hops[k];
+                edge_off[n_edge] = edge_len[n_edge] - 2;
+                n_edge++;
+            }
+            /* Names either side of the 255-byte limit */
+            for (size_t want = 254; want <= 257; want++) {
+                uint8_t *p = edge[n_edge];
+                size_t pos = 12;
+                memset(p, 0, 12);
+                while (pos - 12 + 1 < want) {
+                    size_t l = want - (pos - 12) - 2;
+                    l = l > 63 ? 63 : l;
+                    if (l == 0) {
+                        break;
+                    }
+                    p[pos] = (uint8_t)l;
+                    memset(p + pos + 1, 'x', l);
+                    pos += 1 + l;
+                }
+                p[pos++] = 0;
+                edge_len[n_edge] = pos;
+                edge_off[n_edge++] = 12;
+            }
+
+            int mismatches = 0, cases = 0;
+            uint32_t seed = 0x2545f491;
+            for (int iter = 0; iter < (int)n_edge + 20000; iter++) {
+                uint8_t rnd[320];
+                const uint8_t *pkt;
+                size_t len, off = 12;
+                if (iter < (int)n_edge) {
+                    pkt = edge[iter];
+                    len = edge_len[iter];
+                    off = edge_off[iter];
+                } else {
+                    len = random_name_packet(&seed, rnd);
+                    pkt = rnd;
+                }
+
+                uint8_t ref[DNS_MAX_NAME_LEN + 1], got[DNS_MAX_NAME_LEN + 1];
+                uint16_t ref_len = 0, got_len = 0;
+                dnsasm_select_impl("c");
+                dnsasm_result_t r = dnsasm_decompress_name(pkt, len, off, ref, &ref_len);
+                dnsasm_select_impl("asm");
+                dnsasm_result_t g = dnsasm_decompress_name(pkt, len, off, got, &got_len);
+                if (g.error != r.error ||
+                    (r.error == 0 && (g.offset != r.offset || got_len != ref_len ||
+                                      memcmp(got, ref, ref_len) != 0))) {
+                    mismatches++;
+                }
+                cases++;
+            }
+            dnsasm_select_impl(prev);
+
+            if (mismatches == 0) {
+                printf(COLOR_GREEN "PASSED" COLOR_RESET " (%d names)\n", cases);
+                passed++;
+            } else {
+                printf(COLOR_RED "FAILED (%d of %d names differ)\n" COLOR_RESET, mismatches, cases);
+                failed++;
+            }
         }
     }
-    
+
     /* Summary */
     printf("\n═══════════════════════════════════════════════════════════\n");
     printf("Results: ");
@@ -231,6 +1740,8 @@ static void run_benchmarks(void) {
     printf("═══════════════════════════════════════════════════════════\n\n" COLOR_RESET);
     
     const int iterations = 10000000;
+
+    printf("Implementation: %s\n\n", dnsasm_active_impl());
     
     /* Benchmark: Header parsing */
     {
@@ -290,8 +1801,548 @@ static void run_benchmarks(void) {
         printf("  Rate:     %.2f M packets/sec\n", ops_per_sec / 1e6);
         printf("  (%.0f cycles @ 3GHz)\n", ns_per_op * 3.0);
     }
-    
+
+    /* Benchmark: Batch parse (header + question, full bursts) */
+    {
+        const int batches = iterations / DNSASM_BATCH_MAX;
+        printf("\nBenchmark: Batch parse (%d x %d packets)...\n", batches, DNSASM_BATCH_MAX);
+        const uint8_t *pkts[DNSASM_BATCH_MAX];
+        uint16_t lens[DNSASM_BATCH_MAX];
+        static dnsasm_batch_t b;
+        for (int i = 0; i < DNSASM_BATCH_MAX; i++) {
+            pkts[i] = sample_query;
+            lens[i] = sizeof(sample_query);
+        }
+
+        uint64_t start = get_time_ns();
+        for (int i = 0; i < batches; i++) {
+            dnsasm_parse_batch(pkts, lens, DNSASM_BATCH_MAX, &b);
+        }
+        uint64_t end = get_time_ns();
+
+        double ns_per_op = (double)(end - start) / ((double)batches * DNSASM_BATCH_MAX);
+        double ops_per_sec = 1e9 / ns_per_op;
+
+        printf("  Time:     %.2f ns/packet\n", ns_per_op);
+        printf("  Rate:     %.2f M packets/sec\n", ops_per_sec / 1e6);
+        printf("  (%.0f cycles @ 3GHz)\n", ns_per_op * 3.0);
+    }
+
+    /* Benchmark: Name equality, mixed case (active implementation) */
+    {
+        printf("\nBenchmark: Name equality, %s (%d iterations)...\n",
+               dnsasm_active_impl(), iterations);
+        static const uint8_t upper[] = {3, 'W', 'W', 'W', 7, 'E', 'X', 'A', 'M', 'P', 'L', 'E', 3, 'C', 'O', 'M', 0};
+        const uint8_t *lower = sample_query + 12;
+        volatile int sink = 0;
+
+        uint64_t start = get_time_ns();
+        for (int i = 0; i < iterations; i++) {
+            sink += dnsasm_name_equal(upper, sizeof(upper), lower, sizeof(upper));
+        }
+        uint64_t end = get_time_ns();
+        (void)sink;
+
+        double ns_per_op = (double)(end - start) / iterations;
+        printf("  Time:     %.2f ns/op\n", ns_per_op);
+        printf("  Rate:     %.2f M ops/sec\n", 1e3 / ns_per_op);
+    }
+
+    /* Benchmark: Name filter miss (every ancestor probed) */
+    {
+        printf("\nBenchmark: Name filter miss (%d iterations)...\n", iterations);
+        static uint8_t filter_buf[64 << 10] __attribute__((aligned(64)));
+        const dnsasm_hash_key_t key = {1, 2};
+        dnsasm_filter_t *f = (dnsasm_filter_t *)filter_buf;
+        dnsasm_filter_init(filter_buf, sizeof(filter_buf), 10000, &key);
+        dnsasm_filter_add(f, (const uint8_t *)"\x03" "bad" "\x07" "example", 13);
+        const uint8_t *name = sample_query + 12;
+        volatile int sink = 0;
+
+        uint64_t start = get_time_ns();
+        for (int i = 0; i < iterations; i++) {
+            sink += dnsasm_filter_match(f, name, 17);
+        }
+        uint64_t end = get_time_ns();
+        (void)sink;
+
+        double ns_per_op = (double)(end - start) / iterations;
+        printf("  Time:     %.2f ns/op\n", ns_per_op);
+        printf("  Rate:     %.2f M ops/sec\n", 1e3 / ns_per_op);
+    }
+
+    /* Benchmark: Prefix table lookup */
+    {
+        printf("\nBenchmark: Prefix table lookup (%d iterations)...\n", iterations);
+        static uint8_t lpm_buf[1 << 20] __attribute__((aligned(64)));
+        dnsasm_lpm_entry_t e[2] = {
+            {.addr = {10}, .family = 4, .prefix_len = 8, .value = 1},
+            {.addr = {10, 1, 2}, .family = 4, .prefix_len = 24, .value = 2},
+        };
+        dnsasm_lpm_build(e, 2, lpm_buf, sizeof(lpm_buf));
+        const dnsasm_lpm_t *lpm = (const dnsasm_lpm_t *)lpm_buf;
+        uint8_t addr[4] = {10, 1, 2, 3};
+        volatile uint32_t sink = 0;
+
+        uint64_t start = get_time_ns();
+        for (int i = 0; i < iterations; i++) {
+            addr[3] = (uint8_t)i;
+            sink += dnsasm_lpm_lookup4(lpm, addr);
+        }
+        uint64_t end = get_time_ns();
+        (void)sink;
+
+        double ns_per_op = (double)(end - start) / iterations;
+        printf("  Time:     %.2f ns/op\n", ns_per_op);
+        printf("  Rate:     %.2f M ops/sec\n", 1e3 / ns_per_op);
+    }
+
+    /* Benchmark: Cookie check batch */
+    {
+        enum { N = 64 };
+        const int rounds = iterations / N / 4;
+        printf("\nBenchmark: Cookie check, batches of %d (%d requests)...\n", N, rounds * N);
+        static dnsasm_cookie_req_t reqs[N];
+        static uint8_t opts[N][24];
+        dnsasm_cookie_secrets_t secrets = {{1, 2}, {3, 4}, 1, 0};
+        for (int i = 0; i < N; i++) {
+            memset(opts[i], i, 8);
+            reqs[i].addr_len = 4;
+            reqs[i].addr[0] = 10;
+            reqs[i].addr[3] = (uint8_t)i;
+            dnsasm_cookie_make(&secrets.current, opts[i], reqs[i].addr, 4, 1000, opts[i] + 8);
+            reqs[i].option = opts[i];
+            reqs[i].option_len = 24;
+        }
+
+        uint64_t start = get_time_ns();
+        for (int i = 0; i < rounds; i++) {
+            dnsasm_cookie_check_batch(&secrets, reqs, N, 1000);
+        }
+        uint64_t end = get_time_ns();
+
+        double ns_per_op = (double)(end - start) / ((double)rounds * N);
+        printf("  Time:     %.2f ns/request\n", ns_per_op);
+        printf("  Rate:     %.2f M requests/sec\n", 1e3 / ns_per_op);
+    }
+
+    printf("\n═══════════════════════════════════════════════════════════\n");
+}
+
+/* ============================================================================
+ * Capture replay
+ * ============================================================================ */
+
+#define REPLAY_MAX_THREADS  256
+#define REPLAY_MAX_IMPLS    8
+#define REPLAY_MAX_FILES    64
+#define REPLAY_STAGES       5       /* Header, question, answer, authority, additional */
+#define REPLAY_CODES        11      /* -DNSASM_ERR_*, with the last slot for unknown codes */
+
+static const char *const replay_stages[REPLAY_STAGES] = {
+    "header", "question", "answer", "authority", "additional"
+};
+
+typedef struct {
+    const corpus_t *corpus;
+    size_t first, last;         /* Messages [first, last) */
+    int passes;
+    int cpu;                    /* Pin to this CPU, or -1 */
+
+    /* Results, written once when the worker finishes */
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t records;           /* Questions and RRs parsed */
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t failed[REPLAY_STAGES][REPLAY_CODES];
+} replay_worker_t;
+
+/*
+ * Full parse of one message: the header, then every question and RR
+ * with its name decompressed, as a resolver front end would. Returns 0
+ * or the first error, with the stage it happened in.
+ */
+static int replay_parse(const uint8_t *packet, size_t len, int *stage, uint64_t *records) {
+    dnsasm_header_t h;
+    int err = dnsasm_parse_header(packet, len, &h);
+    if (err != 0) {
+        *stage = 0;
+        return err;
+    }
+
+    size_t off = 12;
+    dnsasm_question_t q;
+    for (int i = 0; i < h.qdcount; i++) {
+        dnsasm_result_t res = dnsasm_parse_question(packet, len, off, &q);
+        if (res.error != 0) {
+            *stage = 1;
+            return res.error;
+        }
+        off = res.offset;
+        (*records)++;
+    }
+
+    const uint16_t counts[3] = {h.ancount, h.nscount, h.arcount};
+    dnsasm_rr_t rr;
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < counts[s]; i++) {
+            dnsasm_result_t res = dnsasm_parse_rr(packet, len, off, &rr);
+            if (res.error != 0) {
+                *stage = 2 + s;
+                return res.error;
+            }
+            off = res.offset;
+            (*records)++;
+        }
+    }
+    return 0;
+}
+
+static uint64_t clock_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *replay_worker(void *arg) {
+    replay_worker_t *w = arg;
+#if defined(__linux__)
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            w->cpu = -1;
+        }
+    }
+#endif
+
+    /* Counters stay on this thread's stack until the end */
+    uint64_t packets = 0, bytes = 0, records = 0;
+    uint64_t failed[REPLAY_STAGES][REPLAY_CODES];
+    memset(failed, 0, sizeof(failed));
+
+    uint64_t wall = get_time_ns();
+    uint64_t cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (int pass = 0; pass < w->passes; pass++) {
+        for (size_t i = w->first; i < w->last; i++) {
+            const corpus_packet_t *p = &w->corpus->packets[i];
+            int stage = 0;
+            int err = replay_parse(p->data, p->len, &stage, &records);
+            if (err != 0) {
+                int code = -err;
+                if (code <= 0 || code >= REPLAY_CODES) {
+                    code = REPLAY_CODES - 1;
+                }
+                failed[stage][code]++;
+            }
+            bytes += p->len;
+        }
+        packets += w->last - w->first;
+    }
+    w->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    w->wall_ns = get_time_ns() - wall;
+
+    w->packets = packets;
+    w->bytes = bytes;
+    w->records = records;
+    memcpy(w->failed, failed, sizeof(failed));
+    return NULL;
+}
+
+static double mpps(uint64_t packets, uint64_t ns) {
+    return ns ? (double)packets * 1e3 / (double)ns : 0.0;
+}
+
+/* Replay the corpus once on every thread with the selected implementation */
+static int replay_run(const corpus_t *c, replay_worker_t *workers, int threads, int passes,
+                      int pin) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t tids[REPLAY_MAX_THREADS];
+
+    for (int t = 0; t < threads; t++) {
+        replay_worker_t *w = &workers[t];
+        memset(w, 0, sizeof(*w));
+        w->corpus = c;
+        w->first = c->count * (size_t)t / (size_t)threads;
+        w->last = c->count * (size_t)(t + 1) / (size_t)threads;
+        w->passes = passes;
+        w->cpu = pin && ncpu > 0 ? (int)(t % ncpu) : -1;
+    }
+
+    uint64_t start = get_time_ns();
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, replay_worker, &workers[t]) != 0) {
+            fprintf(stderr, "dnsasm-console: cannot start thread %d\n", t);
+            for (int j = 0; j < t; j++) {
+                pthread_join(tids[j], NULL);
+            }
+            return -1;
+        }
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    uint64_t wall = get_time_ns() - start;
+
+    /* Per-thread rates, then the totals */
+    uint64_t packets = 0, bytes = 0, records = 0, cpu_ns = 0;
+    uint64_t failed[REPLAY_STAGES][REPLAY_CODES];
+    memset(failed, 0, sizeof(failed));
+
+    printf("  thread   cpu        packets        Mpps   Mpps/core    ns/packet\n");
+    for (int t = 0; t < threads; t++) {
+        const replay_worker_t *w = &workers[t];
+        char cpu[16] = "-";
+        if (w->cpu >= 0) {
+            snprintf(cpu, sizeof(cpu), "%d", w->cpu);
+        }
+        printf("  %6d %5s %14llu %11.2f %11.2f %12.1f\n", t, cpu,
+               (unsigned long long)w->packets, mpps(w->packets, w->wall_ns),
+               mpps(w->packets, w->cpu_ns),
+               w->packets ? (double)w->cpu_ns / (double)w->packets : 0.0);
+        packets += w->packets;
+        bytes += w->bytes;
+        records += w->records;
+        cpu_ns += w->cpu_ns;
+        for (int s = 0; s < REPLAY_STAGES; s++) {
+            for (int e = 0; e < REPLAY_CODES; e++) {
+                failed[s][e] += w->failed[s][e];
+            }
+        }
+    }
+    printf(COLOR_BOLD "  %6s %5s %14llu %11.2f %11.2f %12.1f" COLOR_RESET "\n", "total", "",
+           (unsigned long long)packets, mpps(packets, wall), mpps(packets, cpu_ns),
+           packets ? (double)cpu_ns / (double)packets : 0.0);
+
+    uint64_t errors = 0;
+    uint64_t by_code[REPLAY_CODES] = {0};
+    for (int s = 0; s < REPLAY_STAGES; s++) {
+        for (int e = 0; e < REPLAY_CODES; e++) {
+            by_code[e] += failed[s][e];
+            errors += failed[s][e];
+        }
+    }
+    printf("\n  Parsed:   %llu of %llu packets (%.2f%%), %llu records, %.1f MB in %.1f ms\n",
+           (unsigned long long)(packets - errors), (unsigned long long)packets,
+           packets ? 100.0 * (double)(packets - errors) / (double)packets : 0.0,
+           (unsigned long long)records, (double)bytes / 1e6, (double)wall / 1e6);
+
+    if (errors == 0) {
+        printf("  Errors:   none\n");
+        return 0;
+    }
+    printf("\n  %-10s", "error");
+    for (int s = 0; s < REPLAY_STAGES; s++) {
+        printf(" %11s", replay_stages[s]);
+    }
+    printf(" %11s\n", "total");
+    for (int e = 1; e < REPLAY_CODES; e++) {
+        if (by_code[e] == 0) {
+            continue;
+        }
+        printf("  %-10s", error_name(-e));
+        for (int s = 0; s < REPLAY_STAGES; s++) {
+            printf(" %11llu", (unsigned long long)failed[s][e]);
+        }
+        printf(" %11llu\n", (unsigned long long)by_code[e]);
+    }
+    return 0;
+}
+
+/* Library counters (STATS=1 builds) accumulated over every run */
+static void replay_stats(void) {
+    dnsasm_stats_t st;
+    dnsasm_stats_snapshot(&st);
+
+    printf(COLOR_CYAN "\n[library counters]" COLOR_RESET "\n");
+    printf("  Names:    %llu decompressed, %llu pointer hops (%.2f per name)\n",
+           (unsigned long long)st.names, (unsigned long long)st.pointer_hops,
+           st.names ? (double)st.pointer_hops / (double)st.names : 0.0);
+
+    printf("  Errors:  ");
+    int any = 0;
+    for (int e = 0; e < DNSASM_STATS_ERRORS; e++) {
+        if (st.errors[e] != 0) {
+            printf(" %s %llu", error_name(-e), (unsigned long long)st.errors[e]);
+            any = 1;
+        }
+    }
+    printf("%s\n", any ? "" : " none");
+
+    printf("  Lengths: ");
+    for (int b = 0; b < DNSASM_STATS_NAME_BUCKETS; b++) {
+        if (st.name_len[b] != 0) {
+            printf(" %d-%d:%llu", b * 16, b * 16 + 15, (unsigned long long)st.name_len[b]);
+        }
+    }
+    printf("\n");
+
+    /* Top qtypes by count */
+    printf("  Qtypes:  ");
+    uint8_t shown[DNSASM_STATS_QTYPES] = {0};
+    for (int n = 0; n < 8; n++) {
+        int best = -1;
+        for (int t = 0; t < DNSASM_STATS_QTYPES; t++) {
+            if (!shown[t] && st.qtype[t] != 0 && (best < 0 || st.qtype[t] > st.qtype[best])) {
+                best = t;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        shown[best] = 1;
+        if (best == DNSASM_STATS_QTYPES - 1) {
+            printf(" >255:%llu", (unsigned long long)st.qtype[best]);
+        } else {
+            printf(" %s(%d):%llu", type_name((uint16_t)best), best,
+                   (unsigned long long)st.qtype[best]);
+        }
+    }
+    printf("\n");
+}
+
+static void replay_usage(const char *prog) {
+    printf("Usage: %s --pcap <file> [file ...] [options]\n\n", prog);
+    printf("Replays the DNS messages of pcap captures (or hex text, one message\n");
+    printf("per line) through the full header, question and RR parse.\n\n");
+    printf("  --threads N   Worker threads (default: online CPUs)\n");
+    printf("  --passes N    Times each worker replays its share (default 1)\n");
+    printf("  --impl NAME   Implementation to run, repeatable; 'all' for every\n");
+    printf("                one this CPU supports (default: the active one)\n");
+    printf("  --port N      Capture port filter, 0 for any (default 53)\n");
+    printf("  --pin         Pin worker i to CPU i\n");
+}
+
+/* --pcap mode */
+static int run_replay(int argc, char *argv[]) {
+    const char *files[REPLAY_MAX_FILES];
+    const char *impls[REPLAY_MAX_IMPLS];
+    size_t file_count = 0, impl_count = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int passes = 1, port = 53, pin = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--pcap") == 0) {
+            continue;
+        } else if (strcmp(a, "--pin") == 0) {
+            pin = 1;
+            continue;
+        } else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
+            replay_usage(argv[0]);
+            return 0;
+        }
+        if (strncmp(a, "--", 2) == 0 && v == NULL) {
+            fprintf(stderr, "dnsasm-console: %s needs a value\n", a);
+            return 2;
+        }
+        if (strcmp(a, "--threads") == 0) {
+            threads = atol(v);
+        } else if (strcmp(a, "--passes") == 0) {
+            passes = atoi(v);
+        } else if (strcmp(a, "--port") == 0) {
+            port = atoi(v);
+        } else if (strcmp(a, "--impl") == 0) {
+            if (strcmp(v, "all") == 0) {
+                impl_count = dnsasm_impl_names(impls, REPLAY_MAX_IMPLS);
+            } else if (impl_count < REPLAY_MAX_IMPLS) {
+                impls[impl_count++] = v;
+            }
+        } else if (strncmp(a, "--", 2) == 0) {
+            fprintf(stderr, "dnsasm-console: unknown option %s\n", a);
+            replay_usage(argv[0]);
+            return 2;
+        } else if (file_count < REPLAY_MAX_FILES) {
+            files[file_count++] = a;
+            continue;
+        }
+        i++;
+    }
+    if (file_count == 0) {
+        replay_usage(argv[0]);
+        return 2;
+    }
+    if (threads < 1 || threads > REPLAY_MAX_THREADS || passes < 1 || port < 0 || port > 65535) {
+        fprintf(stderr, "dnsasm-console: bad option value\n");
+        return 2;
+    }
+#if !defined(__linux__)
+    if (pin) {
+        fprintf(stderr, "dnsasm-console: --pin is only supported on Linux\n");
+        return 2;
+    }
+#endif
+
+    corpus_t corpus;
+    corpus_init(&corpus, (uint16_t)port);
+    for (size_t f = 0; f < file_count; f++) {
+        char err[256];
+        if (corpus_load(&corpus, files[f], err, sizeof(err)) != 0) {
+            fprintf(stderr, "dnsasm-console: %s: %s\n", files[f], err);
+            corpus_free(&corpus);
+            return 1;
+        }
+    }
+    if (corpus.count == 0) {
+        fprintf(stderr, "dnsasm-console: no DNS messages found\n");
+        corpus_free(&corpus);
+        return 1;
+    }
+    if ((size_t)threads > corpus.count) {
+        threads = (long)corpus.count;
+    }
+
+    size_t by_source[4] = {0};
+    for (size_t i = 0; i < corpus.count; i++) {
+        by_source[corpus.packets[i].source & 3]++;
+    }
+
+    printf(COLOR_BOLD "\n═══════════════════════════════════════════════════════════\n");
+    printf("                    DNSASM Capture Replay\n");
+    printf("═══════════════════════════════════════════════════════════\n\n" COLOR_RESET);
+    printf("Messages: %zu (udp %zu, tcp %zu, hex %zu)\n", corpus.count,
+           by_source[CORPUS_UDP], by_source[CORPUS_TCP], by_source[CORPUS_HEX]);
+    printf("Frames:   %zu (%zu fragments and %zu others skipped)\n",
+           corpus.frames, corpus.skipped_fragment, corpus.skipped_other);
+    if (corpus.truncated > 0) {
+        printf(COLOR_YELLOW "%zu capture(s) cut off mid-record; the partial record was dropped\n"
+               COLOR_RESET, corpus.truncated);
+    }
+    printf("Threads:  %ld%s, %d pass%s each\n", threads, pin ? " (pinned)" : "",
+           passes, passes == 1 ? "" : "es");
+
+    replay_worker_t *workers = calloc((size_t)threads, sizeof(*workers));
+    if (workers == NULL) {
+        corpus_free(&corpus);
+        return 1;
+    }
+
+    int rc = 0;
+    if (impl_count == 0) {
+        impls[impl_count++] = dnsasm_active_impl();
+    }
+    for (size_t m = 0; m < impl_count && rc == 0; m++) {
+        if (dnsasm_select_impl(impls[m]) != 0) {
+            fprintf(stderr, "dnsasm-console: implementation %s not available\n", impls[m]);
+            rc = 1;
+            break;
+        }
+        printf(COLOR_CYAN "\n[%s]" COLOR_RESET "\n", dnsasm_active_impl());
+        if (replay_run(&corpus, workers, (int)threads, passes, pin) != 0) {
+            rc = 1;
+        }
+    }
+    if (rc == 0 && dnsasm_stats_enabled()) {
+        replay_stats();
+    }
+
     printf("\n═══════════════════════════════════════════════════════════\n");
+    free(workers);
+    corpus_free(&corpus);
+    return rc;
 }
 
 /* Interactive mode */
@@ -329,36 +2380,12 @@ static void interactive_mode(void) {
         } else if (strcmp(line, "sample") == 0) {
             printf("\nSample query packet:\n");
             hexdump(sample_query, sizeof(sample_query));
-            
-            dnsasm_header_t h;
-            if (dnsasm_parse_header(sample_query, sizeof(sample_query), &h) == 0) {
-                print_header(&h);
-                
-                if (h.qdcount > 0) {
-                    dnsasm_question_t q;
-                    dnsasm_result_t res = dnsasm_parse_question(sample_query, sizeof(sample_query), 12, &q);
-                    if (res.error == 0) {
-                        print_question(&q);
-                    }
-                }
-            }
+            print_message(sample_query, sizeof(sample_query));
             printf("\n");
         } else if (strcmp(line, "response") == 0) {
             printf("\nSample response packet:\n");
             hexdump(sample_response, sizeof(sample_response));
-            
-            dnsasm_header_t h;
-            if (dnsasm_parse_header(sample_response, sizeof(sample_response), &h) == 0) {
-                print_header(&h);
-                
-                if (h.qdcount > 0) {
-                    dnsasm_question_t q;
-                    dnsasm_result_t res = dnsasm_parse_question(sample_response, sizeof(sample_response), 12, &q);
-                    if (res.error == 0) {
-                        print_question(&q);
-                    }
-                }
-            }
+            print_message(sample_response, sizeof(sample_response));
             printf("\n");
         } else if (strcmp(line, "test") == 0) {
             run_tests();
@@ -384,13 +2411,7 @@ static void interactive_mode(void) {
             
             printf("\nParsed packet:\n");
             hexdump(packet, pkt_len);
-            
-            dnsasm_header_t h;
-            if (dnsasm_parse_header(packet, pkt_len, &h) == 0) {
-                print_header(&h);
-            } else {
-                printf(COLOR_RED "Error parsing header\n" COLOR_RESET);
-            }
+            print_message(packet, pkt_len);
             
             free(packet);
         } else if (line[0] != '\0') {
@@ -406,8 +2427,10 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[1], "--bench") == 0) {
             run_benchmarks();
             return 0;
+        } else if (strcmp(argv[1], "--pcap") == 0) {
+            return run_replay(argc, argv);
         } else if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
-            printf("Usage: %s [--test|--bench|--help]\n", argv[0]);
+            printf("Usage: %s [--test|--bench|--pcap <file> [options]|--help]\n", argv[0]);
             return 0;
         }
     }
@@ -19,10 +19,346 @@ package dnsasm
 
 #include "dnsasm.h"
 #include <stdlib.h>
+#include <string.h>
+
+// Build the packet pointer array on the C side so Go never hands C a
+// Go pointer stored in memory.
+static size_t parse_batch_slab(const uint8_t *slab, size_t stride,
+                               const uint16_t *lens, size_t count,
+                               dnsasm_batch_t *out) {
+	const uint8_t *pkts[DNSASM_BATCH_MAX];
+	if (count > DNSASM_BATCH_MAX) {
+		count = DNSASM_BATCH_MAX;
+	}
+	for (size_t i = 0; i < count; i++) {
+		pkts[i] = slab + i * stride;
+	}
+	return dnsasm_parse_batch(pkts, lens, count, out);
+}
+
+// Keep the question on the C stack and return by value, so QueryHash
+// passes no Go pointers that would force an allocation.
+typedef struct {
+	uint64_t hash;
+	dnsasm_result_t result;
+} query_hash_t;
+
+static query_hash_t query_hash(const uint8_t *packet, size_t len, size_t offset,
+                               uint8_t bits, uint64_t k0, uint64_t k1) {
+	dnsasm_question_t q;
+	dnsasm_hash_key_t key = {k0, k1};
+	query_hash_t r = {0};
+	r.result = dnsasm_parse_question_keyed(packet, len, offset, bits, &key, &q, &r.hash);
+	return r;
+}
+
+// ParseHeaderInto, ParseQuestionInto and ParseRRInto get their results
+// back by value as well. The name is only copied out when it is
+// compressed; otherwise Go slices it straight out of the packet.
+typedef struct {
+	dnsasm_header_t header;
+	int error;
+} parse_header_t;
+
+static parse_header_t parse_header(const uint8_t *packet, size_t len) {
+	parse_header_t r;
+	r.error = dnsasm_parse_header(packet, len, &r.header);
+	return r;
+}
+
+typedef struct {
+	int32_t  error;
+	uint32_t next;              // Offset after the question or RR
+	uint16_t name_len;
+	uint16_t name_wire;         // Wire bytes of the name; == name_len if not compressed
+	uint16_t type;
+	uint16_t rclass;
+	uint32_t ttl;
+	uint16_t rdlength;
+	uint16_t wire_len;
+	uint8_t  name[DNS_MAX_NAME_LEN + 1];
+} parsed_t;
+
+static parsed_t parse_question_into(const uint8_t *packet, size_t len, size_t offset) {
+	dnsasm_question_t q;
+	parsed_t r;
+	dnsasm_result_t res = dnsasm_parse_question(packet, len, offset, &q);
+	r.error = res.error;
+	r.next = res.offset;
+	if (res.error != DNSASM_OK) {
+		return r;
+	}
+	r.name_len = q.name_len;
+	r.name_wire = (uint16_t)(q.wire_len - 4);
+	r.type = q.qtype;
+	r.rclass = q.qclass;
+	r.wire_len = q.wire_len;
+	if (r.name_wire != r.name_len) {
+		memcpy(r.name, q.name, q.name_len);
+	}
+	return r;
+}
+
+static parsed_t parse_rr_into(const uint8_t *packet, size_t len, size_t offset) {
+	dnsasm_rr_t rr;
+	parsed_t r;
+	dnsasm_result_t res = dnsasm_parse_rr(packet, len, offset, &rr);
+	r.error = res.error;
+	r.next = res.offset;
+	if (res.error != DNSASM_OK) {
+		return r;
+	}
+	r.name_len = rr.name_len;
+	r.name_wire = (uint16_t)(rr.wire_len - 10 - rr.rdlength);
+	r.type = rr.rtype;
+	r.rclass = rr.rclass;
+	r.ttl = rr.ttl;
+	r.rdlength = rr.rdlength;
+	r.wire_len = rr.wire_len;
+	if (r.name_wire != r.name_len) {
+		memcpy(r.name, rr.name, rr.name_len);
+	}
+	return r;
+}
+
+// Same trick for ParseEDNS: the summary comes back by value.
+typedef struct {
+	dnsasm_edns_t edns;
+	int error;
+} parse_edns_t;
+
+static parse_edns_t parse_edns(const uint8_t *packet, size_t len, size_t offset) {
+	parse_edns_t r;
+	r.error = dnsasm_parse_edns(packet, len, offset, &r.edns);
+	return r;
+}
+
+// RDATA decoders with a name inside, returned by value for the same reason.
+#define RDATA_BY_VALUE(kind)                                                  \
+	typedef struct {                                                          \
+		dnsasm_rdata_##kind##_t v;                                            \
+		int error;                                                            \
+	} rdata_##kind##_r;                                                       \
+	static rdata_##kind##_r rdata_##kind(const uint8_t *packet, size_t len,   \
+	                                     size_t off, uint16_t rdlength) {     \
+		rdata_##kind##_r r;                                                   \
+		r.error = dnsasm_rdata_##kind(packet, len, off, rdlength, &r.v);      \
+		return r;                                                             \
+	}
+
+RDATA_BY_VALUE(name)
+RDATA_BY_VALUE(mx)
+RDATA_BY_VALUE(srv)
+RDATA_BY_VALUE(soa)
+RDATA_BY_VALUE(rrsig)
+
+static dnsasm_query_class_t classify_query(const uint8_t *packet, size_t len) {
+	dnsasm_query_class_t c;
+	dnsasm_classify_query(packet, len, &c);
+	return c;
+}
+
+// Writer state and its buffer live in one C allocation, because the
+// writer keeps a pointer to the buffer between calls.
+static dnsasm_writer_t *writer_new(void) {
+	dnsasm_writer_t *w = malloc(sizeof(*w) + DNS_MAX_PACKET_SIZE);
+	if (w != NULL) {
+		dnsasm_writer_init(w, (uint8_t *)(w + 1), DNS_MAX_PACKET_SIZE);
+	}
+	return w;
+}
+
+// Addresses and SOA fields by value, again to keep Go pointers off the
+// C side.
+static int writer_a(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                    uint32_t ttl, uint32_t addr) {
+	uint8_t a[4];
+	a[0] = addr >> 24; a[1] = addr >> 16; a[2] = addr >> 8; a[3] = addr;
+	return dnsasm_writer_a(w, name, name_len, ttl, a);
+}
+
+static int writer_aaaa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, uint64_t hi, uint64_t lo) {
+	uint8_t a[16];
+	for (int i = 0; i < 8; i++) {
+		a[i] = hi >> (56 - 8 * i);
+		a[8 + i] = lo >> (56 - 8 * i);
+	}
+	return dnsasm_writer_aaaa(w, name, name_len, ttl, a);
+}
+
+static int writer_soa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      uint32_t ttl, const uint8_t *mname, size_t mname_len,
+                      const uint8_t *rname, size_t rname_len, uint32_t serial,
+                      uint32_t refresh, uint32_t retry, uint32_t expire,
+                      uint32_t minimum) {
+	dnsasm_rdata_soa_t soa;
+	if (mname_len > DNS_MAX_NAME_LEN || rname_len > DNS_MAX_NAME_LEN) {
+		return DNSASM_ERR_NAME;
+	}
+	memcpy(soa.mname, mname, mname_len);
+	memcpy(soa.rname, rname, rname_len);
+	soa.mname_len = mname_len;
+	soa.rname_len = rname_len;
+	soa.serial = serial;
+	soa.refresh = refresh;
+	soa.retry = retry;
+	soa.expire = expire;
+	soa.minimum = minimum;
+	return dnsasm_writer_soa(w, name, name_len, ttl, &soa);
+}
+
+// Rebuild the few classification fields dnsasm_reply_error reads from
+// scalars instead of passing a Go struct across.
+static int reply_error(uint8_t *out, size_t out_size, const uint8_t *req,
+                       size_t req_len, int have_qc, uint16_t qname_len,
+                       uint8_t edns, uint8_t dnssec_ok, uint16_t rcode,
+                       uint16_t flags) {
+	dnsasm_query_class_t qc;
+	if (!have_qc) {
+		return dnsasm_reply_error(out, out_size, req, req_len, NULL, rcode, flags);
+	}
+	memset(&qc, 0, sizeof(qc));
+	qc.qname_len = qname_len;
+	qc.edns.present = edns;
+	qc.edns.dnssec_ok = dnssec_ok;
+	return dnsasm_reply_error(out, out_size, req, req_len, &qc, rcode, flags);
+}
+
+// The matched value comes back by value as well.
+typedef struct {
+	int off;
+	uint32_t value;
+} trie_match_t;
+
+static trie_match_t trie_match(const dnsasm_trie_t *trie, const uint8_t *name, size_t len) {
+	trie_match_t r = {0};
+	r.off = dnsasm_trie_match(trie, name, len, &r.value);
+	return r;
+}
+
+// Addresses go in as integers so no Go array has to escape to C.
+static uint32_t lpm_lookup_v4(const dnsasm_lpm_t *lpm, uint32_t addr) {
+	uint8_t a[4] = {addr >> 24, addr >> 16, addr >> 8, addr};
+	return dnsasm_lpm_lookup4(lpm, a);
+}
+
+static uint32_t lpm_lookup_v6(const dnsasm_lpm_t *lpm, uint64_t hi, uint64_t lo) {
+	uint8_t a[16];
+	for (int i = 0; i < 8; i++) {
+		a[i] = (uint8_t)(hi >> (56 - 8 * i));
+		a[8 + i] = (uint8_t)(lo >> (56 - 8 * i));
+	}
+	return dnsasm_lpm_lookup6(lpm, a);
+}
+
+// Cookies: secrets go in and cookies come out by value, and the client
+// address always arrives as 16 bytes (IPv4-mapped for IPv4).
+static void addr16(uint8_t a[16], uint64_t hi, uint64_t lo) {
+	for (int i = 0; i < 8; i++) {
+		a[i] = (uint8_t)(hi >> (56 - 8 * i));
+		a[8 + i] = (uint8_t)(lo >> (56 - 8 * i));
+	}
+}
+
+typedef struct {
+	int status;
+	uint8_t cookie[DNSASM_COOKIE_SERVER_LEN];
+} cookie_r;
+
+static cookie_r cookie_make(dnsasm_hash_key_t secret, uint64_t client, uint64_t hi,
+                            uint64_t lo, uint32_t now) {
+	uint8_t c[8], a[16];
+	cookie_r r;
+	for (int i = 0; i < 8; i++) {
+		c[i] = (uint8_t)(client >> (56 - 8 * i));
+	}
+	addr16(a, hi, lo);
+	r.status = dnsasm_cookie_make(&secret, c, a, 16, now, r.cookie);
+	return r;
+}
+
+static cookie_r cookie_check(dnsasm_cookie_secrets_t secrets, const uint8_t *option,
+                             size_t option_len, uint64_t hi, uint64_t lo, uint32_t now) {
+	uint8_t a[16];
+	cookie_r r;
+	addr16(a, hi, lo);
+	r.status = dnsasm_cookie_check(&secrets, option, option_len, a, 16, now, r.cookie);
+	return r;
+}
+
+// Option pointers are set from the slab here and cleared again before
+// returning, so the Go side never holds a Go pointer in reqs. reqs comes
+// in as bytes: a pointer to a type with pointers in it would cost the
+// call a cgocheck closure and an allocation.
+static void cookie_check_slab(dnsasm_cookie_secrets_t secrets, const uint8_t *slab,
+                              size_t stride, uint8_t *req_bytes, size_t count,
+                              uint32_t now) {
+	dnsasm_cookie_req_t *reqs = (dnsasm_cookie_req_t *)req_bytes;
+	for (size_t i = 0; i < count; i++) {
+		reqs[i].option = slab + i * stride;
+	}
+	dnsasm_cookie_check_batch(&secrets, reqs, count, now);
+	for (size_t i = 0; i < count; i++) {
+		reqs[i].option = NULL;
+	}
+}
+
+// The per-batch IO calls take the handle as an integer: cgo cannot see
+// inside the opaque dnsasm_io_t, so a pointer to it is checked for Go
+// pointers on every call, at one allocation each.
+static int io_recv(uintptr_t h) {
+	return dnsasm_io_recv((dnsasm_io_t *)h);
+}
+
+static int io_queue(uintptr_t h, uint32_t slot, const uint8_t *data, size_t len) {
+	return dnsasm_io_queue((dnsasm_io_t *)h, slot, data, len);
+}
+
+static int io_flush(uintptr_t h) {
+	return dnsasm_io_flush((dnsasm_io_t *)h);
+}
+
+// Classify and parse the whole receive ring where it lies.
+static void io_classify(uintptr_t h, size_t count, dnsasm_query_class_t *qc,
+                        dnsasm_batch_t *out) {
+	dnsasm_io_t *io = (dnsasm_io_t *)h;
+	const uint8_t *const *pkts = dnsasm_io_packets(io);
+	const uint16_t *lens = dnsasm_io_lens(io);
+	dnsasm_parse_batch(pkts, lens, count, out);
+	for (size_t i = 0; i < count; i++) {
+		dnsasm_classify_query(pkts[i], lens[i], &qc[i]);
+	}
+}
+
+// Patch, truncate and queue one answer. Nothing is queued if patching
+// fails, even with ERR_NAME where only the ID got patched.
+static int io_answer(uintptr_t h, uint32_t slot, uint8_t *resp, size_t len,
+                     size_t limit) {
+	dnsasm_io_t *io = (dnsasm_io_t *)h;
+	int rc = dnsasm_patch_response(resp, len, dnsasm_io_packets(io)[slot],
+	                               dnsasm_io_lens(io)[slot]);
+	if (rc != DNSASM_OK) {
+		return rc;
+	}
+	int n = dnsasm_truncate(resp, len, limit);
+	if (n < 0) {
+		return n;
+	}
+	return dnsasm_io_queue(io, slot, resp, (size_t)n);
+}
 */
 import "C"
 import (
+	"encoding/binary"
 	"errors"
+	"hash/maphash"
+	"net"
+	"net/netip"
+	"sort"
+	"sync/atomic"
+	"syscall"
+	"time"
 	"unsafe"
 )
 
@@ -33,6 +369,10 @@ var (
 	ErrPointer  = errors.New("dnsasm: invalid compression pointer")
 	ErrLoop     = errors.New("dnsasm: compression pointer loop")
 	ErrOverflow = errors.New("dnsasm: name too long")
+	ErrSpace    = errors.New("dnsasm: output table or buffer full")
+	ErrEDNS     = errors.New("dnsasm: malformed or duplicate OPT record")
+	ErrRData    = errors.New("dnsasm: RDATA does not fit its type")
+	ErrFormat   = errors.New("dnsasm: table data unsorted, corrupt or misaligned")
 )
 
 // errorFromCode converts a C error code to a Go error.
@@ -50,6 +390,14 @@ func errorFromCode(code C.int) error {
 		return ErrLoop
 	case C.DNSASM_ERR_OVERFLOW:
 		return ErrOverflow
+	case C.DNSASM_ERR_SPACE:
+		return ErrSpace
+	case C.DNSASM_ERR_EDNS:
+		return ErrEDNS
+	case C.DNSASM_ERR_RDATA:
+		return ErrRData
+	case C.DNSASM_ERR_FORMAT:
+		return ErrFormat
 	default:
 		return errors.New("dnsasm: unknown error")
 	}
@@ -96,22 +444,27 @@ type RR struct {
 // ParseHeader parses the DNS header from a packet.
 // This is extremely fast: ~10 nanoseconds per call.
 func ParseHeader(packet []byte) (*Header, error) {
-	if len(packet) < 12 {
-		return nil, ErrShort
+	h := new(Header)
+	if err := ParseHeaderInto(packet, h); err != nil {
+		return nil, err
 	}
+	return h, nil
+}
 
-	var ch C.dnsasm_header_t
-	ret := C.dnsasm_parse_header(
-		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
-		C.size_t(len(packet)),
-		&ch,
-	)
+// ParseHeaderInto is ParseHeader filling a caller-owned Header. It does
+// not allocate.
+func ParseHeaderInto(packet []byte, h *Header) error {
+	if len(packet) < 12 {
+		return ErrShort
+	}
 
-	if ret != C.DNSASM_OK {
-		return nil, errorFromCode(ret)
+	r := C.parse_header((*C.uint8_t)(unsafe.Pointer(&packet[0])), C.size_t(len(packet)))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(r.error)
 	}
 
-	return &Header{
+	ch := &r.header
+	*h = Header{
 		ID:      uint16(ch.id),
 		Flags:   uint16(ch.flags),
 		QDCount: uint16(ch.qdcount),
@@ -125,173 +478,2048 @@ func ParseHeader(packet []byte) (*Header, error) {
 		RD:      ch.rd != 0,
 		RA:      ch.ra != 0,
 		RCode:   uint8(ch.rcode),
-	}, nil
+	}
+	return nil
 }
 
 // ParseQuestion parses a DNS question section starting at the given offset.
 // Returns the parsed question and the new offset after the question.
 func ParseQuestion(packet []byte, offset int) (*Question, int, error) {
+	var buf WireName
+	q := new(Question)
+	name, next, err := ParseQuestionInto(packet, offset, q, &buf, nil)
+	if err != nil {
+		return nil, 0, err
+	}
+	q.Name = wireNameToString(name, len(name))
+	return q, next, nil
+}
+
+// ParseQuestionInto is ParseQuestion without allocating. It fills q and
+// returns the decompressed wire-format name and the offset after the
+// question. The name is a sub-slice of packet when it is not compressed
+// (the usual case for a query), otherwise it is copied into buf; either
+// way it is only valid while packet and buf are.
+//
+// q.Name is filled from names, which hands out one shared string per
+// hot name without allocating; with a nil names it is left empty.
+func ParseQuestionInto(packet []byte, offset int, q *Question, buf *WireName, names *NameCache) ([]byte, int, error) {
 	if offset >= len(packet) {
 		return nil, 0, ErrShort
 	}
 
-	var cq C.dnsasm_question_t
-	result := C.dnsasm_parse_question(
-		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
-		C.size_t(len(packet)),
-		C.size_t(offset),
-		&cq,
-	)
-
-	if result.error != C.DNSASM_OK {
-		return nil, 0, errorFromCode(result.error)
+	r := C.parse_question_into((*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)), C.size_t(offset))
+	if r.error != C.DNSASM_OK {
+		return nil, 0, errorFromCode(C.int(r.error))
 	}
 
-	// Convert wire-format name to dotted notation
-	nameLen := int(cq.name_len)
-	nameBytes := make([]byte, nameLen)
-	for i := 0; i < nameLen; i++ {
-		nameBytes[i] = byte(cq.name[i])
+	name := parsedName(&r, packet, offset, buf)
+	q.Name = ""
+	if names != nil {
+		q.Name = names.String(name)
 	}
-	name := wireNameToString(nameBytes, nameLen)
-
-	return &Question{
-		Name:    name,
-		Type:    uint16(cq.qtype),
-		Class:   uint16(cq.qclass),
-		WireLen: uint16(cq.wire_len),
-	}, int(result.offset), nil
+	q.Type = uint16(r._type)
+	q.Class = uint16(r.rclass)
+	q.WireLen = uint16(r.wire_len)
+	return name, int(r.next), nil
 }
 
 // ParseRR parses a DNS resource record starting at the given offset.
 func ParseRR(packet []byte, offset int) (*RR, int, error) {
+	var buf WireName
+	rr := new(RR)
+	name, next, err := ParseRRInto(packet, offset, rr, &buf, nil)
+	if err != nil {
+		return nil, 0, err
+	}
+	rr.Name = wireNameToString(name, len(name))
+	rr.RData = append([]byte(nil), rr.RData...) // Outlives packet
+	return rr, next, nil
+}
+
+// ParseRRInto is ParseRR without allocating, on the terms of
+// ParseQuestionInto. rr.RData is a sub-slice of packet, not a copy.
+func ParseRRInto(packet []byte, offset int, rr *RR, buf *WireName, names *NameCache) ([]byte, int, error) {
 	if offset >= len(packet) {
 		return nil, 0, ErrShort
 	}
 
-	var crr C.dnsasm_rr_t
-	result := C.dnsasm_parse_rr(
-		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
-		C.size_t(len(packet)),
-		C.size_t(offset),
-		&crr,
-	)
-
-	if result.error != C.DNSASM_OK {
-		return nil, 0, errorFromCode(result.error)
+	r := C.parse_rr_into((*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)), C.size_t(offset))
+	if r.error != C.DNSASM_OK {
+		return nil, 0, errorFromCode(C.int(r.error))
 	}
 
-	// Convert wire-format name
-	nameLen := int(crr.name_len)
-	nameBytes := make([]byte, nameLen)
-	for i := 0; i < nameLen; i++ {
-		nameBytes[i] = byte(crr.name[i])
+	name := parsedName(&r, packet, offset, buf)
+	next := int(r.next)
+	rr.Name = ""
+	if names != nil {
+		rr.Name = names.String(name)
 	}
-	name := wireNameToString(nameBytes, nameLen)
+	rr.Type = uint16(r._type)
+	rr.Class = uint16(r.rclass)
+	rr.TTL = uint32(r.ttl)
+	rr.RDLength = uint16(r.rdlength)
+	rr.RData = packet[next-int(r.rdlength) : next : next]
+	rr.WireLen = uint16(r.wire_len)
+	return name, next, nil
+}
 
-	// Copy RDATA
-	rdata := make([]byte, crr.rdlength)
-	if crr.rdlength > 0 && crr.rdata != nil {
-		copy(rdata, (*[65535]byte)(unsafe.Pointer(crr.rdata))[:crr.rdlength:crr.rdlength])
+// parsedName returns the name of a parse_*_into result: in place when it
+// was not compressed, else copied into buf.
+func parsedName(r *C.parsed_t, packet []byte, offset int, buf *WireName) []byte {
+	n := int(r.name_len)
+	if r.name_wire == r.name_len {
+		return packet[offset : offset+n : offset+n]
 	}
+	buf.n = copy(buf.b[:], unsafe.Slice((*byte)(unsafe.Pointer(&r.name[0])), n))
+	return buf.b[:buf.n]
+}
 
-	return &RR{
-		Name:     name,
-		Type:     uint16(crr.rtype),
-		Class:    uint16(crr.rclass),
-		TTL:      uint32(crr.ttl),
-		RDLength: uint16(crr.rdlength),
-		RData:    rdata,
-		WireLen:  uint16(crr.wire_len),
-	}, int(result.offset), nil
+// NameCache interns the dotted form of hot names: a name seen before
+// comes back as the same string without allocating. It is a fixed-size,
+// direct-mapped table keyed by a seeded hash of the exact wire bytes
+// (case included); a colliding name replaces the slot's occupant. Safe
+// for concurrent use.
+type NameCache struct {
+	seed  maphash.Seed
+	mask  uint64
+	slots []atomic.Pointer[cachedName]
 }
 
-// wireNameToString converts a wire-format DNS name to dotted notation.
-// Wire format: len1, label1, len2, label2, ..., 0
-// Dotted: label1.label2....
-func wireNameToString(wire []byte, length int) string {
-	if length == 0 || (length == 1 && wire[0] == 0) {
-		return "."
+type cachedName struct {
+	wire   string
+	dotted string
+}
+
+// NewNameCache returns a cache of size slots, rounded up to a power of
+// two.
+func NewNameCache(size int) *NameCache {
+	n := 1
+	for n < size {
+		n <<= 1
+	}
+	return &NameCache{
+		seed:  maphash.MakeSeed(),
+		mask:  uint64(n - 1),
+		slots: make([]atomic.Pointer[cachedName], n),
 	}
+}
 
-	var result []byte
-	pos := 0
+// String returns the dotted form of a wire-format name, allocating only
+// when the name is not cached yet.
+func (c *NameCache) String(wire []byte) string {
+	slot := &c.slots[maphash.Bytes(c.seed, wire)&c.mask]
+	if e := slot.Load(); e != nil && e.wire == string(wire) {
+		return e.dotted
+	}
+	e := &cachedName{wire: string(wire), dotted: wireNameToString(wire, len(wire))}
+	slot.Store(e)
+	return e.dotted
+}
 
-	for pos < length && wire[pos] != 0 {
-		labelLen := int(wire[pos])
-		pos++
+// ActiveImpl reports which kernel implementation libdnsasm picked at load
+// time ("c", "sse42", "avx2", "avx512bw" or "asm").
+func ActiveImpl() string {
+	return C.GoString(C.dnsasm_active_impl())
+}
 
-		if pos+labelLen > length {
-			break
-		}
+// ErrImpl is returned by SelectImpl for unknown or unsupported variants.
+var ErrImpl = errors.New("dnsasm: implementation not available on this CPU")
 
-		if len(result) > 0 {
-			result = append(result, '.')
-		}
-		result = append(result, wire[pos:pos+labelLen]...)
-		pos += labelLen
+// SelectImpl switches to the named kernel implementation. It is meant for
+// tests and A/B benchmarks; call it before starting workers. Setting
+// DNSASM_IMPL in the environment does the same at startup.
+func SelectImpl(name string) error {
+	cname := C.CString(name)
+	defer C.free(unsafe.Pointer(cname))
+	if C.dnsasm_select_impl(cname) != 0 {
+		return ErrImpl
 	}
+	return nil
+}
 
-	return string(result)
+// Impls lists the implementations this CPU can run, best first.
+func Impls() []string {
+	var names [8]*C.char
+	n := int(C.dnsasm_impl_names(&names[0], C.size_t(len(names))))
+	out := make([]string, n)
+	for i := 0; i < n; i++ {
+		out[i] = C.GoString(names[i])
+	}
+	return out
 }
 
-// BuildHeader creates a DNS header in wire format.
-func BuildHeader(buf []byte, id, flags, qdcount, ancount, nscount, arcount uint16) int {
-	if len(buf) < 12 {
+// BatchMax is the maximum number of packets ParseBatch handles per call.
+const BatchMax = C.DNSASM_BATCH_MAX
+
+// Batch holds the structure-of-arrays result of ParseBatch.
+// It is large (about 1.5 KB) and meant to be reused by a worker.
+type Batch struct {
+	c C.dnsasm_batch_t
+}
+
+// Len returns the number of packets in the batch.
+func (b *Batch) Len() int { return int(b.c.count) }
+
+// Err returns the parse error for packet i, or nil.
+func (b *Batch) Err(i int) error { return errorFromCode(C.int(b.c.error[i])) }
+
+// ID returns the transaction ID of packet i.
+func (b *Batch) ID(i int) uint16 { return uint16(b.c.id[i]) }
+
+// Flags returns the raw flags field of packet i.
+func (b *Batch) Flags(i int) uint16 { return uint16(b.c.flags[i]) }
+
+// QDCount returns the question count of packet i.
+func (b *Batch) QDCount(i int) uint16 { return uint16(b.c.qdcount[i]) }
+
+// ANCount returns the answer count of packet i.
+func (b *Batch) ANCount(i int) uint16 { return uint16(b.c.ancount[i]) }
+
+// NSCount returns the authority count of packet i.
+func (b *Batch) NSCount(i int) uint16 { return uint16(b.c.nscount[i]) }
+
+// ARCount returns the additional count of packet i.
+func (b *Batch) ARCount(i int) uint16 { return uint16(b.c.arcount[i]) }
+
+// QType returns the first question type of packet i.
+func (b *Batch) QType(i int) uint16 { return uint16(b.c.qtype[i]) }
+
+// QClass returns the first question class of packet i.
+func (b *Batch) QClass(i int) uint16 { return uint16(b.c.qclass[i]) }
+
+// QName returns the wire-format question name of packet i as a sub-slice
+// of that packet. Nothing is copied.
+func (b *Batch) QName(packet []byte, i int) []byte {
+	off := int(b.c.name_off[i])
+	return packet[off : off+int(b.c.name_len[i])]
+}
+
+// ParseBatch parses the header and first question of up to BatchMax
+// packets in a single cgo call. Packet i starts at slab[i*stride] and is
+// lens[i] bytes long. Returns the number of packets parsed without error;
+// per-packet errors are available through b.Err.
+func ParseBatch(slab []byte, stride int, lens []uint16, b *Batch) int {
+	count := len(lens)
+	if count > BatchMax {
+		count = BatchMax
+	}
+	if len(slab) == 0 || stride <= 0 {
+		count = 0
+	}
+	for i := 0; i < count; i++ {
+		if i*stride+int(lens[i]) > len(slab) {
+			count = i
+			break
+		}
+	}
+	if count == 0 {
+		b.c.count = 0
 		return 0
 	}
 
-	n := C.dnsasm_build_header(
-		(*C.uint8_t)(unsafe.Pointer(&buf[0])),
-		C.uint16_t(id),
-		C.uint16_t(flags),
-		C.uint16_t(qdcount),
-		C.uint16_t(ancount),
-		C.uint16_t(nscount),
-		C.uint16_t(arcount),
+	n := C.parse_batch_slab(
+		(*C.uint8_t)(unsafe.Pointer(&slab[0])),
+		C.size_t(stride),
+		(*C.uint16_t)(unsafe.Pointer(&lens[0])),
+		C.size_t(count),
+		&b.c,
 	)
-
 	return int(n)
 }
 
-// DNS record types
+// Message sections, in wire order.
 const (
-	TypeA     = 1
-	TypeNS    = 2
-	TypeCNAME = 5
-	TypeSOA   = 6
-	TypePTR   = 12
-	TypeMX    = 15
-	TypeTXT   = 16
-	TypeAAAA  = 28
-	TypeSRV   = 33
-	TypeOPT   = 41
-	TypeANY   = 255
+	SectionQuestion   = C.DNSASM_SECTION_QUESTION
+	SectionAnswer     = C.DNSASM_SECTION_ANSWER
+	SectionAuthority  = C.DNSASM_SECTION_AUTHORITY
+	SectionAdditional = C.DNSASM_SECTION_ADDITIONAL
 )
 
-// DNS classes
-const (
-	ClassIN  = 1
-	ClassCH  = 3
-	ClassHS  = 4
-	ClassANY = 255
-)
+// RRIndex locates one question or RR inside a packet. Its layout matches
+// dnsasm_rr_index_t so a slice of them can be filled by C directly.
+type RRIndex struct {
+	NameOff  uint16 // Wire offset of owner name (may be compressed)
+	Type     uint16 // Record type / qtype
+	Class    uint16 // Record class / qclass
+	TTLOff   uint16 // Wire offset of TTL (0 for questions)
+	RDataOff uint16 // Wire offset of RDATA (0 for questions)
+	RDLength uint16 // RDATA length
+}
 
-// DNS response codes
-const (
-	RCodeNoError  = 0
-	RCodeFormErr  = 1
-	RCodeServFail = 2
-	RCodeNXDomain = 3
-	RCodeNotImp   = 4
-	RCodeRefused  = 5
-)
+// defaultMessageRR is the table size Message allocates on first use.
+const defaultMessageRR = 64
 
-// DNS header flags
+// Message is a zero-copy index over a wire-format DNS message. Reuse one
+// per worker: the entry table is kept across calls to Parse.
+type Message struct {
+	RR    []RRIndex // Entries for every section, in wire order
+	End   int       // Offset after the last indexed entry
+	start [4]uint16
+	count [4]uint16
+}
+
+// Parse indexes packet in a single pass. Names are not decompressed.
+// If RR has no spare capacity, a table of 64 entries is allocated; if
+// the message needs more, ErrSpace is returned and RR holds the entries
+// that fit.
+func (m *Message) Parse(packet []byte) error {
+	if cap(m.RR) == 0 {
+		m.RR = make([]RRIndex, defaultMessageRR)
+	}
+	m.RR = m.RR[:cap(m.RR)]
+	if len(packet) == 0 {
+		m.RR = m.RR[:0]
+		m.End = 0
+		return ErrShort
+	}
+
+	var cm C.dnsasm_msg_t
+	ret := C.dnsasm_parse_message(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+		&cm,
+		(*C.dnsasm_rr_index_t)(unsafe.Pointer(&m.RR[0])),
+		C.size_t(len(m.RR)),
+	)
+
+	m.RR = m.RR[:cm.total]
+	m.End = int(cm.end)
+	for s := 0; s < 4; s++ {
+		m.start[s] = uint16(cm.start[s])
+		m.count[s] = uint16(cm.count[s])
+	}
+	return errorFromCode(ret)
+}
+
+// Section returns the entries of section s (SectionQuestion ...).
+func (m *Message) Section(s int) []RRIndex {
+	start := int(m.start[s])
+	return m.RR[start : start+int(m.count[s])]
+}
+
+// TTL reads the TTL of an indexed RR straight from the packet.
+func (e *RRIndex) TTL(packet []byte) uint32 {
+	p := packet[e.TTLOff : e.TTLOff+4]
+	return uint32(p[0])<<24 | uint32(p[1])<<16 | uint32(p[2])<<8 | uint32(p[3])
+}
+
+// RData returns the RDATA of an indexed RR as a sub-slice of packet.
+func (e *RRIndex) RData(packet []byte) []byte {
+	return packet[e.RDataOff : e.RDataOff+e.RDLength]
+}
+
+// Name decompresses the owner name of an indexed entry on demand and
+// returns it in dotted form.
+func (e *RRIndex) Name(packet []byte) (string, error) {
+	var buf [256]C.uint8_t
+	var nameLen C.uint16_t
+	result := C.dnsasm_decompress_name(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+		C.size_t(e.NameOff),
+		&buf[0],
+		&nameLen,
+	)
+	if result.error != C.DNSASM_OK {
+		return "", errorFromCode(result.error)
+	}
+	wire := C.GoBytes(unsafe.Pointer(&buf[0]), C.int(nameLen))
+	return wireNameToString(wire, int(nameLen)), nil
+}
+
+// HashKey is the 128-bit secret for the keyed query hash. Generate it
+// once per process with crypto/rand.
+type HashKey struct {
+	K0, K1 uint64
+}
+
+// Request bits folded into the query hash.
 const (
-	FlagQR = 1 << 15 // Query/Response
-	FlagAA = 1 << 10 // Authoritative Answer
-	FlagTC = 1 << 9  // Truncated
-	FlagRD = 1 << 8  // Recursion Desired
-	FlagRA = 1 << 7  // Recursion Available
+	HashDO = C.DNSASM_HASH_DO // EDNS DNSSEC OK
+	HashCD = C.DNSASM_HASH_CD // Checking Disabled
 )
+
+// QueryHash parses the question at offset and returns its keyed hash
+// (SipHash-1-3 over the lowercased wire name, qtype, qclass and bits)
+// and the offset after the question. It does not allocate, so a cache
+// can be probed before the name is ever turned into a string.
+func QueryHash(packet []byte, offset int, bits uint8, key HashKey) (uint64, int, error) {
+	if offset >= len(packet) {
+		return 0, 0, ErrShort
+	}
+
+	r := C.query_hash(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+		C.size_t(offset),
+		C.uint8_t(bits),
+		C.uint64_t(key.K0),
+		C.uint64_t(key.K1),
+	)
+	if r.result.error != C.DNSASM_OK {
+		return 0, 0, errorFromCode(r.result.error)
+	}
+	return uint64(r.hash), int(r.result.offset), nil
+}
+
+// ParseQuestionKeyed is ParseQuestion with the name lowercased and the
+// QueryHash of the question computed in the same call.
+func ParseQuestionKeyed(packet []byte, offset int, bits uint8, key HashKey) (*Question, uint64, int, error) {
+	if offset >= len(packet) {
+		return nil, 0, 0, ErrShort
+	}
+
+	var cq C.dnsasm_question_t
+	var hash C.uint64_t
+	ckey := C.dnsasm_hash_key_t{k0: C.uint64_t(key.K0), k1: C.uint64_t(key.K1)}
+	result := C.dnsasm_parse_question_keyed(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+		C.size_t(offset),
+		C.uint8_t(bits),
+		&ckey,
+		&cq,
+		&hash,
+	)
+	if result.error != C.DNSASM_OK {
+		return nil, 0, 0, errorFromCode(result.error)
+	}
+
+	nameLen := int(cq.name_len)
+	nameBytes := C.GoBytes(unsafe.Pointer(&cq.name[0]), C.int(nameLen))
+
+	return &Question{
+		Name:    wireNameToString(nameBytes, nameLen),
+		Type:    uint16(cq.qtype),
+		Class:   uint16(cq.qclass),
+		WireLen: uint16(cq.wire_len),
+	}, uint64(hash), int(result.offset), nil
+}
+
+// HashName returns the query hash of an uncompressed wire-format name,
+// for callers that did not get the question from a packet. Any casing
+// of name gives the same result as QueryHash.
+func HashName(name []byte, qtype, qclass uint16, bits uint8, key HashKey) uint64 {
+	if len(name) == 0 {
+		return 0
+	}
+	ckey := C.dnsasm_hash_key_t{k0: C.uint64_t(key.K0), k1: C.uint64_t(key.K1)}
+	return uint64(C.dnsasm_hash_name(
+		&ckey,
+		(*C.uint8_t)(unsafe.Pointer(&name[0])),
+		C.size_t(len(name)),
+		C.uint16_t(qtype),
+		C.uint16_t(qclass),
+		C.uint8_t(bits),
+	))
+}
+
+// EDNS option codes indexed by ParseEDNS.
+const (
+	EDNSOptionECS       = C.DNS_EDNS_OPT_ECS
+	EDNSOptionCookie    = C.DNS_EDNS_OPT_COOKIE
+	EDNSOptionKeepalive = C.DNS_EDNS_OPT_KEEPALIVE
+	EDNSOptionPadding   = C.DNS_EDNS_OPT_PADDING
+)
+
+// EDNS is the decoded OPT pseudo-RR of a message. Option data stays in
+// the packet; the accessors return sub-slices of it.
+type EDNS struct {
+	Present  bool   // Message carries an OPT RR
+	UDPSize  uint16 // Requestor's UDP payload size
+	ExtRCode uint8  // Upper 8 bits of the extended RCODE
+	Version  uint8  // EDNS version
+	DO       bool   // DNSSEC OK
+	Flags    uint16 // DO and Z bits
+	RROff    int    // Offset of the OPT RR
+	Options  int    // Number of options of any code
+
+	cookie, ecs, padding, keepalive C.dnsasm_edns_opt_t
+}
+
+// ParseEDNS finds the OPT RR of packet in one pass, starting at offset
+// (just after the question section). A message without OPT is not an
+// error: e.Present is false. ParseEDNS does not allocate.
+func ParseEDNS(packet []byte, offset int, e *EDNS) error {
+	*e = EDNS{}
+	if len(packet) < 12 {
+		return ErrShort
+	}
+
+	r := C.parse_edns(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+		C.size_t(offset),
+	)
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(r.error)
+	}
+
+	*e = ednsFromC(&r.edns)
+	return nil
+}
+
+func ednsFromC(ce *C.dnsasm_edns_t) EDNS {
+	return EDNS{
+		Present:   ce.present != 0,
+		UDPSize:   uint16(ce.udp_size),
+		ExtRCode:  uint8(ce.ext_rcode),
+		Version:   uint8(ce.version),
+		DO:        ce.dnssec_ok != 0,
+		Flags:     uint16(ce.flags),
+		RROff:     int(ce.rr_off),
+		Options:   int(ce.option_count),
+		cookie:    ce.cookie,
+		ecs:       ce.ecs,
+		padding:   ce.padding,
+		keepalive: ce.keepalive,
+	}
+}
+
+func ednsOption(packet []byte, o C.dnsasm_edns_opt_t) []byte {
+	if o.off == 0 {
+		return nil
+	}
+	return packet[o.off : int(o.off)+int(o.len)]
+}
+
+// Cookie returns the COOKIE option data, or nil if absent.
+func (e *EDNS) Cookie(packet []byte) []byte { return ednsOption(packet, e.cookie) }
+
+// ECS returns the Client Subnet option data, or nil if absent.
+func (e *EDNS) ECS(packet []byte) []byte { return ednsOption(packet, e.ecs) }
+
+// Padding returns the Padding option data, or nil if absent.
+func (e *EDNS) Padding(packet []byte) []byte { return ednsOption(packet, e.padding) }
+
+// Keepalive returns the TCP Keepalive option data, or nil if absent. A
+// query's keepalive option is present but empty (non-nil, length 0).
+func (e *EDNS) Keepalive(packet []byte) []byte { return ednsOption(packet, e.keepalive) }
+
+// Query actions: Action() of a QueryClass is exactly one of these.
+const (
+	ClassDrop    = C.DNSASM_CLASS_DROP    // Not answerable: ignore silently
+	ClassFast    = C.DNSASM_CLASS_FAST    // Plain query, fast path
+	ClassSlow    = C.DNSASM_CLASS_SLOW    // Legal but unusual: full parser
+	ClassFormErr = C.DNSASM_CLASS_FORMERR // Malformed: answer FORMERR
+	ClassNotImp  = C.DNSASM_CLASS_NOTIMP  // Unsupported opcode: answer NOTIMP
+)
+
+// Reasons and attributes in a QueryClass verdict.
+const (
+	ClassShort     = C.DNSASM_CLASS_SHORT     // Shorter than a header
+	ClassResponse  = C.DNSASM_CLASS_RESPONSE  // QR is set
+	ClassOpcode    = C.DNSASM_CLASS_OPCODE    // Opcode other than QUERY
+	ClassNoQD      = C.DNSASM_CLASS_NO_QD     // QDCOUNT is 0
+	ClassMultiQD   = C.DNSASM_CLASS_MULTI_QD  // QDCOUNT above 1
+	ClassRecords   = C.DNSASM_CLASS_RECORDS   // ANCOUNT or NSCOUNT non-zero
+	ClassTSIG      = C.DNSASM_CLASS_TSIG      // TSIG in additional
+	ClassTrailing  = C.DNSASM_CLASS_TRAILING  // Bytes after the last RR
+	ClassMalformed = C.DNSASM_CLASS_MALFORMED // Parse error, see Err
+	ClassEDNS      = C.DNSASM_CLASS_EDNS      // OPT present
+	ClassDO        = C.DNSASM_CLASS_DO        // OPT has DO set
+	ClassBadVers   = C.DNSASM_CLASS_BADVERS   // EDNS version above 0
+	ClassCookie    = C.DNSASM_CLASS_COOKIE    // COOKIE option present
+	ClassBadOPT    = C.DNSASM_CLASS_BAD_OPT   // Malformed or second OPT
+)
+
+// QueryClass is the admission verdict for one request.
+type QueryClass struct {
+	Verdict     uint32 // Action | reasons
+	Err         error  // Parse error behind ClassMalformed
+	ID          uint16 // Transaction ID
+	Flags       uint16 // Raw header flags
+	QType       uint16 // First question type
+	QClass      uint16 // First question class
+	QNameLen    int    // Wire length of the first qname (at offset 12)
+	QuestionEnd int    // Offset after the question section
+	End         int    // Offset after the last RR
+	EDNS        EDNS   // Decoded OPT, if any
+}
+
+// Action returns the ClassDrop ... ClassNotImp part of the verdict.
+func (c *QueryClass) Action() int { return int(c.Verdict & C.DNSASM_CLASS_ACTION) }
+
+// ClassifyQuery inspects a request once and fills c; route on
+// c.Action(). It does not allocate.
+func ClassifyQuery(packet []byte, c *QueryClass) {
+	if len(packet) == 0 {
+		*c = QueryClass{Verdict: ClassDrop | ClassShort, Err: ErrShort}
+		return
+	}
+
+	cc := C.classify_query(
+		(*C.uint8_t)(unsafe.Pointer(&packet[0])),
+		C.size_t(len(packet)),
+	)
+	queryClassFromC(&cc, c)
+}
+
+func queryClassFromC(cc *C.dnsasm_query_class_t, c *QueryClass) {
+	*c = QueryClass{
+		Verdict:     uint32(cc.verdict),
+		Err:         errorFromCode(C.int(cc.error)),
+		ID:          uint16(cc.id),
+		Flags:       uint16(cc.flags),
+		QType:       uint16(cc.qtype),
+		QClass:      uint16(cc.qclass),
+		QNameLen:    int(cc.qname_len),
+		QuestionEnd: int(cc.question_end),
+		End:         int(cc.end),
+		EDNS:        ednsFromC(&cc.edns),
+	}
+}
+
+// WireName holds a decompressed wire-format name in place, so decoding
+// RDATA does not allocate.
+type WireName struct {
+	b [256]byte
+	n int
+}
+
+// Bytes returns the wire-format name, valid until w is reused.
+func (w *WireName) Bytes() []byte { return w.b[:w.n] }
+
+// String returns the name in dotted form (allocates).
+func (w *WireName) String() string { return wireNameToString(w.b[:w.n], w.n) }
+
+func (w *WireName) set(name *C.uint8_t, n C.uint16_t) {
+	w.n = int(n)
+	copy(w.b[:w.n], unsafe.Slice((*byte)(unsafe.Pointer(name)), w.n))
+}
+
+// MX is decoded MX RDATA.
+type MX struct {
+	Preference uint16
+	Exchange   WireName
+}
+
+// SRV is decoded SRV RDATA.
+type SRV struct {
+	Priority uint16
+	Weight   uint16
+	Port     uint16
+	Target   WireName
+}
+
+// SOA is decoded SOA RDATA.
+type SOA struct {
+	MName   WireName // Primary server
+	RName   WireName // Responsible mailbox
+	Serial  uint32
+	Refresh uint32
+	Retry   uint32
+	Expire  uint32
+	Minimum uint32 // Negative caching TTL
+}
+
+// DS is decoded DS RDATA; Digest is a sub-slice of the packet.
+type DS struct {
+	KeyTag     uint16
+	Algorithm  uint8
+	DigestType uint8
+	Digest     []byte
+}
+
+// RRSIG is decoded RRSIG RDATA; Signature is a sub-slice of the packet.
+type RRSIG struct {
+	TypeCovered uint16
+	Algorithm   uint8
+	Labels      uint8
+	OrigTTL     uint32
+	Expiration  uint32
+	Inception   uint32
+	KeyTag      uint16
+	Signer      WireName
+	Signature   []byte
+}
+
+// rdataArgs returns the C arguments locating e's RDATA in packet.
+func (e *RRIndex) rdataArgs(packet []byte) (*C.uint8_t, C.size_t, C.size_t, C.uint16_t) {
+	return (*C.uint8_t)(unsafe.Pointer(&packet[0])), C.size_t(len(packet)),
+		C.size_t(e.RDataOff), C.uint16_t(e.RDLength)
+}
+
+// rdataFits checks e's RDATA lies inside packet and is n bytes (or at
+// least n if exact is false).
+func (e *RRIndex) rdataFits(packet []byte, n int, exact bool) bool {
+	if int(e.RDataOff)+int(e.RDLength) > len(packet) || e.RDataOff == 0 {
+		return false
+	}
+	if exact {
+		return int(e.RDLength) == n
+	}
+	return int(e.RDLength) >= n
+}
+
+// The fixed-layout types below decode in Go: that is cheaper than the
+// cgo call, and applies the same checks as dnsasm_rdata_a and friends.
+
+// A decodes A RDATA.
+func (e *RRIndex) A(packet []byte) (netip.Addr, error) {
+	if !e.rdataFits(packet, 4, true) {
+		return netip.Addr{}, ErrRData
+	}
+	return netip.AddrFrom4([4]byte(packet[e.RDataOff : e.RDataOff+4])), nil
+}
+
+// AAAA decodes AAAA RDATA.
+func (e *RRIndex) AAAA(packet []byte) (netip.Addr, error) {
+	if !e.rdataFits(packet, 16, true) {
+		return netip.Addr{}, ErrRData
+	}
+	return netip.AddrFrom16([16]byte(packet[e.RDataOff : e.RDataOff+16])), nil
+}
+
+// DS decodes DS RDATA.
+func (e *RRIndex) DS(packet []byte, out *DS) error {
+	if !e.rdataFits(packet, 5, false) {
+		return ErrRData
+	}
+	p := packet[e.RDataOff : e.RDataOff+e.RDLength]
+	*out = DS{
+		KeyTag:     uint16(p[0])<<8 | uint16(p[1]),
+		Algorithm:  p[2],
+		DigestType: p[3],
+		Digest:     p[4:],
+	}
+	return nil
+}
+
+// Target decodes the name target of CNAME, NS, PTR or DNAME RDATA.
+func (e *RRIndex) Target(packet []byte, out *WireName) error {
+	if !e.rdataFits(packet, 1, false) {
+		return ErrRData
+	}
+	r := C.rdata_name(e.rdataArgs(packet))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(C.int(r.error))
+	}
+	out.set(&r.v.name[0], r.v.name_len)
+	return nil
+}
+
+// MX decodes MX RDATA.
+func (e *RRIndex) MX(packet []byte, out *MX) error {
+	if !e.rdataFits(packet, 3, false) {
+		return ErrRData
+	}
+	r := C.rdata_mx(e.rdataArgs(packet))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(C.int(r.error))
+	}
+	out.Preference = uint16(r.v.preference)
+	out.Exchange.set(&r.v.exchange[0], r.v.exchange_len)
+	return nil
+}
+
+// SRV decodes SRV RDATA.
+func (e *RRIndex) SRV(packet []byte, out *SRV) error {
+	if !e.rdataFits(packet, 7, false) {
+		return ErrRData
+	}
+	r := C.rdata_srv(e.rdataArgs(packet))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(C.int(r.error))
+	}
+	out.Priority = uint16(r.v.priority)
+	out.Weight = uint16(r.v.weight)
+	out.Port = uint16(r.v.port)
+	out.Target.set(&r.v.target[0], r.v.target_len)
+	return nil
+}
+
+// SOA decodes SOA RDATA.
+func (e *RRIndex) SOA(packet []byte, out *SOA) error {
+	if !e.rdataFits(packet, 22, false) {
+		return ErrRData
+	}
+	r := C.rdata_soa(e.rdataArgs(packet))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(C.int(r.error))
+	}
+	out.MName.set(&r.v.mname[0], r.v.mname_len)
+	out.RName.set(&r.v.rname[0], r.v.rname_len)
+	out.Serial = uint32(r.v.serial)
+	out.Refresh = uint32(r.v.refresh)
+	out.Retry = uint32(r.v.retry)
+	out.Expire = uint32(r.v.expire)
+	out.Minimum = uint32(r.v.minimum)
+	return nil
+}
+
+// RRSIG decodes the RRSIG header and locates the signature.
+func (e *RRIndex) RRSIG(packet []byte, out *RRSIG) error {
+	if !e.rdataFits(packet, 19, false) {
+		return ErrRData
+	}
+	r := C.rdata_rrsig(e.rdataArgs(packet))
+	if r.error != C.DNSASM_OK {
+		return errorFromCode(C.int(r.error))
+	}
+	out.TypeCovered = uint16(r.v.type_covered)
+	out.Algorithm = uint8(r.v.algorithm)
+	out.Labels = uint8(r.v.labels)
+	out.OrigTTL = uint32(r.v.orig_ttl)
+	out.Expiration = uint32(r.v.expiration)
+	out.Inception = uint32(r.v.inception)
+	out.KeyTag = uint16(r.v.key_tag)
+	out.Signer.set(&r.v.signer[0], r.v.signer_len)
+	out.Signature = packet[r.v.sig_off : int(r.v.sig_off)+int(r.v.sig_len)]
+	return nil
+}
+
+// RDataIter walks the character-strings of TXT RDATA or the options of
+// OPT RDATA, like dnsasm_txt_next / dnsasm_opt_next.
+type RDataIter struct {
+	p   []byte
+	err error
+}
+
+// Iter starts iterating e's RDATA.
+func (e *RRIndex) Iter(packet []byte) RDataIter {
+	if int(e.RDataOff)+int(e.RDLength) > len(packet) {
+		return RDataIter{err: ErrRData}
+	}
+	return RDataIter{p: packet[e.RDataOff : e.RDataOff+e.RDLength]}
+}
+
+// NextString returns the next TXT character-string, or false at the end
+// or on error (see Err).
+func (it *RDataIter) NextString() ([]byte, bool) {
+	if len(it.p) == 0 || it.err != nil {
+		return nil, false
+	}
+	n := int(it.p[0])
+	if 1+n > len(it.p) {
+		it.err = ErrRData
+		return nil, false
+	}
+	s := it.p[1 : 1+n]
+	it.p = it.p[1+n:]
+	return s, true
+}
+
+// NextOption returns the next OPT option, or false at the end or on
+// error (see Err).
+func (it *RDataIter) NextOption() (code uint16, data []byte, ok bool) {
+	if len(it.p) == 0 || it.err != nil {
+		return 0, nil, false
+	}
+	if len(it.p) < 4 {
+		it.err = ErrRData
+		return 0, nil, false
+	}
+	n := int(it.p[2])<<8 | int(it.p[3])
+	if 4+n > len(it.p) {
+		it.err = ErrRData
+		return 0, nil, false
+	}
+	code = uint16(it.p[0])<<8 | uint16(it.p[1])
+	data = it.p[4 : 4+n]
+	it.p = it.p[4+n:]
+	return code, data, true
+}
+
+// Err reports a length that ran past the RDATA.
+func (it *RDataIter) Err() error { return it.err }
+
+// Writer renders a response with name compression into a buffer held
+// in C memory. Names are uncompressed wire format. An RR that would
+// cross the size limit is dropped whole and ErrSpace returned; what was
+// written before stays a valid message, so the caller can set TC and
+// Finish. A Writer is not safe for concurrent use.
+type Writer struct {
+	w *C.dnsasm_writer_t
+}
+
+// NewWriter allocates a writer with room for a 64 KiB message.
+func NewWriter() *Writer {
+	w := C.writer_new()
+	if w == nil {
+		panic("dnsasm: out of memory")
+	}
+	return &Writer{w: w}
+}
+
+// Free releases the writer's C memory.
+func (w *Writer) Free() {
+	C.free(unsafe.Pointer(w.w))
+	w.w = nil
+}
+
+// Reset starts a new message of at most limit bytes.
+func (w *Writer) Reset(limit int) {
+	if limit < 0 {
+		limit = 0
+	}
+	C.dnsasm_writer_init(w.w, w.w.buf, C.size_t(limit))
+}
+
+// bytesArg returns the C pointer and length of b (nil when empty).
+func bytesArg(b []byte) (*C.uint8_t, C.size_t) {
+	if len(b) == 0 {
+		return nil, 0
+	}
+	return (*C.uint8_t)(unsafe.Pointer(&b[0])), C.size_t(len(b))
+}
+
+// Header writes the header; counts are filled in by Finish.
+func (w *Writer) Header(id, flags uint16) error {
+	return errorFromCode(C.dnsasm_writer_header(w.w, C.uint16_t(id), C.uint16_t(flags)))
+}
+
+// Question appends a question; ErrOverflow once an RR has been written.
+func (w *Writer) Question(name []byte, qtype, qclass uint16) error {
+	p, n := bytesArg(name)
+	return errorFromCode(C.dnsasm_writer_question(w.w, p, n, C.uint16_t(qtype), C.uint16_t(qclass)))
+}
+
+// Section moves on to SectionAnswer, SectionAuthority or SectionAdditional.
+func (w *Writer) Section(s int) error {
+	return errorFromCode(C.dnsasm_writer_section(w.w, C.int(s)))
+}
+
+// RR appends a record with opaque RDATA.
+func (w *Writer) RR(name []byte, rrtype, class uint16, ttl uint32, rdata []byte) error {
+	if len(rdata) > 0xFFFF {
+		return ErrSpace
+	}
+	p, n := bytesArg(name)
+	rp, rn := bytesArg(rdata)
+	return errorFromCode(C.dnsasm_writer_rr(w.w, p, n, C.uint16_t(rrtype), C.uint16_t(class),
+		C.uint32_t(ttl), rp, C.uint16_t(rn)))
+}
+
+// A appends an A record; addr must be IPv4.
+func (w *Writer) A(name []byte, ttl uint32, addr netip.Addr) error {
+	if !addr.Is4() {
+		return ErrRData
+	}
+	a := addr.As4()
+	p, n := bytesArg(name)
+	return errorFromCode(C.writer_a(w.w, p, n, C.uint32_t(ttl), C.uint32_t(binary.BigEndian.Uint32(a[:]))))
+}
+
+// AAAA appends an AAAA record.
+func (w *Writer) AAAA(name []byte, ttl uint32, addr netip.Addr) error {
+	a := addr.As16()
+	p, n := bytesArg(name)
+	return errorFromCode(C.writer_aaaa(w.w, p, n, C.uint32_t(ttl),
+		C.uint64_t(binary.BigEndian.Uint64(a[:8])), C.uint64_t(binary.BigEndian.Uint64(a[8:]))))
+}
+
+// Target appends a record whose RDATA is one name (CNAME, NS, PTR,
+// DNAME). Only CNAME, NS and PTR targets are compressed.
+func (w *Writer) Target(name []byte, rrtype uint16, ttl uint32, target []byte) error {
+	p, n := bytesArg(name)
+	tp, tn := bytesArg(target)
+	return errorFromCode(C.dnsasm_writer_name_rr(w.w, p, n, C.uint16_t(rrtype), C.uint32_t(ttl), tp, tn))
+}
+
+// MX appends an MX record.
+func (w *Writer) MX(name []byte, ttl uint32, preference uint16, exchange []byte) error {
+	p, n := bytesArg(name)
+	ep, en := bytesArg(exchange)
+	return errorFromCode(C.dnsasm_writer_mx(w.w, p, n, C.uint32_t(ttl), C.uint16_t(preference), ep, en))
+}
+
+// SRV appends an SRV record; the target is never compressed (RFC 2782).
+func (w *Writer) SRV(name []byte, ttl uint32, priority, weight, port uint16, target []byte) error {
+	p, n := bytesArg(name)
+	tp, tn := bytesArg(target)
+	return errorFromCode(C.dnsasm_writer_srv(w.w, p, n, C.uint32_t(ttl), C.uint16_t(priority),
+		C.uint16_t(weight), C.uint16_t(port), tp, tn))
+}
+
+// SOA appends an SOA record.
+func (w *Writer) SOA(name []byte, ttl uint32, soa *SOA) error {
+	p, n := bytesArg(name)
+	mp, mn := bytesArg(soa.MName.Bytes())
+	rp, rn := bytesArg(soa.RName.Bytes())
+	return errorFromCode(C.writer_soa(w.w, p, n, C.uint32_t(ttl), mp, mn, rp, rn,
+		C.uint32_t(soa.Serial), C.uint32_t(soa.Refresh), C.uint32_t(soa.Retry),
+		C.uint32_t(soa.Expire), C.uint32_t(soa.Minimum)))
+}
+
+// TXT appends a TXT record, splitting text into 255-byte strings.
+func (w *Writer) TXT(name []byte, ttl uint32, text []byte) error {
+	p, n := bytesArg(name)
+	tp, tn := bytesArg(text)
+	return errorFromCode(C.dnsasm_writer_txt(w.w, p, n, C.uint32_t(ttl), tp, tn))
+}
+
+// OPT appends the EDNS(0) OPT record, moving to the additional section.
+// options is the encoded option list.
+func (w *Writer) OPT(udpSize uint16, extRCode, version uint8, flags uint16, options []byte) error {
+	if len(options) > 0xFFFF {
+		return ErrSpace
+	}
+	op, on := bytesArg(options)
+	return errorFromCode(C.dnsasm_writer_opt(w.w, C.uint16_t(udpSize), C.uint8_t(extRCode),
+		C.uint8_t(version), C.uint16_t(flags), op, C.uint16_t(on)))
+}
+
+// Len returns the bytes written so far.
+func (w *Writer) Len() int { return int(w.w.len) }
+
+// Finish patches the header counts and returns the message. The slice
+// views C memory and is valid until the next Reset or Free.
+func (w *Writer) Finish() []byte {
+	n := C.dnsasm_writer_finish(w.w)
+	return unsafe.Slice((*byte)(unsafe.Pointer(w.w.buf)), int(n))
+}
+
+// AgeTTLs lowers every RR TTL in msg (except OPT) by elapsed seconds in
+// place, never below minTTL and never raising a TTL already under it.
+func AgeTTLs(msg []byte, elapsed, minTTL uint32) error {
+	if len(msg) < 12 {
+		return ErrShort
+	}
+	return errorFromCode(C.dnsasm_age_ttls((*C.uint8_t)(unsafe.Pointer(&msg[0])), C.size_t(len(msg)),
+		C.uint32_t(elapsed), C.uint32_t(minTTL)))
+}
+
+// PatchResponse gives resp the ID of query and the exact casing of its
+// question name (0x20). If the question names differ beyond case only
+// the ID is patched and ErrName returned.
+func PatchResponse(resp, query []byte) error {
+	if len(resp) < 12 || len(query) < 12 {
+		return ErrShort
+	}
+	return errorFromCode(C.dnsasm_patch_response((*C.uint8_t)(unsafe.Pointer(&resp[0])), C.size_t(len(resp)),
+		(*C.uint8_t)(unsafe.Pointer(&query[0])), C.size_t(len(query))))
+}
+
+// Truncate shrinks msg in place to at most limit bytes, cutting at an
+// RRset boundary, keeping OPT and setting TC if answers or authority
+// were lost. It returns msg resliced to the new length.
+func Truncate(msg []byte, limit int) ([]byte, error) {
+	if len(msg) < 12 {
+		return msg, ErrShort
+	}
+	if limit < 0 {
+		limit = 0
+	}
+	n := C.dnsasm_truncate((*C.uint8_t)(unsafe.Pointer(&msg[0])), C.size_t(len(msg)), C.size_t(limit))
+	if n < 0 {
+		return msg, errorFromCode(n)
+	}
+	return msg[:n], nil
+}
+
+// ReplyBufSize always holds a reply from Reply: header, the largest
+// question and a bare OPT.
+const ReplyBufSize = 12 + 255 + 4 + 11
+
+// Reply writes an empty response to req into out: FORMERR, SERVFAIL,
+// REFUSED, NOTIMP, or a TC=1 slip with RCodeNoError and FlagTC. The ID,
+// opcode, RD, CD and the first question (when intact) are echoed, and a
+// bare OPT added if req had one. qc may be nil; passing the request's
+// classification saves the OPT lookup. Reply does not allocate.
+func Reply(out, req []byte, qc *QueryClass, rcode int, flags uint16) ([]byte, error) {
+	if len(req) < 12 {
+		return nil, ErrShort
+	}
+	if len(out) == 0 {
+		return nil, ErrSpace
+	}
+
+	var haveQC, qnameLen, edns, do C.int
+	if qc != nil {
+		haveQC, qnameLen = 1, C.int(qc.QNameLen)
+		if qc.EDNS.Present && qc.Verdict&ClassBadOPT == 0 {
+			edns = 1
+		}
+		if qc.EDNS.DO {
+			do = 1
+		}
+	}
+	n := C.reply_error((*C.uint8_t)(unsafe.Pointer(&out[0])), C.size_t(len(out)),
+		(*C.uint8_t)(unsafe.Pointer(&req[0])), C.size_t(len(req)),
+		haveQC, C.uint16_t(qnameLen), C.uint8_t(edns), C.uint8_t(do),
+		C.uint16_t(rcode), C.uint16_t(flags))
+	if n < 0 {
+		return nil, errorFromCode(n)
+	}
+	return out[:n], nil
+}
+
+// NameEqual reports whether two wire-format names are equal ignoring
+// ASCII case, using the selected SIMD implementation.
+func NameEqual(a, b []byte) bool {
+	if len(a) != len(b) {
+		return false
+	}
+	ap, an := bytesArg(a)
+	bp, bn := bytesArg(b)
+	return C.dnsasm_name_equal(ap, an, bp, bn) == 0
+}
+
+// NameCompare orders two uncompressed wire-format names in DNSSEC
+// canonical order (RFC 4034 6.1), label by label from the right. It
+// returns a negative number, 0 or a positive number like bytes.Compare,
+// so it drops into slices.SortFunc for zone sorting and NSEC lookups.
+func NameCompare(a, b []byte) int {
+	ap, an := bytesArg(a)
+	bp, bn := bytesArg(b)
+	return int(C.dnsasm_name_compare(ap, an, bp, bn))
+}
+
+// wireNameToString converts a wire-format DNS name to dotted notation.
+// Wire format: len1, label1, len2, label2, ..., 0
+// Dotted: label1.label2....
+func wireNameToString(wire []byte, length int) string {
+	if length == 0 || (length == 1 && wire[0] == 0) {
+		return "."
+	}
+
+	// A name is at most 255 wire bytes, so the dotted form fits on the stack
+	var result [256]byte
+	n := 0
+	pos := 0
+
+	for pos < length && wire[pos] != 0 {
+		labelLen := int(wire[pos])
+		pos++
+
+		if pos+labelLen > length || n+labelLen+1 > len(result) {
+			break
+		}
+
+		if n > 0 {
+			result[n] = '.'
+			n++
+		}
+		n += copy(result[n:], wire[pos:pos+labelLen])
+		pos += labelLen
+	}
+
+	return string(result[:n])
+}
+
+// BuildHeader creates a DNS header in wire format.
+func BuildHeader(buf []byte, id, flags, qdcount, ancount, nscount, arcount uint16) int {
+	if len(buf) < 12 {
+		return 0
+	}
+
+	n := C.dnsasm_build_header(
+		(*C.uint8_t)(unsafe.Pointer(&buf[0])),
+		C.uint16_t(id),
+		C.uint16_t(flags),
+		C.uint16_t(qdcount),
+		C.uint16_t(ancount),
+		C.uint16_t(nscount),
+		C.uint16_t(arcount),
+	)
+
+	return int(n)
+}
+
+// DNS record types
+const (
+	TypeA     = 1
+	TypeNS    = 2
+	TypeCNAME = 5
+	TypeSOA   = 6
+	TypePTR   = 12
+	TypeMX    = 15
+	TypeTXT   = 16
+	TypeAAAA  = 28
+	TypeSRV   = 33
+	TypeOPT   = 41
+	TypeANY   = 255
+)
+
+// DNS classes
+const (
+	ClassIN  = 1
+	ClassCH  = 3
+	ClassHS  = 4
+	ClassANY = 255
+)
+
+// DNS response codes
+const (
+	RCodeNoError  = 0
+	RCodeFormErr  = 1
+	RCodeServFail = 2
+	RCodeNXDomain = 3
+	RCodeNotImp   = 4
+	RCodeRefused  = 5
+)
+
+// DNS header flags
+const (
+	FlagQR = 1 << 15 // Query/Response
+	FlagAA = 1 << 10 // Authoritative Answer
+	FlagTC = 1 << 9  // Truncated
+	FlagRD = 1 << 8  // Recursion Desired
+	FlagRA = 1 << 7  // Recursion Available
+	FlagCD = 1 << 4  // Checking Disabled
+)
+
+// NameSet is an immutable hashed set of wire-format names, matched
+// ignoring case: RPZ exact triggers, allow/deny lists, zone owners.
+// It lives in one flat buffer that is also its serialized form.
+type NameSet struct {
+	buf []byte
+}
+
+// alignedBytes returns n zeroed bytes starting on a cache line.
+func alignedBytes(n int) []byte {
+	b := make([]byte, n+63)
+	off := int(-uintptr(unsafe.Pointer(&b[0])) & 63)
+	return b[off : off+n]
+}
+
+func (s *NameSet) c() *C.dnsasm_nameset_t {
+	return (*C.dnsasm_nameset_t)(unsafe.Pointer(&s.buf[0]))
+}
+
+// BuildNameSet builds a set from uncompressed wire names laid back to
+// back in names. Duplicates (ignoring case) are kept once.
+func BuildNameSet(names []byte, key HashKey) (*NameSet, error) {
+	np, nn := bytesArg(names)
+	need := int(C.dnsasm_nameset_size(np, nn))
+	if need == 0 {
+		return nil, ErrName
+	}
+
+	buf := alignedBytes(need)
+	ckey := C.dnsasm_hash_key_t{k0: C.uint64_t(key.K0), k1: C.uint64_t(key.K1)}
+	err := errorFromCode(C.dnsasm_nameset_build(np, nn, &ckey,
+		(*C.uint8_t)(unsafe.Pointer(&buf[0])), C.size_t(len(buf))))
+	if err != nil {
+		return nil, err
+	}
+	s := &NameSet{buf: buf}
+	s.buf = buf[:s.c().size]
+	return s, nil
+}
+
+// OpenNameSet validates a serialized set, e.g. one read from disk. The
+// set aliases b unless b is not 8-byte aligned, in which case it is
+// copied.
+func OpenNameSet(b []byte) (*NameSet, error) {
+	if len(b) == 0 {
+		return nil, ErrShort
+	}
+	if uintptr(unsafe.Pointer(&b[0]))&7 != 0 {
+		b = append(alignedBytes(len(b))[:0], b...)
+	}
+	var set *C.dnsasm_nameset_t
+	err := errorFromCode(C.dnsasm_nameset_open((*C.uint8_t)(unsafe.Pointer(&b[0])), C.size_t(len(b)), &set))
+	if err != nil {
+		return nil, err
+	}
+	s := &NameSet{buf: b}
+	s.buf = b[:s.c().size]
+	return s, nil
+}
+
+// Contains reports whether the set holds name. It does not allocate.
+func (s *NameSet) Contains(name []byte) bool {
+	if len(name) == 0 {
+		return false
+	}
+	return C.dnsasm_nameset_contains(s.c(), (*C.uint8_t)(unsafe.Pointer(&name[0])), C.size_t(len(name))) != 0
+}
+
+// Len returns the number of distinct names.
+func (s *NameSet) Len() int { return int(s.c().count) }
+
+// Bytes returns the serialized set; OpenNameSet reverses it.
+func (s *NameSet) Bytes() []byte { return s.buf }
+
+// SuffixTrie maps wire-format names to values and finds the closest
+// enclosing one for any name in a single walk: the zone a query falls
+// in, the RPZ wildcard base covering it, the bailiwick it belongs to.
+// Like NameSet it is immutable and its buffer is its serialized form;
+// rebuild it from the full list when the list changes.
+type SuffixTrie struct {
+	buf []byte
+}
+
+func (t *SuffixTrie) c() *C.dnsasm_trie_t {
+	return (*C.dnsasm_trie_t)(unsafe.Pointer(&t.buf[0]))
+}
+
+// isPlainName reports whether b is exactly one uncompressed wire name.
+func isPlainName(b []byte) bool {
+	for i := 0; i < len(b) && i < 255; {
+		switch l := int(b[i]); {
+		case l == 0:
+			return i == len(b)-1
+		case l > 63:
+			return false
+		default:
+			i += 1 + l
+		}
+	}
+	return false
+}
+
+// BuildSuffixTrie builds a trie from uncompressed wire names, in any
+// order. values gives each name's value; if nil, a name's value is its
+// index in names. Of names equal ignoring case, the last one wins.
+func BuildSuffixTrie(names [][]byte, values []uint32) (*SuffixTrie, error) {
+	if values != nil && len(values) != len(names) {
+		return nil, ErrFormat
+	}
+	order := make([]int, len(names))
+	size := 0
+	for i, n := range names {
+		if !isPlainName(n) {
+			return nil, ErrName
+		}
+		order[i] = i
+		size += len(n)
+	}
+	sort.SliceStable(order, func(i, j int) bool {
+		return NameCompare(names[order[i]], names[order[j]]) < 0
+	})
+
+	list := make([]byte, 0, size)
+	vals := make([]uint32, len(names)+1)
+	for i, k := range order {
+		list = append(list, names[k]...)
+		vals[i] = uint32(k)
+		if values != nil {
+			vals[i] = values[k]
+		}
+	}
+
+	np, nn := bytesArg(list)
+	need := int(C.dnsasm_trie_size(np, nn))
+	if need == 0 {
+		return nil, ErrName
+	}
+	buf := alignedBytes(need)
+	err := errorFromCode(C.dnsasm_trie_build(np, nn, (*C.uint32_t)(unsafe.Pointer(&vals[0])),
+		(*C.uint8_t)(unsafe.Pointer(&buf[0])), C.size_t(len(buf))))
+	if err != nil {
+		return nil, err
+	}
+	t := &SuffixTrie{buf: buf}
+	t.buf = buf[:t.c().size]
+	return t, nil
+}
+
+// OpenSuffixTrie validates a serialized trie. The trie aliases b unless
+// b is not 8-byte aligned, in which case it is copied.
+func OpenSuffixTrie(b []byte) (*SuffixTrie, error) {
+	if len(b) == 0 {
+		return nil, ErrShort
+	}
+	if uintptr(unsafe.Pointer(&b[0]))&7 != 0 {
+		b = append(alignedBytes(len(b))[:0], b...)
+	}
+	var trie *C.dnsasm_trie_t
+	err := errorFromCode(C.dnsasm_trie_open((*C.uint8_t)(unsafe.Pointer(&b[0])), C.size_t(len(b)), &trie))
+	if err != nil {
+		return nil, err
+	}
+	t := &SuffixTrie{buf: b}
+	t.buf = b[:t.c().size]
+	return t, nil
+}
+
+// Match finds the longest suffix of name (name itself included) that
+// is in the trie, ignoring case. off is where that suffix starts in
+// name. For a wildcard such as *.example.com, store example.com and
+// match name[1+name[0]:]. Match does not allocate.
+func (t *SuffixTrie) Match(name []byte) (value uint32, off int, ok bool) {
+	if len(name) == 0 {
+		return 0, 0, false
+	}
+	r := C.trie_match(t.c(), (*C.uint8_t)(unsafe.Pointer(&name[0])), C.size_t(len(name)))
+	if r.off < 0 {
+		return 0, 0, false
+	}
+	return uint32(r.value), int(r.off), true
+}
+
+// Len returns the number of distinct names.
+func (t *SuffixTrie) Len() int { return int(t.c().count) }
+
+// Bytes returns the serialized trie; OpenSuffixTrie reverses it.
+func (t *SuffixTrie) Bytes() []byte { return t.buf }
+
+// NameFilter is a blocked Bloom filter over wire-format names that
+// rules out policy lookups (RPZ triggers, blocklists) before any lock
+// or map probe. Match tests a name and all its ancestors, one cache
+// line each. A hit may be false (about 0.05% per probe at capacity);
+// a miss is certain. Add may run alongside Match but not alongside
+// another Add.
+type NameFilter struct {
+	buf []byte
+}
+
+func (f *NameFilter) c() *C.dnsasm_filter_t {
+	return (*C.dnsasm_filter_t)(unsafe.Pointer(&f.buf[0]))
+}
+
+// NewNameFilter returns an empty filter sized for capacity names.
+func NewNameFilter(capacity int, key HashKey) (*NameFilter, error) {
+	need := 0
+	if capacity >= 0 {
+		need = int(C.dnsasm_filter_size(C.size_t(capacity)))
+	}
+	if need == 0 {
+		return nil, ErrSpace
+	}
+	buf := alignedBytes(need)
+	ckey := C.dnsasm_hash_key_t{k0: C.uint64_t(key.K0), k1: C.uint64_t(key.K1)}
+	err := errorFromCode(C.dnsasm_filter_init((*C.uint8_t)(unsafe.Pointer(&buf[0])), C.size_t(len(buf)),
+		C.size_t(capacity), &ckey))
+	if err != nil {
+		return nil, err
+	}
+	return &NameFilter{buf: buf}, nil
+}
+
+// OpenNameFilter validates a serialized filter. The filter aliases b
+// unless b does not start on a cache line, in which case it is copied.
+func OpenNameFilter(b []byte) (*NameFilter, error) {
+	if len(b) == 0 {
+		return nil, ErrShort
+	}
+	if uintptr(unsafe.Pointer(&b[0]))&63 != 0 {
+		b = append(alignedBytes(len(b))[:0], b...)
+	}
+	var filter *C.dnsasm_filter_t
+	err := errorFromCode(C.dnsasm_filter_open((*C.uint8_t)(unsafe.Pointer(&b[0])), C.size_t(len(b)), &filter))
+	if err != nil {
+		return nil, err
+	}
+	f := &NameFilter{buf: b}
+	f.buf = b[:f.c().size]
+	return f, nil
+}
+
+// Add adds an uncompressed wire name, ignoring case. It returns ErrSpace
+// once the filter holds Cap names; build a bigger one then.
+func (f *NameFilter) Add(name []byte) error {
+	np, nn := bytesArg(name)
+	return errorFromCode(C.dnsasm_filter_add(f.c(), np, nn))
+}
+
+// Match reports whether name or one of its ancestors below the root may
+// have been added, and where the longest such suffix starts in name.
+// Match does not allocate.
+func (f *NameFilter) Match(name []byte) (off int, ok bool) {
+	np, nn := bytesArg(name)
+	r := int(C.dnsasm_filter_match(f.c(), np, nn))
+	return r, r >= 0
+}
+
+// Len returns the number of names added.
+func (f *NameFilter) Len() int { return int(f.c().count) }
+
+// Cap returns the number of names the filter was sized for.
+func (f *NameFilter) Cap() int { return int(f.c().capacity) }
+
+// Bytes returns the serialized filter; OpenNameFilter reverses it.
+func (f *NameFilter) Bytes() []byte { return f.buf }
+
+// PrefixTable maps IP prefixes to small values (an ACL action, a view,
+// an exemption) and answers lookups in a few array loads, however many
+// prefixes it holds. It is immutable and its buffer is its serialized
+// form: rebuild it when the prefix list changes and swap it in.
+type PrefixTable struct {
+	buf []byte
+}
+
+func (t *PrefixTable) c() *C.dnsasm_lpm_t {
+	return (*C.dnsasm_lpm_t)(unsafe.Pointer(&t.buf[0]))
+}
+
+// PrefixFromIPNet converts n the way net.IPNet.Contains reads it: an
+// IPv4 network in 16-byte form, or with a 16-byte mask, is an IPv4
+// prefix. ok is false for a malformed or non-contiguous mask.
+func PrefixFromIPNet(n *net.IPNet) (p netip.Prefix, ok bool) {
+	ip, mask := n.IP.To4(), n.Mask
+	if ip == nil {
+		ip = n.IP
+	}
+	if len(mask) == net.IPv6len && len(ip) == net.IPv4len {
+		mask = mask[12:]
+	}
+	ones, bits := mask.Size()
+	if bits == 0 || bits != 8*len(ip) {
+		return netip.Prefix{}, false
+	}
+	addr, _ := netip.AddrFromSlice(ip)
+	return netip.PrefixFrom(addr, ones), true
+}
+
+// BuildPrefixTable paints values[i] over prefixes[i] in order, so a
+// later prefix wins where it overlaps an earlier one: sort by length
+// for longest-prefix match, or list overriding prefixes (denies) last.
+// An IPv4-mapped prefix of /96 or longer counts as IPv4. Values must
+// be below 1<<31 - 1.
+func BuildPrefixTable(prefixes []netip.Prefix, values []uint32) (*PrefixTable, error) {
+	if len(values) != len(prefixes) {
+		return nil, ErrFormat
+	}
+	entries := make([]C.dnsasm_lpm_entry_t, len(prefixes)+1)
+	for i, p := range prefixes {
+		if !p.IsValid() {
+			return nil, ErrFormat
+		}
+		addr, bits := p.Addr(), p.Bits()
+		if addr.Is4In6() && bits >= 96 {
+			addr, bits = addr.Unmap(), bits-96
+		}
+		e := &entries[i]
+		if addr.Is4() {
+			a := addr.As4()
+			e.family = 4
+			copy((*[16]byte)(unsafe.Pointer(&e.addr[0]))[:], a[:])
+		} else {
+			a := addr.As16()
+			e.family = 6
+			copy((*[16]byte)(unsafe.Pointer(&e.addr[0]))[:], a[:])
+		}
+		e.prefix_len = C.uint8_t(bits)
+		e.value = C.uint32_t(values[i])
+	}
+
+	n := C.size_t(len(prefixes))
+	need := int(C.dnsasm_lpm_size(&entries[0], n))
+	if need == 0 {
+		return nil, ErrFormat
+	}
+	buf := alignedBytes(need)
+	err := errorFromCode(C.dnsasm_lpm_build(&entries[0], n, (*C.uint8_t)(unsafe.Pointer(&buf[0])), C.size_t(len(buf))))
+	if err != nil {
+		return nil, err
+	}
+	t := &PrefixTable{buf: buf}
+	t.buf = buf[:t.c().size]
+	return t, nil
+}
+
+// OpenPrefixTable validates a serialized table. The table aliases b
+// unless b does not start on a cache line, in which case it is copied.
+func OpenPrefixTable(b []byte) (*PrefixTable, error) {
+	if len(b) == 0 {
+		return nil, ErrShort
+	}
+	if uintptr(unsafe.Pointer(&b[0]))&63 != 0 {
+		b = append(alignedBytes(len(b))[:0], b...)
+	}
+	var lpm *C.dnsasm_lpm_t
+	err := errorFromCode(C.dnsasm_lpm_open((*C.uint8_t)(unsafe.Pointer(&b[0])), C.size_t(len(b)), &lpm))
+	if err != nil {
+		return nil, err
+	}
+	t := &PrefixTable{buf: b}
+	t.buf = b[:t.c().size]
+	return t, nil
+}
+
+func (t *PrefixTable) result(v C.uint32_t) (uint32, bool) {
+	if v == C.DNSASM_LPM_NONE {
+		return 0, false
+	}
+	return uint32(v), true
+}
+
+// Lookup returns the value of the last-painted prefix covering addr.
+// IPv4-mapped addresses are looked up as IPv4. Lookup does not allocate.
+func (t *PrefixTable) Lookup(addr netip.Addr) (value uint32, ok bool) {
+	switch {
+	case addr.Is4() || addr.Is4In6():
+		a := addr.As4()
+		return t.result(C.lpm_lookup_v4(t.c(), C.uint32_t(binary.BigEndian.Uint32(a[:]))))
+	case addr.Is6():
+		a := addr.As16()
+		return t.result(C.lpm_lookup_v6(t.c(), C.uint64_t(binary.BigEndian.Uint64(a[:8])),
+			C.uint64_t(binary.BigEndian.Uint64(a[8:]))))
+	}
+	return 0, false
+}
+
+// LookupIP is Lookup for a net.IP in either 4- or 16-byte form. It does
+// not allocate.
+func (t *PrefixTable) LookupIP(ip net.IP) (value uint32, ok bool) {
+	if v4 := ip.To4(); v4 != nil {
+		return t.result(C.lpm_lookup_v4(t.c(), C.uint32_t(binary.BigEndian.Uint32(v4))))
+	}
+	if len(ip) == net.IPv6len {
+		return t.result(C.lpm_lookup_v6(t.c(), C.uint64_t(binary.BigEndian.Uint64(ip[:8])),
+			C.uint64_t(binary.BigEndian.Uint64(ip[8:]))))
+	}
+	return 0, false
+}
+
+// Len returns the number of prefixes painted.
+func (t *PrefixTable) Len() int { return int(t.c().count) }
+
+// Bytes returns the serialized table; OpenPrefixTable reverses it.
+func (t *PrefixTable) Bytes() []byte { return t.buf }
+
+// Cookie outcomes, as CheckCookie reports them.
+type CookieStatus int
+
+const (
+	CookieClient  CookieStatus = C.DNSASM_COOKIE_CLIENT  // Client cookie only
+	CookieValid   CookieStatus = C.DNSASM_COOKIE_VALID   // Good: echo it
+	CookieRenew   CookieStatus = C.DNSASM_COOKIE_RENEW   // Good, but send the fresh one
+	CookieBad     CookieStatus = C.DNSASM_COOKIE_BAD     // Wrong, or not ours
+	CookieExpired CookieStatus = C.DNSASM_COOKIE_EXPIRED // Timestamp out of window
+	CookieFormErr CookieStatus = C.DNSASM_COOKIE_FORMERR // Illegal option length
+)
+
+// Good reports whether the request proved it saw one of our cookies.
+func (s CookieStatus) Good() bool { return s == CookieValid || s == CookieRenew }
+
+// CookieSecrets are the server cookie secrets. Current signs; cookies
+// under Previous still pass for an hour after a rotation.
+type CookieSecrets struct {
+	Current     HashKey
+	Previous    HashKey
+	HasPrevious bool
+}
+
+func (s *CookieSecrets) c() C.dnsasm_cookie_secrets_t {
+	var cs C.dnsasm_cookie_secrets_t
+	cs.current.k0, cs.current.k1 = C.uint64_t(s.Current.K0), C.uint64_t(s.Current.K1)
+	cs.previous.k0, cs.previous.k1 = C.uint64_t(s.Previous.K0), C.uint64_t(s.Previous.K1)
+	if s.HasPrevious {
+		cs.has_previous = 1
+	}
+	return cs
+}
+
+func addrWords(addr netip.Addr) (C.uint64_t, C.uint64_t) {
+	a := addr.As16()
+	return C.uint64_t(binary.BigEndian.Uint64(a[:8])), C.uint64_t(binary.BigEndian.Uint64(a[8:]))
+}
+
+func cookieBytes(r *C.cookie_r) [16]byte {
+	return *(*[16]byte)(unsafe.Pointer(&r.cookie[0]))
+}
+
+// MakeServerCookie returns the RFC 9018 server cookie for client and
+// addr at time now (Unix seconds). It does not allocate.
+func MakeServerCookie(secret HashKey, client [8]byte, addr netip.Addr, now uint32) [16]byte {
+	hi, lo := addrWords(addr)
+	r := C.cookie_make(C.dnsasm_hash_key_t{k0: C.uint64_t(secret.K0), k1: C.uint64_t(secret.K1)},
+		C.uint64_t(binary.BigEndian.Uint64(client[:])), hi, lo, C.uint32_t(now))
+	return cookieBytes(&r)
+}
+
+// CheckCookie checks COOKIE option data from a request (EDNS.Cookie)
+// against both secrets and returns the server cookie to answer with:
+// the request's own when it is valid, a fresh one otherwise. The reply
+// is meaningless for CookieFormErr. CheckCookie does not allocate.
+func CheckCookie(s *CookieSecrets, option []byte, addr netip.Addr, now uint32) (CookieStatus, [16]byte) {
+	var p *C.uint8_t
+	if len(option) > 0 {
+		p = (*C.uint8_t)(unsafe.Pointer(&option[0]))
+	}
+	hi, lo := addrWords(addr)
+	r := C.cookie_check(s.c(), p, C.size_t(len(option)), hi, lo, C.uint32_t(now))
+	return CookieStatus(r.status), cookieBytes(&r)
+}
+
+// Longest legal COOKIE option
+const cookieOptionMax = C.DNSASM_COOKIE_CLIENT_LEN + 32
+
+// CookieBatch checks the cookies of up to BatchMax requests at once, so
+// the SipHash work of a whole receive batch runs four lanes at a time.
+// Reuse one batch per receive loop: Add, Check, read the results, Reset.
+type CookieBatch struct {
+	n    int
+	reqs [BatchMax]C.dnsasm_cookie_req_t
+	opts [BatchMax][cookieOptionMax]byte
+}
+
+// Add queues a request's COOKIE option data and client address and
+// returns its index, or -1 if the batch is full. An option longer than
+// any legal one is queued as a FORMERR.
+func (b *CookieBatch) Add(option []byte, addr netip.Addr) int {
+	if b.n == BatchMax {
+		return -1
+	}
+	i := b.n
+	r := &b.reqs[i]
+	r.option_len = C.uint16_t(copy(b.opts[i][:], option))
+	if len(option) > cookieOptionMax {
+		r.option_len = 0
+	}
+	r.addr_len = 16
+	a := addr.As16()
+	copy((*[16]byte)(unsafe.Pointer(&r.addr[0]))[:], a[:])
+	b.n++
+	return i
+}
+
+// Check checks every queued request. It does not allocate.
+func (b *CookieBatch) Check(s *CookieSecrets, now uint32) {
+	if b.n == 0 {
+		return
+	}
+	C.cookie_check_slab(s.c(), (*C.uint8_t)(unsafe.Pointer(&b.opts[0][0])), cookieOptionMax,
+		(*C.uint8_t)(unsafe.Pointer(&b.reqs[0])), C.size_t(b.n), C.uint32_t(now))
+}
+
+// Len returns the number of queued requests.
+func (b *CookieBatch) Len() int { return b.n }
+
+// Result returns the outcome and reply cookie of request i after Check.
+func (b *CookieBatch) Result(i int) (CookieStatus, [16]byte) {
+	r := &b.reqs[i]
+	return CookieStatus(r.status), *(*[16]byte)(unsafe.Pointer(&r.reply[0]))
+}
+
+// Reset empties the batch.
+func (b *CookieBatch) Reset() { b.n = 0 }
+
+// Stats is a snapshot of libdnsasm's hot-path counters. They are only
+// kept by libraries built with STATS=1; see StatsEnabled. Every counter
+// only grows, so diff two snapshots for rates. The layout mirrors
+// dnsasm_stats_t.
+type Stats struct {
+	Threads     uint64                              // Threads counting now
+	Names       uint64                              // Names decompressed
+	PointerHops uint64                              // Compression pointers followed
+	Errors      [C.DNSASM_STATS_ERRORS]uint64       // By negated C error code; see ErrorCount
+	NameLen     [C.DNSASM_STATS_NAME_BUCKETS]uint64 // By decompressed name length / 16
+	QType       [C.DNSASM_STATS_QTYPES]uint64       // Questions by qtype, all above 255 in the last
+}
+
+// Stats must stay byte-for-byte the C struct
+var _ [unsafe.Sizeof(Stats{}) - C.sizeof_dnsasm_stats_t]byte
+var _ [C.sizeof_dnsasm_stats_t - unsafe.Sizeof(Stats{})]byte
+
+// StatsEnabled reports whether the linked libdnsasm was built with
+// STATS=1. Without it ReadStats always returns zeros.
+func StatsEnabled() bool {
+	return C.dnsasm_stats_enabled() != 0
+}
+
+// ReadStats sums the counters of every thread that has called into
+// libdnsasm, including exited ones.
+func ReadStats(s *Stats) {
+	C.dnsasm_stats_snapshot((*C.dnsasm_stats_t)(unsafe.Pointer(s)))
+}
+
+// ErrorCount returns how often the parse paths detected err (ErrShort,
+// ErrPointer, ErrLoop, ...).
+func (s *Stats) ErrorCount(err error) uint64 {
+	for i := 1; i < len(s.Errors); i++ {
+		if errorFromCode(C.int(-i)) == err {
+			return s.Errors[i]
+		}
+	}
+	return 0
+}
+
+// IOConfig sizes a batched socket. Zero fields take the defaults: 64
+// datagrams per batch, 4 KiB slots, no timeout.
+type IOConfig struct {
+	Batch     int           // Datagrams per system call, at most 64
+	RxSize    int           // Receive slot bytes; longer datagrams arrive empty
+	TxSize    int           // Largest response Queue accepts
+	Timeout   time.Duration // How long Recv waits for the first datagram; 0 blocks
+	SockBuf   int           // SO_RCVBUF/SO_SNDBUF bytes, 0 keeps the default
+	ReusePort bool          // SO_REUSEPORT, for one socket per worker
+	URing     bool          // io_uring where the kernel has it; see Backend
+}
+
+// IOCounters are the running totals of an IO.
+type IOCounters struct {
+	RecvCalls  uint64 // Receives that waited in the kernel and returned data
+	Received   uint64 // Datagrams received
+	Truncated  uint64 // Datagrams longer than RxSize
+	SendCalls  uint64 // Send system calls, or batches handed to io_uring
+	Sent       uint64 // Responses the kernel accepted
+	SendErrors uint64 // Responses the kernel refused
+}
+
+var _ [unsafe.Sizeof(IOCounters{}) - C.sizeof_dnsasm_io_counters_t]byte
+var _ [C.sizeof_dnsasm_io_counters_t - unsafe.Sizeof(IOCounters{})]byte
+
+// ErrIOShutdown is returned by Recv once Shutdown has been called.
+var ErrIOShutdown = errors.New("dnsasm: socket shut down")
+
+// IO is a UDP socket owned by libdnsasm: Recv takes up to a batch of
+// datagrams with one recvmmsg into a ring in C memory, Queue copies
+// answers into a send queue and the next Recv (or Flush) sends them
+// with one sendmmsg. With IOConfig.URing the same calls run on
+// io_uring instead, and Packet slices point into kernel-filled buffers.
+// Packet slices are only valid until the next Recv. An IO belongs to
+// one goroutine; only Shutdown may be called from another.
+type IO struct {
+	io    *C.dnsasm_io_t
+	h     C.uintptr_t // io, for the per-batch calls
+	pkts  []*C.uint8_t
+	lens  []uint16
+	peers []C.dnsasm_io_peer_t
+	cls   []C.dnsasm_query_class_t // Classify's C-side results
+	n     int
+}
+
+// ioConfig converts cfg for dnsasm_io_open and dnsasm_io_listen.
+func ioConfig(cfg IOConfig) (C.dnsasm_io_config_t, error) {
+	if cfg.Batch < 0 || cfg.RxSize < 0 || cfg.TxSize < 0 || cfg.SockBuf < 0 {
+		return C.dnsasm_io_config_t{}, syscall.EINVAL
+	}
+	c := C.dnsasm_io_config_t{
+		batch:      C.uint32_t(cfg.Batch),
+		rx_size:    C.uint32_t(cfg.RxSize),
+		tx_size:    C.uint32_t(cfg.TxSize),
+		timeout_ms: -1,
+		sockbuf:    C.uint32_t(cfg.SockBuf),
+	}
+	if cfg.Timeout > 0 {
+		c.timeout_ms = C.int32_t((cfg.Timeout + time.Millisecond - 1) / time.Millisecond)
+	}
+	if cfg.ReusePort {
+		c.flags |= C.DNSASM_IO_REUSEPORT
+	}
+	if cfg.URing {
+		c.flags |= C.DNSASM_IO_URING
+	}
+	return c, nil
+}
+
+// ioAddr fills raw with addr for the C side and returns its length: 0
+// for the wildcard, 4 for IPv4 (mapped or not), 16 otherwise.
+func ioAddr(addr netip.Addr, raw *[16]byte) int {
+	switch ip := addr.Unmap(); {
+	case ip.Is4():
+		*(*[4]byte)(raw[:]) = ip.As4()
+		return 4
+	case ip.IsValid():
+		*raw = ip.As16()
+		return 16
+	}
+	return 0
+}
+
+// OpenIO binds a UDP socket to addr. An invalid address (as from
+// ":53") binds the wildcard, dual-stack where the host allows; an
+// IPv4-mapped one binds IPv4.
+func OpenIO(addr netip.AddrPort, cfg IOConfig) (*IO, error) {
+	c, err := ioConfig(cfg)
+	if err != nil {
+		return nil, err
+	}
+	var raw [16]byte
+	var p *C.uint8_t
+	n := ioAddr(addr.Addr(), &raw)
+	if n > 0 {
+		p = (*C.uint8_t)(unsafe.Pointer(&raw[0]))
+	}
+	h, err := C.dnsasm_io_open(p, C.size_t(n), C.uint16_t(addr.Port()), &c)
+	if h == nil {
+		return nil, err
+	}
+
+	batch := int(c.batch)
+	if batch == 0 {
+		batch = C.DNSASM_IO_MAX_BATCH
+	}
+	return &IO{
+		io:    h,
+		h:     C.uintptr_t(uintptr(unsafe.Pointer(h))),
+		pkts:  unsafe.Slice(C.dnsasm_io_packets(h), batch),
+		lens:  unsafe.Slice((*uint16)(unsafe.Pointer(C.dnsasm_io_lens(h))), batch),
+		peers: unsafe.Slice(C.dnsasm_io_peers(h), batch),
+		cls:   make([]C.dnsasm_query_class_t, batch),
+	}, nil
+}
+
+// Recv sends what is queued, then waits for datagrams and returns how
+// many arrived: 0 when the timeout ran out.
+func (io *IO) Recv() (int, error) {
+	io.n = 0
+	n, err := C.io_recv(io.h)
+	if n < 0 {
+		if err == syscall.ESHUTDOWN {
+			return 0, ErrIOShutdown
+		}
+		return 0, err
+	}
+	io.n = int(n)
+	return io.n, nil
+}
+
+// Len is the number of datagrams from the last Recv.
+func (io *IO) Len() int { return io.n }
+
+// Packet returns datagram i of the last Recv, empty if it was longer
+// than RxSize.
+func (io *IO) Packet(i int) []byte {
+	return unsafe.Slice((*byte)(unsafe.Pointer(io.pkts[i])), io.lens[:io.n][i])
+}
+
+// Peer returns the sender of datagram i; IPv4-mapped senders come back
+// as IPv4.
+func (io *IO) Peer(i int) netip.AddrPort {
+	p := &io.peers[:io.n][i]
+	var ip netip.Addr
+	if p.addr_len == 4 {
+		ip = netip.AddrFrom4(*(*[4]byte)(unsafe.Pointer(&p.addr[0])))
+	} else {
+		ip = netip.AddrFrom16(*(*[16]byte)(unsafe.Pointer(&p.addr[0])))
+	}
+	return netip.AddrPortFrom(ip, uint16(p.port))
+}
+
+// Classify does ClassifyQuery into qc[i] and ParseBatch into b for
+// every datagram of the last Recv, in one cgo call over the ring in
+// place. qc must have room for Len() entries.
+func (io *IO) Classify(qc []QueryClass, b *Batch) {
+	qc = qc[:io.n]
+	if io.n == 0 {
+		b.c.count = 0
+		return
+	}
+	C.io_classify(io.h, C.size_t(io.n), &io.cls[0], &b.c)
+	for i := range qc {
+		queryClassFromC(&io.cls[i], &qc[i])
+	}
+}
+
+// Answer does PatchResponse of resp against datagram i, Truncate to
+// limit and Queue in one call; nothing is queued if any of them fails.
+// resp is modified in place.
+func (io *IO) Answer(i int, resp []byte, limit int) error {
+	if i < 0 || i >= io.n {
+		return ErrFormat
+	}
+	if len(resp) < 12 {
+		return ErrShort
+	}
+	if limit < 0 {
+		limit = 0
+	}
+	return errorFromCode(C.io_answer(io.h, C.uint32_t(i), (*C.uint8_t)(unsafe.Pointer(&resp[0])),
+		C.size_t(len(resp)), C.size_t(limit)))
+}
+
+// Queue copies resp to be sent to the sender of datagram i. It fails
+// with ErrSpace above TxSize and ErrFormat for an i not received.
+func (io *IO) Queue(i int, resp []byte) error {
+	if i < 0 || i >= io.n {
+		return ErrFormat
+	}
+	var p *C.uint8_t
+	if len(resp) > 0 {
+		p = (*C.uint8_t)(unsafe.Pointer(&resp[0]))
+	}
+	return errorFromCode(C.io_queue(io.h, C.uint32_t(i), p, C.size_t(len(resp))))
+}
+
+// Flush sends what is queued now and returns how many the kernel took.
+func (io *IO) Flush() (int, error) {
+	n, err := C.io_flush(io.h)
+	if n < 0 {
+		return 0, err
+	}
+	return int(n), nil
+}
+
+// Port returns the bound port.
+func (io *IO) Port() int { return int(C.dnsasm_io_port(io.io)) }
+
+// Backend names what the IO runs on: "io_uring", "recvmmsg" or
+// "recvmsg".
+func (io *IO) Backend() string { return C.GoString(C.dnsasm_io_backend(io.io)) }
+
+// Counters returns the running totals; safe from any goroutine.
+func (io *IO) Counters() IOCounters {
+	var c IOCounters
+	C.dnsasm_io_counters(io.io, (*C.dnsasm_io_counters_t)(unsafe.Pointer(&c)))
+	return c
+}
+
+// Shutdown makes the pending and every later Recv return ErrIOShutdown.
+func (io *IO) Shutdown() { C.dnsasm_io_shutdown(io.io) }
+
+// Close flushes the queue and releases the socket and ring. The IO
+// must not be used afterwards.
+func (io *IO) Close() error {
+	C.dnsasm_io_close(io.io)
+	io.io, io.h, io.pkts, io.lens, io.peers, io.n = nil, 0, nil, nil, nil, 0
+	return nil
+}
+
+// Listener is a TCP socket owned by libdnsasm that hands out accepted
+// connections in batches: with IOConfig.URing from one multishot
+// io_uring accept, otherwise poll and accept4 until the backlog is
+// empty. Only Timeout, SockBuf, ReusePort and URing apply. A Listener
+// belongs to one goroutine; only Shutdown may be called from another.
+type Listener struct {
+	l   *C.dnsasm_io_listener_t
+	fds [64]C.int
+}
+
+// ListenTCP binds and listens on addr, with the same address rules as
+// OpenIO.
+func ListenTCP(addr netip.AddrPort, cfg IOConfig) (*Listener, error) {
+	c, err := ioConfig(cfg)
+	if err != nil {
+		return nil, err
+	}
+	var raw [16]byte
+	var p *C.uint8_t
+	n := ioAddr(addr.Addr(), &raw)
+	if n > 0 {
+		p = (*C.uint8_t)(unsafe.Pointer(&raw[0]))
+	}
+	h, err := C.dnsasm_io_listen(p, C.size_t(n), C.uint16_t(addr.Port()), &c)
+	if h == nil {
+		return nil, err
+	}
+	return &Listener{l: h}, nil
+}
+
+// Accept waits for connections and stores up to len(fds) of them,
+// returning how many: 0 when the timeout ran out. The descriptors are
+// blocking and close-on-exec, and the caller owns them.
+func (l *Listener) Accept(fds []int) (int, error) {
+	room := len(fds)
+	if room > len(l.fds) {
+		room = len(l.fds)
+	}
+	n, err := C.dnsasm_io_accept(l.l, &l.fds[0], C.size_t(room))
+	if n < 0 {
+		if err == syscall.ESHUTDOWN {
+			return 0, ErrIOShutdown
+		}
+		return 0, err
+	}
+	for i := 0; i < int(n); i++ {
+		fds[i] = int(l.fds[i])
+	}
+	return int(n), nil
+}
+
+// Port returns the bound port.
+func (l *Listener) Port() int { return int(C.dnsasm_io_listener_port(l.l)) }
+
+// Backend names what the Listener runs on: "io_uring" or "accept".
+func (l *Listener) Backend() string { return C.GoString(C.dnsasm_io_listener_backend(l.l)) }
+
+// Shutdown makes the pending and every later Accept return
+// ErrIOShutdown.
+func (l *Listener) Shutdown() { C.dnsasm_io_listener_shutdown(l.l) }
+
+// Close closes the socket and any connection accepted but not yet
+// returned. The Listener must not be used afterwards.
+func (l *Listener) Close() error {
+	C.dnsasm_io_listener_close(l.l)
+	l.l = nil
+	return nil
+}
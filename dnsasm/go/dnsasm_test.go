@@ -1,7 +1,14 @@
 package dnsasm
 
 import (
+	"net"
+	"net/netip"
+	"os"
+	"sort"
+	"syscall"
 	"testing"
+	"time"
+	"unsafe"
 )
 
 // Sample DNS query packet
@@ -62,6 +69,68 @@ func TestParseQuestion(t *testing.T) {
 	}
 }
 
+func TestParseInto(t *testing.T) {
+	var h Header
+	if err := ParseHeaderInto(sampleResponse, &h); err != nil || h.ID != 0x1234 || !h.QR || h.ANCount != 1 {
+		t.Fatalf("ParseHeaderInto = %+v, %v", h, err)
+	}
+	if err := ParseHeaderInto(sampleResponse[:11], &h); err != ErrShort {
+		t.Errorf("short header: %v", err)
+	}
+
+	names := NewNameCache(64)
+	var buf WireName
+	var q Question
+	name, off, err := ParseQuestionInto(sampleResponse, 12, &q, &buf, names)
+	if err != nil || q.Name != "www.example.com" || q.Type != TypeA || off != 33 {
+		t.Fatalf("ParseQuestionInto = %+v, %d, %v", q, off, err)
+	}
+	if &name[0] != &sampleResponse[12] {
+		t.Error("uncompressed name was copied instead of sliced from the packet")
+	}
+
+	var rr RR
+	rname, next, err := ParseRRInto(sampleResponse, off, &rr, &buf, names)
+	if err != nil || next != len(sampleResponse) || rr.TTL != 300 || rr.RDLength != 4 {
+		t.Fatalf("ParseRRInto = %+v, %d, %v", rr, next, err)
+	}
+	if string(rname) != string(name) || &rname[0] != &buf.b[0] {
+		t.Error("compressed name not decompressed into buf")
+	}
+	if rr.Name != q.Name || unsafe.StringData(rr.Name) != unsafe.StringData(q.Name) {
+		t.Error("name cache returned a different string for the same name")
+	}
+	if &rr.RData[0] != &sampleResponse[next-4] || cap(rr.RData) != 4 {
+		t.Error("RData is not a capped sub-slice of the packet")
+	}
+
+	// The allocating wrappers agree and own their data
+	full, _, _ := ParseRR(sampleResponse, off)
+	if full.Name != "www.example.com" || string(full.RData) != string(rr.RData) ||
+		&full.RData[0] == &rr.RData[0] {
+		t.Errorf("ParseRR = %+v", full)
+	}
+	if _, _, err := ParseQuestionInto(sampleResponse[:20], 12, &q, &buf, nil); err != ErrShort || q.Name != "www.example.com" {
+		t.Errorf("cut name: %v", err)
+	}
+	if _, _, err := ParseQuestionInto(sampleQuery, 12, &q, &buf, nil); err != nil || q.Name != "" {
+		t.Errorf("without a cache Name = %q, %v", q.Name, err)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		var h Header
+		var q Question
+		var rr RR
+		var buf WireName
+		ParseHeaderInto(sampleResponse, &h)
+		_, off, _ := ParseQuestionInto(sampleResponse, 12, &q, &buf, names)
+		ParseRRInto(sampleResponse, off, &rr, &buf, names)
+	})
+	if allocs != 0 {
+		t.Errorf("Into variants allocate %.0f times", allocs)
+	}
+}
+
 func TestParseHeaderShort(t *testing.T) {
 	_, err := ParseHeader([]byte{0x12, 0x34})
 	if err != ErrShort {
@@ -81,9 +150,1378 @@ func BenchmarkParseQuestion(b *testing.B) {
 	}
 }
 
+func BenchmarkParseQuestionInto(b *testing.B) {
+	names := NewNameCache(1024)
+	var q Question
+	var buf WireName
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		ParseQuestionInto(sampleQuery, 12, &q, &buf, names)
+	}
+}
+
 func BenchmarkParsePacket(b *testing.B) {
 	for i := 0; i < b.N; i++ {
 		_, _ = ParseHeader(sampleQuery)
 		_, _, _ = ParseQuestion(sampleQuery, 12)
 	}
 }
+
+func TestParseBatch(t *testing.T) {
+	const stride = 512
+	slab := make([]byte, 3*stride)
+	copy(slab, sampleQuery)
+	copy(slab[stride:], []byte{0x12, 0x34})
+	copy(slab[2*stride:], sampleQuery)
+	slab[2*stride] = 0xbe
+	slab[2*stride+1] = 0xef
+	lens := []uint16{uint16(len(sampleQuery)), 2, uint16(len(sampleQuery))}
+
+	var b Batch
+	ok := ParseBatch(slab, stride, lens, &b)
+	if ok != 2 || b.Len() != 3 {
+		t.Fatalf("ParseBatch = %d (len %d), want 2 (len 3)", ok, b.Len())
+	}
+	if b.Err(1) != ErrShort {
+		t.Errorf("Err(1) = %v, want ErrShort", b.Err(1))
+	}
+	if b.Err(2) != nil || b.ID(2) != 0xbeef {
+		t.Errorf("packet 2: err=%v id=%04x", b.Err(2), b.ID(2))
+	}
+	if b.QType(0) != TypeA || b.QClass(0) != ClassIN || b.QDCount(0) != 1 {
+		t.Errorf("packet 0: qtype=%d qclass=%d qdcount=%d", b.QType(0), b.QClass(0), b.QDCount(0))
+	}
+	name := b.QName(slab, 0)
+	if wireNameToString(name, len(name)) != "www.example.com" {
+		t.Errorf("QName = %q", name)
+	}
+}
+
+func BenchmarkParseBatch(b *testing.B) {
+	const stride = 512
+	slab := make([]byte, BatchMax*stride)
+	lens := make([]uint16, BatchMax)
+	for i := range lens {
+		copy(slab[i*stride:], sampleQuery)
+		lens[i] = uint16(len(sampleQuery))
+	}
+	var batch Batch
+	b.ResetTimer()
+	for i := 0; i < b.N; i += BatchMax {
+		ParseBatch(slab, stride, lens, &batch)
+	}
+}
+
+// Sample DNS response packet (answer name compressed to the question)
+var sampleResponse = []byte{
+	0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+	0x03, 'w', 'w', 'w',
+	0x07, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+	0x03, 'c', 'o', 'm',
+	0x00,
+	0x00, 0x01, 0x00, 0x01,
+	0xc0, 0x0c, // Name: pointer to offset 12
+	0x00, 0x01, 0x00, 0x01,
+	0x00, 0x00, 0x01, 0x2c, // TTL: 300
+	0x00, 0x04,
+	0x5d, 0xb8, 0xd8, 0x22,
+}
+
+func TestMessageParse(t *testing.T) {
+	var m Message
+	if err := m.Parse(sampleResponse); err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+	if len(m.RR) != 2 || m.End != len(sampleResponse) {
+		t.Fatalf("len(RR) = %d, End = %d", len(m.RR), m.End)
+	}
+	an := m.Section(SectionAnswer)
+	if len(an) != 1 || len(m.Section(SectionAdditional)) != 0 {
+		t.Fatalf("answer section = %v", an)
+	}
+	if an[0].Type != TypeA || an[0].TTL(sampleResponse) != 300 {
+		t.Errorf("answer type=%d ttl=%d", an[0].Type, an[0].TTL(sampleResponse))
+	}
+	if rd := an[0].RData(sampleResponse); len(rd) != 4 || rd[0] != 0x5d {
+		t.Errorf("RData = %v", rd)
+	}
+	name, err := an[0].Name(sampleResponse)
+	if err != nil || name != "www.example.com" {
+		t.Errorf("Name = %q, %v", name, err)
+	}
+
+	small := Message{RR: make([]RRIndex, 1)}
+	if err := small.Parse(sampleResponse); err != ErrSpace {
+		t.Errorf("expected ErrSpace, got %v", err)
+	}
+}
+
+func BenchmarkMessageParse(b *testing.B) {
+	var m Message
+	for i := 0; i < b.N; i++ {
+		_ = m.Parse(sampleResponse)
+	}
+}
+
+func TestImpls(t *testing.T) {
+	impls := Impls()
+	hasC := false
+	for _, name := range impls {
+		hasC = hasC || name == "c"
+	}
+	if !hasC {
+		t.Fatalf("Impls() = %v, want c among them", impls)
+	}
+	prev := ActiveImpl()
+	defer SelectImpl(prev)
+
+	for _, name := range impls {
+		if err := SelectImpl(name); err != nil {
+			t.Fatalf("SelectImpl(%q): %v", name, err)
+		}
+		if ActiveImpl() != name {
+			t.Errorf("ActiveImpl() = %q, want %q", ActiveImpl(), name)
+		}
+		q, _, err := ParseQuestion(sampleQuery, 12)
+		if err != nil || q.Name != "www.example.com" {
+			t.Errorf("%s: ParseQuestion = %v, %v", name, q, err)
+		}
+	}
+	if err := SelectImpl("no-such-impl"); err != ErrImpl {
+		t.Errorf("SelectImpl(bogus) = %v, want ErrImpl", err)
+	}
+}
+
+// asmName is a question at off in packet.
+type asmName struct {
+	packet []byte
+	off    int
+}
+
+// asmNames returns questions whose names loop, run past the 127-hop and
+// 255-byte limits or use reserved label types, followed by the random
+// names of the console's implementation test.
+func asmNames() []asmName {
+	hdr := make([]byte, 12)
+	q := func(name ...byte) asmName {
+		return asmName{append(append(append([]byte{}, hdr...), name...), 0, 1, 0, 1), 12}
+	}
+	names := []asmName{
+		q(0xc0, 0x0c),         // Points at itself
+		q(1, 'a', 0xc0, 0x0c), // a -> a -> ...
+		q(0x40, 'a', 'b', 'c', 0),
+		q(0x80, 'a', 'b', 'c', 0),
+		q(3, 'a', 'b'),
+	}
+	for _, hops := range []int{126, 127, 128} {
+		// The root at 12, then pointers that each name the one before
+		p := append(append([]byte{}, hdr...), 0)
+		prev := 12
+		for h := 0; h < hops; h++ {
+			p = append(p, 0xc0|byte(prev>>8), byte(prev))
+			prev = len(p) - 2
+		}
+		names = append(names, asmName{append(p, 0, 1, 0, 1), prev})
+	}
+	for want := 254; want <= 257; want++ {
+		var name []byte
+		for len(name)+2 < want {
+			l := want - len(name) - 2
+			if l > 63 {
+				l = 63
+			}
+			name = append(name, byte(l))
+			for i := 0; i < l; i++ {
+				name = append(name, 'x')
+			}
+		}
+		names = append(names, q(append(name, 0)...))
+	}
+
+	seed := uint32(0x2545f491)
+	next := func() uint32 {
+		seed ^= seed << 13
+		seed ^= seed >> 17
+		seed ^= seed << 5
+		return seed
+	}
+	for i := 0; i < 5000; i++ {
+		p := make([]byte, 12+seed%300)
+		for j := range p {
+			p[j] = byte(next())
+		}
+		for pos := 12; pos < len(p); {
+			x := next()
+			l := byte(x % 64)
+			if x%11 == 0 {
+				p[pos] = 0xc0
+				break
+			}
+			p[pos] = l
+			if x%7 == 0 {
+				p[pos] = 0
+			}
+			if p[pos] == 0 {
+				break
+			}
+			pos += 1 + int(l)
+		}
+		names = append(names, asmName{p, 12})
+	}
+	return names
+}
+
+func TestAsmImpl(t *testing.T) {
+	prev := ActiveImpl()
+	defer SelectImpl(prev)
+	if err := SelectImpl("asm"); err != nil {
+		t.Skip("built without USE_ASM=1")
+	}
+
+	for i, n := range asmNames() {
+		SelectImpl("c")
+		want, wantNext, wantErr := ParseQuestion(n.packet, n.off)
+		SelectImpl("asm")
+		got, gotNext, gotErr := ParseQuestion(n.packet, n.off)
+		if gotErr != wantErr || gotNext != wantNext ||
+			(wantErr == nil && *got != *want) {
+			t.Errorf("name %d (% x at %d): asm = %v, %d, %v; c = %v, %d, %v",
+				i, n.packet, n.off, got, gotNext, gotErr, want, wantNext, wantErr)
+		}
+	}
+}
+
+// SipHash-1-3 test key 00..0f
+var testHashKey = HashKey{K0: 0x0706050403020100, K1: 0x0f0e0d0c0b0a0908}
+
+func TestQueryHash(t *testing.T) {
+	h, off, err := QueryHash(sampleQuery, 12, 0, testHashKey)
+	if err != nil {
+		t.Fatalf("QueryHash failed: %v", err)
+	}
+	if h != 0x7aededfcb247961e || off != len(sampleQuery) {
+		t.Errorf("QueryHash = %016x, %d", h, off)
+	}
+
+	mixed := append([]byte(nil), sampleQuery...)
+	mixed[13], mixed[17] = 'W', 'E'
+	q, hm, _, err := ParseQuestionKeyed(mixed, 12, 0, testHashKey)
+	if err != nil || hm != h || q.Name != "www.example.com" {
+		t.Errorf("ParseQuestionKeyed = %v, %016x, %v", q, hm, err)
+	}
+	if hn := HashName(mixed[12:29], TypeA, ClassIN, 0, testHashKey); hn != h {
+		t.Errorf("HashName = %016x, want %016x", hn, h)
+	}
+
+	if hd, _, _ := QueryHash(sampleQuery, 12, HashDO, testHashKey); hd == h {
+		t.Error("DO bit did not change the hash")
+	}
+	if hk, _, _ := QueryHash(sampleQuery, 12, 0, HashKey{K0: 1}); hk == h {
+		t.Error("key did not change the hash")
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		QueryHash(sampleQuery, 12, 0, testHashKey)
+	})
+	if allocs != 0 {
+		t.Errorf("QueryHash allocates %.0f times", allocs)
+	}
+}
+
+func BenchmarkQueryHash(b *testing.B) {
+	for i := 0; i < b.N; i++ {
+		QueryHash(sampleQuery, 12, 0, testHashKey)
+	}
+}
+
+func TestParseEDNS(t *testing.T) {
+	// sampleQuery with an A record ahead of OPT in the additional section
+	pkt := append([]byte(nil), sampleQuery...)
+	pkt[11] = 2
+	pkt = append(pkt,
+		0x01, 'k', 0x00, 0x00, 0x01, 0x00, 0x01,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 10, 0, 0, 1,
+		0x00, 0x00, 0x29, 0x04, 0xd0, // . OPT 1232
+		0x00, 0x00, 0x80, 0x00, 0x00, 0x10, // DO, rdlength 16
+		0x00, 0x0a, 0x00, 0x08, 1, 2, 3, 4, 5, 6, 7, 8,
+		0x00, 0x0b, 0x00, 0x00,
+	)
+
+	var e EDNS
+	if err := ParseEDNS(pkt, len(sampleQuery), &e); err != nil {
+		t.Fatalf("ParseEDNS failed: %v", err)
+	}
+	if !e.Present || e.UDPSize != 1232 || !e.DO || e.Options != 2 || e.RROff != 50 {
+		t.Errorf("ParseEDNS = %+v", e)
+	}
+	if c := e.Cookie(pkt); len(c) != 8 || c[0] != 1 || c[7] != 8 {
+		t.Errorf("Cookie = %v", c)
+	}
+	if k := e.Keepalive(pkt); k == nil || len(k) != 0 {
+		t.Errorf("Keepalive = %v, want empty non-nil", k)
+	}
+	if e.ECS(pkt) != nil || e.Padding(pkt) != nil {
+		t.Error("absent options should be nil")
+	}
+
+	if err := ParseEDNS(sampleQuery, len(sampleQuery), &e); err != nil || e.Present {
+		t.Errorf("plain query: Present=%v err=%v", e.Present, err)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		ParseEDNS(pkt, len(sampleQuery), &e)
+	})
+	if allocs != 0 {
+		t.Errorf("ParseEDNS allocates %.0f times", allocs)
+	}
+}
+
+func TestClassifyQuery(t *testing.T) {
+	var c QueryClass
+
+	ClassifyQuery(sampleQuery, &c)
+	if c.Verdict != ClassFast || c.ID != 0x1234 || c.QType != TypeA ||
+		c.QNameLen != 17 || c.End != len(sampleQuery) || c.Err != nil {
+		t.Errorf("plain query: %+v", c)
+	}
+
+	ClassifyQuery(sampleResponse, &c)
+	if c.Action() != ClassDrop || c.Verdict&ClassResponse == 0 {
+		t.Errorf("response: verdict %#x", c.Verdict)
+	}
+
+	bad := append([]byte(nil), sampleQuery...)
+	bad[5] = 2 // QDCOUNT=2, one question
+	ClassifyQuery(bad, &c)
+	if c.Action() != ClassFormErr || c.Err != ErrShort {
+		t.Errorf("truncated question: verdict %#x err %v", c.Verdict, c.Err)
+	}
+
+	trailing := append(append([]byte(nil), sampleQuery...), 0)
+	ClassifyQuery(trailing, &c)
+	if c.Action() != ClassSlow || c.Verdict&ClassTrailing == 0 {
+		t.Errorf("trailing byte: verdict %#x", c.Verdict)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		ClassifyQuery(sampleQuery, &c)
+	})
+	if allocs != 0 {
+		t.Errorf("ClassifyQuery allocates %.0f times", allocs)
+	}
+}
+
+// example.com MX response: MX, A, AAAA, TXT, SOA, SRV, DS, RRSIG, CNAME
+var rdataResponse = []byte{
+	0xbe, 0xef, 0x81, 0x80, 0x00, 0x01, 0x00, 0x09, 0x00, 0x00, 0x00, 0x00,
+	0x07, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d,
+	0x00, 0x00, 0x0f, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x0f, 0x00, 0x01, 0x00,
+	0x00, 0x01, 0x2c, 0x00, 0x04, 0x00, 0x0a, 0xc0, 0x0c, 0xc0, 0x0c, 0x00,
+	0x01, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x04, 0xc0, 0x00, 0x02,
+	0x01, 0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00,
+	0x10, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x01, 0xc0, 0x0c, 0x00, 0x10, 0x00, 0x01, 0x00,
+	0x00, 0x01, 0x2c, 0x00, 0x0c, 0x05, 0x68, 0x65, 0x6c, 0x6c, 0x6f, 0x05,
+	0x77, 0x6f, 0x72, 0x6c, 0x64, 0xc0, 0x0c, 0x00, 0x06, 0x00, 0x01, 0x00,
+	0x00, 0x01, 0x2c, 0x00, 0x27, 0x03, 0x6e, 0x73, 0x31, 0xc0, 0x0c, 0x0a,
+	0x68, 0x6f, 0x73, 0x74, 0x6d, 0x61, 0x73, 0x74, 0x65, 0x72, 0xc0, 0x0c,
+	0x78, 0xa3, 0xf1, 0x75, 0x00, 0x00, 0x1c, 0x20, 0x00, 0x00, 0x0e, 0x10,
+	0x00, 0x12, 0x75, 0x00, 0x00, 0x00, 0x01, 0x2c, 0xc0, 0x0c, 0x00, 0x21,
+	0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x0c, 0x00, 0x01, 0x00, 0x02,
+	0x01, 0xbb, 0x03, 0x77, 0x77, 0x77, 0xc0, 0x0c, 0xc0, 0x0c, 0x00, 0x2b,
+	0x00, 0x01, 0x00, 0x00, 0x01, 0x2c, 0x00, 0x08, 0x30, 0x39, 0x08, 0x02,
+	0xde, 0xad, 0xbe, 0xef, 0xc0, 0x0c, 0x00, 0x2e, 0x00, 0x01, 0x00, 0x00,
+	0x01, 0x2c, 0x00, 0x23, 0x00, 0x01, 0x08, 0x02, 0x00, 0x00, 0x0e, 0x10,
+	0x65, 0x53, 0xf1, 0x00, 0x64, 0xbb, 0x5a, 0x80, 0x30, 0x39, 0x07, 0x65,
+	0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x03, 0x63, 0x6f, 0x6d, 0x00, 0x01,
+	0x02, 0x03, 0x04, 0xc0, 0x0c, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x01,
+	0x2c, 0x00, 0x06, 0x03, 0x77, 0x77, 0x77, 0xc0, 0x0c,
+}
+
+func TestRData(t *testing.T) {
+	var m Message
+	if err := m.Parse(rdataResponse); err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+	an := m.Section(SectionAnswer)
+	if len(an) != 9 {
+		t.Fatalf("answers = %d, want 9", len(an))
+	}
+
+	var mx MX
+	if err := an[0].MX(rdataResponse, &mx); err != nil || mx.Preference != 10 ||
+		mx.Exchange.String() != "example.com" {
+		t.Errorf("MX = %d %q, %v", mx.Preference, mx.Exchange.String(), err)
+	}
+	if a, err := an[1].A(rdataResponse); err != nil || a.String() != "192.0.2.1" {
+		t.Errorf("A = %v, %v", a, err)
+	}
+	if a, err := an[2].AAAA(rdataResponse); err != nil || a.String() != "2001:db8::1" {
+		t.Errorf("AAAA = %v, %v", a, err)
+	}
+	if _, err := an[2].A(rdataResponse); err != ErrRData {
+		t.Errorf("A on AAAA RDATA: %v, want ErrRData", err)
+	}
+
+	it := an[3].Iter(rdataResponse)
+	var txt []string
+	for s, ok := it.NextString(); ok; s, ok = it.NextString() {
+		txt = append(txt, string(s))
+	}
+	if it.Err() != nil || len(txt) != 2 || txt[0] != "hello" || txt[1] != "world" {
+		t.Errorf("TXT = %q, %v", txt, it.Err())
+	}
+
+	var soa SOA
+	if err := an[4].SOA(rdataResponse, &soa); err != nil || soa.MName.String() != "ns1.example.com" ||
+		soa.RName.String() != "hostmaster.example.com" || soa.Minimum != 300 {
+		t.Errorf("SOA = %q %q %d, %v", soa.MName.String(), soa.RName.String(), soa.Minimum, err)
+	}
+
+	var sig RRSIG
+	if err := an[7].RRSIG(rdataResponse, &sig); err != nil || sig.TypeCovered != TypeA ||
+		sig.KeyTag != 12345 || sig.Signer.String() != "example.com" || len(sig.Signature) != 4 {
+		t.Errorf("RRSIG = %+v, %v", sig, err)
+	}
+
+	var target WireName
+	if err := an[8].Target(rdataResponse, &target); err != nil || target.String() != "www.example.com" {
+		t.Errorf("CNAME = %q, %v", target.String(), err)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		an[4].SOA(rdataResponse, &soa)
+		an[1].A(rdataResponse)
+	})
+	if allocs != 0 {
+		t.Errorf("RDATA decoding allocates %.0f times", allocs)
+	}
+}
+
+func TestWriter(t *testing.T) {
+	www := []byte("\x03www\x07example\x03com\x00")
+	example := www[4:]
+	mail := []byte("\x04mail\x07example\x03com\x00")
+
+	var src Message
+	if err := src.Parse(rdataResponse); err != nil {
+		t.Fatalf("Parse failed: %v", err)
+	}
+	var soa SOA
+	if err := src.Section(SectionAnswer)[4].SOA(rdataResponse, &soa); err != nil {
+		t.Fatalf("SOA: %v", err)
+	}
+
+	w := NewWriter()
+	defer w.Free()
+	w.Reset(512)
+	steps := []error{
+		w.Header(0xbeef, FlagQR|FlagRD|FlagRA),
+		w.Question(www, TypeA, ClassIN),
+		w.Target(www, TypeCNAME, 300, []byte("\x03WEB\x07Example\x03COM\x00")),
+		w.A(www, 300, netip.MustParseAddr("192.0.2.1")),
+		w.AAAA(www, 300, netip.MustParseAddr("2001:db8::1")),
+		w.MX(example, 300, 10, mail),
+		w.TXT(example, 300, []byte("hello")),
+		w.Section(SectionAuthority),
+		w.SOA(example, 300, &soa),
+		w.OPT(1232, 0, 0, 0x8000, nil),
+	}
+	for i, err := range steps {
+		if err != nil {
+			t.Fatalf("step %d: %v", i, err)
+		}
+	}
+	if err := w.Question(www, TypeA, ClassIN); err != ErrOverflow {
+		t.Errorf("Question after answers: %v, want ErrOverflow", err)
+	}
+	out := w.Finish()
+
+	var m Message
+	if err := m.Parse(out); err != nil {
+		t.Fatalf("Parse written message: %v", err)
+	}
+	an := m.Section(SectionAnswer)
+	if len(an) != 5 || len(m.Section(SectionAuthority)) != 1 || len(m.Section(SectionAdditional)) != 1 {
+		t.Fatalf("sections = %d/%d/%d", len(an), len(m.Section(SectionAuthority)),
+			len(m.Section(SectionAdditional)))
+	}
+	if name, _ := an[0].Name(out); name != "www.example.com" || out[an[0].NameOff] != 0xc0 {
+		t.Errorf("CNAME owner = %q, not compressed", name)
+	}
+	// The target's suffix points at the question's example.com
+	var target WireName
+	if err := an[0].Target(out, &target); err != nil || target.String() != "WEB.example.com" {
+		t.Errorf("CNAME = %q, %v", target.String(), err)
+	}
+	if a, err := an[2].AAAA(out); err != nil || a.String() != "2001:db8::1" {
+		t.Errorf("AAAA = %v, %v", a, err)
+	}
+	var mx MX
+	if err := an[3].MX(out, &mx); err != nil || mx.Exchange.String() != "mail.example.com" {
+		t.Errorf("MX = %q, %v", mx.Exchange.String(), err)
+	}
+	var soa2 SOA
+	if err := m.Section(SectionAuthority)[0].SOA(out, &soa2); err != nil ||
+		soa2.RName.String() != "hostmaster.example.com" || soa2.Serial != soa.Serial {
+		t.Errorf("SOA = %q %d, %v", soa2.RName.String(), soa2.Serial, err)
+	}
+
+	// A record past the limit is dropped and the message stays valid
+	w.Reset(50)
+	w.Header(1, FlagQR)
+	w.Question(www, TypeA, ClassIN)
+	if err := w.A(www, 60, netip.MustParseAddr("192.0.2.1")); err != nil {
+		t.Fatalf("A: %v", err)
+	}
+	if err := w.A(mail, 60, netip.MustParseAddr("192.0.2.2")); err != ErrSpace {
+		t.Errorf("A past limit: %v, want ErrSpace", err)
+	}
+	if out := w.Finish(); len(out) != 49 || out[7] != 1 {
+		t.Errorf("truncated message = %d bytes, ANCOUNT %d", len(out), out[7])
+	}
+
+	addr := netip.MustParseAddr("192.0.2.1")
+	allocs := testing.AllocsPerRun(100, func() {
+		w.Reset(512)
+		w.Header(1, FlagQR)
+		w.Question(www, TypeA, ClassIN)
+		w.A(www, 60, addr)
+		w.Finish()
+	})
+	if allocs != 0 {
+		t.Errorf("Writer allocates %.0f times", allocs)
+	}
+}
+
+func TestAgeAndPatch(t *testing.T) {
+	www := []byte("\x03www\x07example\x03com\x00")
+	w := NewWriter()
+	defer w.Free()
+	w.Reset(512)
+	w.Header(0xbeef, FlagQR|FlagRD|FlagRA)
+	w.Question(www, TypeA, ClassIN)
+	w.A(www, 300, netip.MustParseAddr("192.0.2.1"))
+	w.OPT(1232, 0, 0, 0x8000, nil)
+	resp := append([]byte(nil), w.Finish()...)
+
+	w.Reset(512)
+	w.Header(0x1234, FlagRD)
+	w.Question([]byte("\x03WwW\x07eXaMpLe\x03CoM\x00"), TypeA, ClassIN)
+	query := append([]byte(nil), w.Finish()...)
+
+	if err := AgeTTLs(resp, 100, 30); err != nil {
+		t.Fatalf("AgeTTLs: %v", err)
+	}
+	if err := PatchResponse(resp, query); err != nil {
+		t.Fatalf("PatchResponse: %v", err)
+	}
+
+	var m Message
+	if err := m.Parse(resp); err != nil {
+		t.Fatalf("Parse: %v", err)
+	}
+	an, ar := m.Section(SectionAnswer), m.Section(SectionAdditional)
+	if ttl := an[0].TTL(resp); ttl != 200 {
+		t.Errorf("aged TTL = %d, want 200", ttl)
+	}
+	if flags := ar[0].TTL(resp); flags != 0x8000 {
+		t.Errorf("OPT TTL field = %#x, want untouched", flags)
+	}
+	if name, _ := an[0].Name(resp); resp[0] != 0x12 || resp[1] != 0x34 || name != "WwW.eXaMpLe.CoM" {
+		t.Errorf("patched ID %#x%02x name %q", resp[0], resp[1], name)
+	}
+
+	query[13] = 'x'
+	if err := PatchResponse(resp, query); err != ErrName {
+		t.Errorf("PatchResponse with other name: %v, want ErrName", err)
+	}
+}
+
+func TestTruncate(t *testing.T) {
+	www := []byte("\x03www\x07example\x03com\x00")
+	w := NewWriter()
+	defer w.Free()
+	w.Reset(512)
+	w.Header(1, FlagQR)
+	w.Question(www, TypeA, ClassIN)
+	for i := 0; i < 3; i++ {
+		w.A(www, 300, netip.MustParseAddr("192.0.2.1"))
+	}
+	aaaaAt := w.Len()
+	w.AAAA(www, 300, netip.MustParseAddr("2001:db8::1"))
+	w.OPT(1232, 0, 0, 0, nil)
+	msg := append([]byte(nil), w.Finish()...)
+
+	if out, err := Truncate(msg, len(msg)); err != nil || len(out) != len(msg) {
+		t.Fatalf("Truncate at full size = %d, %v", len(out), err)
+	}
+	out, err := Truncate(msg, len(msg)-1)
+	if err != nil || len(out) != aaaaAt+11 {
+		t.Fatalf("Truncate = %d bytes, %v; want %d", len(out), err, aaaaAt+11)
+	}
+	h, _ := ParseHeader(out)
+	if !h.TC || h.ANCount != 3 || h.ARCount != 1 {
+		t.Errorf("header after truncation = %+v", h)
+	}
+	var e EDNS
+	if err := ParseEDNS(out, 33, &e); err != nil || !e.Present || e.UDPSize != 1232 {
+		t.Errorf("OPT after truncation: %+v, %v", e, err)
+	}
+	if _, err := Truncate(msg, 20); err != ErrSpace {
+		t.Errorf("Truncate below question size: %v, want ErrSpace", err)
+	}
+}
+
+func TestReply(t *testing.T) {
+	www := []byte("\x03wWw\x07example\x03com\x00")
+	w := NewWriter()
+	defer w.Free()
+	w.Reset(512)
+	w.Header(0xbeef, FlagRD|FlagCD)
+	w.Question(www, TypeA, ClassIN)
+	w.OPT(4096, 0, 0, 0x8000, nil)
+	req := append([]byte(nil), w.Finish()...)
+
+	var qc QueryClass
+	ClassifyQuery(req, &qc)
+	buf := make([]byte, ReplyBufSize)
+	out, err := Reply(buf, req, &qc, RCodeServFail, 0)
+	if err != nil || len(out) != len(req) {
+		t.Fatalf("Reply = %d bytes, %v; want %d", len(out), err, len(req))
+	}
+	h, _ := ParseHeader(out)
+	if h.ID != 0xbeef || !h.QR || !h.RD || h.RCode != RCodeServFail || h.QDCount != 1 || h.ARCount != 1 {
+		t.Errorf("reply header = %+v", h)
+	}
+	var e EDNS
+	if err := ParseEDNS(out, 33, &e); err != nil || !e.Present || !e.DO || e.UDPSize != 1232 {
+		t.Errorf("reply OPT = %+v, %v", e, err)
+	}
+
+	// Slip without a classification
+	out, err = Reply(buf, req[:33], nil, RCodeNoError, FlagTC)
+	if h, _ = ParseHeader(out); err != nil || len(out) != 33 || !h.TC || h.ARCount != 0 {
+		t.Errorf("slip = %d bytes, %+v, %v", len(out), h, err)
+	}
+	if _, err := Reply(buf[:20], req, &qc, RCodeFormErr, 0); err != ErrSpace {
+		t.Errorf("Reply into short buffer: %v, want ErrSpace", err)
+	}
+
+	// RFC 6891 7: the FORMERR for a second OPT carries none
+	dup := append(append([]byte(nil), req...), req[33:]...)
+	dup[11] = 2
+	ClassifyQuery(dup, &qc)
+	if qc.Action() != ClassFormErr || qc.Verdict&ClassBadOPT == 0 || qc.EDNS.Present {
+		t.Errorf("duplicate OPT classified %#x, EDNS %+v", qc.Verdict, qc.EDNS)
+	}
+	out, err = Reply(buf, dup, &qc, RCodeFormErr, 0)
+	if h, _ = ParseHeader(out); err != nil || len(out) != 33 || h.ARCount != 0 {
+		t.Errorf("duplicate OPT reply = %d bytes, %+v, %v", len(out), h, err)
+	}
+	ClassifyQuery(req, &qc)
+
+	allocs := testing.AllocsPerRun(100, func() {
+		Reply(buf, req, &qc, RCodeRefused, 0)
+	})
+	if allocs != 0 {
+		t.Errorf("Reply allocates %.0f times", allocs)
+	}
+}
+
+func TestNameCompare(t *testing.T) {
+	// RFC 4034 6.1, in canonical order
+	want := [][]byte{
+		[]byte("\x07example\x00"),
+		[]byte("\x01a\x07example\x00"),
+		[]byte("\x08yljkjljk\x01a\x07example\x00"),
+		[]byte("\x01Z\x01a\x07example\x00"),
+		[]byte("\x04zABC\x01a\x07EXAMPLE\x00"),
+		[]byte("\x01z\x07example\x00"),
+		[]byte("\x01\x01\x01z\x07example\x00"),
+		[]byte("\x01*\x01z\x07example\x00"),
+		[]byte("\x01\xc8\x01z\x07example\x00"),
+	}
+	got := [][]byte{want[5], want[8], want[0], want[3], want[7], want[1], want[6], want[2], want[4]}
+	sort.Slice(got, func(i, j int) bool { return NameCompare(got[i], got[j]) < 0 })
+	for i := range want {
+		if string(got[i]) != string(want[i]) {
+			t.Fatalf("position %d: got %q, want %q", i, got[i], want[i])
+		}
+	}
+
+	a := []byte("\x03WWW\x07Example\x03COM\x00")
+	b := []byte("\x03www\x07example\x03com\x00")
+	if !NameEqual(a, b) || NameCompare(a, b) != 0 {
+		t.Errorf("case-only difference: equal=%v compare=%d", NameEqual(a, b), NameCompare(a, b))
+	}
+	if NameEqual(a, b[:len(b)-1]) || NameEqual(a, []byte("\x03wwx\x07example\x03com\x00")) {
+		t.Error("NameEqual matched different names")
+	}
+}
+
+func TestNameSet(t *testing.T) {
+	var names []byte
+	for _, n := range []string{"\x03www\x07example\x03com\x00", "\x04mail\x07example\x03com\x00",
+		"\x03WWW\x07EXAMPLE\x03com\x00", "\x00"} {
+		names = append(names, n...)
+	}
+	key := HashKey{K0: 1, K1: 2}
+	s, err := BuildNameSet(names, key)
+	if err != nil || s.Len() != 3 {
+		t.Fatalf("BuildNameSet = %v, %v; want 3 names", s, err)
+	}
+	if !s.Contains([]byte("\x03Www\x07example\x03COM\x00")) || !s.Contains([]byte("\x00")) ||
+		s.Contains([]byte("\x03ftp\x07example\x03com\x00")) {
+		t.Error("Contains gave a wrong answer")
+	}
+
+	// Round trip through a misaligned copy
+	raw := append(make([]byte, 1), s.Bytes()...)[1:]
+	o, err := OpenNameSet(raw)
+	if err != nil || o.Len() != 3 || !o.Contains([]byte("\x04MAIL\x07example\x03com\x00")) {
+		t.Errorf("OpenNameSet = %v, %v", o, err)
+	}
+	raw[0] ^= 0xff
+	if _, err := OpenNameSet(raw); err != ErrFormat {
+		t.Errorf("OpenNameSet on a bad magic: %v, want ErrFormat", err)
+	}
+	if _, err := BuildNameSet([]byte("\x03www\xc0\x0c"), key); err != ErrName {
+		t.Errorf("BuildNameSet on a compressed name: %v, want ErrName", err)
+	}
+
+	q := []byte("\x03www\x07example\x03com\x00")
+	if allocs := testing.AllocsPerRun(100, func() { s.Contains(q) }); allocs != 0 {
+		t.Errorf("Contains allocates %.0f times", allocs)
+	}
+}
+
+func TestSuffixTrie(t *testing.T) {
+	names := [][]byte{
+		[]byte("\x07example\x03com\x00"),
+		[]byte("\x03com\x00"),
+		[]byte("\x03sub\x07EXAMPLE\x03com\x00"),
+		[]byte("\x07example\x03net\x00"),
+	}
+	tr, err := BuildSuffixTrie(names, nil)
+	if err != nil || tr.Len() != 4 {
+		t.Fatalf("BuildSuffixTrie = %v, %v; want 4 names", tr, err)
+	}
+	for _, c := range []struct {
+		name  string
+		value uint32
+		off   int
+		ok    bool
+	}{
+		{"\x03www\x03sub\x07example\x03com\x00", 2, 4, true},
+		{"\x03WWW\x07Example\x03COM\x00", 0, 4, true},
+		{"\x03com\x00", 1, 0, true},
+		{"\x03www\x07example\x03net\x00", 3, 4, true},
+		{"\x03net\x00", 0, 0, false},
+		{"\x03org\x00", 0, 0, false},
+		{"\x03www\x07example\x03com", 0, 0, false},
+	} {
+		v, off, ok := tr.Match([]byte(c.name))
+		if v != c.value || off != c.off || ok != c.ok {
+			t.Errorf("Match(%q) = %d, %d, %v; want %d, %d, %v", c.name, v, off, ok, c.value, c.off, c.ok)
+		}
+	}
+
+	// Later duplicates win; a misaligned copy opens
+	tr, err = BuildSuffixTrie(append(names, []byte("\x03COM\x00")), []uint32{10, 11, 12, 13, 14})
+	if err != nil {
+		t.Fatal(err)
+	}
+	raw := append(make([]byte, 1), tr.Bytes()...)[1:]
+	o, err := OpenSuffixTrie(raw)
+	if err != nil {
+		t.Fatalf("OpenSuffixTrie: %v", err)
+	}
+	if v, off, ok := o.Match([]byte("\x03foo\x03com\x00")); v != 14 || off != 4 || !ok {
+		t.Errorf("Match after open = %d, %d, %v; want 14, 4, true", v, off, ok)
+	}
+	raw[0] ^= 0xff
+	if _, err := OpenSuffixTrie(raw); err != ErrFormat {
+		t.Errorf("OpenSuffixTrie on a bad magic: %v, want ErrFormat", err)
+	}
+	if _, err := BuildSuffixTrie([][]byte{[]byte("\x03com\x00\x03net\x00")}, nil); err != ErrName {
+		t.Errorf("BuildSuffixTrie on two names in one: %v, want ErrName", err)
+	}
+
+	q := []byte("\x03www\x03sub\x07example\x03com\x00")
+	if allocs := testing.AllocsPerRun(100, func() { tr.Match(q) }); allocs != 0 {
+		t.Errorf("Match allocates %.0f times", allocs)
+	}
+}
+
+func TestNameFilter(t *testing.T) {
+	f, err := NewNameFilter(2, HashKey{K0: 3, K1: 4})
+	if err != nil {
+		t.Fatal(err)
+	}
+	for _, n := range []string{"\x03bad\x07example\x03com\x00", "\x04evil\x03net\x00"} {
+		if err := f.Add([]byte(n)); err != nil {
+			t.Fatalf("Add(%q): %v", n, err)
+		}
+	}
+	if err := f.Add([]byte("\x03one\x03too\x04many\x00")); err != ErrSpace {
+		t.Errorf("Add past capacity: %v, want ErrSpace", err)
+	}
+	if err := f.Add([]byte("\x03www\xc0\x0c")); err != ErrName {
+		t.Errorf("Add of a compressed name: %v, want ErrName", err)
+	}
+	if f.Len() != 2 || f.Cap() != 2 {
+		t.Errorf("Len, Cap = %d, %d; want 2, 2", f.Len(), f.Cap())
+	}
+
+	// Members and names below them always hit
+	for _, c := range []struct {
+		name string
+		off  int
+	}{
+		{"\x03BAD\x07example\x03com\x00", 0},
+		{"\x01a\x01b\x03bad\x07Example\x03com\x00", 4},
+		{"\x03www\x04EVIL\x03net\x00", 4},
+	} {
+		if off, ok := f.Match([]byte(c.name)); !ok || off > c.off {
+			t.Errorf("Match(%q) = %d, %v; want a hit at or before %d", c.name, off, ok, c.off)
+		}
+	}
+	if _, ok := f.Match([]byte("\x03www\x07example\x03com")); ok {
+		t.Error("Match hit a name without its root label")
+	}
+
+	raw := append(make([]byte, 1), f.Bytes()...)[1:]
+	o, err := OpenNameFilter(raw)
+	if err != nil || o.Len() != 2 {
+		t.Fatalf("OpenNameFilter = %v, %v", o, err)
+	}
+	if _, ok := o.Match([]byte("\x04evil\x03net\x00")); !ok {
+		t.Error("Match after open missed a member")
+	}
+	raw[0] ^= 0xff
+	if _, err := OpenNameFilter(raw); err != ErrFormat {
+		t.Errorf("OpenNameFilter on a bad magic: %v, want ErrFormat", err)
+	}
+
+	q := []byte("\x03www\x07example\x03org\x00")
+	if allocs := testing.AllocsPerRun(100, func() { f.Match(q) }); allocs != 0 {
+		t.Errorf("Match allocates %.0f times", allocs)
+	}
+}
+
+func TestPrefixTable(t *testing.T) {
+	var prefixes []netip.Prefix
+	for _, s := range []string{"0.0.0.0/0", "10.0.0.0/8", "10.1.2.0/24", "2001:db8::/32", "::ffff:192.168.0.0/112"} {
+		prefixes = append(prefixes, netip.MustParsePrefix(s))
+	}
+	_, n, _ := net.ParseCIDR("10.1.2.3/32")
+	p, ok := PrefixFromIPNet(n)
+	if !ok || p.String() != "10.1.2.3/32" {
+		t.Fatalf("PrefixFromIPNet(%v) = %v, %v", n, p, ok)
+	}
+	prefixes = append(prefixes, p)
+	tab, err := BuildPrefixTable(prefixes, []uint32{1, 2, 3, 4, 5, 6})
+	if err != nil {
+		t.Fatal(err)
+	}
+	if tab.Len() != 6 {
+		t.Errorf("Len = %d, want 6", tab.Len())
+	}
+
+	for _, c := range []struct {
+		addr  string
+		value uint32
+		ok    bool
+	}{
+		{"10.1.2.3", 6, true},
+		{"10.1.2.4", 3, true},
+		{"10.200.0.1", 2, true},
+		{"8.8.8.8", 1, true},
+		{"::ffff:10.1.2.4", 3, true},
+		{"192.168.9.9", 5, true},
+		{"2001:db8::53", 4, true},
+		{"2001:db9::53", 0, false},
+	} {
+		addr := netip.MustParseAddr(c.addr)
+		if v, ok := tab.Lookup(addr); v != c.value || ok != c.ok {
+			t.Errorf("Lookup(%s) = %d, %v; want %d, %v", c.addr, v, ok, c.value, c.ok)
+		}
+		if v, ok := tab.LookupIP(net.ParseIP(c.addr)); v != c.value || ok != c.ok {
+			t.Errorf("LookupIP(%s) = %d, %v; want %d, %v", c.addr, v, ok, c.value, c.ok)
+		}
+	}
+	if _, ok := tab.LookupIP(net.IP{1, 2, 3}); ok {
+		t.Error("LookupIP matched a 3-byte address")
+	}
+
+	if _, err := BuildPrefixTable(prefixes[:1], []uint32{1 << 31}); err != ErrFormat {
+		t.Errorf("BuildPrefixTable with a value out of range: %v, want ErrFormat", err)
+	}
+	if _, ok := PrefixFromIPNet(&net.IPNet{IP: net.IPv4(10, 0, 0, 0), Mask: net.IPMask{255, 0, 255, 0}}); ok {
+		t.Error("PrefixFromIPNet accepted a non-contiguous mask")
+	}
+
+	raw := append(make([]byte, 1), tab.Bytes()...)[1:]
+	o, err := OpenPrefixTable(raw)
+	if err != nil || o.Len() != 6 {
+		t.Fatalf("OpenPrefixTable = %v, %v", o, err)
+	}
+	if v, _ := o.Lookup(netip.MustParseAddr("10.1.2.3")); v != 6 {
+		t.Errorf("Lookup after open = %d, want 6", v)
+	}
+	raw[0] ^= 0xff
+	if _, err := OpenPrefixTable(raw); err != ErrFormat {
+		t.Errorf("OpenPrefixTable on a bad magic: %v, want ErrFormat", err)
+	}
+
+	a4, a6, ip := netip.MustParseAddr("10.1.2.3"), netip.MustParseAddr("2001:db8::1"), net.ParseIP("10.1.2.3")
+	if allocs := testing.AllocsPerRun(100, func() {
+		tab.Lookup(a4)
+		tab.Lookup(a6)
+		tab.LookupIP(ip)
+	}); allocs != 0 {
+		t.Errorf("Lookup allocates %.0f times", allocs)
+	}
+}
+
+func TestCookies(t *testing.T) {
+	// RFC 9018 Appendix A.1 and A.2
+	secrets := &CookieSecrets{Current: HashKey{0x3fa4b2a6e573e9e5, 0xcfbf379e84dce748}}
+	client := [8]byte{0x24, 0x64, 0xc4, 0xab, 0xcf, 0x10, 0xc9, 0x57}
+	addr := netip.MustParseAddr("198.51.100.100")
+	want := [16]byte{1, 0, 0, 0, 0x5c, 0xf7, 0x9f, 0x11, 0x1f, 0x81, 0x30, 0xc3, 0xee, 0xe2, 0x94, 0x80}
+	if got := MakeServerCookie(secrets.Current, client, addr, 1559731985); got != want {
+		t.Fatalf("MakeServerCookie = %x, want %x", got, want)
+	}
+	opt := append(client[:], want[:]...)
+	if st, reply := CheckCookie(secrets, opt, netip.MustParseAddr("::ffff:198.51.100.100"), 1559731985+60); st != CookieValid || reply != want {
+		t.Errorf("CheckCookie = %d, %x; want valid echo", st, reply)
+	}
+	renewed := [16]byte{1, 0, 0, 0, 0x5c, 0xf7, 0xa8, 0x71, 0xd4, 0xa5, 0x64, 0xa1, 0x44, 0x2a, 0xca, 0x77}
+	if st, reply := CheckCookie(secrets, opt, addr, 1559734385); st != CookieRenew || reply != renewed {
+		t.Errorf("CheckCookie after 40 minutes = %d, %x; want renewal %x", st, reply, renewed)
+	}
+
+	rotated := &CookieSecrets{Current: HashKey{1, 2}, Previous: secrets.Current, HasPrevious: true}
+	for _, c := range []struct {
+		s      *CookieSecrets
+		option []byte
+		addr   netip.Addr
+		now    uint32
+		want   CookieStatus
+	}{
+		{rotated, opt, addr, 1559731985, CookieRenew},
+		{&CookieSecrets{Current: HashKey{1, 2}}, opt, addr, 1559731985, CookieBad},
+		{secrets, opt, netip.MustParseAddr("198.51.100.101"), 1559731985, CookieBad},
+		{secrets, opt, addr, 1559731985 + 3601, CookieExpired},
+		{secrets, opt[:8], addr, 1559731985, CookieClient},
+		{secrets, opt[:12], addr, 1559731985, CookieFormErr},
+		{secrets, nil, addr, 1559731985, CookieFormErr},
+	} {
+		if st, _ := CheckCookie(c.s, c.option, c.addr, c.now); st != c.want {
+			t.Errorf("CheckCookie(%x, %v, %d) = %d, want %d", c.option, c.addr, c.now, st, c.want)
+		}
+	}
+
+	var b CookieBatch
+	addrs := []netip.Addr{addr, netip.MustParseAddr("2001:db8::53")}
+	for i := 0; i < BatchMax; i++ {
+		a := addrs[i%2]
+		o := append([]byte(nil), client[:]...)
+		o[0] = byte(i)
+		s := MakeServerCookie(rotated.Current, [8]byte(o), a, 1559731985)
+		if i%3 == 0 {
+			s[15] ^= 1
+		}
+		if b.Add(append(o, s[:]...), a) != i {
+			t.Fatalf("Add %d did not queue", i)
+		}
+	}
+	if b.Add(opt, addr) != -1 {
+		t.Error("Add queued past BatchMax")
+	}
+	b.Check(rotated, 1559731985)
+	for i := 0; i < b.Len(); i++ {
+		st, reply := b.Result(i)
+		wantSt, wantReply := CheckCookie(rotated, append([]byte(nil), b.opts[i][:24]...), addrs[i%2], 1559731985)
+		if st != wantSt || reply != wantReply || st.Good() == (i%3 == 0) {
+			t.Errorf("batch %d = %d, %x; single check %d, %x", i, st, reply, wantSt, wantReply)
+		}
+	}
+
+	if allocs := testing.AllocsPerRun(100, func() {
+		CheckCookie(rotated, opt, addr, 1559731985)
+		MakeServerCookie(rotated.Current, client, addr, 1559731985)
+		b.Check(rotated, 1559731985)
+	}); allocs != 0 {
+		t.Errorf("cookie checks allocate %.0f times", allocs)
+	}
+}
+
+func TestStats(t *testing.T) {
+	var before, after Stats
+	ReadStats(&before)
+	if _, _, err := ParseQuestion(sampleQuery, 12); err != nil {
+		t.Fatal(err)
+	}
+	if _, _, err := ParseQuestion(sampleQuery[:20], 12); err != ErrShort {
+		t.Fatalf("cut name: %v", err)
+	}
+	ReadStats(&after)
+
+	if !StatsEnabled() {
+		if after != (Stats{}) {
+			t.Fatal("counters moved in a build without STATS=1")
+		}
+		t.Skip("libdnsasm built without STATS=1")
+	}
+	if after.Threads < 1 {
+		t.Errorf("threads = %d", after.Threads)
+	}
+	if d := after.Names - before.Names; d != 1 {
+		t.Errorf("names +%d, want 1", d)
+	}
+	if d := after.NameLen[1] - before.NameLen[1]; d != 1 {
+		t.Errorf("17-byte names +%d, want 1", d)
+	}
+	if d := after.QType[1] - before.QType[1]; d != 1 {
+		t.Errorf("qtype A +%d, want 1", d)
+	}
+	if d := after.ErrorCount(ErrShort) - before.ErrorCount(ErrShort); d != 1 {
+		t.Errorf("ErrShort +%d, want 1", d)
+	}
+}
+
+func TestIO(t *testing.T) {
+	io, err := OpenIO(netip.MustParseAddrPort("127.0.0.1:0"), IOConfig{Batch: 8, Timeout: time.Second})
+	if err != nil {
+		t.Fatalf("OpenIO: %v", err)
+	}
+	defer io.Close()
+	client, err := net.DialUDP("udp", nil, &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1), Port: io.Port()})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+	from := client.LocalAddr().(*net.UDPAddr).AddrPort()
+
+	for i := 0; i < 3; i++ {
+		client.Write(sampleQuery)
+	}
+	n, err := io.Recv()
+	if err != nil || n != 3 || io.Len() != 3 {
+		t.Fatalf("Recv = %d, %v", n, err)
+	}
+	for i := 0; i < n; i++ {
+		if string(io.Packet(i)) != string(sampleQuery) || io.Peer(i) != from {
+			t.Errorf("datagram %d from %v = %x", i, io.Peer(i), io.Packet(i))
+		}
+		if err := io.Queue(i, sampleResponse); err != nil {
+			t.Fatalf("Queue: %v", err)
+		}
+	}
+	if io.Queue(n, sampleResponse) != ErrFormat || io.Queue(0, make([]byte, 5000)) != ErrSpace {
+		t.Error("Queue accepted a bad slot or an oversized response")
+	}
+	if sent, err := io.Flush(); sent != 3 || err != nil {
+		t.Fatalf("Flush = %d, %v", sent, err)
+	}
+	buf := make([]byte, 512)
+	for i := 0; i < 3; i++ {
+		client.SetReadDeadline(time.Now().Add(time.Second))
+		if m, err := client.Read(buf); err != nil || string(buf[:m]) != string(sampleResponse) {
+			t.Fatalf("reply %d: %x, %v", i, buf[:m], err)
+		}
+	}
+
+	// Steady state: one datagram in, one answer out, nothing allocated
+	allocs := testing.AllocsPerRun(100, func() {
+		client.Write(sampleQuery)
+		if n, _ := io.Recv(); n == 1 {
+			io.Queue(0, io.Packet(0))
+			_ = io.Peer(0)
+		}
+	})
+	if allocs != 0 {
+		t.Errorf("receive and queue allocate %.0f times", allocs)
+	}
+	io.Flush()
+
+	c := io.Counters()
+	if c.Received != 104 || c.RecvCalls != 102 || c.Sent != 104 || c.SendErrors != 0 {
+		t.Errorf("counters %+v", c)
+	}
+
+	done := make(chan error)
+	go func() {
+		for {
+			if _, err := io.Recv(); err != nil {
+				done <- err
+				return
+			}
+		}
+	}()
+	io.Shutdown()
+	if err := <-done; err != ErrIOShutdown {
+		t.Errorf("Recv after Shutdown: %v", err)
+	}
+
+	if _, err := OpenIO(netip.MustParseAddrPort("127.0.0.1:0"), IOConfig{Batch: 65}); err != syscall.EINVAL {
+		t.Errorf("batch of 65: %v", err)
+	}
+}
+
+func TestIOClassifyAnswer(t *testing.T) {
+	io, err := OpenIO(netip.MustParseAddrPort("127.0.0.1:0"), IOConfig{Batch: 8, Timeout: time.Second})
+	if err != nil {
+		t.Fatalf("OpenIO: %v", err)
+	}
+	defer io.Close()
+	client, err := net.DialUDP("udp", nil, &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1), Port: io.Port()})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+
+	upper := append([]byte(nil), sampleQuery...)
+	upper[0], upper[13] = 0x56, 'W'
+	client.Write(upper)
+	client.Write(sampleResponse)
+	client.Write(sampleQuery[:7])
+	if n, err := io.Recv(); n != 3 || err != nil {
+		t.Fatalf("Recv = %d, %v", n, err)
+	}
+
+	var qc [BatchMax]QueryClass
+	var b Batch
+	io.Classify(qc[:], &b)
+	if b.Len() != 3 {
+		t.Fatalf("batch of %d", b.Len())
+	}
+	for i := 0; i < 3; i++ {
+		var want QueryClass
+		ClassifyQuery(io.Packet(i), &want)
+		if qc[i] != want {
+			t.Errorf("datagram %d: %+v, want %+v", i, qc[i], want)
+		}
+	}
+	if b.Err(0) != nil || string(b.QName(io.Packet(0), 0)) != string(upper[12:29]) || b.Err(2) != ErrShort {
+		t.Errorf("batch: %v %q %v", b.Err(0), b.QName(io.Packet(0), 0), b.Err(2))
+	}
+
+	resp := append([]byte(nil), sampleResponse...)
+	if err := io.Answer(0, resp, 512); err != nil {
+		t.Fatalf("Answer: %v", err)
+	}
+	if err := io.Answer(2, append([]byte(nil), sampleResponse...), 512); err != ErrShort {
+		t.Errorf("Answer to a runt: %v", err)
+	}
+	if io.Answer(3, resp, 512) != ErrFormat {
+		t.Error("Answer accepted a bad slot")
+	}
+	if sent, err := io.Flush(); sent != 1 || err != nil {
+		t.Fatalf("Flush = %d, %v", sent, err)
+	}
+	buf := make([]byte, 512)
+	client.SetReadDeadline(time.Now().Add(time.Second))
+	m, err := client.Read(buf)
+	if err != nil || buf[0] != 0x56 || buf[13] != 'W' || m != len(sampleResponse) {
+		t.Fatalf("reply %x, %v", buf[:m], err)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		client.Write(sampleQuery)
+		if n, _ := io.Recv(); n == 1 {
+			io.Classify(qc[:], &b)
+			io.Answer(0, resp, 512)
+		}
+	})
+	if allocs != 0 {
+		t.Errorf("classify and answer allocate %.0f times", allocs)
+	}
+}
+
+func TestIOURing(t *testing.T) {
+	io, err := OpenIO(netip.MustParseAddrPort("127.0.0.1:0"), IOConfig{Batch: 8, Timeout: time.Second, URing: true})
+	if err != nil {
+		t.Fatalf("OpenIO: %v", err)
+	}
+	defer io.Close()
+	t.Logf("backend %s", io.Backend())
+	client, err := net.DialUDP("udp", nil, &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1), Port: io.Port()})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer client.Close()
+	from := client.LocalAddr().(*net.UDPAddr).AddrPort()
+
+	// More than a batch, and more than fit the provided buffers at
+	// once: every one is answered, in order
+	const total = 100
+	go func() {
+		for i := 0; i < total; i++ {
+			q := append([]byte(nil), sampleQuery...)
+			q[1] = byte(i)
+			client.Write(q)
+		}
+	}()
+	buf := make([]byte, 512)
+	for answered := 0; answered < total; {
+		n, err := io.Recv()
+		if err != nil || n == 0 || n > 8 {
+			t.Fatalf("Recv = %d, %v", n, err)
+		}
+		for i := 0; i < n; i++ {
+			if io.Peer(i) != from || len(io.Packet(i)) != len(sampleQuery) {
+				t.Fatalf("datagram from %v = %x", io.Peer(i), io.Packet(i))
+			}
+			io.Queue(i, io.Packet(i))
+		}
+		if sent, err := io.Flush(); sent != n || err != nil {
+			t.Fatalf("Flush = %d, %v", sent, err)
+		}
+		client.SetReadDeadline(time.Now().Add(time.Second))
+		for ; n > 0; n-- {
+			if m, err := client.Read(buf); err != nil || m != len(sampleQuery) || buf[1] != byte(answered) {
+				t.Fatalf("reply %d: %x, %v", answered, buf[:m], err)
+			}
+			answered++
+		}
+	}
+
+	// Without Flush a batch's answers go out with the next Recv and stay
+	// in flight while that batch is answered; none may be overwritten
+	replies := make(chan []byte, total)
+	go func() {
+		defer close(replies)
+		b := make([]byte, 512)
+		for i := 0; i < total; i++ {
+			client.SetReadDeadline(time.Now().Add(2 * time.Second))
+			m, err := client.Read(b)
+			if err != nil {
+				return
+			}
+			replies <- append([]byte(nil), b[:m]...)
+		}
+	}()
+	for i := 0; i < total; i++ {
+		q := append([]byte(nil), sampleQuery...)
+		q[0], q[1] = 0xab, byte(i)
+		client.Write(q)
+	}
+	for received := 0; received < total; {
+		n, err := io.Recv()
+		if err != nil || n == 0 {
+			t.Fatalf("Recv = %d, %v", n, err)
+		}
+		for i := 0; i < n; i++ {
+			io.Queue(i, io.Packet(i))
+		}
+		received += n
+	}
+	io.Flush()
+	seen := make(map[byte]bool)
+	for r := range replies {
+		if len(r) != len(sampleQuery) || r[0] != 0xab || seen[r[1]] {
+			t.Fatalf("reply %x", r)
+		}
+		seen[r[1]] = true
+	}
+	if len(seen) != total {
+		t.Fatalf("%d of %d replies", len(seen), total)
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		client.Write(sampleQuery)
+		if n, _ := io.Recv(); n == 1 {
+			io.Queue(0, io.Packet(0))
+		}
+	})
+	if allocs != 0 {
+		t.Errorf("receive and queue allocate %.0f times", allocs)
+	}
+	io.Flush()
+	if c := io.Counters(); c.Received != 2*total+101 || c.Sent != 2*total+101 || c.SendErrors != 0 {
+		t.Errorf("counters %+v", c)
+	}
+
+	done := make(chan error)
+	go func() {
+		for {
+			if _, err := io.Recv(); err != nil {
+				done <- err
+				return
+			}
+		}
+	}()
+	time.Sleep(10 * time.Millisecond)
+	io.Shutdown()
+	if err := <-done; err != ErrIOShutdown {
+		t.Errorf("Recv after Shutdown: %v", err)
+	}
+}
+
+func TestListener(t *testing.T) {
+	for _, uring := range []bool{false, true} {
+		l, err := ListenTCP(netip.MustParseAddrPort("127.0.0.1:0"), IOConfig{Timeout: time.Second, URing: uring})
+		if err != nil {
+			t.Fatalf("ListenTCP: %v", err)
+		}
+		addr := &net.TCPAddr{IP: net.IPv4(127, 0, 0, 1), Port: l.Port()}
+		var clients []net.Conn
+		for i := 0; i < 3; i++ {
+			c, err := net.DialTCP("tcp", nil, addr)
+			if err != nil {
+				t.Fatal(err)
+			}
+			c.Write([]byte{byte(i)})
+			clients = append(clients, c)
+		}
+
+		fds := make([]int, 8)
+		seen := 0
+		for accepted := 0; accepted < 3; {
+			n, err := l.Accept(fds)
+			if err != nil || n == 0 {
+				t.Fatalf("%s: Accept = %d, %v", l.Backend(), n, err)
+			}
+			for _, fd := range fds[:n] {
+				f := os.NewFile(uintptr(fd), "")
+				conn, err := net.FileConn(f)
+				f.Close()
+				if err != nil {
+					t.Fatal(err)
+				}
+				b := make([]byte, 1)
+				if _, err := conn.Read(b); err != nil {
+					t.Fatal(err)
+				}
+				seen |= 1 << b[0]
+				conn.Close()
+			}
+			accepted += n
+		}
+		if seen != 7 {
+			t.Errorf("%s: connections %b", l.Backend(), seen)
+		}
+
+		done := make(chan error)
+		go func() {
+			_, err := l.Accept(fds)
+			for err == nil {
+				_, err = l.Accept(fds)
+			}
+			done <- err
+		}()
+		time.Sleep(10 * time.Millisecond)
+		l.Shutdown()
+		if err := <-done; err != ErrIOShutdown {
+			t.Errorf("%s: Accept after Shutdown: %v", l.Backend(), err)
+		}
+		l.Close()
+		for _, c := range clients {
+			c.Close()
+		}
+	}
+}
@@ -36,10 +36,21 @@ extern "C" {
 #define DNS_RCODE_NOTIMP    4
 #define DNS_RCODE_REFUSED   5
 
+/* DNS header flag bits */
+#define DNS_FLAG_QR         0x8000
+#define DNS_FLAG_AA         0x0400
+#define DNS_FLAG_TC         0x0200
+#define DNS_FLAG_RD         0x0100
+#define DNS_FLAG_RA         0x0080
+#define DNS_FLAG_AD         0x0020
+#define DNS_FLAG_CD         0x0010
+
 /* DNS opcodes */
 #define DNS_OPCODE_QUERY    0
 #define DNS_OPCODE_IQUERY   1
 #define DNS_OPCODE_STATUS   2
+#define DNS_OPCODE_NOTIFY   4
+#define DNS_OPCODE_UPDATE   5
 
 /* DNS record types */
 #define DNS_TYPE_A          1
@@ -52,6 +63,9 @@ extern "C" {
 #define DNS_TYPE_AAAA       28
 #define DNS_TYPE_SRV        33
 #define DNS_TYPE_OPT        41
+#define DNS_TYPE_DS         43
+#define DNS_TYPE_RRSIG      46
+#define DNS_TYPE_TSIG       250
 #define DNS_TYPE_ANY        255
 
 /* DNS classes */
@@ -133,6 +147,10 @@ typedef struct {
 #define DNSASM_ERR_POINTER     -3   /* Invalid compression pointer */
 #define DNSASM_ERR_LOOP        -4   /* Compression pointer loop */
 #define DNSASM_ERR_OVERFLOW    -5   /* Name too long */
+#define DNSASM_ERR_SPACE       -6   /* Caller-supplied table or buffer full */
+#define DNSASM_ERR_EDNS        -7   /* Malformed or duplicate OPT record */
+#define DNSASM_ERR_RDATA       -8   /* RDATA does not fit its type */
+#define DNSASM_ERR_FORMAT      -9   /* Table data unsorted, corrupt or misaligned */
 
 /* ============================================================================
  * Core Functions
@@ -190,6 +208,481 @@ dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
                                         size_t offset, uint8_t *out, 
                                         uint16_t *out_len);
 
+/* ============================================================================
+ * Implementation Dispatch
+ * ============================================================================ */
+
+/*
+ * libdnsasm carries several implementations of its hot kernels:
+ *
+ *   "c"         Portable reference, always available
+ *   "sse42"     x86_64 SSE4.2
+ *   "avx2"      x86_64 AVX2
+ *   "avx512bw"  x86_64 AVX-512BW/VL (byte-masked tails)
+ *   "asm"       Hand-written assembly (USE_ASM=1 builds only; never
+ *               chosen automatically, only by name)
+ *
+ * The best one the CPU supports is chosen once at load time. Setting
+ * DNSASM_IMPL=<name> in the environment forces a variant instead, as
+ * long as the CPU can run it.
+ */
+
+/*
+ * Name of the implementation currently in use.
+ */
+const char *dnsasm_active_impl(void);
+
+/*
+ * Switch to the named implementation.
+ *
+ * Intended for tests and benchmarks; switch before starting workers.
+ *
+ * @param name      Implementation name (see above)
+ * @return          0 on success, -1 if unknown or not supported here
+ */
+int dnsasm_select_impl(const char *name);
+
+/*
+ * List the implementations this CPU can run, best first.
+ *
+ * @param names     Output array of names
+ * @param max       Capacity of names
+ * @return          Number of names written
+ */
+size_t dnsasm_impl_names(const char **names, size_t max);
+
+/* ============================================================================
+ * Batch Functions
+ * ============================================================================ */
+
+/* Maximum packets per dnsasm_parse_batch call (one recvmmsg burst) */
+#define DNSASM_BATCH_MAX        64
+
+/* How many packets ahead of the parse loop to prefetch */
+#define DNSASM_BATCH_PREFETCH   4
+
+/*
+ * Structure-of-arrays result for a batch of queries.
+ *
+ * Every array holds DNSASM_BATCH_MAX entries, so each one starts on a
+ * cache-line boundary whenever the struct itself does. No alignment
+ * attribute is used so that the struct can live in Go memory.
+ *
+ * name_off/name_len describe the first question's name in wire format,
+ * in place in the packet; nothing is copied or decompressed.
+ */
+typedef struct {
+    uint16_t id[DNSASM_BATCH_MAX];        /* Transaction ID */
+    uint16_t flags[DNSASM_BATCH_MAX];     /* Raw flags field */
+    uint16_t qdcount[DNSASM_BATCH_MAX];   /* Question count */
+    uint16_t ancount[DNSASM_BATCH_MAX];   /* Answer count */
+    uint16_t nscount[DNSASM_BATCH_MAX];   /* Authority count */
+    uint16_t arcount[DNSASM_BATCH_MAX];   /* Additional count */
+    uint16_t qtype[DNSASM_BATCH_MAX];     /* First question type */
+    uint16_t qclass[DNSASM_BATCH_MAX];    /* First question class */
+    uint16_t name_off[DNSASM_BATCH_MAX];  /* Wire offset of qname */
+    uint16_t name_len[DNSASM_BATCH_MAX];  /* Wire length of qname */
+    int8_t   error[DNSASM_BATCH_MAX];     /* DNSASM_OK or error code */
+    uint32_t count;                       /* Number of entries filled */
+} dnsasm_batch_t;
+
+/*
+ * Parse the header and first question of a batch of queries.
+ *
+ * Packets with QDCOUNT=0 get zeroed question fields and DNSASM_OK.
+ * The question name must not be compressed: a pointer there can only
+ * refer into the header, so it is rejected with DNSASM_ERR_POINTER.
+ * Packets further down the batch are prefetched while earlier ones
+ * are parsed.
+ *
+ * @param packets   Array of packet pointers
+ * @param lens      Array of packet lengths
+ * @param count     Number of packets (clamped to DNSASM_BATCH_MAX)
+ * @param out       Output SoA result
+ * @return          Number of packets parsed without error
+ *
+ * Performance: one call per recvmmsg burst instead of two per packet
+ */
+size_t dnsasm_parse_batch(const uint8_t *const *packets, const uint16_t *lens,
+                           size_t count, dnsasm_batch_t *out);
+
+/* ============================================================================
+ * Message Index Functions
+ * ============================================================================ */
+
+/* Message sections, in wire order */
+#define DNSASM_SECTION_QUESTION     0
+#define DNSASM_SECTION_ANSWER       1
+#define DNSASM_SECTION_AUTHORITY    2
+#define DNSASM_SECTION_ADDITIONAL   3
+#define DNSASM_SECTION_COUNT        4
+
+/*
+ * Index entry for one question or RR (12 bytes, no name copy).
+ *
+ * All offsets are from the start of the packet. Question entries have
+ * ttl_off, rdata_off and rdlength set to zero.
+ */
+typedef struct {
+    uint16_t name_off;     /* Wire offset of owner name (may be compressed) */
+    uint16_t type;         /* Record type / qtype */
+    uint16_t rclass;       /* Record class / qclass */
+    uint16_t ttl_off;      /* Wire offset of the 32-bit TTL field */
+    uint16_t rdata_off;    /* Wire offset of RDATA */
+    uint16_t rdlength;     /* RDATA length */
+} dnsasm_rr_index_t;
+
+/*
+ * Per-message summary produced alongside the entry table.
+ *
+ * Section s occupies entries [start[s], start[s] + count[s]).
+ */
+typedef struct {
+    uint16_t start[DNSASM_SECTION_COUNT];  /* First entry of each section */
+    uint16_t count[DNSASM_SECTION_COUNT];  /* Entries in each section */
+    uint16_t total;                        /* Entries filled */
+    uint16_t _pad;
+    uint32_t end;                          /* Offset after last entry */
+} dnsasm_msg_t;
+
+/*
+ * Index every question and RR of a message in a single pass.
+ *
+ * Names are skipped, not decompressed: a compression pointer ends the
+ * name and is only checked to point backwards. Use
+ * dnsasm_decompress_name on an entry's name_off when the name is
+ * actually needed. On error, the entries indexed so far stay valid and
+ * msg->end is the offset after the last of them.
+ *
+ * @param packet    Pointer to raw DNS packet
+ * @param len       Length of packet
+ * @param msg       Output summary
+ * @param rr        Caller-provided entry table
+ * @param max_rr    Capacity of rr
+ * @return          0 on success, DNSASM_ERR_SPACE if rr is too small,
+ *                  other negative error code on malformed input
+ */
+int dnsasm_parse_message(const uint8_t *packet, size_t len, dnsasm_msg_t *msg,
+                          dnsasm_rr_index_t *rr, size_t max_rr);
+
+/* ============================================================================
+ * Keyed Query Hashing
+ * ============================================================================ */
+
+/*
+ * 128-bit secret for the query hash. Generate it once per process from
+ * a CSPRNG; an attacker who cannot see it cannot aim queries at one
+ * cache shard or bucket chain.
+ */
+typedef struct {
+    uint64_t k0;
+    uint64_t k1;
+} dnsasm_hash_key_t;
+
+/* Request bits folded into the hash (they select different answers) */
+#define DNSASM_HASH_DO      0x01    /* EDNS DNSSEC OK */
+#define DNSASM_HASH_CD      0x02    /* Checking Disabled */
+
+/*
+ * Parse a question, lowercasing the name as it is decompressed and
+ * hashing it in the same pass.
+ *
+ * The hash is SipHash-1-3 over the canonical wire name followed by
+ * qtype, qclass (both network order) and one byte of DNSASM_HASH_*
+ * bits, so it equals dnsasm_hash_name() on the lowercased name.
+ *
+ * @param packet    Pointer to packet data
+ * @param len       Length of packet
+ * @param offset    Offset to start of question (typically 12)
+ * @param bits      DNSASM_HASH_* bits of the request
+ * @param key       Per-process secret
+ * @param out       Output question; name is lowercased
+ * @param hash      Output hash
+ * @return          Result with error code and offset after question
+ */
+dnsasm_result_t dnsasm_parse_question_keyed(const uint8_t *packet, size_t len,
+                                             size_t offset, uint8_t bits,
+                                             const dnsasm_hash_key_t *key,
+                                             dnsasm_question_t *out,
+                                             uint64_t *hash);
+
+/*
+ * Hash an uncompressed wire-format name the same way.
+ *
+ * ASCII letters are folded to lowercase before hashing, so any casing
+ * of a name gives the same result.
+ *
+ * @param key       Per-process secret
+ * @param name      Uncompressed wire-format name
+ * @param name_len  Length of name including the root label
+ * @param qtype     Query type
+ * @param qclass    Query class
+ * @param bits      DNSASM_HASH_* bits
+ * @return          64-bit hash
+ */
+uint64_t dnsasm_hash_name(const dnsasm_hash_key_t *key, const uint8_t *name,
+                           size_t name_len, uint16_t qtype, uint16_t qclass,
+                           uint8_t bits);
+
+/* ============================================================================
+ * EDNS(0)
+ * ============================================================================ */
+
+/* Option codes indexed by dnsasm_parse_edns */
+#define DNS_EDNS_OPT_ECS        8     /* Client Subnet (RFC 7871) */
+#define DNS_EDNS_OPT_COOKIE     10    /* DNS Cookie (RFC 7873) */
+#define DNS_EDNS_OPT_KEEPALIVE  11    /* TCP Keepalive (RFC 7828) */
+#define DNS_EDNS_OPT_PADDING    12    /* Padding (RFC 7830) */
+
+/* DO bit in the OPT flags */
+#define DNS_EDNS_FLAG_DO        0x8000
+
+/*
+ * Location of one option's data in the packet. off is 0 when the option
+ * is absent; a present option may have len 0 (keepalive in a query).
+ */
+typedef struct {
+    uint16_t off;
+    uint16_t len;
+} dnsasm_edns_opt_t;
+
+/*
+ * Decoded OPT pseudo-RR (RFC 6891). Offsets point into the packet.
+ */
+typedef struct {
+    uint8_t  present;          /* 1 if the message carries an OPT RR */
+    uint8_t  version;          /* EDNS version */
+    uint8_t  ext_rcode;        /* Upper 8 bits of the extended RCODE */
+    uint8_t  dnssec_ok;        /* DO bit */
+    uint16_t udp_size;         /* Requestor's UDP payload size */
+    uint16_t flags;            /* DO and Z bits */
+    uint16_t rr_off;           /* Offset of the OPT RR (its root name) */
+    uint16_t rdlength;         /* Length of all options */
+    uint16_t option_count;     /* Options of any code */
+    uint16_t _pad;
+    dnsasm_edns_opt_t cookie;
+    dnsasm_edns_opt_t ecs;
+    dnsasm_edns_opt_t padding;
+    dnsasm_edns_opt_t keepalive;
+} dnsasm_edns_t;
+
+/*
+ * Find and decode the OPT RR in one pass.
+ *
+ * Skips the answer and authority sections, then scans the whole
+ * additional section, so OPT is found wherever it sits (e.g. ahead of
+ * TSIG). A message without OPT is not an error; out->present is 0.
+ *
+ * @param packet    Pointer to packet data
+ * @param len       Length of packet
+ * @param offset    Offset after the question section
+ * @param out       Output EDNS summary
+ * @return          0 on success, DNSASM_ERR_EDNS for a second OPT, a
+ *                  non-root owner, options that overrun RDATA or a
+ *                  repeated indexed option, other negative error code
+ *                  on malformed input
+ */
+int dnsasm_parse_edns(const uint8_t *packet, size_t len, size_t offset,
+                       dnsasm_edns_t *out);
+
+/* ============================================================================
+ * Query Classification
+ * ============================================================================ */
+
+/*
+ * Action for a request: the low bits of the verdict hold exactly one of
+ * these, so a server can route with a single switch.
+ */
+#define DNSASM_CLASS_DROP       0     /* Not answerable: ignore silently */
+#define DNSASM_CLASS_FAST       1     /* Plain query, fast path */
+#define DNSASM_CLASS_SLOW       2     /* Legal but unusual: full parser */
+#define DNSASM_CLASS_FORMERR    3     /* Malformed: answer FORMERR */
+#define DNSASM_CLASS_NOTIMP     4     /* Unsupported opcode: answer NOTIMP */
+#define DNSASM_CLASS_ACTION     0x0f  /* Mask for the action */
+
+/* Reasons and attributes, above the action bits */
+#define DNSASM_CLASS_SHORT      0x0010  /* Shorter than a header */
+#define DNSASM_CLASS_RESPONSE   0x0020  /* QR is set */
+#define DNSASM_CLASS_OPCODE     0x0040  /* Opcode other than QUERY */
+#define DNSASM_CLASS_NO_QD      0x0080  /* QDCOUNT is 0 */
+#define DNSASM_CLASS_MULTI_QD   0x0100  /* QDCOUNT above 1 */
+#define DNSASM_CLASS_RECORDS    0x0200  /* ANCOUNT or NSCOUNT non-zero */
+#define DNSASM_CLASS_TSIG       0x0400  /* TSIG in additional */
+#define DNSASM_CLASS_TRAILING   0x0800  /* Bytes after the last RR */
+#define DNSASM_CLASS_MALFORMED  0x1000  /* Parse error, see error */
+#define DNSASM_CLASS_EDNS       0x2000  /* OPT present */
+#define DNSASM_CLASS_DO         0x4000  /* OPT has DO set */
+#define DNSASM_CLASS_BADVERS    0x8000  /* EDNS version above 0 */
+#define DNSASM_CLASS_COOKIE     0x10000 /* COOKIE option present */
+#define DNSASM_CLASS_BAD_OPT    0x20000 /* Malformed or second OPT */
+
+/*
+ * Everything a server needs from a request to route it.
+ */
+typedef struct {
+    uint32_t verdict;          /* DNSASM_CLASS_* action | reasons */
+    int32_t  error;            /* Parse error behind CLASS_MALFORMED */
+    uint16_t id;               /* Transaction ID */
+    uint16_t flags;            /* Raw header flags */
+    uint16_t qtype;            /* First question type */
+    uint16_t qclass;           /* First question class */
+    uint16_t qname_len;        /* Wire length of the first qname */
+    uint16_t question_end;     /* Offset after the question section */
+    uint32_t end;              /* Offset after the last RR */
+    dnsasm_edns_t edns;        /* Decoded OPT; zero unless all records parsed */
+} dnsasm_query_class_t;
+
+/*
+ * Inspect a request once and decide how to handle it.
+ *
+ * Checks, in one pass: header, opcode, counts, every question and RR,
+ * the OPT record (as dnsasm_parse_edns) and TSIG. Responses and runts
+ * are dropped; malformed queries get FORMERR and opcodes other than
+ * QUERY, NOTIFY and UPDATE get NOTIMP. Anything legal but not a plain
+ * QDCOUNT=1 query without answer/authority records, TSIG, trailing
+ * bytes or an EDNS version above 0 goes to the slow path.
+ *
+ * @param packet    Pointer to packet data
+ * @param len       Length of packet
+ * @param out       Output classification
+ * @return          out->verdict
+ */
+uint32_t dnsasm_classify_query(const uint8_t *packet, size_t len,
+                                dnsasm_query_class_t *out);
+
+/* ============================================================================
+ * RDATA Decoders
+ * ============================================================================ */
+
+/*
+ * Typed views of common RDATA. Every decoder takes the RDATA location
+ * (e.g. dnsasm_rr_index_t.rdata_off/rdlength), checks that the data
+ * fits its type exactly, and fills a caller-provided struct; nothing is
+ * allocated. Embedded names are decompressed against the whole packet
+ * but must end inside the RDATA. Variable blobs (digests, signatures,
+ * TXT strings) are returned as packet offsets.
+ *
+ * All return 0 on success, DNSASM_ERR_RDATA if the RDATA is the wrong
+ * shape, or the name error from decompression.
+ */
+
+/* Name target of CNAME, NS, PTR and DNAME */
+typedef struct {
+    uint8_t  name[DNS_MAX_NAME_LEN + 1];
+    uint16_t name_len;
+} dnsasm_rdata_name_t;
+
+typedef struct {
+    uint16_t preference;
+    uint16_t exchange_len;
+    uint8_t  exchange[DNS_MAX_NAME_LEN + 1];
+} dnsasm_rdata_mx_t;
+
+typedef struct {
+    uint16_t priority;
+    uint16_t weight;
+    uint16_t port;
+    uint16_t target_len;
+    uint8_t  target[DNS_MAX_NAME_LEN + 1];
+} dnsasm_rdata_srv_t;
+
+typedef struct {
+    uint8_t  mname[DNS_MAX_NAME_LEN + 1];  /* Primary server */
+    uint8_t  rname[DNS_MAX_NAME_LEN + 1];  /* Responsible mailbox */
+    uint16_t mname_len;
+    uint16_t rname_len;
+    uint32_t serial;
+    uint32_t refresh;
+    uint32_t retry;
+    uint32_t expire;
+    uint32_t minimum;                      /* Negative caching TTL */
+} dnsasm_rdata_soa_t;
+
+typedef struct {
+    uint16_t key_tag;
+    uint8_t  algorithm;
+    uint8_t  digest_type;
+    uint16_t digest_off;
+    uint16_t digest_len;
+} dnsasm_rdata_ds_t;
+
+/* RRSIG fields ahead of the signature (RFC 4034 3.1) */
+typedef struct {
+    uint16_t type_covered;
+    uint8_t  algorithm;
+    uint8_t  labels;
+    uint32_t orig_ttl;
+    uint32_t expiration;
+    uint32_t inception;
+    uint16_t key_tag;
+    uint16_t signer_len;
+    uint8_t  signer[DNS_MAX_NAME_LEN + 1];
+    uint16_t sig_off;
+    uint16_t sig_len;
+} dnsasm_rdata_rrsig_t;
+
+/* Cursor over length-prefixed TXT strings or OPT options */
+typedef struct {
+    uint16_t pos;
+    uint16_t end;
+} dnsasm_rdata_iter_t;
+
+int dnsasm_rdata_a(const uint8_t *packet, size_t len, size_t off,
+                    uint16_t rdlength, uint8_t addr[4]);
+
+int dnsasm_rdata_aaaa(const uint8_t *packet, size_t len, size_t off,
+                       uint16_t rdlength, uint8_t addr[16]);
+
+int dnsasm_rdata_name(const uint8_t *packet, size_t len, size_t off,
+                       uint16_t rdlength, dnsasm_rdata_name_t *out);
+
+int dnsasm_rdata_mx(const uint8_t *packet, size_t len, size_t off,
+                     uint16_t rdlength, dnsasm_rdata_mx_t *out);
+
+int dnsasm_rdata_srv(const uint8_t *packet, size_t len, size_t off,
+                      uint16_t rdlength, dnsasm_rdata_srv_t *out);
+
+int dnsasm_rdata_soa(const uint8_t *packet, size_t len, size_t off,
+                      uint16_t rdlength, dnsasm_rdata_soa_t *out);
+
+int dnsasm_rdata_ds(const uint8_t *packet, size_t len, size_t off,
+                     uint16_t rdlength, dnsasm_rdata_ds_t *out);
+
+int dnsasm_rdata_rrsig(const uint8_t *packet, size_t len, size_t off,
+                        uint16_t rdlength, dnsasm_rdata_rrsig_t *out);
+
+/*
+ * Start iterating TXT strings or OPT options of the RDATA at off.
+ *
+ * @return          0, or DNSASM_ERR_RDATA if the RDATA runs past len;
+ *                  the iterator is then empty
+ */
+int dnsasm_rdata_iter_init(dnsasm_rdata_iter_t *it, size_t len, size_t off,
+                            uint16_t rdlength);
+
+/*
+ * Next TXT character-string.
+ *
+ * @param packet    Pointer to packet data
+ * @param it        Iterator from dnsasm_rdata_iter_init
+ * @param str_off   Output: offset of the string bytes
+ * @param str_len   Output: length of the string
+ * @return          1 for a string, 0 at the end, DNSASM_ERR_RDATA if a
+ *                  length runs past the RDATA
+ */
+int dnsasm_txt_next(const uint8_t *packet, dnsasm_rdata_iter_t *it,
+                     uint16_t *str_off, uint8_t *str_len);
+
+/*
+ * Next OPT option; same contract as dnsasm_txt_next.
+ *
+ * @param code      Output: option code
+ * @param data_off  Output: offset of the option data
+ * @param data_len  Output: length of the option data
+ */
+int dnsasm_opt_next(const uint8_t *packet, dnsasm_rdata_iter_t *it,
+                     uint16_t *code, uint16_t *data_off, uint16_t *data_len);
+
 /* ============================================================================
  * Response Building Functions
  * ============================================================================ */
@@ -236,12 +729,242 @@ size_t dnsasm_build_a_record(uint8_t *out, const uint8_t *name, size_t name_len,
                               uint32_t ttl, const uint8_t *ip);
 
 /* ============================================================================
- * SIMD-Optimized Functions (x86_64 AVX2 / ARM64 NEON)
+ * Response Writer
+ * ============================================================================ */
+
+/* Suffix table slots for name compression (power of two) */
+#define DNSASM_WRITER_SLOTS     64
+
+/*
+ * Stateful message writer over a caller-supplied buffer.
+ *
+ * Names are given uncompressed; the writer compresses them against
+ * every name already written (case-insensitively, RFC 1035 4.1.4) via a
+ * small open-addressed table of suffix hashes. Records are appended
+ * section by section and the header counts are patched by finish. An
+ * RR that would cross the size limit is rolled back whole and
+ * DNSASM_ERR_SPACE returned, leaving the message valid so the caller
+ * can set TC and finish.
+ */
+typedef struct {
+    uint8_t  *buf;             /* Output buffer */
+    size_t    limit;           /* Never write past this many bytes */
+    size_t    len;             /* Bytes written */
+    uint16_t  count[DNSASM_SECTION_COUNT];
+    int       section;         /* Section being written */
+    uint16_t  rclass;          /* Class for the typed helpers (IN) */
+    uint16_t  used;            /* Occupied table slots */
+    struct {
+        uint32_t hash;
+        uint16_t off;          /* Suffix offset in buf, 0 = empty */
+    } table[DNSASM_WRITER_SLOTS];
+} dnsasm_writer_t;
+
+/*
+ * Start a message.
+ *
+ * @param w         Writer state
+ * @param buf       Output buffer of at least limit bytes
+ * @param limit     Maximum message size (e.g. the client's UDP size)
+ */
+void dnsasm_writer_init(dnsasm_writer_t *w, uint8_t *buf, size_t limit);
+
+/*
+ * Write the header; counts are filled in by dnsasm_writer_finish.
+ *
+ * @return          0 or DNSASM_ERR_SPACE
+ */
+int dnsasm_writer_header(dnsasm_writer_t *w, uint16_t id, uint16_t flags);
+
+/*
+ * Append a question.
+ *
+ * @param name      Uncompressed wire-format name
+ * @param name_len  Length of name including the root label
+ * @return          0, DNSASM_ERR_NAME, DNSASM_ERR_SPACE, or
+ *                  DNSASM_ERR_OVERFLOW if a section has been started
+ */
+int dnsasm_writer_question(dnsasm_writer_t *w, const uint8_t *name,
+                            size_t name_len, uint16_t qtype, uint16_t qclass);
+
+/*
+ * Move on to DNSASM_SECTION_ANSWER, _AUTHORITY or _ADDITIONAL.
+ * Sections only advance.
+ *
+ * @return          0 or DNSASM_ERR_OVERFLOW if s is behind the current one
+ */
+int dnsasm_writer_section(dnsasm_writer_t *w, int section);
+
+/*
+ * Append an RR with opaque RDATA (no names inside, or names that must
+ * stay uncompressed).
+ *
+ * @return          0, DNSASM_ERR_NAME or DNSASM_ERR_SPACE
+ */
+int dnsasm_writer_rr(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      uint16_t type, uint16_t rclass, uint32_t ttl,
+                      const uint8_t *rdata, uint16_t rdlength);
+
+/* Typed RRs, class w->rclass. Same returns as dnsasm_writer_rr. */
+
+int dnsasm_writer_a(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                     uint32_t ttl, const uint8_t addr[4]);
+
+int dnsasm_writer_aaaa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                        uint32_t ttl, const uint8_t addr[16]);
+
+/*
+ * CNAME, NS or PTR with a compressed target; any other type gets the
+ * target written uncompressed (RFC 3597 4).
+ */
+int dnsasm_writer_name_rr(dnsasm_writer_t *w, const uint8_t *name,
+                           size_t name_len, uint16_t type, uint32_t ttl,
+                           const uint8_t *target, size_t target_len);
+
+int dnsasm_writer_mx(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      uint32_t ttl, uint16_t preference,
+                      const uint8_t *exchange, size_t exchange_len);
+
+/* SRV target is never compressed (RFC 2782) */
+int dnsasm_writer_srv(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, uint16_t priority, uint16_t weight,
+                       uint16_t port, const uint8_t *target, size_t target_len);
+
+int dnsasm_writer_soa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, const dnsasm_rdata_soa_t *soa);
+
+/*
+ * TXT from raw text, split into 255-byte character-strings.
+ */
+int dnsasm_writer_txt(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, const uint8_t *text, size_t text_len);
+
+/*
+ * OPT pseudo-RR in the additional section (switches to it if needed).
+ *
+ * @param options   Pre-encoded options (code, length, data)*, may be NULL
+ */
+int dnsasm_writer_opt(dnsasm_writer_t *w, uint16_t udp_size,
+                       uint8_t ext_rcode, uint8_t version, uint16_t flags,
+                       const uint8_t *options, uint16_t options_len);
+
+/*
+ * Patch the section counts into the header.
+ *
+ * @return          Message length
+ */
+size_t dnsasm_writer_finish(dnsasm_writer_t *w);
+
+/* ============================================================================
+ * Cached Response Aging
+ * ============================================================================ */
+
+/*
+ * Age the TTL of every RR in a wire message in place (OPT is skipped,
+ * its TTL field holds flags). Each TTL drops by elapsed seconds but not
+ * below min_ttl; a TTL already under min_ttl is left as it is, so no
+ * TTL ever grows. Serving a cached response is then a copy of the
+ * stored bytes plus this pass and dnsasm_patch_response.
+ *
+ * @param buf       Message (a private copy; it is modified)
+ * @param len       Message length
+ * @param elapsed   Seconds since the message was cached
+ * @param min_ttl   Floor for aged TTLs (e.g. 30 for serve-stale)
+ * @return          0 or negative error; on error earlier RRs may
+ *                  already be aged
+ */
+int dnsasm_age_ttls(uint8_t *buf, size_t len, uint32_t elapsed, uint32_t min_ttl);
+
+/*
+ * Make a cached response answer a particular query: copy the query's
+ * transaction ID, then its first question name over the response's, so
+ * the client sees its own 0x20 casing (owner names compressed to the
+ * question follow along).
+ *
+ * The name is only copied when both questions are uncompressed and
+ * equal ignoring case; otherwise the ID is still patched and
+ * DNSASM_ERR_NAME returned.
+ *
+ * @param buf       Response to patch
+ * @param len       Response length
+ * @param query     Client query
+ * @param query_len Query length
+ * @return          0, DNSASM_ERR_SHORT or DNSASM_ERR_NAME
+ */
+int dnsasm_patch_response(uint8_t *buf, size_t len,
+                           const uint8_t *query, size_t query_len);
+
+/* ============================================================================
+ * Truncation
+ * ============================================================================ */
+
+/*
+ * Shrink a response to fit a UDP payload limit, in place.
+ *
+ * The message is cut at an RRset boundary (RFC 2181 9), keeping the
+ * longest prefix that fits together with the OPT record, which is moved
+ * up behind the cut. Additional data goes first; TC is set only when
+ * answer or authority RRs had to be dropped. Section counts are fixed.
+ * Names in the kept prefix stay valid because compression pointers
+ * only point backwards.
+ *
+ * @param buf       Response to shrink
+ * @param len       Response length
+ * @param limit     Maximum size (512, or the client's EDNS payload size)
+ * @return          New length (len if it already fits), or negative
+ *                  error; DNSASM_ERR_SPACE if not even the questions fit
+ */
+int dnsasm_truncate(uint8_t *buf, size_t len, size_t limit);
+
+/* ============================================================================
+ * Error Responses
+ * ============================================================================ */
+
+/* Payload size advertised in the OPT of a synthesized reply */
+#define DNSASM_REPLY_UDP_SIZE   1232
+
+/*
+ * Answer a request with an empty response: FORMERR, SERVFAIL, REFUSED,
+ * NOTIMP, or a TC=1 "slip" (rcode 0, flags DNS_FLAG_TC) for RRL.
+ *
+ * The reply echoes the ID, opcode, RD and CD, and copies the first
+ * question byte for byte when it is uncompressed and complete (else
+ * QDCOUNT is 0). If the request carried a well-formed OPT, a bare OPT
+ * is appended with the DO bit echoed and the upper rcode bits, so
+ * extended codes such as BADVERS (16) work; without OPT only the low 4
+ * bits are sent. A request whose records do not parse gets no OPT, so
+ * the FORMERR for a malformed or duplicate OPT has none (RFC 6891 7).
+ *
+ * With qc from dnsasm_classify_query nothing is re-read but the
+ * question; without it (NULL) the additional section is scanned for
+ * OPT only when the question is intact. Responses are not refused
+ * here; route with the classifier first.
+ *
+ * @param out       Output buffer (12 + 259 + 11 bytes always suffice)
+ * @param out_size  Size of out
+ * @param req       Request
+ * @param req_len   Request length
+ * @param qc        Classification of req, or NULL
+ * @param rcode     Response code (12 bits with EDNS, 4 without)
+ * @param flags     Extra header flags, e.g. DNS_FLAG_TC or DNS_FLAG_AA
+ * @return          Reply length, DNSASM_ERR_SHORT for a runt request or
+ *                  DNSASM_ERR_SPACE if out is too small
+ */
+int dnsasm_reply_error(uint8_t *out, size_t out_size,
+                        const uint8_t *req, size_t req_len,
+                        const dnsasm_query_class_t *qc,
+                        uint16_t rcode, uint16_t flags);
+
+/* ============================================================================
+ * Name Comparison
  * ============================================================================ */
 
 /*
  * Compare two DNS names (case-insensitive).
- * Uses SIMD for 16+ byte comparisons.
+ * Dispatched like dnsasm_decompress_name: the SSE4.2 and AVX2 variants
+ * compare 16/32 bytes per step with case folded by masking, AVX-512BW
+ * uses masked loads for the tail; names under 16 bytes are compared as
+ * two 8-byte words.
  * 
  * @param a         First name (raw wire format or decompressed)
  * @param a_len     Length of first name
@@ -252,9 +975,30 @@ size_t dnsasm_build_a_record(uint8_t *out, const uint8_t *name, size_t name_len,
 int dnsasm_name_equal(const uint8_t *a, size_t a_len,
                        const uint8_t *b, size_t b_len);
 
+/*
+ * Order two names canonically (RFC 4034 6.1), as DNSSEC needs for zone
+ * sorting, NSEC/NSEC3 proofs and AXFR output.
+ *
+ * Labels are compared from the rightmost one, each as a string of
+ * lowercased octets, a label that is a prefix of another sorting first;
+ * a name that runs out of labels sorts before the longer one. Names
+ * must be uncompressed wire format (e.g. from dnsasm_decompress_name);
+ * a malformed tail is ignored from the first bad label on.
+ *
+ * @param a         First name
+ * @param a_len     Length of first name
+ * @param b         Second name
+ * @param b_len     Length of second name
+ * @return          Negative if a sorts first, 0 if equal, positive if
+ *                  b sorts first
+ */
+int dnsasm_name_compare(const uint8_t *a, size_t a_len,
+                         const uint8_t *b, size_t b_len);
+
 /*
  * Find a name in a list (for zone lookups).
- * Uses SIMD for parallel comparison.
+ * Each entry is checked with dnsasm_name_equal, so this is linear in
+ * the list; build a dnsasm_nameset_t for anything but a few names.
  * 
  * @param needle    Name to find
  * @param needle_len Length of needle
@@ -265,6 +1009,693 @@ int dnsasm_name_equal(const uint8_t *a, size_t a_len,
 int dnsasm_name_find(const uint8_t *needle, size_t needle_len,
                       const uint8_t **haystack, size_t count);
 
+/* ============================================================================
+ * Name Sets
+ * ============================================================================ */
+
+#define DNSASM_NAMESET_MAGIC    0x534e4d5341534e44ULL   /* "DNSASMNS" */
+#define DNSASM_NAMESET_VERSION  1
+
+/*
+ * Immutable hashed set of names (RPZ exact triggers, allow/deny lists,
+ * zone owner index). The set is one flat buffer: this header, then
+ * bucket_mask + 1 buckets of 64 bytes, then the lowercased names. It
+ * holds no pointers, so the buffer is its own serialized form; it is
+ * in host byte order and the magic rejects the other one.
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t magic;            /* DNSASM_NAMESET_MAGIC */
+    uint32_t version;          /* DNSASM_NAMESET_VERSION */
+    uint32_t bucket_mask;      /* Bucket count - 1 (power of two) */
+    uint32_t count;            /* Distinct names */
+    uint32_t size;             /* Bytes in use, header included */
+    dnsasm_hash_key_t key;     /* Hash secret chosen at build time */
+    uint8_t  _pad[24];
+} dnsasm_nameset_t;
+
+/*
+ * Buffer size dnsasm_nameset_build needs for a list of names.
+ *
+ * @param names     Uncompressed wire names back to back
+ * @param names_len Length of the list
+ * @return          Bytes needed, 0 if a name is malformed or the set
+ *                  would pass 4 GiB
+ */
+size_t dnsasm_nameset_size(const uint8_t *names, size_t names_len);
+
+/*
+ * Build a set. Names are matched ignoring case and stored once.
+ *
+ * @param names     Uncompressed wire names back to back
+ * @param names_len Length of the list
+ * @param key       Hash secret (from a CSPRNG)
+ * @param out       Output buffer, 8-byte aligned (64 to align buckets)
+ * @param out_size  Size of out, at least dnsasm_nameset_size()
+ * @return          0, DNSASM_ERR_NAME for a malformed name,
+ *                  DNSASM_ERR_SPACE if out is too small or
+ *                  DNSASM_ERR_FORMAT if it is misaligned; the bytes to
+ *                  keep or save are ((dnsasm_nameset_t *)out)->size
+ */
+int dnsasm_nameset_build(const uint8_t *names, size_t names_len,
+                          const dnsasm_hash_key_t *key,
+                          uint8_t *out, size_t out_size);
+
+/*
+ * Validate a serialized set (e.g. read from disk) before use. Every
+ * slot is bounds-checked, so lookups in an opened set are safe.
+ *
+ * @param buf       Serialized set, 8-byte aligned
+ * @param len       Bytes available
+ * @param out       Output: the set, aliasing buf
+ * @return          0, DNSASM_ERR_SHORT or DNSASM_ERR_FORMAT
+ */
+int dnsasm_nameset_open(const uint8_t *buf, size_t len, const dnsasm_nameset_t **out);
+
+/*
+ * Look a name up, ignoring case. Usually one bucket: one hash, one
+ * vector compare of 8 fingerprints and one name compare.
+ *
+ * @param set       Built or opened set
+ * @param name      Uncompressed wire name
+ * @param len       Length of name
+ * @return          1 if the set holds name, 0 otherwise
+ */
+int dnsasm_nameset_contains(const dnsasm_nameset_t *set, const uint8_t *name, size_t len);
+
+/* ============================================================================
+ * Suffix Tries
+ * ============================================================================ */
+
+#define DNSASM_TRIE_MAGIC       0x52544d5341534e44ULL   /* "DNSASMTR" */
+#define DNSASM_TRIE_VERSION     1
+#define DNSASM_TRIE_NONE        0xFFFFFFFFu             /* No value */
+
+/*
+ * Immutable reverse-label trie of names with a 32-bit value each (zone
+ * apexes, RPZ wildcard bases, bailiwicks). Matching a name walks its
+ * labels from the root, so the cost is per label, not per entry. Like
+ * dnsasm_nameset_t it is one flat buffer in host byte order: this
+ * header, node_count nodes of 16 bytes, then the lowercased labels.
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t magic;            /* DNSASM_TRIE_MAGIC */
+    uint32_t version;          /* DNSASM_TRIE_VERSION */
+    uint32_t node_count;       /* Nodes, the root included */
+    uint32_t label_off;        /* Start of the label store */
+    uint32_t size;             /* Bytes in use, header included */
+    uint32_t count;            /* Nodes holding a value */
+    uint8_t  _pad[36];
+} dnsasm_trie_t;
+
+/*
+ * Buffer size dnsasm_trie_build needs for a list of names.
+ *
+ * @param names     Uncompressed wire names back to back
+ * @param names_len Length of the list
+ * @return          Bytes needed, 0 if a name is malformed or the trie
+ *                  would pass 4 GiB
+ */
+size_t dnsasm_trie_size(const uint8_t *names, size_t names_len);
+
+/*
+ * Build a trie. Names must be in canonical order (dnsasm_name_compare);
+ * of equal names the last one's value is kept.
+ *
+ * @param names     Uncompressed wire names back to back, sorted
+ * @param names_len Length of the list
+ * @param values    One value per name, or NULL for the name's index
+ * @param out       Output buffer, 8-byte aligned
+ * @param out_size  Size of out, at least dnsasm_trie_size()
+ * @return          0, DNSASM_ERR_NAME for a malformed name,
+ *                  DNSASM_ERR_FORMAT if the names are unsorted or out
+ *                  is misaligned, or DNSASM_ERR_SPACE; the bytes to keep
+ *                  or save are ((dnsasm_trie_t *)out)->size
+ */
+int dnsasm_trie_build(const uint8_t *names, size_t names_len, const uint32_t *values,
+                       uint8_t *out, size_t out_size);
+
+/*
+ * Validate a serialized trie before use. Every node and label is
+ * bounds-checked and children must follow their parent, so matching
+ * an opened trie is safe.
+ *
+ * @param buf       Serialized trie, 8-byte aligned
+ * @param len       Bytes available
+ * @param out       Output: the trie, aliasing buf
+ * @return          0, DNSASM_ERR_SHORT or DNSASM_ERR_FORMAT
+ */
+int dnsasm_trie_open(const uint8_t *buf, size_t len, const dnsasm_trie_t **out);
+
+/*
+ * Longest enclosing suffix: the closest ancestor of name (or name
+ * itself) that holds a value, ignoring case. For a wildcard trigger
+ * such as *.example.com, store example.com and match the name with its
+ * first label stripped.
+ *
+ * @param trie      Built or opened trie
+ * @param name      Uncompressed wire name
+ * @param len       Length of name
+ * @param value     Output: value of the match
+ * @return          Offset in name where the matching suffix starts,
+ *                  -1 if none matches or name is malformed
+ */
+int dnsasm_trie_match(const dnsasm_trie_t *trie, const uint8_t *name, size_t len,
+                       uint32_t *value);
+
+/* ============================================================================
+ * Name Filters
+ * ============================================================================ */
+
+#define DNSASM_FILTER_MAGIC     0x46424d5341534e44ULL   /* "DNSASMBF" */
+#define DNSASM_FILTER_VERSION   1
+
+/*
+ * Blocked Bloom filter over names, for ruling out policy lookups (RPZ
+ * triggers, blocklists) before taking any lock. Each name sets one bit
+ * in each 64-bit word of a single 64-byte block, so a probe reads one
+ * cache line. False positives run near 0.05% per probe at capacity;
+ * there are no false negatives. One flat buffer in host byte order:
+ * this header, then block_count blocks.
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t magic;            /* DNSASM_FILTER_MAGIC */
+    uint32_t version;          /* DNSASM_FILTER_VERSION */
+    uint32_t block_count;      /* 64-byte blocks */
+    uint32_t capacity;         /* Names it was sized for */
+    uint32_t count;            /* Names added */
+    uint32_t size;             /* Bytes, header included */
+    uint32_t _reserved;
+    dnsasm_hash_key_t key;     /* Hash seed chosen at init */
+    uint8_t  _pad[16];
+} dnsasm_filter_t;
+
+/*
+ * Buffer size for a filter sized for capacity names.
+ *
+ * @return          Bytes needed, 0 past 4 GiB
+ */
+size_t dnsasm_filter_size(size_t capacity);
+
+/*
+ * Set up an empty filter in out.
+ *
+ * @param out       Output buffer, 64-byte aligned
+ * @param out_size  Size of out, at least dnsasm_filter_size(capacity)
+ * @param capacity  Names it will hold
+ * @param key       Hash seed (from a CSPRNG; guessing it only buys an
+ *                  attacker false positives)
+ * @return          0, DNSASM_ERR_SPACE, DNSASM_ERR_OVERFLOW or
+ *                  DNSASM_ERR_FORMAT if out is misaligned
+ */
+int dnsasm_filter_init(uint8_t *out, size_t out_size, size_t capacity,
+                        const dnsasm_hash_key_t *key);
+
+/*
+ * Add a name, ignoring case. Adds must be serialized with each other
+ * but may run alongside dnsasm_filter_match on other threads.
+ *
+ * @return          0, DNSASM_ERR_NAME for a malformed name, or
+ *                  DNSASM_ERR_SPACE once capacity names are in (build
+ *                  a bigger filter)
+ */
+int dnsasm_filter_add(dnsasm_filter_t *filter, const uint8_t *name, size_t len);
+
+/*
+ * Validate a serialized filter before use.
+ *
+ * @param buf       Serialized filter, 64-byte aligned
+ * @param len       Bytes available
+ * @param out       Output: the filter, aliasing buf
+ * @return          0, DNSASM_ERR_SHORT or DNSASM_ERR_FORMAT
+ */
+int dnsasm_filter_open(const uint8_t *buf, size_t len, const dnsasm_filter_t **out);
+
+/*
+ * Probe a name and each of its ancestors below the root. The suffix
+ * hashes come from one right-to-left pass over the name, and all the
+ * blocks are prefetched before the first is tested.
+ *
+ * @param filter    Filter
+ * @param name      Uncompressed wire name
+ * @param len       Length of name
+ * @return          Offset of the longest suffix that may have been
+ *                  added, -1 if none was (or name is malformed)
+ */
+int dnsasm_filter_match(const dnsasm_filter_t *filter, const uint8_t *name, size_t len);
+
+/* ============================================================================
+ * Prefix Tables
+ * ============================================================================ */
+
+#define DNSASM_LPM_MAGIC        0x504c4d5341534e44ULL   /* "DNSASMLP" */
+#define DNSASM_LPM_VERSION      1
+#define DNSASM_LPM_NONE         0x7FFFFFFFu             /* No prefix covers */
+
+/* One prefix to paint into a table */
+typedef struct {
+    uint8_t  addr[16];         /* Network, IPv4 in the first 4 bytes */
+    uint8_t  family;           /* 4 or 6 */
+    uint8_t  prefix_len;       /* 0-32 or 0-128; host bits are ignored */
+    uint16_t _pad;
+    uint32_t value;            /* Below DNSASM_LPM_NONE (an action, a view) */
+} dnsasm_lpm_entry_t;
+
+/*
+ * Immutable longest-prefix-match table for client address policy (ACLs,
+ * rate limit exemptions, views). Each family is a multibit trie with a
+ * 16-bit first stride and 8-bit strides after it, so an IPv4 lookup is
+ * at most three dependent loads whatever the number of prefixes. One
+ * flat buffer in host byte order: this header, the IPv4 and IPv6 root
+ * arrays of 65536 entries each, then chunk_count chunks of 256 entries.
+ * An entry is a value, or a chunk index with bit 31 set.
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t magic;            /* DNSASM_LPM_MAGIC */
+    uint32_t version;          /* DNSASM_LPM_VERSION */
+    uint32_t chunk_count;      /* 256-entry chunks after the roots */
+    uint32_t size;             /* Bytes in use, header included */
+    uint32_t count;            /* Entries painted */
+    uint8_t  _pad[40];
+} dnsasm_lpm_t;
+
+/*
+ * Buffer size dnsasm_lpm_build needs for a list of entries.
+ *
+ * @param entries   Prefixes
+ * @param count     Number of entries
+ * @return          Bytes needed, 0 if the table would pass 4 GiB
+ */
+size_t dnsasm_lpm_size(const dnsasm_lpm_entry_t *entries, size_t count);
+
+/*
+ * Build a table by painting each entry's value over its address range
+ * in list order, so a later entry wins where it overlaps an earlier
+ * one. Sort by prefix length for longest-prefix semantics; put
+ * overriding entries (denies over allows) last for precedence.
+ *
+ * @param entries   Prefixes
+ * @param count     Number of entries
+ * @param out       Output buffer, 64-byte aligned
+ * @param out_size  Size of out, at least dnsasm_lpm_size()
+ * @return          0, DNSASM_ERR_FORMAT for a bad family, length or
+ *                  value or a misaligned out, or DNSASM_ERR_SPACE; the
+ *                  bytes to keep or save are ((dnsasm_lpm_t *)out)->size
+ */
+int dnsasm_lpm_build(const dnsasm_lpm_entry_t *entries, size_t count,
+                      uint8_t *out, size_t out_size);
+
+/*
+ * Validate a serialized table before use. Every chunk index is
+ * bounds-checked, so lookups in an opened table are safe.
+ *
+ * @param buf       Serialized table, 64-byte aligned
+ * @param len       Bytes available
+ * @param out       Output: the table, aliasing buf
+ * @return          0, DNSASM_ERR_SHORT or DNSASM_ERR_FORMAT
+ */
+int dnsasm_lpm_open(const uint8_t *buf, size_t len, const dnsasm_lpm_t **out);
+
+/*
+ * Value of the last-painted prefix covering an address.
+ *
+ * @return          The value, or DNSASM_LPM_NONE
+ */
+uint32_t dnsasm_lpm_lookup4(const dnsasm_lpm_t *lpm, const uint8_t addr[4]);
+uint32_t dnsasm_lpm_lookup6(const dnsasm_lpm_t *lpm, const uint8_t addr[16]);
+
+/*
+ * Look up the address of a sockaddr_in or sockaddr_in6 as received from
+ * recvfrom or recvmsg. IPv4-mapped IPv6 addresses (::ffff:a.b.c.d) are
+ * looked up as IPv4, as dual-stack sockets report IPv4 clients.
+ *
+ * @param sa        Socket address
+ * @param len       Length of sa
+ * @return          The value, or DNSASM_LPM_NONE (also for other
+ *                  families and short addresses)
+ */
+uint32_t dnsasm_lpm_lookup_sockaddr(const dnsasm_lpm_t *lpm, const void *sa, size_t len);
+
+/* ============================================================================
+ * DNS Cookies
+ * ============================================================================ */
+
+#define DNSASM_COOKIE_CLIENT_LEN    8     /* Client cookie (RFC 7873) */
+#define DNSASM_COOKIE_SERVER_LEN    16    /* Server cookie (RFC 9018) */
+#define DNSASM_COOKIE_VERSION       1
+
+/* Outcome of checking a COOKIE option */
+#define DNSASM_COOKIE_CLIENT        0     /* Client cookie only */
+#define DNSASM_COOKIE_VALID         1     /* Server cookie good: echo it */
+#define DNSASM_COOKIE_RENEW         2     /* Good but aging or under the
+                                             previous secret: send a new one */
+#define DNSASM_COOKIE_BAD           3     /* Server cookie wrong, or of
+                                             another version or length */
+#define DNSASM_COOKIE_EXPIRED       4     /* Timestamp outside the window */
+#define DNSASM_COOKIE_FORMERR       5     /* Option length illegal: FORMERR */
+
+/*
+ * Server secrets. The current one signs; cookies signed under the
+ * previous one are still accepted (as RENEW) for a rotation period.
+ * Each secret is 16 bytes read as two little-endian words, as SipHash
+ * keys are.
+ */
+typedef struct {
+    dnsasm_hash_key_t current;
+    dnsasm_hash_key_t previous;
+    uint32_t has_previous;     /* 0 until the first rotation */
+    uint32_t _pad;
+} dnsasm_cookie_secrets_t;
+
+/*
+ * One request of a batch. The option is the COOKIE option data as it
+ * sits in the packet (see dnsasm_edns_t.cookie).
+ */
+typedef struct {
+    const uint8_t *option;     /* COOKIE option data */
+    uint16_t option_len;
+    uint8_t  addr_len;         /* 4 or 16; IPv4-mapped counts as IPv4 */
+    uint8_t  status;           /* Output: DNSASM_COOKIE_* */
+    uint8_t  addr[16];         /* Client address */
+    uint8_t  reply[DNSASM_COOKIE_SERVER_LEN];  /* Output: server cookie to
+                                                  send, unless FORMERR */
+} dnsasm_cookie_req_t;
+
+/*
+ * Make an RFC 9018 server cookie: version 1, three reserved bytes, the
+ * timestamp and SipHash-2-4 of the client cookie, those 8 bytes and the
+ * client address under the secret.
+ *
+ * @param secret    Server secret
+ * @param client    Client cookie
+ * @param addr      Client address
+ * @param addr_len  4 or 16
+ * @param now       Current time in seconds (Unix time, mod 2^32)
+ * @param out       Output server cookie
+ * @return          0, or DNSASM_ERR_FORMAT for another address length
+ */
+int dnsasm_cookie_make(const dnsasm_hash_key_t *secret, const uint8_t client[8],
+                        const uint8_t *addr, size_t addr_len, uint32_t now,
+                        uint8_t out[DNSASM_COOKIE_SERVER_LEN]);
+
+/*
+ * Check the COOKIE option of a request and produce the server cookie
+ * for the reply. A timestamp more than an hour old or five minutes
+ * ahead is EXPIRED; one past half an hour gets RENEW. The current and
+ * previous secrets and the fresh cookie are hashed in one 4-lane pass.
+ *
+ * @param secrets   Server secrets
+ * @param option    COOKIE option data
+ * @param option_len Length of option
+ * @param addr      Client address
+ * @param addr_len  4 or 16
+ * @param now       Current time in seconds
+ * @param reply     Output: server cookie to send, unless FORMERR
+ * @return          DNSASM_COOKIE_*, or DNSASM_ERR_FORMAT for another
+ *                  address length
+ */
+int dnsasm_cookie_check(const dnsasm_cookie_secrets_t *secrets,
+                         const uint8_t *option, size_t option_len,
+                         const uint8_t *addr, size_t addr_len, uint32_t now,
+                         uint8_t reply[DNSASM_COOKIE_SERVER_LEN]);
+
+/*
+ * dnsasm_cookie_check for many requests (a recvmmsg batch). Hashes from
+ * different requests share SIMD lanes, IPv4 and IPv6 clients in
+ * separate groups since their messages differ in length.
+ *
+ * @return          0, or DNSASM_ERR_FORMAT (before any work) if an
+ *                  address length is neither 4 nor 16
+ */
+int dnsasm_cookie_check_batch(const dnsasm_cookie_secrets_t *secrets,
+                               dnsasm_cookie_req_t *reqs, size_t count, uint32_t now);
+
+/* ============================================================================
+ * Statistics
+ * ============================================================================ */
+
+/*
+ * Hot-path counters, compiled in with STATS=1 (-DDNSASM_STATS) and
+ * absent otherwise. Each thread counts into its own cache-line-aligned
+ * slot with plain loads and stores, so the parse path takes no lock and
+ * no atomic read-modify-write; a snapshot sums every slot.
+ *
+ * Errors are counted where they are detected, once per failed call, by
+ * the parse entry points (header, question, RR, name, batch, message
+ * index, EDNS, classification). Name lengths and pointer hops cover
+ * decompressed names; qtypes cover question parsing, not
+ * classification. The asm variant's decompressor counts no hops.
+ */
+
+#define DNSASM_STATS_ERRORS         16      /* Indexed by -error code */
+#define DNSASM_STATS_NAME_BUCKETS   16      /* Decompressed length / 16 */
+#define DNSASM_STATS_QTYPES         257     /* qtype 0-255, the rest in 256 */
+
+/* Every field is a uint64_t counter */
+typedef struct {
+    uint64_t threads;                               /* Threads counting now */
+    uint64_t names;                                 /* Names decompressed */
+    uint64_t pointer_hops;                          /* Compression pointers followed */
+    uint64_t errors[DNSASM_STATS_ERRORS];           /* errors[-DNSASM_ERR_x], [0] unknown */
+    uint64_t name_len[DNSASM_STATS_NAME_BUCKETS];   /* By decompressed length / 16 */
+    uint64_t qtype[DNSASM_STATS_QTYPES];            /* Questions by qtype */
+} dnsasm_stats_t;
+
+/*
+ * Whether this build counts (STATS=1).
+ */
+int dnsasm_stats_enabled(void);
+
+/*
+ * Sum the counters of every thread that has used the library, including
+ * threads that have exited. Counters only grow; diff two snapshots for
+ * rates. A snapshot taken while other threads parse may miss their
+ * latest increments but never tears a counter. All zero when
+ * dnsasm_stats_enabled() is 0.
+ *
+ * @param out       Output totals
+ */
+void dnsasm_stats_snapshot(dnsasm_stats_t *out);
+
+/* ============================================================================
+ * Batched Socket I/O
+ * ============================================================================ */
+
+/*
+ * A UDP socket owned by the library, read with recvmmsg into a receive
+ * ring and written with sendmmsg from a response queue, so a burst of
+ * queries costs two system calls instead of two per datagram. All
+ * buffers are allocated at open. A handle belongs to one thread; run
+ * one per worker with DNSASM_IO_REUSEPORT to spread load across
+ * sockets. Where recvmmsg is missing the same calls loop over recvmsg
+ * and sendmsg.
+ *
+ * The typical loop is receive, answer each slot with dnsasm_io_queue,
+ * receive again: dnsasm_io_recv flushes what was queued first.
+ *
+ * DNSASM_IO_URING moves the handle onto io_uring where the kernel has
+ * multishot receive and provided buffer rings (Linux 6.0): one armed
+ * recvmsg keeps filling kernel-selected buffers, queued responses are
+ * submitted with the next wait and left in flight while the next batch
+ * is handled, and while datagrams keep arriving a receive is served
+ * from the completion queue without a system call. The send queue is
+ * then twice tx_size * batch bytes.
+ * Otherwise the flag is ignored; dnsasm_io_backend says which runs.
+ */
+
+#define DNSASM_IO_MAX_BATCH     DNSASM_BATCH_MAX  /* One dnsasm_parse_batch */
+#define DNSASM_IO_DEFAULT_SIZE  4096              /* Default slot size */
+
+/* dnsasm_io_config_t.flags */
+#define DNSASM_IO_REUSEPORT     0x01    /* SO_REUSEPORT: one socket per worker */
+#define DNSASM_IO_URING         0x02    /* io_uring where the kernel has it */
+
+typedef struct dnsasm_io dnsasm_io_t;
+
+/* A zero batch or size takes the default */
+typedef struct {
+    uint32_t batch;            /* Datagrams per system call, at most
+                                  DNSASM_IO_MAX_BATCH (the default) */
+    uint32_t rx_size;          /* Receive slot bytes; longer datagrams are
+                                  handed over with length 0 */
+    uint32_t tx_size;          /* Largest response that can be queued */
+    int32_t  timeout_ms;       /* How long dnsasm_io_recv waits for the
+                                  first datagram; negative blocks, 0
+                                  only takes what is already there */
+    uint32_t sockbuf;          /* SO_RCVBUF/SO_SNDBUF bytes, 0 keeps the
+                                  system default */
+    uint32_t flags;            /* DNSASM_IO_* */
+} dnsasm_io_config_t;
+
+/* Sender of a received datagram */
+typedef struct {
+    uint8_t  addr[16];         /* IPv4 (and IPv4-mapped) in the first 4 bytes */
+    uint8_t  addr_len;         /* 4 or 16 */
+    uint8_t  _pad;
+    uint16_t port;             /* Host byte order */
+} dnsasm_io_peer_t;
+
+/* Running totals; safe to read from another thread */
+typedef struct {
+    uint64_t recv_calls;       /* Receives that waited in the kernel and
+                                  returned data */
+    uint64_t received;         /* Datagrams received */
+    uint64_t truncated;        /* Received longer than rx_size */
+    uint64_t send_calls;       /* Send system calls, or batches handed
+                                  to io_uring */
+    uint64_t sent;             /* Responses the kernel accepted */
+    uint64_t send_errors;      /* Responses the kernel refused */
+} dnsasm_io_counters_t;
+
+/*
+ * Open and bind a UDP socket.
+ *
+ * @param addr      Address to bind, 4 or 16 bytes; NULL binds the IPv6
+ *                  wildcard accepting IPv4 too, or the IPv4 wildcard on
+ *                  hosts without IPv6
+ * @param addr_len  4, 16, or 0 with a NULL addr
+ * @param port      Port in host byte order, 0 for an ephemeral one
+ * @param cfg       Settings, or NULL for the defaults
+ * @return          Handle, or NULL with errno set (EINVAL for a bad
+ *                  address length or batch)
+ */
+dnsasm_io_t *dnsasm_io_open(const uint8_t *addr, size_t addr_len, uint16_t port,
+                             const dnsasm_io_config_t *cfg);
+
+/*
+ * Flush what is queued, close the socket and free the handle.
+ */
+void dnsasm_io_close(dnsasm_io_t *io);
+
+/*
+ * Make every later dnsasm_io_recv fail with ESHUTDOWN and wake one that
+ * is waiting (on Linux; elsewhere it returns when its timeout runs
+ * out). Besides dnsasm_io_backend and dnsasm_io_counters, the only
+ * call that may come from another thread.
+ */
+void dnsasm_io_shutdown(dnsasm_io_t *io);
+
+/*
+ * Bound port in host byte order.
+ */
+uint16_t dnsasm_io_port(const dnsasm_io_t *io);
+
+/*
+ * Which backend the handle runs on: "io_uring", "recvmmsg", or
+ * "recvmsg" where recvmmsg is missing. A handle drops from io_uring to
+ * the socket calls if the kernel turns the multishot receive down; this
+ * may be asked from any thread.
+ */
+const char *dnsasm_io_backend(const dnsasm_io_t *io);
+
+/*
+ * Flush the queue, then wait up to the configured timeout for a
+ * datagram and take every one ready, up to the batch size, in a single
+ * recvmmsg (or from the io_uring completion queue). Results stay valid
+ * until the next call.
+ *
+ * @return          Number of datagrams, 0 on timeout or signal, or -1
+ *                  with errno set (ESHUTDOWN after dnsasm_io_shutdown)
+ */
+int dnsasm_io_recv(dnsasm_io_t *io);
+
+/*
+ * The receive ring, fixed for the life of the handle and filled in by
+ * each dnsasm_io_recv: packets[i] is slot i's datagram, lens[i] and
+ * peers[i] describe it. packets and lens feed dnsasm_parse_batch
+ * directly. With io_uring the packets entries themselves change on each
+ * receive, pointing into the kernel's buffers.
+ */
+const uint8_t *const *dnsasm_io_packets(const dnsasm_io_t *io);
+const uint16_t *dnsasm_io_lens(const dnsasm_io_t *io);
+const dnsasm_io_peer_t *dnsasm_io_peers(const dnsasm_io_t *io);
+
+/*
+ * Copy a response to the sender of a slot of the last receive into the
+ * send queue. A full queue is flushed first.
+ *
+ * @param io        Handle
+ * @param slot      Index into the last receive
+ * @param data      Response
+ * @param len       Length, at most tx_size
+ * @return          0, DNSASM_ERR_SPACE if len exceeds tx_size, or
+ *                  DNSASM_ERR_FORMAT if slot was not received
+ */
+int dnsasm_io_queue(dnsasm_io_t *io, uint32_t slot, const uint8_t *data, size_t len);
+
+/*
+ * Send everything queued with as few sendmmsg calls as the kernel
+ * allows. A response the kernel refuses is dropped and counted.
+ *
+ * @return          Number of responses sent, or -1 with errno set if
+ *                  the socket failed
+ */
+int dnsasm_io_flush(dnsasm_io_t *io);
+
+/*
+ * Read the running totals.
+ */
+void dnsasm_io_counters(const dnsasm_io_t *io, dnsasm_io_counters_t *out);
+
+/*
+ * A TCP listener handing out accepted sockets in batches, for servers
+ * that run the connections themselves (DoT, TCP DNS). With
+ * DNSASM_IO_URING one multishot accept stays armed and a burst of
+ * connections is collected from the completion queue; otherwise it is
+ * poll and accept4 until the backlog is empty. Of the config only
+ * timeout_ms, sockbuf and the flags apply.
+ */
+
+typedef struct dnsasm_io_listener dnsasm_io_listener_t;
+
+/*
+ * Open, bind and listen on a TCP socket (SO_REUSEADDR set).
+ *
+ * @param addr      Address to bind, as for dnsasm_io_open
+ * @param addr_len  4, 16, or 0 with a NULL addr
+ * @param port      Port in host byte order, 0 for an ephemeral one
+ * @param cfg       Settings, or NULL for the defaults
+ * @return          Listener, or NULL with errno set
+ */
+dnsasm_io_listener_t *dnsasm_io_listen(const uint8_t *addr, size_t addr_len, uint16_t port,
+                                       const dnsasm_io_config_t *cfg);
+
+/*
+ * Wait up to the configured timeout for connections and take every one
+ * ready, up to max. The descriptors are blocking, close-on-exec and
+ * belong to the caller.
+ *
+ * @param l         Listener
+ * @param fds       Receives the accepted descriptors
+ * @param max       Room in fds
+ * @return          Number accepted, 0 on timeout or signal, or -1 with
+ *                  errno set (ESHUTDOWN after
+ *                  dnsasm_io_listener_shutdown, EMFILE and the like)
+ */
+int dnsasm_io_accept(dnsasm_io_listener_t *l, int *fds, size_t max);
+
+/*
+ * Make every later dnsasm_io_accept fail with ESHUTDOWN and wake one
+ * that is waiting. The only call that may come from another thread.
+ */
+void dnsasm_io_listener_shutdown(dnsasm_io_listener_t *l);
+
+/*
+ * Close the listening socket, and any connection accepted but not yet
+ * taken, and free the listener.
+ */
+void dnsasm_io_listener_close(dnsasm_io_listener_t *l);
+
+/*
+ * Bound port in host byte order.
+ */
+uint16_t dnsasm_io_listener_port(const dnsasm_io_listener_t *l);
+
+/*
+ * Which backend the listener runs on: "io_uring" or "accept". May be
+ * asked from any thread.
+ */
+const char *dnsasm_io_listener_backend(const dnsasm_io_listener_t *l);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,90 @@
+/*
+ * DNSASM - Cached Response Aging
+ *
+ * Turns stored wire responses back into answers without unpacking them:
+ * one walk rewrites the TTLs, one compare-and-copy restores the client's
+ * ID and question casing.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+int dnsasm_age_ttls(uint8_t *buf, size_t len, uint32_t elapsed, uint32_t min_ttl) {
+    if (len < DNS_HEADER_SIZE) {
+        return DNSASM_ERR_SHORT;
+    }
+
+    size_t pos = DNS_HEADER_SIZE;
+    uint16_t qdcount = load16(buf + 4);
+    uint32_t rrcount = (uint32_t)load16(buf + 6) + load16(buf + 8) + load16(buf + 10);
+
+    for (uint16_t i = 0; i < qdcount; i++) {
+        size_t name_len;
+        int err = skip_name(buf, len, pos, &name_len);
+        if (err != DNSASM_OK) {
+            return err;
+        }
+        pos += name_len + 4;
+        if (pos > len) {
+            return DNSASM_ERR_SHORT;
+        }
+    }
+
+    for (uint32_t i = 0; i < rrcount; i++) {
+        size_t name_len;
+        int err = skip_name(buf, len, pos, &name_len);
+        if (err != DNSASM_OK) {
+            return err;
+        }
+        uint8_t *rr = buf + pos + name_len;
+        if (pos + name_len + DNS_RR_FIXED_LEN > len) {
+            return DNSASM_ERR_SHORT;
+        }
+        pos += name_len + DNS_RR_FIXED_LEN + load16(rr + 8);
+        if (pos > len) {
+            return DNSASM_ERR_SHORT;
+        }
+
+        if (load16(rr) == DNS_TYPE_OPT) {
+            continue;
+        }
+        uint32_t ttl = load32(rr + 4);
+        if (ttl > min_ttl) {
+            ttl = ttl - min_ttl > elapsed ? ttl - elapsed : min_ttl;
+            store32(rr + 4, ttl);
+        }
+    }
+
+    return DNSASM_OK;
+}
+
+int dnsasm_patch_response(uint8_t *buf, size_t len,
+                           const uint8_t *query, size_t query_len) {
+    if (len < DNS_HEADER_SIZE || query_len < DNS_HEADER_SIZE) {
+        return DNSASM_ERR_SHORT;
+    }
+    memcpy(buf, query, 2);
+
+    if (load16(buf + 4) == 0 || load16(query + 4) == 0) {
+        return DNSASM_OK;
+    }
+
+    size_t n = plain_name_len(buf, len, DNS_HEADER_SIZE);
+    if (n == 0 || n != plain_name_len(query, query_len, DNS_HEADER_SIZE)) {
+        return DNSASM_ERR_NAME;
+    }
+
+    /* Label lengths are below 'A', so folding them is harmless */
+    const uint8_t *q = query + DNS_HEADER_SIZE;
+    uint8_t *r = buf + DNS_HEADER_SIZE;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t a = q[i], b = r[i];
+        a |= (uint8_t)(((uint8_t)(a - 'A') < 26) << 5);
+        b |= (uint8_t)(((uint8_t)(b - 'A') < 26) << 5);
+        if (a != b) {
+            return DNSASM_ERR_NAME;
+        }
+    }
+    memcpy(r, q, n);
+    return DNSASM_OK;
+}
@@ -0,0 +1,128 @@
+/*
+ * DNSASM - Query Classification
+ *
+ * One call per request that folds every admission check into a verdict,
+ * so a server routes a packet with a single switch and malformed floods
+ * never reach a general-purpose parser.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+static inline uint32_t classify_done(dnsasm_query_class_t *out,
+                                     uint32_t action) {
+    out->verdict |= action;
+    return out->verdict;
+}
+
+static inline uint32_t classify_error(dnsasm_query_class_t *out, int err) {
+    out->error = err;
+    out->verdict |= DNSASM_CLASS_MALFORMED;
+    return classify_done(out, DNSASM_CLASS_FORMERR);
+}
+
+uint32_t dnsasm_classify_query(const uint8_t *packet, size_t len,
+                                dnsasm_query_class_t *out) {
+    memset(out, 0, sizeof(*out));
+
+    if (len < DNS_HEADER_SIZE) {
+        out->error = stats_error(DNSASM_ERR_SHORT);
+        out->verdict = DNSASM_CLASS_SHORT;
+        return classify_done(out, DNSASM_CLASS_DROP);
+    }
+
+    uint16_t flags = load16(packet + 2);
+    uint16_t qdcount = load16(packet + 4);
+    uint8_t opcode = (flags >> 11) & 0x0F;
+
+    out->id = load16(packet);
+    out->flags = flags;
+
+    /* Never answer a response: that is how reflection loops start */
+    if (flags & 0x8000) {
+        out->verdict = DNSASM_CLASS_RESPONSE;
+        return classify_done(out, DNSASM_CLASS_DROP);
+    }
+
+    if (opcode != DNS_OPCODE_QUERY) {
+        out->verdict |= DNSASM_CLASS_OPCODE;
+        if (opcode != DNS_OPCODE_NOTIFY && opcode != DNS_OPCODE_UPDATE) {
+            return classify_done(out, DNSASM_CLASS_NOTIMP);
+        }
+    }
+    if (qdcount == 0) {
+        out->verdict |= DNSASM_CLASS_NO_QD;
+    } else if (qdcount > 1) {
+        out->verdict |= DNSASM_CLASS_MULTI_QD;
+    }
+    if (load16(packet + 6) != 0 || load16(packet + 8) != 0) {
+        out->verdict |= DNSASM_CLASS_RECORDS;
+    }
+
+    /* Questions */
+    size_t pos = DNS_HEADER_SIZE;
+    for (uint16_t i = 0; i < qdcount; i++) {
+        size_t name_len;
+        int err = skip_name(packet, len, pos, &name_len);
+        if (err != DNSASM_OK) {
+            return classify_error(out, err);
+        }
+        if (pos + name_len + 4 > len) {
+            return classify_error(out, stats_error(DNSASM_ERR_SHORT));
+        }
+        if (i == 0) {
+            out->qname_len = (uint16_t)name_len;
+            out->qtype = load16(packet + pos + name_len);
+            out->qclass = load16(packet + pos + name_len + 2);
+        }
+        pos += name_len + 4;
+    }
+    out->question_end = (uint16_t)pos;
+
+    /* Answer, authority, additional (OPT, TSIG) */
+    dnsasm_scan_t scan;
+    int err = scan_records(packet, len, pos, &out->edns, &scan);
+    if (err != DNSASM_OK) {
+        /* Whatever OPT came before the fault is not to be trusted */
+        memset(&out->edns, 0, sizeof(out->edns));
+        if (err == DNSASM_ERR_EDNS) {
+            out->verdict |= DNSASM_CLASS_BAD_OPT;
+        }
+        return classify_error(out, err);
+    }
+    out->end = scan.end;
+
+    if (scan.tsig_off != 0) {
+        out->verdict |= DNSASM_CLASS_TSIG;
+    }
+    if (scan.end < len) {
+        out->verdict |= DNSASM_CLASS_TRAILING;
+    }
+    if (out->edns.present) {
+        out->verdict |= DNSASM_CLASS_EDNS;
+        if (out->edns.dnssec_ok) {
+            out->verdict |= DNSASM_CLASS_DO;
+        }
+        if (out->edns.version > 0) {
+            out->verdict |= DNSASM_CLASS_BADVERS;
+        }
+        if (out->edns.cookie.off != 0) {
+            out->verdict |= DNSASM_CLASS_COOKIE;
+        }
+    }
+
+    /* A query with no question is only legal as a cookie probe (RFC 7873 5.4) */
+    if ((out->verdict & DNSASM_CLASS_NO_QD) &&
+        !(out->verdict & (DNSASM_CLASS_COOKIE | DNSASM_CLASS_OPCODE))) {
+        return classify_done(out, DNSASM_CLASS_FORMERR);
+    }
+
+    if (out->verdict & (DNSASM_CLASS_OPCODE | DNSASM_CLASS_NO_QD |
+                        DNSASM_CLASS_MULTI_QD | DNSASM_CLASS_RECORDS |
+                        DNSASM_CLASS_TSIG | DNSASM_CLASS_TRAILING |
+                        DNSASM_CLASS_BADVERS)) {
+        return classify_done(out, DNSASM_CLASS_SLOW);
+    }
+
+    return classify_done(out, DNSASM_CLASS_FAST);
+}
@@ -0,0 +1,256 @@
+/*
+ * DNSASM - DNS Cookies
+ *
+ * RFC 9018 server cookies, checked and minted straight from the COOKIE
+ * option bytes and the client address. When a server enforces cookies
+ * under attack every request carries one, so the hashes of a batch are
+ * packed four to a SIMD pass: a request needs up to three (its cookie
+ * under the current and the previous secret, and the reply's fresh
+ * cookie), and all hashes for one address family have the same length.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#define MAX_WORDS       5           /* 32-byte IPv6 message plus the length word */
+#define CHUNK           32          /* Requests per pass over the lanes */
+#define WINDOW_PAST     3600        /* RFC 9018 4.3: older is expired */
+#define WINDOW_FUTURE   300         /* Further ahead is expired */
+#define RENEW_AGE       1800        /* Older gets a fresh cookie */
+
+/* ============================================================================
+ * SipHash-2-4
+ * ============================================================================ */
+
+static uint64_t siphash24(uint64_t k0, uint64_t k1, const uint64_t *m, size_t words,
+                          size_t stride) {
+    sip_state_t s;
+    const dnsasm_hash_key_t key = {k0, k1};
+    sip_init(&s, &key);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t x = m[w * stride];
+        s.v3 ^= x;
+        sip_round(&s);
+        sip_round(&s);
+        s.v0 ^= x;
+    }
+    s.v2 ^= 0xff;
+    for (int r = 0; r < 4; r++) {
+        sip_round(&s);
+    }
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+void dnsasm_siphash24_x4_c(const uint64_t k0[4], const uint64_t k1[4],
+                           const uint64_t *m, size_t words, uint64_t out[4]) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = siphash24(k0[i], k1[i], m + i, words, 4);
+    }
+}
+
+/* ============================================================================
+ * Cookie messages
+ * ============================================================================ */
+
+/* Hashes waiting for a lane, all over messages of `words` words */
+typedef struct {
+    size_t words;
+    int n;
+    uint64_t k0[4], k1[4];
+    uint64_t m[MAX_WORDS * 4];
+    uint64_t *out[4];
+} lanes_t;
+
+static void lanes_flush(lanes_t *l) {
+    if (l->n == 0) {
+        return;
+    }
+    /* Idle lanes repeat lane 0; their results are dropped */
+    for (int i = l->n; i < 4; i++) {
+        l->k0[i] = l->k0[0];
+        l->k1[i] = l->k1[0];
+        for (size_t w = 0; w < l->words; w++) {
+            l->m[w * 4 + i] = l->m[w * 4];
+        }
+    }
+    uint64_t h[4];
+    dnsasm_siphash24_x4(l->k0, l->k1, l->m, l->words, h);
+    for (int i = 0; i < l->n; i++) {
+        *l->out[i] = h[i];
+    }
+    l->n = 0;
+}
+
+static void lanes_push(lanes_t *l, const dnsasm_hash_key_t *key, const uint64_t *msg,
+                       uint64_t *out) {
+    int i = l->n;
+    l->k0[i] = key->k0;
+    l->k1[i] = key->k1;
+    for (size_t w = 0; w < l->words; w++) {
+        l->m[w * 4 + i] = msg[w];
+    }
+    l->out[i] = out;
+    if (++l->n == 4) {
+        lanes_flush(l);
+    }
+}
+
+/*
+ * Padded SipHash words of client cookie | version | reserved |
+ * timestamp | address. Returns the word count: 3 for IPv4, 5 for IPv6.
+ */
+static size_t cookie_message(uint64_t msg[MAX_WORDS], const uint8_t client[8],
+                             uint32_t ts, const uint8_t *addr, size_t addr_len) {
+    uint8_t buf[MAX_WORDS * 8] = {0};
+    size_t len = 16 + addr_len;
+    memcpy(buf, client, 8);
+    buf[8] = DNSASM_COOKIE_VERSION;
+    store32(buf + 12, ts);
+    memcpy(buf + 16, addr, addr_len);
+
+    size_t words = len / 8 + 1;
+    for (size_t w = 0; w < words; w++) {
+        msg[w] = load64le(buf + 8 * w);
+    }
+    msg[words - 1] |= (uint64_t)len << 56;
+    return words;
+}
+
+static void cookie_bytes(uint8_t out[DNSASM_COOKIE_SERVER_LEN], uint32_t ts, uint64_t hash) {
+    out[0] = DNSASM_COOKIE_VERSION;
+    out[1] = out[2] = out[3] = 0;
+    store32(out + 4, ts);
+    for (int i = 0; i < 8; i++) {
+        out[8 + i] = (uint8_t)(hash >> (8 * i));
+    }
+}
+
+/* An IPv4-mapped IPv6 address is the IPv4 client a dual-stack socket saw */
+static const uint8_t *client_addr(const uint8_t *addr, size_t *len) {
+    static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+    if (*len == 16 && memcmp(addr, mapped, sizeof(mapped)) == 0) {
+        *len = 4;
+        return addr + 12;
+    }
+    return addr;
+}
+
+int dnsasm_cookie_make(const dnsasm_hash_key_t *secret, const uint8_t client[8],
+                        const uint8_t *addr, size_t addr_len, uint32_t now,
+                        uint8_t out[DNSASM_COOKIE_SERVER_LEN]) {
+    if (addr_len != 4 && addr_len != 16) {
+        return DNSASM_ERR_FORMAT;
+    }
+    addr = client_addr(addr, &addr_len);
+    uint64_t msg[MAX_WORDS];
+    size_t words = cookie_message(msg, client, now, addr, addr_len);
+    cookie_bytes(out, now, siphash24(secret->k0, secret->k1, msg, words, 1));
+    return DNSASM_OK;
+}
+
+/* ============================================================================
+ * Checking
+ * ============================================================================ */
+
+/* Status from the option shape and timestamp; VALID means "hash it" */
+static int precheck(const uint8_t *opt, size_t len, uint32_t now) {
+    if (len == DNSASM_COOKIE_CLIENT_LEN) {
+        return DNSASM_COOKIE_CLIENT;
+    }
+    if (len < DNSASM_COOKIE_CLIENT_LEN + 8 || len > DNSASM_COOKIE_CLIENT_LEN + 32) {
+        return DNSASM_COOKIE_FORMERR;
+    }
+    if (len != DNSASM_COOKIE_CLIENT_LEN + DNSASM_COOKIE_SERVER_LEN ||
+        opt[8] != DNSASM_COOKIE_VERSION) {
+        return DNSASM_COOKIE_BAD;
+    }
+    int32_t ahead = (int32_t)(load32(opt + 12) - now);
+    if (ahead > WINDOW_FUTURE || ahead < -WINDOW_PAST) {
+        return DNSASM_COOKIE_EXPIRED;
+    }
+    return DNSASM_COOKIE_VALID;
+}
+
+int dnsasm_cookie_check_batch(const dnsasm_cookie_secrets_t *secrets,
+                               dnsasm_cookie_req_t *reqs, size_t count, uint32_t now) {
+    for (size_t i = 0; i < count; i++) {
+        if (reqs[i].addr_len != 4 && reqs[i].addr_len != 16) {
+            return DNSASM_ERR_FORMAT;
+        }
+    }
+
+    for (size_t base = 0; base < count; base += CHUNK) {
+        size_t n = count - base < CHUNK ? count - base : CHUNK;
+        uint64_t h[CHUNK][3];           /* Current, previous, fresh */
+        lanes_t lanes[2] = {{.words = 3}, {.words = 5}};
+
+        for (size_t j = 0; j < n; j++) {
+            dnsasm_cookie_req_t *r = &reqs[base + j];
+            r->status = (uint8_t)precheck(r->option, r->option_len, now);
+            if (r->status == DNSASM_COOKIE_FORMERR) {
+                continue;
+            }
+
+            size_t alen = r->addr_len;
+            const uint8_t *addr = client_addr(r->addr, &alen);
+            lanes_t *l = &lanes[alen == 16];
+            uint64_t msg[MAX_WORDS];
+
+            cookie_message(msg, r->option, now, addr, alen);
+            lanes_push(l, &secrets->current, msg, &h[j][2]);
+            if (r->status == DNSASM_COOKIE_VALID) {
+                cookie_message(msg, r->option, load32(r->option + 12), addr, alen);
+                lanes_push(l, &secrets->current, msg, &h[j][0]);
+                if (secrets->has_previous) {
+                    lanes_push(l, &secrets->previous, msg, &h[j][1]);
+                }
+            }
+        }
+        lanes_flush(&lanes[0]);
+        lanes_flush(&lanes[1]);
+
+        for (size_t j = 0; j < n; j++) {
+            dnsasm_cookie_req_t *r = &reqs[base + j];
+            if (r->status == DNSASM_COOKIE_FORMERR) {
+                continue;
+            }
+            if (r->status == DNSASM_COOKIE_VALID) {
+                uint64_t got = load64le(r->option + 16);
+                uint32_t ts = load32(r->option + 12);
+                if (h[j][0] == got) {
+                    if ((int32_t)(now - ts) > RENEW_AGE) {
+                        r->status = DNSASM_COOKIE_RENEW;
+                    }
+                } else if (secrets->has_previous && h[j][1] == got) {
+                    r->status = DNSASM_COOKIE_RENEW;
+                } else {
+                    r->status = DNSASM_COOKIE_BAD;
+                }
+            }
+            if (r->status == DNSASM_COOKIE_VALID) {
+                memcpy(r->reply, r->option + 8, DNSASM_COOKIE_SERVER_LEN);
+            } else {
+                cookie_bytes(r->reply, now, h[j][2]);
+            }
+        }
+    }
+    return DNSASM_OK;
+}
+
+int dnsasm_cookie_check(const dnsasm_cookie_secrets_t *secrets,
+                         const uint8_t *option, size_t option_len,
+                         const uint8_t *addr, size_t addr_len, uint32_t now,
+                         uint8_t reply[DNSASM_COOKIE_SERVER_LEN]) {
+    if (addr_len != 4 && addr_len != 16) {
+        return DNSASM_ERR_FORMAT;
+    }
+    dnsasm_cookie_req_t r = {
+        .option = option,
+        .option_len = (uint16_t)(option_len < 0xFFFF ? option_len : 0xFFFF),
+        .addr_len = (uint8_t)addr_len,
+    };
+    memcpy(r.addr, addr, addr_len);
+    dnsasm_cookie_check_batch(secrets, &r, 1, now);
+    memcpy(reply, r.reply, DNSASM_COOKIE_SERVER_LEN);
+    return r.status;
+}
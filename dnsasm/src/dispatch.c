@@ -0,0 +1,141 @@
+/*
+ * DNSASM - Runtime Kernel Dispatch
+ *
+ * Every build carries all the implementations its architecture can
+ * compile. One is chosen once at load time from CPUID, best first; the
+ * DNSASM_IMPL environment variable forces a specific one (for A/B
+ * testing), and dnsasm_select_impl() switches at runtime.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int always_supported(void) {
+    return 1;
+}
+
+static const dnsasm_impl_t impl_c = {
+    "c", always_supported, dnsasm_decompress_name_c, dnsasm_name_equal_c,
+    dnsasm_siphash24_x4_c,
+};
+
+#ifdef DNSASM_HAVE_ASM
+static const dnsasm_impl_t impl_asm = {
+    "asm", always_supported, dnsasm_decompress_name_asm, dnsasm_name_equal_c,
+    dnsasm_siphash24_x4_c,
+};
+#endif
+
+/*
+ * Preference order, best first. The C kernel always qualifies, so the
+ * hand-written code of USE_ASM=1 builds is never picked on its own; it
+ * runs only when asked for by name (DNSASM_IMPL=asm).
+ */
+static const dnsasm_impl_t *const impls[] = {
+#if defined(__x86_64__)
+    &dnsasm_impl_avx512bw,
+    &dnsasm_impl_avx2,
+    &dnsasm_impl_sse42,
+#endif
+    &impl_c,
+#ifdef DNSASM_HAVE_ASM
+    &impl_asm,
+#endif
+};
+
+#define IMPL_COUNT (sizeof(impls) / sizeof(impls[0]))
+
+/* Portable until the constructor runs, so early callers are still safe */
+static const dnsasm_impl_t *active = &impl_c;
+
+static inline const dnsasm_impl_t *current(void) {
+    return __atomic_load_n(&active, __ATOMIC_RELAXED);
+}
+
+__attribute__((constructor))
+static void init_impl(void) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+#endif
+
+    const char *forced = getenv("DNSASM_IMPL");
+    if (forced != NULL && forced[0] != '\0' && dnsasm_select_impl(forced) == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < IMPL_COUNT; i++) {
+        if (impls[i]->supported()) {
+            __atomic_store_n(&active, impls[i], __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+/*
+ * Report the implementation in use.
+ */
+const char *dnsasm_active_impl(void) {
+    return current()->name;
+}
+
+/*
+ * Switch implementation by name.
+ */
+int dnsasm_select_impl(const char *name) {
+    for (size_t i = 0; i < IMPL_COUNT; i++) {
+        if (strcmp(impls[i]->name, name) == 0) {
+            if (!impls[i]->supported()) {
+                return -1;
+            }
+            __atomic_store_n(&active, impls[i], __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * List the implementations this CPU can run.
+ */
+size_t dnsasm_impl_names(const char **names, size_t max) {
+    size_t n = 0;
+    for (size_t i = 0; i < IMPL_COUNT && n < max; i++) {
+        if (impls[i]->supported()) {
+            names[n++] = impls[i]->name;
+        }
+    }
+    return n;
+}
+
+/*
+ * Decompress a DNS name using the selected implementation.
+ */
+dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
+                                        size_t offset, uint8_t *out,
+                                        uint16_t *out_len) {
+    dnsasm_result_t result = current()->decompress_name(packet, len, offset, out, out_len);
+    if (result.error != DNSASM_OK) {
+        stats_error(result.error);
+    } else {
+        stats_name(*out_len);
+    }
+    return result;
+}
+
+/*
+ * Compare two names using the selected implementation.
+ */
+int dnsasm_name_equal(const uint8_t *a, size_t a_len,
+                       const uint8_t *b, size_t b_len) {
+    return current()->name_equal(a, a_len, b, b_len);
+}
+
+/*
+ * Four-lane SipHash-2-4 using the selected implementation.
+ */
+void dnsasm_siphash24_x4(const uint64_t k0[4], const uint64_t k1[4],
+                         const uint64_t *m, size_t words, uint64_t out[4]) {
+    current()->siphash24_x4(k0, k1, m, words, out);
+}
@@ -11,27 +11,18 @@
  */
 
 #include "dnsasm.h"
+#include "internal.h"
 #include <string.h>
 
-/* Byte swap 16-bit value */
-static inline uint16_t bswap16(uint16_t x) {
-    return (x >> 8) | (x << 8);
-}
-
-/* Byte swap 32-bit value */
-static inline uint32_t bswap32(uint32_t x) {
-    return ((x >> 24) & 0xff) |
-           ((x >> 8) & 0xff00) |
-           ((x << 8) & 0xff0000) |
-           ((x << 24) & 0xff000000);
-}
-
+#ifndef DNSASM_HAVE_ASM
 /*
  * Parse DNS header from packet.
+ *
+ * With USE_ASM=1 this comes from header.asm / header.s instead.
  */
 int dnsasm_parse_header(const uint8_t *packet, size_t len, dnsasm_header_t *out) {
     if (len < DNS_HEADER_SIZE) {
-        return DNSASM_ERR_SHORT;
+        return stats_error(DNSASM_ERR_SHORT);
     }
 
     /* Parse 16-bit fields with byte swap */
@@ -54,16 +45,21 @@ int dnsasm_parse_header(const uint8_t *packet, size_t len, dnsasm_header_t *out)
 
     return DNSASM_OK;
 }
+#endif /* DNSASM_HAVE_ASM */
 
 /*
- * Decompress a DNS name.
- * 
+ * Decompress a DNS name (portable reference implementation).
+ *
+ * This is the "c" entry in the dispatch table and the oracle every
+ * other variant is tested against; dnsasm_decompress_name itself lives
+ * in dispatch.c.
+ *
  * Returns wire bytes consumed in result.offset (high 32 bits).
  * Returns error code in result.error (low 32 bits).
  */
-dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
-                                        size_t offset, uint8_t *out,
-                                        uint16_t *out_len) {
+dnsasm_result_t dnsasm_decompress_name_c(const uint8_t *packet, size_t len,
+                                          size_t offset, uint8_t *out,
+                                          uint16_t *out_len) {
     dnsasm_result_t result = {0, 0};
     size_t out_pos = 0;
     size_t wire_len = 0;
@@ -71,7 +67,13 @@ dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
     int ptr_count = 0;
     size_t pos = offset;
 
-    while (pos < len) {
+    for (;;) {
+        /* Running off the end before the root label is a short packet */
+        if (pos >= len) {
+            result.error = DNSASM_ERR_SHORT;
+            return result;
+        }
+
         uint8_t label_len = packet[pos];
 
         /* Check for compression pointer */
@@ -102,6 +104,7 @@ dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
                 return result;
             }
 
+            stats_hop();
             pos = ptr;
             continue;
         }
@@ -169,7 +172,7 @@ dnsasm_result_t dnsasm_parse_question(const uint8_t *packet, size_t len,
 
     /* Check room for qtype + qclass */
     if (pos + 4 > len) {
-        result.error = DNSASM_ERR_SHORT;
+        result.error = stats_error(DNSASM_ERR_SHORT);
         result.offset = 0;
         return result;
     }
@@ -178,6 +181,7 @@ dnsasm_result_t dnsasm_parse_question(const uint8_t *packet, size_t len,
     out->qtype = bswap16(*(const uint16_t *)(packet + pos));
     out->qclass = bswap16(*(const uint16_t *)(packet + pos + 2));
     out->wire_len = (uint16_t)(wire_len + 4);
+    stats_qtype(out->qtype);
 
     result.error = DNSASM_OK;
     result.offset = (uint32_t)(pos + 4);  /* Offset after question */
@@ -202,7 +206,7 @@ dnsasm_result_t dnsasm_parse_rr(const uint8_t *packet, size_t len,
 
     /* Check room for type(2) + class(2) + ttl(4) + rdlength(2) = 10 bytes */
     if (pos + 10 > len) {
-        result.error = DNSASM_ERR_SHORT;
+        result.error = stats_error(DNSASM_ERR_SHORT);
         result.offset = 0;
         return result;
     }
@@ -217,7 +221,7 @@ dnsasm_result_t dnsasm_parse_rr(const uint8_t *packet, size_t len,
 
     /* Check room for rdata */
     if (pos + out->rdlength > len) {
-        result.error = DNSASM_ERR_SHORT;
+        result.error = stats_error(DNSASM_ERR_SHORT);
         result.offset = 0;
         return result;
     }
@@ -230,6 +234,99 @@ dnsasm_result_t dnsasm_parse_rr(const uint8_t *packet, size_t len,
     return result;
 }
 
+/*
+ * Parse a batch of queries into structure-of-arrays form.
+ */
+size_t dnsasm_parse_batch(const uint8_t *const *packets, const uint16_t *lens,
+                           size_t count, dnsasm_batch_t *out) {
+    size_t ok = 0;
+
+    if (count > DNSASM_BATCH_MAX) {
+        count = DNSASM_BATCH_MAX;
+    }
+
+    /* Warm up the first few packets before the loop needs them */
+    for (size_t i = 0; i < count && i < DNSASM_BATCH_PREFETCH; i++) {
+        __builtin_prefetch(packets[i], 0, 3);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *packet = packets[i];
+        size_t len = lens[i];
+
+        /* Pull in header and the start of the qname for a later packet */
+        if (i + DNSASM_BATCH_PREFETCH < count) {
+            const uint8_t *next = packets[i + DNSASM_BATCH_PREFETCH];
+            __builtin_prefetch(next, 0, 3);
+            __builtin_prefetch(next + 64, 0, 3);
+        }
+
+        out->qtype[i] = 0;
+        out->qclass[i] = 0;
+        out->name_off[i] = 0;
+        out->name_len[i] = 0;
+
+        if (len < DNS_HEADER_SIZE) {
+            out->id[i] = 0;
+            out->flags[i] = 0;
+            out->qdcount[i] = 0;
+            out->ancount[i] = 0;
+            out->nscount[i] = 0;
+            out->arcount[i] = 0;
+            out->error[i] = (int8_t)stats_error(DNSASM_ERR_SHORT);
+            continue;
+        }
+
+        out->id[i]      = bswap16(*(const uint16_t *)(packet + 0));
+        out->flags[i]   = bswap16(*(const uint16_t *)(packet + 2));
+        out->qdcount[i] = bswap16(*(const uint16_t *)(packet + 4));
+        out->ancount[i] = bswap16(*(const uint16_t *)(packet + 6));
+        out->nscount[i] = bswap16(*(const uint16_t *)(packet + 8));
+        out->arcount[i] = bswap16(*(const uint16_t *)(packet + 10));
+
+        if (out->qdcount[i] == 0) {
+            out->error[i] = DNSASM_OK;
+            ok++;
+            continue;
+        }
+
+        size_t wire_len;
+        int err = skip_name(packet, len, DNS_HEADER_SIZE, &wire_len);
+        if (err != DNSASM_OK) {
+            out->error[i] = (int8_t)err;
+            continue;
+        }
+        /* Slots hand out the name bytes as they are, so no pointers. A
+           name ends in its root label or in a pointer; only a label byte
+           of 0xC0 or above before the root looks like the latter */
+        const uint8_t *end = packet + DNS_HEADER_SIZE + wire_len;
+        if (end[-1] != 0 ||
+            (wire_len >= 2 && (end[-2] & 0xC0) == 0xC0 &&
+             plain_name_len(packet, len, DNS_HEADER_SIZE) != wire_len)) {
+            out->error[i] = (int8_t)stats_error(DNSASM_ERR_POINTER);
+            continue;
+        }
+
+        size_t pos = DNS_HEADER_SIZE + wire_len;
+        if (pos + 4 > len) {
+            out->error[i] = (int8_t)stats_error(DNSASM_ERR_SHORT);
+            continue;
+        }
+
+        out->qtype[i]    = bswap16(*(const uint16_t *)(packet + pos));
+        out->qclass[i]   = bswap16(*(const uint16_t *)(packet + pos + 2));
+        out->name_off[i] = DNS_HEADER_SIZE;
+        out->name_len[i] = (uint16_t)wire_len;
+        out->error[i]    = DNSASM_OK;
+        stats_qtype(out->qtype[i]);
+        ok++;
+    }
+
+    out->count = (uint32_t)count;
+    return ok;
+}
+
+#ifndef DNSASM_HAVE_ASM
 /*
  * Build DNS header.
  */
@@ -244,6 +341,7 @@ size_t dnsasm_build_header(uint8_t *out, uint16_t id, uint16_t flags,
     *(uint16_t *)(out + 10) = bswap16(arcount);
     return DNS_HEADER_SIZE;
 }
+#endif /* DNSASM_HAVE_ASM */
 
 /*
  * Copy question section.
@@ -289,10 +387,10 @@ size_t dnsasm_build_a_record(uint8_t *out, const uint8_t *name, size_t name_len,
 }
 
 /*
- * Compare two DNS names (case-insensitive).
+ * Compare two DNS names (case-insensitive), portable reference.
  */
-int dnsasm_name_equal(const uint8_t *a, size_t a_len,
-                       const uint8_t *b, size_t b_len) {
+int dnsasm_name_equal_c(const uint8_t *a, size_t a_len,
+                        const uint8_t *b, size_t b_len) {
     if (a_len != b_len) {
         return 1;  /* Not equal */
     }
@@ -338,3 +436,33 @@ int dnsasm_name_find(const uint8_t *needle, size_t needle_len,
 
     return -1;  /* Not found */
 }
+
+/*
+ * Order two names canonically (RFC 4034 6.1).
+ */
+int dnsasm_name_compare(const uint8_t *a, size_t a_len,
+                         const uint8_t *b, size_t b_len) {
+    uint8_t a_off[128], b_off[128];
+    int na = label_offsets(a, a_len, a_off, NULL);
+    int nb = label_offsets(b, b_len, b_off, NULL);
+
+    /* Rightmost label first; within a label, folded bytes then length */
+    while (na > 0 && nb > 0) {
+        const uint8_t *x = a + a_off[--na];
+        const uint8_t *y = b + b_off[--nb];
+        uint8_t n = x[0] < y[0] ? x[0] : y[0];
+
+        for (uint8_t i = 1; i <= n; i++) {
+            uint8_t cx = x[i], cy = y[i];
+            cx |= (uint8_t)(((uint8_t)(cx - 'A') < 26) << 5);
+            cy |= (uint8_t)(((uint8_t)(cy - 'A') < 26) << 5);
+            if (cx != cy) {
+                return (int)cx - (int)cy;
+            }
+        }
+        if (x[0] != y[0]) {
+            return (int)x[0] - (int)y[0];
+        }
+    }
+    return na - nb;
+}
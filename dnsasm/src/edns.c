@@ -0,0 +1,133 @@
+/*
+ * DNSASM - EDNS(0) OPT Parser
+ *
+ * Locates the OPT pseudo-RR without decoding anything else and indexes
+ * the options the server acts on, so EDNS queries never need a full
+ * message unpack.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+/* Record one indexed option; a repeat makes the OPT ambiguous */
+static inline int index_option(dnsasm_edns_opt_t *opt, size_t off, uint16_t len) {
+    if (opt->off != 0) {
+        return stats_error(DNSASM_ERR_EDNS);
+    }
+    opt->off = (uint16_t)off;
+    opt->len = len;
+    return DNSASM_OK;
+}
+
+static int parse_options(const uint8_t *packet, size_t pos, size_t end,
+                         dnsasm_edns_t *out) {
+    while (pos < end) {
+        if (pos + 4 > end) {
+            return stats_error(DNSASM_ERR_EDNS);
+        }
+
+        uint16_t code = load16(packet + pos);
+        uint16_t opt_len = load16(packet + pos + 2);
+        size_t data = pos + 4;
+
+        if (data + opt_len > end) {
+            return stats_error(DNSASM_ERR_EDNS);
+        }
+
+        int err = DNSASM_OK;
+        switch (code) {
+        case DNS_EDNS_OPT_COOKIE:
+            err = index_option(&out->cookie, data, opt_len);
+            break;
+        case DNS_EDNS_OPT_ECS:
+            err = index_option(&out->ecs, data, opt_len);
+            break;
+        case DNS_EDNS_OPT_PADDING:
+            err = index_option(&out->padding, data, opt_len);
+            break;
+        case DNS_EDNS_OPT_KEEPALIVE:
+            err = index_option(&out->keepalive, data, opt_len);
+            break;
+        default:
+            break;
+        }
+        if (err != DNSASM_OK) {
+            return err;
+        }
+
+        out->option_count++;
+        pos = data + opt_len;
+    }
+
+    return DNSASM_OK;
+}
+
+int scan_records(const uint8_t *packet, size_t len, size_t offset,
+                 dnsasm_edns_t *out, dnsasm_scan_t *scan) {
+    memset(out, 0, sizeof(*out));
+    memset(scan, 0, sizeof(*scan));
+
+    if (len < DNS_HEADER_SIZE || offset < DNS_HEADER_SIZE) {
+        return stats_error(DNSASM_ERR_SHORT);
+    }
+
+    uint32_t skip = (uint32_t)load16(packet + 6) + load16(packet + 8);
+    uint32_t total = skip + load16(packet + 10);
+    size_t pos = offset;
+
+    for (uint32_t i = 0; i < total; i++) {
+        size_t name_len;
+        int err = skip_name(packet, len, pos, &name_len);
+        if (err != DNSASM_OK) {
+            return err;
+        }
+
+        size_t p = pos + name_len;
+        if (p + DNS_RR_FIXED_LEN > len) {
+            return stats_error(DNSASM_ERR_SHORT);
+        }
+
+        uint16_t type = load16(packet + p);
+        uint16_t rdlength = load16(packet + p + 8);
+        size_t rdata = p + DNS_RR_FIXED_LEN;
+        if (rdata + rdlength > len) {
+            return stats_error(DNSASM_ERR_SHORT);
+        }
+
+        if (i >= skip && type == DNS_TYPE_OPT) {
+            /* RFC 6891 6.1.1: exactly one OPT, owned by the root */
+            if (out->present || packet[pos] != 0) {
+                return stats_error(DNSASM_ERR_EDNS);
+            }
+
+            uint16_t flags = load16(packet + p + 6);
+
+            out->present = 1;
+            out->udp_size = load16(packet + p + 2);
+            out->ext_rcode = packet[p + 4];
+            out->version = packet[p + 5];
+            out->flags = flags;
+            out->dnssec_ok = (flags & DNS_EDNS_FLAG_DO) != 0;
+            out->rr_off = (uint16_t)pos;
+            out->rdlength = rdlength;
+
+            err = parse_options(packet, rdata, rdata + rdlength, out);
+            if (err != DNSASM_OK) {
+                return err;
+            }
+        } else if (i >= skip && type == DNS_TYPE_TSIG) {
+            scan->tsig_off = (uint16_t)pos;
+        }
+
+        pos = rdata + rdlength;
+    }
+
+    scan->end = (uint32_t)pos;
+    return DNSASM_OK;
+}
+
+int dnsasm_parse_edns(const uint8_t *packet, size_t len, size_t offset,
+                       dnsasm_edns_t *out) {
+    dnsasm_scan_t scan;
+    return scan_records(packet, len, offset, out, &scan);
+}
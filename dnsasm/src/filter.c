@@ -0,0 +1,221 @@
+/*
+ * DNSASM - Blocked Bloom Name Filter
+ *
+ * A negative cache for policy lookups: nearly every query matches no
+ * RPZ trigger, and this answers "definitely not" for the name and all
+ * its ancestors in a handful of cache lines and no locks.
+ *
+ * A name sets one bit in each of the 8 words of one 64-byte block.
+ * Suffix hashes are chained from the root label down, so a name's
+ * hash is a function of its parent's, and one pass over the labels
+ * yields the hash of every ancestor. The chain is a keyed multiply
+ * mix, not SipHash: a guessed key buys nothing but false positives.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#define BLOCK_WORDS     8
+#define BITS_PER_NAME   24          /* About 0.05% false positives */
+
+typedef struct {
+    uint64_t w[BLOCK_WORDS];
+} block_t;
+
+_Static_assert(sizeof(block_t) == 64, "block must be one cache line");
+_Static_assert(sizeof(dnsasm_filter_t) == 64, "header must be one cache line");
+
+static inline block_t *blocks(const dnsasm_filter_t *f) {
+    return (block_t *)(f + 1);
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t w) {
+    h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+/*
+ * Extend a suffix hash by one label (length byte included, case
+ * folded). A short tail is read as one word from inside the name and
+ * masked, rather than copied out byte by byte.
+ */
+static inline uint64_t hash_label(uint64_t h, const uint8_t *name, size_t len, size_t off) {
+    const uint8_t *label = name + off;
+    size_t n = 1 + (size_t)label[0];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, label + i, 8);
+        h = mix(h, fold64(w));
+    }
+    if (i < n) {
+        size_t r = n - i;
+        uint64_t w = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if (off + i + 8 <= len) {
+            memcpy(&w, label + i, 8);
+        } else if (len >= 8) {
+            memcpy(&w, name + len - 8, 8);
+            w >>= 8 * (off + i + 8 - len);
+        } else
+#endif
+        {
+            copy_small((uint8_t *)&w, label + i, r);
+        }
+        w &= ~0ULL >> (64 - 8 * r);
+        h = mix(h, fold64(w));
+    }
+    return h;
+}
+
+/* Murmur3 finalizer with the second key word folded in */
+static inline uint64_t finish(const dnsasm_filter_t *f, uint64_t h) {
+    h ^= f->key.k1;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+static inline const block_t *block_of(const dnsasm_filter_t *f, uint64_t h) {
+    return &blocks(f)[((h >> 32) * f->block_count) >> 32];
+}
+
+/* One bit per word: 6-bit indexes from the top 48 bits of a second multiply */
+static inline uint64_t bit_seed(uint64_t h) {
+    return (h ^ (h >> 32)) * 0x9e3779b97f4a7c15ULL;
+}
+
+static inline unsigned bit_index(uint64_t seed, int i) {
+    return (unsigned)(seed >> (16 + 6 * i)) & 63;
+}
+
+/*
+ * Hashes of a name's suffixes: hash[k] covers the labels from off[k]
+ * on. Returns the label count, or -1 if the name is malformed.
+ */
+static int suffix_hashes(const dnsasm_filter_t *f, const uint8_t *name, size_t len,
+                         uint8_t off[128], uint64_t hash[128]) {
+    size_t end;
+    int n = label_offsets(name, len, off, &end);
+    if (end >= len || name[end] != 0) {
+        return -1;
+    }
+    uint64_t h = f->key.k0;
+    for (int k = n - 1; k >= 0; k--) {
+        h = hash_label(h, name, len, off[k]);
+        hash[k] = finish(f, h);
+    }
+    if (n == 0) {
+        hash[0] = finish(f, h);
+    }
+    return n;
+}
+
+size_t dnsasm_filter_size(size_t capacity) {
+    if (capacity > UINT32_MAX) {
+        return 0;
+    }
+    size_t nb = (capacity * BITS_PER_NAME + 511) / 512;
+    size_t size = sizeof(dnsasm_filter_t) + (nb ? nb : 1) * sizeof(block_t);
+    return size <= UINT32_MAX ? size : 0;
+}
+
+int dnsasm_filter_init(uint8_t *out, size_t out_size, size_t capacity,
+                        const dnsasm_hash_key_t *key) {
+    size_t size = dnsasm_filter_size(capacity);
+    if (size == 0) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    if (((uintptr_t)out & 63) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (size > out_size) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    memset(out, 0, size);
+    dnsasm_filter_t *f = (dnsasm_filter_t *)out;
+    f->magic = DNSASM_FILTER_MAGIC;
+    f->version = DNSASM_FILTER_VERSION;
+    f->block_count = (uint32_t)((size - sizeof(dnsasm_filter_t)) / sizeof(block_t));
+    f->capacity = (uint32_t)capacity;
+    f->size = (uint32_t)size;
+    f->key = *key;
+    return DNSASM_OK;
+}
+
+int dnsasm_filter_add(dnsasm_filter_t *filter, const uint8_t *name, size_t len) {
+    uint8_t off[128];
+    uint64_t hash[128];
+    if (suffix_hashes(filter, name, len, off, hash) < 0) {
+        return DNSASM_ERR_NAME;
+    }
+    if (filter->count >= filter->capacity) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    /* Readers may be probing: set bits atomically, never clear them */
+    block_t *b = (block_t *)block_of(filter, hash[0]);
+    uint64_t seed = bit_seed(hash[0]);
+    for (int i = 0; i < BLOCK_WORDS; i++) {
+        __atomic_fetch_or(&b->w[i], 1ULL << bit_index(seed, i), __ATOMIC_RELAXED);
+    }
+    filter->count++;
+    return DNSASM_OK;
+}
+
+int dnsasm_filter_open(const uint8_t *buf, size_t len, const dnsasm_filter_t **out) {
+    *out = NULL;
+    if (len < sizeof(dnsasm_filter_t)) {
+        return DNSASM_ERR_SHORT;
+    }
+    if (((uintptr_t)buf & 63) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    const dnsasm_filter_t *f = (const dnsasm_filter_t *)buf;
+    if (f->magic != DNSASM_FILTER_MAGIC || f->version != DNSASM_FILTER_VERSION ||
+        f->block_count == 0 || f->count > f->capacity ||
+        (size_t)f->size != sizeof(dnsasm_filter_t) + (size_t)f->block_count * sizeof(block_t)) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (f->size > len) {
+        return DNSASM_ERR_SHORT;
+    }
+
+    *out = f;
+    return DNSASM_OK;
+}
+
+int dnsasm_filter_match(const dnsasm_filter_t *filter, const uint8_t *name, size_t len) {
+    uint8_t off[128];
+    uint64_t hash[128];
+    int n = suffix_hashes(filter, name, len, off, hash);
+    if (n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        n = 1;                      /* The root probes itself */
+        off[0] = 0;
+    }
+
+    for (int k = 0; k < n; k++) {
+        __builtin_prefetch(block_of(filter, hash[k]));
+    }
+    /* Most words of a block are sparse, so a miss usually shows in the first */
+    for (int k = 0; k < n; k++) {
+        const block_t *b = block_of(filter, hash[k]);
+        uint64_t seed = bit_seed(hash[k]);
+        int i = 0;
+        while (i < BLOCK_WORDS &&
+               ((__atomic_load_n(&b->w[i], __ATOMIC_RELAXED) >> bit_index(seed, i)) & 1)) {
+            i++;
+        }
+        if (i == BLOCK_WORDS) {
+            return off[k];
+        }
+    }
+    return -1;
+}
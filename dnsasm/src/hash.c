@@ -0,0 +1,152 @@
+/*
+ * DNSASM - Keyed Query Hashing
+ *
+ * Cache and table keys for (qname, qtype, qclass, DO/CD). The name is
+ * folded to lowercase during the run copy of decompression, then
+ * SipHash-1-3 runs over the canonical bytes while they are still in L1.
+ * The per-process key keeps remote clients from choosing collisions.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+/* ============================================================================
+ * SipHash-1-3
+ * ============================================================================ */
+
+static inline void sip_absorb(sip_state_t *s, uint64_t m) {
+    s->v3 ^= m;
+    sip_round(s);
+    s->v0 ^= m;
+}
+
+static inline uint64_t sip_final(sip_state_t *s) {
+    s->v2 ^= 0xff;
+    sip_round(s);
+    sip_round(s);
+    sip_round(s);
+    return s->v0 ^ s->v1 ^ s->v2 ^ s->v3;
+}
+
+/* ============================================================================
+ * ASCII case folding
+ * ============================================================================ */
+
+/* Words go through fold64; this handles the bytes left over */
+static inline uint8_t lower8(uint8_t c) {
+    return c | (uint8_t)(((uint8_t)(c - 'A') < 26) << 5);
+}
+
+/* copy_run_fn for decompress_name_runs: copy and fold in one move */
+static inline void lower_copy_run(uint8_t *dst, const uint8_t *src, size_t n) {
+    if (n < 8) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = lower8(src[i]);
+        }
+        return;
+    }
+
+    /* Folding is idempotent, so the last word may overlap the previous */
+    size_t i = 0;
+    for (; i + 8 < n; i += 8) {
+        uint64_t w;
+        memcpy(&w, src + i, 8);
+        w = fold64(w);
+        memcpy(dst + i, &w, 8);
+    }
+    uint64_t w;
+    memcpy(&w, src + n - 8, 8);
+    w = fold64(w);
+    memcpy(dst + n - 8, &w, 8);
+}
+
+/* ============================================================================
+ * Query hash
+ * ============================================================================ */
+
+/*
+ * Hash name (already lowercase if fold is 0) || qtype || qclass || bits.
+ * The 5 trailing bytes join the final partial word, so a name of any
+ * length costs (name_len + 5) / 8 + 1 compression rounds.
+ */
+static inline uint64_t query_hash(const dnsasm_hash_key_t *key,
+                                  const uint8_t *name, size_t name_len,
+                                  uint16_t qtype, uint16_t qclass,
+                                  uint8_t bits, int fold) {
+    sip_state_t s;
+    uint8_t tail[16] = {0};
+    size_t total = name_len + 5;
+    size_t rem = name_len & 7;
+    size_t i = 0;
+
+    sip_init(&s, key);
+
+    for (; i < name_len - rem; i += 8) {
+        uint64_t w = load64le(name + i);
+        if (fold) {
+            w = fold64(w);
+        }
+        sip_absorb(&s, w);
+    }
+
+    for (size_t j = 0; j < rem; j++) {
+        tail[j] = fold ? lower8(name[i + j]) : name[i + j];
+    }
+    store16(tail + rem, qtype);
+    store16(tail + rem + 2, qclass);
+    tail[rem + 4] = bits;
+    rem += 5;
+
+    size_t t = 0;
+    if (rem >= 8) {
+        sip_absorb(&s, load64le(tail));
+        t = 8;
+    }
+    tail[t + 7] = (uint8_t)total;
+    sip_absorb(&s, load64le(tail + t));
+
+    return sip_final(&s);
+}
+
+dnsasm_result_t dnsasm_parse_question_keyed(const uint8_t *packet, size_t len,
+                                             size_t offset, uint8_t bits,
+                                             const dnsasm_hash_key_t *key,
+                                             dnsasm_question_t *out,
+                                             uint64_t *hash) {
+    dnsasm_result_t result;
+
+    result = decompress_name_runs(packet, len, offset, out->name,
+                                  &out->name_len, lower_copy_run);
+    if (result.error != DNSASM_OK) {
+        stats_error(result.error);
+        return result;
+    }
+    stats_name(out->name_len);
+
+    size_t wire_len = result.offset;
+    size_t pos = offset + wire_len;
+
+    if (pos + 4 > len) {
+        result.error = stats_error(DNSASM_ERR_SHORT);
+        result.offset = 0;
+        return result;
+    }
+
+    out->qtype = load16(packet + pos);
+    out->qclass = load16(packet + pos + 2);
+    out->wire_len = (uint16_t)(wire_len + 4);
+    stats_qtype(out->qtype);
+
+    *hash = query_hash(key, out->name, out->name_len, out->qtype,
+                       out->qclass, bits, 0);
+
+    result.error = DNSASM_OK;
+    result.offset = (uint32_t)(pos + 4);
+    return result;
+}
+
+uint64_t dnsasm_hash_name(const dnsasm_hash_key_t *key, const uint8_t *name,
+                           size_t name_len, uint16_t qtype, uint16_t qclass,
+                           uint8_t bits) {
+    return query_hash(key, name, name_len, qtype, qclass, bits, 1);
+}
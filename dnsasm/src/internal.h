@@ -0,0 +1,467 @@
+/*
+ * DNSASM - Internal helpers shared by the C implementation files.
+ *
+ * Not installed; nothing here is part of the public ABI.
+ */
+
+#ifndef DNSASM_INTERNAL_H
+#define DNSASM_INTERNAL_H
+
+#include "dnsasm.h"
+#include <string.h>
+
+/* Byte swap 16-bit value */
+static inline uint16_t bswap16(uint16_t x) {
+    return (x >> 8) | (x << 8);
+}
+
+/* Byte swap 32-bit value */
+static inline uint32_t bswap32(uint32_t x) {
+    return ((x >> 24) & 0xff) |
+           ((x >> 8) & 0xff00) |
+           ((x << 8) & 0xff0000) |
+           ((x << 24) & 0xff000000);
+}
+
+/* Unaligned network-order loads and stores */
+static inline uint16_t load16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return bswap16(v);
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return bswap32(v);
+}
+
+static inline void store16(uint8_t *p, uint16_t v) {
+    v = bswap16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    v = bswap32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+/*
+ * Hot-path counters (STATS=1). A thread finds its slot through a
+ * thread-local pointer, attaching one on first use. Only the owning
+ * thread writes a slot, so an increment is a relaxed load and store
+ * (plain movs, no lock prefix) that dnsasm_stats_snapshot may read
+ * concurrently. Without DNSASM_STATS every hook compiles to nothing.
+ */
+#ifdef DNSASM_STATS
+typedef struct stats_slot {
+    dnsasm_stats_t c;
+    struct stats_slot *next;        /* Every slot, for the snapshot */
+    struct stats_slot *next_free;   /* Slots of exited threads */
+} __attribute__((aligned(64))) stats_slot_t;
+
+extern __thread stats_slot_t *dnsasm_stats_tls __attribute__((tls_model("initial-exec")));
+stats_slot_t *dnsasm_stats_attach(void);
+
+static inline stats_slot_t *stats_slot(void) {
+    stats_slot_t *s = dnsasm_stats_tls;
+    if (__builtin_expect(s == NULL, 0)) {
+        s = dnsasm_stats_attach();
+    }
+    return s;
+}
+
+static inline void stats_bump(uint64_t *c) {
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/* Count an error where it is detected; returns it for tail use */
+static inline int stats_error(int err) {
+    unsigned i = (unsigned)-err;
+    stats_bump(&stats_slot()->c.errors[i < DNSASM_STATS_ERRORS ? i : 0]);
+    return err;
+}
+
+static inline void stats_name(size_t name_len) {
+    stats_slot_t *s = stats_slot();
+    stats_bump(&s->c.names);
+    stats_bump(&s->c.name_len[(name_len >> 4) & (DNSASM_STATS_NAME_BUCKETS - 1)]);
+}
+
+static inline void stats_hop(void) {
+    stats_bump(&stats_slot()->c.pointer_hops);
+}
+
+static inline void stats_qtype(uint16_t qtype) {
+    stats_bump(&stats_slot()->c.qtype[qtype < 256 ? qtype : 256]);
+}
+#else
+static inline int stats_error(int err) { return err; }
+static inline void stats_name(size_t name_len) { (void)name_len; }
+static inline void stats_hop(void) {}
+static inline void stats_qtype(uint16_t qtype) { (void)qtype; }
+#endif
+
+/* Fixed part of an RR after the owner name: type, class, TTL, rdlength */
+#define DNS_RR_FIXED_LEN    10
+
+/*
+ * Skip over a (possibly compressed) name without following pointers.
+ *
+ * Validates label lengths and that a terminating pointer points
+ * backwards, then stores the number of wire bytes the name occupies at
+ * offset in *wire_len. Pointer targets are not visited; callers that
+ * need the name itself use dnsasm_decompress_name.
+ */
+static inline int skip_name(const uint8_t *packet, size_t len,
+                            size_t offset, size_t *wire_len) {
+    size_t pos = offset;
+
+    for (;;) {
+        if (pos >= len) {
+            return stats_error(DNSASM_ERR_SHORT);
+        }
+
+        uint8_t label_len = packet[pos];
+
+        if (label_len == 0) {
+            pos++;
+            break;
+        }
+        if ((label_len & 0xC0) == 0xC0) {
+            if (pos + 1 >= len) {
+                return stats_error(DNSASM_ERR_SHORT);
+            }
+            if ((size_t)(((label_len & 0x3F) << 8) | packet[pos + 1]) >= pos) {
+                return stats_error(DNSASM_ERR_POINTER);
+            }
+            pos += 2;
+            break;
+        }
+        if (label_len > 63) {
+            return stats_error(DNSASM_ERR_NAME);
+        }
+
+        pos += 1 + label_len;
+        if (pos - offset > DNS_MAX_NAME_LEN) {
+            return stats_error(DNSASM_ERR_OVERFLOW);
+        }
+    }
+
+    *wire_len = pos - offset;
+    return DNSASM_OK;
+}
+
+/* Length of an uncompressed name at pos, 0 if compressed or invalid */
+static inline size_t plain_name_len(const uint8_t *packet, size_t len, size_t pos) {
+    size_t start = pos;
+
+    while (pos < len && pos - start < DNS_MAX_NAME_LEN) {
+        uint8_t l = packet[pos];
+        if (l == 0) {
+            return pos + 1 - start;
+        }
+        if (l > 63) {
+            return 0;
+        }
+        pos += 1 + l;
+    }
+    return 0;
+}
+
+/*
+ * Offsets of the complete labels of an uncompressed name, root excluded
+ * (a name has at most 127). Stops at the root or the first bad label;
+ * *end, if given, is where it stopped.
+ */
+static inline int label_offsets(const uint8_t *name, size_t len, uint8_t off[128],
+                                size_t *end) {
+    int n = 0;
+    size_t pos = 0;
+
+    if (len > DNS_MAX_NAME_LEN) {
+        len = DNS_MAX_NAME_LEN;
+    }
+    while (pos < len && name[pos] != 0 && name[pos] <= 63 &&
+           pos + 1 + name[pos] <= len) {
+        off[n++] = (uint8_t)pos;
+        pos += 1 + name[pos];
+    }
+    if (end != NULL) {
+        *end = pos;
+    }
+    return n;
+}
+
+/* Where scan_records stopped and what else it saw on the way */
+typedef struct {
+    uint32_t end;          /* Offset after the last RR */
+    uint16_t tsig_off;     /* Offset of a TSIG RR in additional, 0 if none */
+} dnsasm_scan_t;
+
+/*
+ * Walk the answer, authority and additional sections from offset (just
+ * after the questions), decoding OPT into *edns (edns.c). Shared by
+ * dnsasm_parse_edns and dnsasm_classify_query.
+ */
+int scan_records(const uint8_t *packet, size_t len, size_t offset,
+                 dnsasm_edns_t *edns, dnsasm_scan_t *scan);
+
+/* ============================================================================
+ * SipHash core (hash.c runs 1-3 for table keys, cookie.c 2-4 for cookies)
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t v0, v1, v2, v3;
+} sip_state_t;
+
+static inline uint64_t rotl64(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline uint64_t load64le(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void sip_round(sip_state_t *s) {
+    s->v0 += s->v1; s->v1 = rotl64(s->v1, 13); s->v1 ^= s->v0; s->v0 = rotl64(s->v0, 32);
+    s->v2 += s->v3; s->v3 = rotl64(s->v3, 16); s->v3 ^= s->v2;
+    s->v0 += s->v3; s->v3 = rotl64(s->v3, 21); s->v3 ^= s->v0;
+    s->v2 += s->v1; s->v1 = rotl64(s->v1, 17); s->v1 ^= s->v2; s->v2 = rotl64(s->v2, 32);
+}
+
+static inline void sip_init(sip_state_t *s, const dnsasm_hash_key_t *key) {
+    s->v0 = key->k0 ^ 0x736f6d6570736575ULL;
+    s->v1 = key->k1 ^ 0x646f72616e646f6dULL;
+    s->v2 = key->k0 ^ 0x6c7967656e657261ULL;
+    s->v3 = key->k1 ^ 0x7465646279746573ULL;
+}
+
+/* ============================================================================
+ * Kernel Dispatch
+ * ============================================================================ */
+
+typedef dnsasm_result_t (*decompress_name_fn)(const uint8_t *packet, size_t len,
+                                              size_t offset, uint8_t *out,
+                                              uint16_t *out_len);
+
+typedef int (*name_equal_fn)(const uint8_t *a, size_t a_len,
+                             const uint8_t *b, size_t b_len);
+
+/*
+ * SipHash-2-4 of four messages of the same length at once, one per
+ * lane, each under its own key. Messages come already padded: m holds
+ * words * 4 words, word w of lane i at m[w * 4 + i], the last word
+ * carrying the length byte.
+ */
+typedef void (*siphash24_x4_fn)(const uint64_t k0[4], const uint64_t k1[4],
+                                const uint64_t *m, size_t words, uint64_t out[4]);
+
+/*
+ * One implementation of every dispatched kernel. dispatch.c picks one
+ * of these at load time; see dnsasm_active_impl().
+ */
+typedef struct {
+    const char *name;                      /* Value accepted by DNSASM_IMPL */
+    int (*supported)(void);                /* Can this CPU run it? */
+    decompress_name_fn decompress_name;
+    name_equal_fn name_equal;
+    siphash24_x4_fn siphash24_x4;
+} dnsasm_impl_t;
+
+/* Portable reference decompressor (dnsasm.c), the oracle for all others */
+dnsasm_result_t dnsasm_decompress_name_c(const uint8_t *packet, size_t len,
+                                          size_t offset, uint8_t *out,
+                                          uint16_t *out_len);
+
+/* Portable byte-loop name compare (dnsasm.c), likewise the oracle */
+int dnsasm_name_equal_c(const uint8_t *a, size_t a_len,
+                        const uint8_t *b, size_t b_len);
+
+/* Lane-by-lane SipHash-2-4 (cookie.c), the oracle for the vector ones */
+void dnsasm_siphash24_x4_c(const uint64_t k0[4], const uint64_t k1[4],
+                           const uint64_t *m, size_t words, uint64_t out[4]);
+
+/* The selected implementation's siphash24_x4 (dispatch.c) */
+void dnsasm_siphash24_x4(const uint64_t k0[4], const uint64_t k1[4],
+                         const uint64_t *m, size_t words, uint64_t out[4]);
+
+#if defined(__x86_64__)
+/* SIMD variants (simd_x86.c), built with per-function target attributes */
+extern const dnsasm_impl_t dnsasm_impl_sse42;
+extern const dnsasm_impl_t dnsasm_impl_avx2;
+extern const dnsasm_impl_t dnsasm_impl_avx512bw;
+#endif
+
+#ifdef DNSASM_HAVE_ASM
+/* Hand-written routines (x86_64/question.asm, arm64/question.s) */
+dnsasm_result_t dnsasm_decompress_name_asm(const uint8_t *packet, size_t len,
+                                            size_t offset, uint8_t *out,
+                                            uint16_t *out_len);
+#endif
+
+/* Copy 1..15 bytes with two overlapping moves instead of a byte loop */
+static inline void copy_small(uint8_t *dst, const uint8_t *src, size_t n) {
+    if (n >= 8) {
+        uint64_t a, b;
+        memcpy(&a, src, 8);
+        memcpy(&b, src + n - 8, 8);
+        memcpy(dst, &a, 8);
+        memcpy(dst + n - 8, &b, 8);
+    } else if (n >= 4) {
+        uint32_t a, b;
+        memcpy(&a, src, 4);
+        memcpy(&b, src + n - 4, 4);
+        memcpy(dst, &a, 4);
+        memcpy(dst + n - 4, &b, 4);
+    } else {
+        uint8_t a = src[0], b = src[n - 1], c = src[n / 2];
+        dst[0] = a;
+        dst[n - 1] = b;
+        dst[n / 2] = c;
+    }
+}
+
+/*
+ * Lowercase the ASCII letters in eight bytes at once. Only bytes in
+ * 'A'..'Z' change; the masking keeps carries inside each byte and
+ * excludes bytes with the top bit set.
+ */
+static inline uint64_t fold64(uint64_t x) {
+    uint64_t low7 = x & 0x7f7f7f7f7f7f7f7fULL;
+    uint64_t ge_a = low7 + 0x3f3f3f3f3f3f3f3fULL;   /* bit 7 set from 'A' */
+    uint64_t gt_z = low7 + 0x2525252525252525ULL;   /* bit 7 set above 'Z' */
+    uint64_t upper = ge_a & ~gt_z & ~x & 0x8080808080808080ULL;
+    return x | (upper >> 2);
+}
+
+/* Case-insensitive equality of two 0..15 byte strings, no byte loop */
+static inline int name_equal_small(const uint8_t *a, const uint8_t *b, size_t n) {
+    uint64_t x0 = 0, y0 = 0, x1, y1;
+
+    if (n >= 8) {
+        memcpy(&x0, a, 8);
+        memcpy(&y0, b, 8);
+        memcpy(&x1, a + n - 8, 8);
+        memcpy(&y1, b + n - 8, 8);
+        return ((fold64(x0) ^ fold64(y0)) | (fold64(x1) ^ fold64(y1))) != 0;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    copy_small((uint8_t *)&x0, a, n);
+    copy_small((uint8_t *)&y0, b, n);
+    return fold64(x0) != fold64(y0);
+}
+
+/*
+ * Run-based name decompression shared by the SIMD variants.
+ *
+ * An uncompressed stretch of labels is already in output format, so the
+ * label lengths are only walked to validate the run; copy_run then moves
+ * the whole run at once. Results and error precedence match
+ * dnsasm_decompress_name_c exactly. Always inlined so that each variant
+ * gets its own copy compiled for its target with copy_run inlined.
+ */
+typedef void (*copy_run_fn)(uint8_t *dst, const uint8_t *src, size_t n);
+
+static inline __attribute__((always_inline))
+dnsasm_result_t decompress_name_runs(const uint8_t *packet, size_t len,
+                                     size_t offset, uint8_t *out,
+                                     uint16_t *out_len, copy_run_fn copy_run) {
+    dnsasm_result_t result = {0, 0};
+    size_t out_pos = 0;
+    size_t wire_len = 0;
+    int counting_wire = 1;
+    int ptr_count = 0;
+    size_t pos = offset;
+    size_t run = offset;
+
+    for (;;) {
+        if (pos >= len) {
+            result.error = DNSASM_ERR_SHORT;
+            return result;
+        }
+
+        uint8_t label_len = packet[pos];
+
+        /* Pointer (11), reserved types (01/10) */
+        if (label_len & 0xC0) {
+            if ((label_len & 0xC0) != 0xC0) {
+                result.error = DNSASM_ERR_NAME;
+                return result;
+            }
+
+            if (pos > run) {
+                copy_run(out + out_pos, packet + run, pos - run);
+                out_pos += pos - run;
+                if (counting_wire) {
+                    wire_len += pos - run;
+                }
+            }
+
+            if (pos + 1 >= len) {
+                result.error = DNSASM_ERR_SHORT;
+                return result;
+            }
+
+            uint16_t ptr = ((label_len & 0x3F) << 8) | packet[pos + 1];
+
+            if (counting_wire) {
+                wire_len += 2;
+                counting_wire = 0;
+            }
+            if (++ptr_count > 127) {
+                result.error = DNSASM_ERR_LOOP;
+                return result;
+            }
+            if (ptr >= pos) {
+                result.error = DNSASM_ERR_POINTER;
+                return result;
+            }
+
+            stats_hop();
+            pos = run = ptr;
+            continue;
+        }
+
+        /* End of name */
+        if (label_len == 0) {
+            if (pos > run) {
+                copy_run(out + out_pos, packet + run, pos - run);
+                out_pos += pos - run;
+                if (counting_wire) {
+                    wire_len += pos - run;
+                }
+            }
+            out[out_pos++] = 0;
+            if (counting_wire) {
+                wire_len++;
+            }
+            break;
+        }
+
+        /* Regular label (1-63 by the mask test): extend the run */
+        pos += 1 + label_len;
+        if (pos > len) {
+            result.error = DNSASM_ERR_SHORT;
+            return result;
+        }
+        if (out_pos + (pos - run) > DNS_MAX_NAME_LEN) {
+            result.error = DNSASM_ERR_OVERFLOW;
+            return result;
+        }
+    }
+
+    *out_len = (uint16_t)out_pos;
+    result.offset = (uint32_t)wire_len;
+    result.error = DNSASM_OK;
+    return result;
+}
+
+#endif /* DNSASM_INTERNAL_H */
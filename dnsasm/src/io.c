@@ -0,0 +1,1325 @@
+/*
+ * DNSASM - Batched Socket I/O
+ *
+ * One UDP socket, a receive ring and a send queue. Every slot has its
+ * buffer, iovec, address and message header set up at open, so a
+ * receive is one poll and one recvmmsg and a flush is one sendmmsg in
+ * the common case. The send queue holds copies: responses are built in
+ * the caller's memory, which may move (Go) or be reused at once.
+ *
+ * The socket reads without blocking after poll and writes blocking, so
+ * a full send buffer pushes back on the worker instead of dropping
+ * answers.
+ *
+ * With DNSASM_IO_URING on Linux the same handle runs on io_uring
+ * instead: one multishot recvmsg keeps receiving into a ring of
+ * provided buffers without being resubmitted, responses go out as
+ * SENDMSG entries submitted together with the next wait, and a busy
+ * socket is served straight from the completion queue with no system
+ * call at all. The send queue has two halves that take turns, so one
+ * batch's answers stay in flight while the next is received and
+ * answered; their completions are reaped along with the receives. Receive slots then point into the provided buffers,
+ * which go back to the kernel on the next receive. TCP listeners get
+ * the equivalent multishot accept. Kernels without io_uring, provided
+ * buffer rings or multishot receive (before 6.0) keep the socket calls.
+ */
+
+#define _GNU_SOURCE
+#include "dnsasm.h"
+#include "internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined(__linux__) && defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_URING 1
+#endif
+
+#if defined(__linux__)
+typedef struct mmsghdr io_msg_t;
+#else
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned int  msg_len;
+} io_msg_t;
+#endif
+
+#ifdef HAVE_URING
+typedef struct uring uring_t;
+#else
+typedef void uring_t;
+#endif
+
+struct dnsasm_io {
+    int      fd;
+    int      down;                  /* Set by dnsasm_io_shutdown */
+    uint32_t batch;
+    uint32_t rx_size;
+    uint32_t tx_size;
+    int32_t  timeout_ms;
+    uint32_t rx_count;              /* Datagrams from the last receive */
+    uint32_t tx_count;              /* Responses queued */
+    uint32_t tx_base;               /* First slot of the half being queued */
+
+    dnsasm_io_counters_t counters;
+
+    /* Receive ring, batch entries each */
+    const uint8_t          **rx_packets;
+    uint16_t                *rx_lens;
+    dnsasm_io_peer_t        *rx_peers;
+    io_msg_t                *rx_msgs;
+    struct iovec            *rx_iov;
+    struct sockaddr_storage *rx_addr;
+    uint8_t                 *rx_buf;
+
+    /* Send queue */
+    io_msg_t                *tx_msgs;
+    struct iovec            *tx_iov;
+    struct sockaddr_storage *tx_addr;
+    uint8_t                 *tx_buf;
+
+    uring_t                 *ring;  /* Freed only by dnsasm_io_close */
+    int                      uring; /* Ring in use; 0: socket calls */
+};
+
+struct dnsasm_io_listener {
+    int      fd;
+    int      down;
+    int32_t  timeout_ms;
+    uring_t *ring;                  /* Freed only by dnsasm_io_listener_close */
+    int      uring;                 /* Ring in use; 0: accept calls */
+};
+
+/* Counters have one writer; relaxed stores keep other readers untorn */
+static inline void count_add(uint64_t *c, uint64_t n) {
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/* recvmmsg/sendmmsg, or their one-call-per-datagram equivalent */
+static int recv_batch(int fd, io_msg_t *msgs, unsigned int n) {
+#if defined(__linux__)
+    return recvmmsg(fd, msgs, n, MSG_DONTWAIT, NULL);
+#else
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        ssize_t r = recvmsg(fd, &msgs[i].msg_hdr, MSG_DONTWAIT);
+        if (r < 0) {
+            break;
+        }
+        msgs[i].msg_len = (unsigned int)r;
+    }
+    return i > 0 ? (int)i : -1;
+#endif
+}
+
+static int send_batch(int fd, io_msg_t *msgs, unsigned int n) {
+#if defined(__linux__)
+    return sendmmsg(fd, msgs, n, 0);
+#else
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        ssize_t r = sendmsg(fd, &msgs[i].msg_hdr, 0);
+        if (r < 0) {
+            break;
+        }
+        msgs[i].msg_len = (unsigned int)r;
+    }
+    return i > 0 ? (int)i : -1;
+#endif
+}
+
+static void set_peer(dnsasm_io_peer_t *p, const struct sockaddr_storage *ss) {
+    static const uint8_t mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+    memset(p, 0, sizeof(*p));
+    if (ss->ss_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)ss;
+        memcpy(p->addr, &in->sin_addr, 4);
+        p->addr_len = 4;
+        p->port = ntohs(in->sin_port);
+    } else if (ss->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)ss;
+        const uint8_t *a = in6->sin6_addr.s6_addr;
+        if (memcmp(a, mapped, sizeof(mapped)) == 0) {
+            memcpy(p->addr, a + 12, 4);
+            p->addr_len = 4;
+        } else {
+            memcpy(p->addr, a, 16);
+            p->addr_len = 16;
+        }
+        p->port = ntohs(in6->sin6_port);
+    }
+}
+
+static uint16_t local_port(int fd) {
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+    if (getsockname(fd, (struct sockaddr *)&ss, &len) != 0) {
+        return 0;
+    }
+    dnsasm_io_peer_t p;
+    set_peer(&p, &ss);
+    return p.port;
+}
+
+static int open_socket(int family, int type) {
+#ifdef SOCK_CLOEXEC
+    return socket(family, type | SOCK_CLOEXEC, 0);
+#else
+    int fd = socket(family, type, 0);
+    if (fd >= 0) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#endif
+}
+
+/* Socket bound as asked, or -1 with errno set */
+static int bind_socket(int type, const uint8_t *addr, size_t addr_len, uint16_t port,
+                       const dnsasm_io_config_t *cfg) {
+    struct sockaddr_storage ss;
+    socklen_t ss_len;
+    int fd;
+
+    memset(&ss, 0, sizeof(ss));
+    if (addr_len == 4) {
+        struct sockaddr_in *in = (struct sockaddr_in *)&ss;
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        memcpy(&in->sin_addr, addr, 4);
+        ss_len = sizeof(*in);
+        fd = open_socket(AF_INET, type);
+    } else {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&ss;
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        if (addr_len == 16) {
+            memcpy(&in6->sin6_addr, addr, 16);
+        }
+        ss_len = sizeof(*in6);
+        fd = open_socket(AF_INET6, type);
+        if (fd < 0 && addr_len == 0 && errno == EAFNOSUPPORT) {
+            static const uint8_t any4[4];
+            return bind_socket(type, any4, 4, port, cfg);
+        }
+        if (fd >= 0 && addr_len == 0) {
+            int off = 0;
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        }
+    }
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (type == SOCK_STREAM) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+#ifdef SO_REUSEPORT
+    if (cfg->flags & DNSASM_IO_REUSEPORT) {
+        int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+            goto fail;
+        }
+    }
+#endif
+    if (cfg->sockbuf != 0) {
+        /* Best effort: the kernel caps these at its own limits */
+        int size = cfg->sockbuf > INT32_MAX ? INT32_MAX : (int)cfg->sockbuf;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    if (bind(fd, (struct sockaddr *)&ss, ss_len) != 0) {
+        goto fail;
+    }
+    return fd;
+
+fail:;
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+static int check_addr(const uint8_t *addr, size_t addr_len) {
+    return addr_len == 4 || addr_len == 16 || (addr_len == 0 && addr == NULL);
+}
+
+/* ============================================================================
+ * io_uring
+ * ============================================================================ */
+
+#ifdef HAVE_URING
+
+/* user_data of each kind of submission */
+#define UD_RECV     1
+#define UD_SEND     2
+#define UD_WAKE     3
+#define UD_ACCEPT   4
+#define UD_SEND_B   5               /* A send from the second half */
+
+#define BUF_GROUP   0
+
+/* A completed receive not yet handed out */
+typedef struct {
+    int32_t  res;
+    uint32_t flags;
+} stashed_t;
+
+struct uring {
+    int      fd;
+    int      event_fd;              /* dnsasm_io_shutdown writes here */
+    unsigned to_submit;             /* Queued in the SQ, not yet entered */
+
+    /* Submission queue */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned  sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void   *sq_map, *cq_map;
+    size_t  sq_map_len, cq_map_len, sqes_len;
+
+    /* Provided buffers (UDP) */
+    struct io_uring_buf_ring *br;
+    size_t    br_len;
+    uint8_t  *bufs;
+    uint32_t  nbufs;
+    uint32_t  buf_size;
+    uint16_t  br_tail;
+    struct msghdr msg;              /* Sizes the name in each buffer */
+
+    int       armed;                /* Multishot recvmsg or accept live */
+    int       received;             /* Got data once: multishot works */
+    uint32_t  tx_inflight[2];       /* Sends submitted, not completed, by half */
+
+    stashed_t *stash;               /* Receive completions, FIFO */
+    uint32_t   stash_cap, stash_head, stash_count;
+    uint16_t  *held;                /* Buffer ids lent out by the last recv */
+    uint32_t   held_count;
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                     const void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+    return (int)syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+static void ring_free(uring_t *r) {
+    if (r == NULL) {
+        return;
+    }
+    if (r->fd >= 0) {
+        close(r->fd);               /* Cancels whatever is in flight */
+    }
+    if (r->event_fd >= 0) {
+        close(r->event_fd);
+    }
+    if (r->sqes != NULL) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_map != NULL && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_len);
+    }
+    if (r->sq_map != NULL) {
+        munmap(r->sq_map, r->sq_map_len);
+    }
+    if (r->br != NULL) {
+        munmap(r->br, r->br_len);
+    }
+    free(r->bufs);
+    free(r->stash);
+    free(r->held);
+    free(r);
+}
+
+/* Ring with room for sq submissions and cq completions, or NULL */
+static uring_t *ring_new(unsigned sq, unsigned cq) {
+    uring_t *r = calloc(1, sizeof(*r));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->fd = -1;
+    r->event_fd = -1;
+
+    /* No COOP_TASKRUN or SINGLE_ISSUER: Go moves the caller between
+       threads, and completions must not wait for the thread that armed
+       the receive to next enter the kernel */
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq;
+    r->fd = sys_setup(sq, &p);
+    if (r->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(p.features & IORING_FEAT_EXT_ARG)) {
+        goto fail;
+    }
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (r->cq_map_len > r->sq_map_len) {
+        r->sq_map_len = r->cq_map_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        goto fail;
+    }
+    r->cq_map = r->sq_map;
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+
+    uint8_t *sqm = r->sq_map;
+    r->sq_head = (unsigned *)(sqm + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sqm + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sqm + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sqm + p.sq_off.array);
+    r->sq_entries = p.sq_entries;
+    r->cq_head = (unsigned *)(sqm + p.cq_off.head);
+    r->cq_tail = (unsigned *)(sqm + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(sqm + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(sqm + p.cq_off.cqes);
+    return r;
+
+fail:;
+    int saved = errno;
+    ring_free(r);
+    errno = saved;
+    return NULL;
+}
+
+/* Submit what is queued; if wait, block for one completion or timeout_ms */
+static int ring_enter(uring_t *r, int wait, int32_t timeout_ms) {
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    unsigned flags = 0;
+    if (wait) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+    int n = sys_enter(r->fd, r->to_submit, wait ? 1 : 0, flags, wait ? &arg : NULL,
+                      wait ? sizeof(arg) : 0);
+    if (n >= 0) {
+        r->to_submit -= (unsigned)n < r->to_submit ? (unsigned)n : r->to_submit;
+    }
+    return n;
+}
+
+static struct io_uring_sqe *ring_sqe(uring_t *r) {
+    unsigned tail = *r->sq_tail;
+    if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries) {
+        ring_enter(r, 0, 0);        /* Full: hand what is there over first */
+        if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void ring_push(uring_t *r) {
+    __atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+}
+
+static int ring_arm_wake(uring_t *r) {
+    struct io_uring_sqe *sqe = ring_sqe(r);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = r->event_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = UD_WAKE;
+    ring_push(r);
+    return 0;
+}
+
+/* Hand a provided buffer back to the kernel (published by buf_publish) */
+static void buf_give(uring_t *r, uint16_t bid) {
+    struct io_uring_buf *b = &r->br->bufs[r->br_tail & (r->nbufs - 1)];
+    b->addr = (uint64_t)(uintptr_t)(r->bufs + (size_t)bid * r->buf_size);
+    b->len = r->buf_size;
+    b->bid = bid;
+    r->br_tail++;
+}
+
+static void buf_publish(uring_t *r) {
+    __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+}
+
+static int ring_arm_recv(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    struct io_uring_sqe *sqe = ring_sqe(r);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = io->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&r->msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = UD_RECV;
+    ring_push(r);
+    r->armed = 1;
+    return 0;
+}
+
+static int uring_open(dnsasm_io_t *io) {
+    /* Enough buffers for four bursts in flight, and a CQ to match */
+    uint32_t nbufs = 1;
+    while (nbufs < 4 * io->batch) {
+        nbufs <<= 1;
+    }
+    uring_t *r = ring_new(io->batch + 8, 2 * (nbufs + io->batch));
+    if (r == NULL) {
+        return -1;
+    }
+    io->ring = r;
+
+    /* Each buffer: io_uring_recvmsg_out, the sender address, the payload */
+    r->msg.msg_namelen = sizeof(struct sockaddr_in6);
+    r->nbufs = nbufs;
+    r->buf_size = (uint32_t)(sizeof(struct io_uring_recvmsg_out) + r->msg.msg_namelen +
+                             io->rx_size + 63) & ~63u;
+    r->br_len = (nbufs * sizeof(struct io_uring_buf) + 4095) & ~(size_t)4095;
+    r->br = mmap(NULL, r->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->br == MAP_FAILED) {
+        r->br = NULL;
+        goto fail;
+    }
+    r->bufs = aligned_alloc(64, (size_t)nbufs * r->buf_size);
+    r->stash_cap = nbufs + 4;
+    r->stash = calloc(r->stash_cap, sizeof(*r->stash));
+    r->held = calloc(io->batch, sizeof(*r->held));
+    if (r->bufs == NULL || r->stash == NULL || r->held == NULL) {
+        goto fail;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)r->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = BUF_GROUP;
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        goto fail;
+    }
+    for (uint32_t i = 0; i < nbufs; i++) {
+        buf_give(r, (uint16_t)i);
+    }
+    buf_publish(r);
+
+    r->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (r->event_fd < 0 || ring_arm_wake(r) != 0 || ring_arm_recv(io) != 0 ||
+        ring_enter(r, 0, 0) < 0) {
+        goto fail;
+    }
+    io->uring = 1;
+    return 0;
+
+fail:;
+    int saved = errno;
+    ring_free(r);
+    io->ring = NULL;
+    errno = saved;
+    return -1;
+}
+
+/*
+ * Back to socket calls, e.g. on a kernel without multishot recvmsg. The
+ * ring stays until close: dnsasm_io_shutdown may be writing its eventfd
+ * from another thread right now. The store pairs with the one of down
+ * there, so either this side sees down before it polls or that side
+ * sees the switch and shuts the socket down.
+ */
+static void uring_drop(dnsasm_io_t *io) {
+    __atomic_store_n(&io->uring, 0, __ATOMIC_SEQ_CST);
+    for (uint32_t i = 0; i < io->batch; i++) {
+        io->rx_packets[i] = io->rx_buf + (size_t)i * io->rx_size;
+    }
+}
+
+/* Drain the CQ: count sends, stash receives */
+static void uring_reap(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    uint64_t sent = 0, refused = 0;
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        switch (cqe->user_data) {
+        case UD_SEND:
+        case UD_SEND_B:
+            r->tx_inflight[cqe->user_data == UD_SEND_B]--;
+            if (cqe->res >= 0) {
+                sent++;
+            } else {
+                refused++;
+            }
+            break;
+        case UD_WAKE:
+            break;                  /* The down flag says it all */
+        case UD_RECV:
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                r->armed = 0;
+            }
+            if (r->stash_count < r->stash_cap) {
+                stashed_t *s = &r->stash[(r->stash_head + r->stash_count) % r->stash_cap];
+                s->res = cqe->res;
+                s->flags = cqe->flags;
+                r->stash_count++;
+            } else if (cqe->flags & IORING_CQE_F_BUFFER) {
+                /* Cannot happen: every stashed entry holds a buffer */
+                buf_give(r, (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+                buf_publish(r);
+            }
+            break;
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+    if (sent > 0) {
+        count_add(&io->counters.sent, sent);
+    }
+    if (refused > 0) {
+        count_add(&io->counters.send_errors, refused);
+    }
+}
+
+/*
+ * Move queued responses into SENDMSG submissions, entered later, and
+ * queue into the other half from now on. Its sends, if any are left,
+ * still read their slots; the caller waits them out.
+ */
+static void uring_queue_sends(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    uint32_t half = io->tx_base != 0;
+    uint32_t i;
+    for (i = 0; i < io->tx_count; i++) {
+        struct io_uring_sqe *sqe = ring_sqe(r);
+        if (sqe == NULL) {
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = io->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&io->tx_msgs[io->tx_base + i].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = half ? UD_SEND_B : UD_SEND;
+        ring_push(r);
+        r->tx_inflight[half]++;
+    }
+    if (i < io->tx_count) {
+        count_add(&io->counters.send_errors, io->tx_count - i);
+    }
+    if (i > 0) {
+        count_add(&io->counters.send_calls, 1);
+    }
+    io->tx_count = 0;
+    io->tx_base = half ? 0 : io->batch;
+}
+
+/* Wait until no send still reads the half about to be queued into */
+static int uring_wait_half(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    uint32_t half = io->tx_base != 0;
+    uring_reap(io);
+    while (r->tx_inflight[half] > 0) {
+        if (ring_enter(r, 1, -1) < 0 && errno != EINTR && errno != ETIME) {
+            return -1;
+        }
+        uring_reap(io);
+    }
+    return 0;
+}
+
+/* Wait until no send still reads the send queue */
+static int uring_wait_sends(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    uring_reap(io);
+    while (r->tx_inflight[0] + r->tx_inflight[1] > 0 || r->to_submit > 0) {
+        if (ring_enter(r, r->tx_inflight[0] + r->tx_inflight[1] > 0, -1) < 0 &&
+            errno != EINTR && errno != ETIME) {
+            return -1;
+        }
+        uring_reap(io);
+    }
+    return 0;
+}
+
+static int uring_flush(dnsasm_io_t *io) {
+    uint64_t before = __atomic_load_n(&io->counters.sent, __ATOMIC_RELAXED);
+    uring_queue_sends(io);
+    if (uring_wait_sends(io) != 0) {
+        return -1;
+    }
+    return (int)(__atomic_load_n(&io->counters.sent, __ATOMIC_RELAXED) - before);
+}
+
+/* Turn stashed completions into receive slots */
+static uint32_t uring_take(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+    uint32_t n = 0;
+    uint64_t truncated = 0;
+
+    while (r->stash_count > 0 && n < io->batch) {
+        stashed_t s = r->stash[r->stash_head];
+        r->stash_head = (r->stash_head + 1) % r->stash_cap;
+        r->stash_count--;
+
+        if (!(s.flags & IORING_CQE_F_BUFFER)) {
+            /* Error or end of the multishot; -EINVAL before any data
+               means the kernel has no multishot recvmsg */
+            if (s.res == -EINVAL && !r->received) {
+                r->armed = -1;
+            }
+            continue;
+        }
+        uint16_t bid = (uint16_t)(s.flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t *buf = r->bufs + (size_t)bid * r->buf_size;
+        const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *)buf;
+        const uint8_t *name = buf + sizeof(*out);
+        const uint8_t *payload = name + r->msg.msg_namelen;
+        r->held[r->held_count++] = bid;
+        r->received = 1;
+
+        socklen_t namelen = out->namelen < r->msg.msg_namelen ? out->namelen : r->msg.msg_namelen;
+        memset(&io->rx_addr[n], 0, sizeof(io->rx_addr[n]));
+        memcpy(&io->rx_addr[n], name, namelen);
+        io->rx_msgs[n].msg_hdr.msg_namelen = namelen;
+        set_peer(&io->rx_peers[n], &io->rx_addr[n]);
+
+        io->rx_packets[n] = payload;
+        if ((out->flags & MSG_TRUNC) || out->payloadlen > io->rx_size) {
+            io->rx_lens[n] = 0;
+            truncated++;
+        } else {
+            io->rx_lens[n] = (uint16_t)out->payloadlen;
+        }
+        n++;
+    }
+    if (truncated > 0) {
+        count_add(&io->counters.truncated, truncated);
+    }
+    return n;
+}
+
+static int uring_recv(dnsasm_io_t *io) {
+    uring_t *r = io->ring;
+
+    /* The last batch is done with: its buffers go back, its answers out */
+    for (uint32_t i = 0; i < r->held_count; i++) {
+        buf_give(r, r->held[i]);
+    }
+    if (r->held_count > 0) {
+        buf_publish(r);
+        r->held_count = 0;
+    }
+    /* The half refilled after this returns went out two batches ago;
+       it has almost always completed by now */
+    uring_queue_sends(io);
+    if (uring_wait_half(io) != 0) {
+        return -1;
+    }
+
+    int waited = 0;
+    for (;;) {
+        uring_reap(io);
+        if (r->armed == -1) {
+            if (uring_wait_sends(io) != 0) {
+                return -1;
+            }
+            uring_drop(io);
+            return dnsasm_io_recv(io);
+        }
+        uint32_t n = uring_take(io);
+        if (r->armed == -1) {
+            continue;
+        }
+        if (!r->armed && ring_arm_recv(io) != 0) {
+            return -1;
+        }
+        if (n > 0) {
+            if (r->to_submit > 0) {
+                ring_enter(r, 0, 0);
+            }
+            io->rx_count = n;
+            if (waited) {
+                count_add(&io->counters.recv_calls, 1);
+            }
+            count_add(&io->counters.received, n);
+            return (int)n;
+        }
+        if (__atomic_load_n(&io->down, __ATOMIC_ACQUIRE)) {
+            errno = ESHUTDOWN;
+            return -1;
+        }
+        if (waited && io->timeout_ms >= 0) {
+            return 0;
+        }
+        if (ring_enter(r, io->timeout_ms != 0, io->timeout_ms) < 0) {
+            if (errno == ETIME || errno == EINTR) {
+                return 0;
+            }
+            return -1;
+        }
+        waited = 1;
+    }
+}
+
+static void uring_shutdown(uring_t *r) {
+    uint64_t one = 1;
+    ssize_t w = write(r->event_fd, &one, sizeof(one));
+    (void)w;
+}
+
+#endif /* HAVE_URING */
+
+/* ============================================================================
+ * UDP handles
+ * ============================================================================ */
+
+static void io_free(dnsasm_io_t *io) {
+    free(io->rx_packets);
+    free(io->rx_lens);
+    free(io->rx_peers);
+    free(io->rx_msgs);
+    free(io->rx_iov);
+    free(io->rx_addr);
+    free(io->rx_buf);
+    free(io->tx_msgs);
+    free(io->tx_iov);
+    free(io->tx_addr);
+    free(io->tx_buf);
+    free(io);
+}
+
+dnsasm_io_t *dnsasm_io_open(const uint8_t *addr, size_t addr_len, uint16_t port,
+                             const dnsasm_io_config_t *cfg) {
+    static const dnsasm_io_config_t defaults = { .timeout_ms = -1 };
+    if (cfg == NULL) {
+        cfg = &defaults;
+    }
+
+    uint32_t batch = cfg->batch != 0 ? cfg->batch : DNSASM_IO_MAX_BATCH;
+    uint32_t rx_size = cfg->rx_size != 0 ? cfg->rx_size : DNSASM_IO_DEFAULT_SIZE;
+    uint32_t tx_size = cfg->tx_size != 0 ? cfg->tx_size : DNSASM_IO_DEFAULT_SIZE;
+    if (batch > DNSASM_IO_MAX_BATCH || rx_size > DNS_MAX_PACKET_SIZE ||
+        tx_size > DNS_MAX_PACKET_SIZE || !check_addr(addr, addr_len)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    dnsasm_io_t *io = calloc(1, sizeof(*io));
+    if (io == NULL) {
+        return NULL;
+    }
+    io->batch = batch;
+    io->rx_size = rx_size;
+    io->tx_size = tx_size;
+    io->timeout_ms = cfg->timeout_ms;
+
+    io->rx_packets = calloc(batch, sizeof(*io->rx_packets));
+    io->rx_lens = calloc(batch, sizeof(*io->rx_lens));
+    io->rx_peers = calloc(batch, sizeof(*io->rx_peers));
+    io->rx_msgs = calloc(batch, sizeof(*io->rx_msgs));
+    io->rx_iov = calloc(batch, sizeof(*io->rx_iov));
+    io->rx_addr = calloc(batch, sizeof(*io->rx_addr));
+    io->rx_buf = malloc((size_t)batch * rx_size);
+    /* io_uring alternates between two halves of the send queue */
+    uint32_t tx_slots = cfg->flags & DNSASM_IO_URING ? 2 * batch : batch;
+    io->tx_msgs = calloc(tx_slots, sizeof(*io->tx_msgs));
+    io->tx_iov = calloc(tx_slots, sizeof(*io->tx_iov));
+    io->tx_addr = calloc(tx_slots, sizeof(*io->tx_addr));
+    io->tx_buf = malloc((size_t)tx_slots * tx_size);
+    if (io->rx_packets == NULL || io->rx_lens == NULL || io->rx_peers == NULL ||
+        io->rx_msgs == NULL || io->rx_iov == NULL || io->rx_addr == NULL ||
+        io->rx_buf == NULL || io->tx_msgs == NULL || io->tx_iov == NULL ||
+        io->tx_addr == NULL || io->tx_buf == NULL) {
+        io_free(io);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < batch; i++) {
+        uint8_t *rx = io->rx_buf + (size_t)i * rx_size;
+        io->rx_packets[i] = rx;
+        io->rx_iov[i].iov_base = rx;
+        io->rx_iov[i].iov_len = rx_size;
+        io->rx_msgs[i].msg_hdr.msg_iov = &io->rx_iov[i];
+        io->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        io->rx_msgs[i].msg_hdr.msg_name = &io->rx_addr[i];
+    }
+    for (uint32_t i = 0; i < tx_slots; i++) {
+        io->tx_iov[i].iov_base = io->tx_buf + (size_t)i * tx_size;
+        io->tx_msgs[i].msg_hdr.msg_iov = &io->tx_iov[i];
+        io->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+        io->tx_msgs[i].msg_hdr.msg_name = &io->tx_addr[i];
+    }
+
+    io->fd = bind_socket(SOCK_DGRAM, addr, addr_len, port, cfg);
+    if (io->fd < 0) {
+        int saved = errno;
+        io_free(io);
+        errno = saved;
+        return NULL;
+    }
+#ifdef HAVE_URING
+    if (cfg->flags & DNSASM_IO_URING) {
+        uring_open(io);             /* Keeps the socket calls on failure */
+    }
+#endif
+    return io;
+}
+
+void dnsasm_io_close(dnsasm_io_t *io) {
+    if (io == NULL) {
+        return;
+    }
+    if (io->tx_count > 0) {
+        dnsasm_io_flush(io);
+    }
+#ifdef HAVE_URING
+    if (io->ring != NULL) {
+        if (io->uring) {
+            uring_wait_sends(io);
+        }
+        ring_free(io->ring);
+    }
+#endif
+    close(io->fd);
+    io_free(io);
+}
+
+void dnsasm_io_shutdown(dnsasm_io_t *io) {
+    __atomic_store_n(&io->down, 1, __ATOMIC_SEQ_CST);
+#ifdef HAVE_URING
+    if (io->ring != NULL) {
+        uring_shutdown(io->ring);
+        if (__atomic_load_n(&io->uring, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+    }
+#endif
+    /* Wakes poll on Linux even for an unconnected socket; elsewhere the
+       receive timeout has to run out */
+    shutdown(io->fd, SHUT_RDWR);
+}
+
+uint16_t dnsasm_io_port(const dnsasm_io_t *io) {
+    return local_port(io->fd);
+}
+
+const char *dnsasm_io_backend(const dnsasm_io_t *io) {
+    if (__atomic_load_n(&io->uring, __ATOMIC_RELAXED)) {
+        return "io_uring";
+    }
+#if defined(__linux__)
+    return "recvmmsg";
+#else
+    return "recvmsg";
+#endif
+}
+
+int dnsasm_io_recv(dnsasm_io_t *io) {
+    io->rx_count = 0;
+#ifdef HAVE_URING
+    if (io->uring) {
+        return uring_recv(io);
+    }
+#endif
+    if (io->tx_count > 0) {
+        dnsasm_io_flush(io);
+    }
+
+    if (__atomic_load_n(&io->down, __ATOMIC_SEQ_CST)) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    struct pollfd pfd = { .fd = io->fd, .events = POLLIN };
+    int r = poll(&pfd, 1, io->timeout_ms);
+    if (r <= 0) {
+        return r < 0 && errno != EINTR ? -1 : 0;
+    }
+    if (__atomic_load_n(&io->down, __ATOMIC_ACQUIRE)) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+
+    /* The kernel shrinks these to the sender's address length */
+    for (uint32_t i = 0; i < io->batch; i++) {
+        io->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+    int n = recv_batch(io->fd, io->rx_msgs, io->batch);
+    if (n < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+
+    uint64_t truncated = 0;
+    for (int i = 0; i < n; i++) {
+        const io_msg_t *m = &io->rx_msgs[i];
+        if (m->msg_hdr.msg_flags & MSG_TRUNC) {
+            io->rx_lens[i] = 0;
+            truncated++;
+        } else {
+            io->rx_lens[i] = (uint16_t)m->msg_len;
+        }
+        set_peer(&io->rx_peers[i], &io->rx_addr[i]);
+    }
+    io->rx_count = (uint32_t)n;
+
+    count_add(&io->counters.recv_calls, 1);
+    count_add(&io->counters.received, (uint64_t)n);
+    if (truncated > 0) {
+        count_add(&io->counters.truncated, truncated);
+    }
+    return n;
+}
+
+const uint8_t *const *dnsasm_io_packets(const dnsasm_io_t *io) {
+    return io->rx_packets;
+}
+
+const uint16_t *dnsasm_io_lens(const dnsasm_io_t *io) {
+    return io->rx_lens;
+}
+
+const dnsasm_io_peer_t *dnsasm_io_peers(const dnsasm_io_t *io) {
+    return io->rx_peers;
+}
+
+int dnsasm_io_queue(dnsasm_io_t *io, uint32_t slot, const uint8_t *data, size_t len) {
+    if (slot >= io->rx_count) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (len > io->tx_size) {
+        return DNSASM_ERR_SPACE;
+    }
+    if (io->tx_count == io->batch) {
+        dnsasm_io_flush(io);
+    }
+
+    uint32_t i = io->tx_base + io->tx_count++;
+    memcpy(io->tx_iov[i].iov_base, data, len);
+    io->tx_iov[i].iov_len = len;
+    io->tx_addr[i] = io->rx_addr[slot];
+    io->tx_msgs[i].msg_hdr.msg_namelen = io->rx_msgs[slot].msg_hdr.msg_namelen;
+    return 0;
+}
+
+int dnsasm_io_flush(dnsasm_io_t *io) {
+#ifdef HAVE_URING
+    if (io->uring) {
+        return uring_flush(io);
+    }
+#endif
+    uint32_t done = 0;
+    uint64_t sent = 0;
+    uint64_t refused = 0;
+    int ret = 0;
+
+    while (done < io->tx_count) {
+        int n = send_batch(io->fd, io->tx_msgs + io->tx_base + done, io->tx_count - done);
+        count_add(&io->counters.send_calls, 1);
+        if (n >= 0) {
+            done += (uint32_t)n;
+            sent += (uint64_t)n;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EBADF || errno == ENOTSOCK || errno == EPIPE) {
+            refused += io->tx_count - done;
+            ret = -1;
+            break;
+        }
+        /* The first response was refused (bad address, too big for the
+           route): drop it and send the rest */
+        done++;
+        refused++;
+    }
+
+    int saved = errno;
+    io->tx_count = 0;
+    count_add(&io->counters.sent, sent);
+    if (refused > 0) {
+        count_add(&io->counters.send_errors, refused);
+    }
+    errno = saved;
+    return ret < 0 ? -1 : (int)sent;
+}
+
+void dnsasm_io_counters(const dnsasm_io_t *io, dnsasm_io_counters_t *out) {
+    out->recv_calls = __atomic_load_n(&io->counters.recv_calls, __ATOMIC_RELAXED);
+    out->received = __atomic_load_n(&io->counters.received, __ATOMIC_RELAXED);
+    out->truncated = __atomic_load_n(&io->counters.truncated, __ATOMIC_RELAXED);
+    out->send_calls = __atomic_load_n(&io->counters.send_calls, __ATOMIC_RELAXED);
+    out->sent = __atomic_load_n(&io->counters.sent, __ATOMIC_RELAXED);
+    out->send_errors = __atomic_load_n(&io->counters.send_errors, __ATOMIC_RELAXED);
+}
+
+/* ============================================================================
+ * TCP listeners
+ * ============================================================================ */
+
+#ifdef HAVE_URING
+static int listener_arm(dnsasm_io_listener_t *l) {
+    struct io_uring_sqe *sqe = ring_sqe(l->ring);
+    if (sqe == NULL) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = l->fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = UD_ACCEPT;
+    ring_push(l->ring);
+    l->ring->armed = 1;
+    return 0;
+}
+
+static int listener_uring(dnsasm_io_listener_t *l) {
+    uring_t *r = ring_new(8, 256);
+    if (r == NULL) {
+        return -1;
+    }
+    l->ring = r;
+    r->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (r->event_fd < 0 || ring_arm_wake(r) != 0 || listener_arm(l) != 0 ||
+        ring_enter(r, 0, 0) < 0) {
+        ring_free(r);
+        l->ring = NULL;
+        return -1;
+    }
+    l->uring = 1;
+    return 0;
+}
+
+/* Completed accepts into fds (closed instead if fds is NULL). *err gets
+   the last failure that ended the multishot, other than an aborted
+   connection; armed becomes -1 if the kernel has no multishot accept */
+static size_t listener_reap(dnsasm_io_listener_t *l, int *fds, size_t max, int *err) {
+    uring_t *r = l->ring;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+
+    for (; head != tail && n < max; head++) {
+        const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        if (cqe->user_data != UD_ACCEPT) {
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            r->armed = cqe->res == -EINVAL && !r->received ? -1 : 0;
+        }
+        if (cqe->res >= 0) {
+            r->received = 1;
+            if (fds != NULL) {
+                fds[n++] = cqe->res;
+            } else {
+                close(cqe->res);
+            }
+        } else if (cqe->res != -ECONNABORTED && cqe->res != -ECANCELED) {
+            *err = -cqe->res;
+        }
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+#endif
+
+dnsasm_io_listener_t *dnsasm_io_listen(const uint8_t *addr, size_t addr_len, uint16_t port,
+                                       const dnsasm_io_config_t *cfg) {
+    static const dnsasm_io_config_t defaults = { .timeout_ms = -1 };
+    if (cfg == NULL) {
+        cfg = &defaults;
+    }
+    if (!check_addr(addr, addr_len)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    dnsasm_io_listener_t *l = calloc(1, sizeof(*l));
+    if (l == NULL) {
+        return NULL;
+    }
+    l->timeout_ms = cfg->timeout_ms;
+    l->fd = bind_socket(SOCK_STREAM, addr, addr_len, port, cfg);
+    if (l->fd < 0 || listen(l->fd, SOMAXCONN) != 0) {
+        int saved = errno;
+        if (l->fd >= 0) {
+            close(l->fd);
+        }
+        free(l);
+        errno = saved;
+        return NULL;
+    }
+    /* Accepting without blocking after poll, like the UDP receive */
+    fcntl(l->fd, F_SETFL, fcntl(l->fd, F_GETFL) | O_NONBLOCK);
+#ifdef HAVE_URING
+    if (cfg->flags & DNSASM_IO_URING) {
+        listener_uring(l);
+    }
+#endif
+    return l;
+}
+
+int dnsasm_io_accept(dnsasm_io_listener_t *l, int *fds, size_t max) {
+    if (max == 0) {
+        return 0;
+    }
+#ifdef HAVE_URING
+    if (l->uring) {
+        uring_t *r = l->ring;
+        for (int waited = 0;; waited = 1) {
+            int err = 0;
+            size_t n = listener_reap(l, fds, max, &err);
+            if (r->armed == -1) {
+                /* Like uring_drop: the ring stays until close */
+                __atomic_store_n(&l->uring, 0, __ATOMIC_SEQ_CST);
+                return dnsasm_io_accept(l, fds, max);
+            }
+            if (!r->armed && listener_arm(l) != 0) {
+                return -1;
+            }
+            if (n > 0) {
+                if (r->to_submit > 0) {
+                    ring_enter(r, 0, 0);
+                }
+                return (int)n;
+            }
+            if (__atomic_load_n(&l->down, __ATOMIC_ACQUIRE)) {
+                errno = ESHUTDOWN;
+                return -1;
+            }
+            if (err != 0) {
+                /* E.g. EMFILE: report it rather than spin re-arming */
+                errno = err;
+                return -1;
+            }
+            if ((waited && l->timeout_ms >= 0) || l->timeout_ms == 0) {
+                return 0;
+            }
+            if (ring_enter(r, 1, l->timeout_ms) < 0) {
+                if (errno == ETIME || errno == EINTR) {
+                    return 0;
+                }
+                return -1;
+            }
+        }
+    }
+#endif
+
+    if (__atomic_load_n(&l->down, __ATOMIC_SEQ_CST)) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    struct pollfd pfd = { .fd = l->fd, .events = POLLIN };
+    int r = poll(&pfd, 1, l->timeout_ms);
+    if (r <= 0) {
+        return r < 0 && errno != EINTR ? -1 : 0;
+    }
+    if (__atomic_load_n(&l->down, __ATOMIC_ACQUIRE)) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+
+    size_t n = 0;
+    while (n < max) {
+#if defined(__linux__)
+        int fd = accept4(l->fd, NULL, NULL, SOCK_CLOEXEC);
+#else
+        int fd = accept(l->fd, NULL, NULL);
+        if (fd >= 0) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (n == 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            break;
+        }
+        fds[n++] = fd;
+    }
+    return (int)n;
+}
+
+void dnsasm_io_listener_shutdown(dnsasm_io_listener_t *l) {
+    __atomic_store_n(&l->down, 1, __ATOMIC_SEQ_CST);
+#ifdef HAVE_URING
+    if (l->ring != NULL) {
+        uring_shutdown(l->ring);
+        if (__atomic_load_n(&l->uring, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+    }
+#endif
+    shutdown(l->fd, SHUT_RDWR);
+}
+
+void dnsasm_io_listener_close(dnsasm_io_listener_t *l) {
+    if (l == NULL) {
+        return;
+    }
+#ifdef HAVE_URING
+    if (l->ring != NULL) {
+        int err;
+        listener_reap(l, NULL, SIZE_MAX, &err);     /* Accepted, never taken */
+        ring_free(l->ring);
+    }
+#endif
+    close(l->fd);
+    free(l);
+}
+
+uint16_t dnsasm_io_listener_port(const dnsasm_io_listener_t *l) {
+    return local_port(l->fd);
+}
+
+const char *dnsasm_io_listener_backend(const dnsasm_io_listener_t *l) {
+    return __atomic_load_n(&l->uring, __ATOMIC_RELAXED) ? "io_uring" : "accept";
+}
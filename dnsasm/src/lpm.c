@@ -0,0 +1,204 @@
+/*
+ * DNSASM - Longest-Prefix-Match Tables
+ *
+ * Client address policy without a scan over prefix lists: a multibit
+ * trie per family with a 16-bit first stride (one 256 KiB root array)
+ * and 8-bit strides below it. DIR-24-8's 24-bit first level would make
+ * IPv4 lookups one load shorter but costs 64 MiB per table; with this
+ * shape a server can keep several tables and rebuild them freely.
+ *
+ * The table is built by painting each entry's value over its range in
+ * list order, expanding a leaf into a chunk only where a longer prefix
+ * needs one. Painting over a chunk collapses it back into a leaf; the
+ * orphaned chunk is left unreferenced in the buffer.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define ROOT_BITS       16
+#define ROOT_SIZE       (1u << ROOT_BITS)
+#define CHUNK_SIZE      256
+#define CHILD           0x80000000u
+
+_Static_assert(sizeof(dnsasm_lpm_t) == 64, "header must be one cache line");
+_Static_assert(sizeof(dnsasm_lpm_entry_t) == 24, "entry must be 24 bytes");
+
+static inline uint32_t *root4(const dnsasm_lpm_t *lpm) {
+    return (uint32_t *)(lpm + 1);
+}
+
+static inline uint32_t *root6(const dnsasm_lpm_t *lpm) {
+    return root4(lpm) + ROOT_SIZE;
+}
+
+static inline uint32_t *chunk(const dnsasm_lpm_t *lpm, uint32_t i) {
+    return root6(lpm) + ROOT_SIZE + (size_t)i * CHUNK_SIZE;
+}
+
+static inline size_t table_size(size_t chunks) {
+    return sizeof(dnsasm_lpm_t) + (2 * (size_t)ROOT_SIZE + chunks * CHUNK_SIZE) * sizeof(uint32_t);
+}
+
+/* Chunks an entry may add below the root: one per 8-bit stride it reaches */
+static int scan_entries(const dnsasm_lpm_entry_t *entries, size_t count, size_t *chunks) {
+    *chunks = 0;
+    for (size_t i = 0; i < count; i++) {
+        const dnsasm_lpm_entry_t *e = &entries[i];
+        unsigned max = e->family == 4 ? 32 : e->family == 6 ? 128 : 0;
+        if (max == 0 || e->prefix_len > max || e->value >= DNSASM_LPM_NONE) {
+            return DNSASM_ERR_FORMAT;
+        }
+        if (e->prefix_len > ROOT_BITS) {
+            *chunks += (e->prefix_len - ROOT_BITS + 7) / 8;
+        }
+    }
+    return DNSASM_OK;
+}
+
+size_t dnsasm_lpm_size(const dnsasm_lpm_entry_t *entries, size_t count) {
+    size_t chunks;
+    if (scan_entries(entries, count, &chunks) != DNSASM_OK || chunks >= CHILD) {
+        return 0;
+    }
+    size_t size = table_size(chunks);
+    return size <= UINT32_MAX ? size : 0;
+}
+
+static inline void paint(uint32_t *slot, size_t n, uint32_t value) {
+    for (size_t i = 0; i < n; i++) {
+        slot[i] = value;
+    }
+}
+
+static void insert(dnsasm_lpm_t *lpm, const dnsasm_lpm_entry_t *e) {
+    const uint8_t *a = e->addr;
+    unsigned len = e->prefix_len;
+    size_t idx = (size_t)a[0] << 8 | a[1];
+
+    if (len <= ROOT_BITS) {
+        size_t span = (size_t)1 << (ROOT_BITS - len);
+        paint((e->family == 4 ? root4(lpm) : root6(lpm)) + (idx & ~(span - 1)), span, e->value);
+        return;
+    }
+
+    uint32_t *slot = (e->family == 4 ? root4(lpm) : root6(lpm)) + idx;
+    for (unsigned done = ROOT_BITS;; done += 8) {
+        if ((*slot & CHILD) == 0) {
+            uint32_t c = lpm->chunk_count++;
+            paint(chunk(lpm, c), CHUNK_SIZE, *slot);
+            *slot = CHILD | c;
+        }
+        uint32_t *table = chunk(lpm, *slot & ~CHILD);
+        uint8_t b = a[done / 8];
+        if (len - done <= 8) {
+            size_t span = (size_t)1 << (8 - (len - done));
+            paint(table + (b & ~(span - 1)), span, e->value);
+            return;
+        }
+        slot = table + b;
+    }
+}
+
+int dnsasm_lpm_build(const dnsasm_lpm_entry_t *entries, size_t count,
+                      uint8_t *out, size_t out_size) {
+    size_t chunks;
+    int err = scan_entries(entries, count, &chunks);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    if (((uintptr_t)out & 63) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (chunks >= CHILD || table_size(chunks) > UINT32_MAX) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    if (table_size(chunks) > out_size) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    dnsasm_lpm_t *lpm = (dnsasm_lpm_t *)out;
+    memset(lpm, 0, sizeof(*lpm));
+    lpm->magic = DNSASM_LPM_MAGIC;
+    lpm->version = DNSASM_LPM_VERSION;
+    paint(root4(lpm), 2 * (size_t)ROOT_SIZE, DNSASM_LPM_NONE);
+
+    for (size_t i = 0; i < count; i++) {
+        insert(lpm, &entries[i]);
+    }
+    lpm->count = (uint32_t)count;
+    lpm->size = (uint32_t)table_size(lpm->chunk_count);
+    return DNSASM_OK;
+}
+
+int dnsasm_lpm_open(const uint8_t *buf, size_t len, const dnsasm_lpm_t **out) {
+    *out = NULL;
+    if (len < sizeof(dnsasm_lpm_t)) {
+        return DNSASM_ERR_SHORT;
+    }
+    if (((uintptr_t)buf & 63) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    const dnsasm_lpm_t *lpm = (const dnsasm_lpm_t *)buf;
+    if (lpm->magic != DNSASM_LPM_MAGIC || lpm->version != DNSASM_LPM_VERSION ||
+        lpm->chunk_count >= CHILD || (size_t)lpm->size != table_size(lpm->chunk_count)) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (lpm->size > len) {
+        return DNSASM_ERR_SHORT;
+    }
+
+    /* Lookups stop after the last address byte, so bounds are all to check */
+    const uint32_t *e = root4(lpm);
+    size_t n = 2 * (size_t)ROOT_SIZE + (size_t)lpm->chunk_count * CHUNK_SIZE;
+    for (size_t i = 0; i < n; i++) {
+        if ((e[i] & CHILD) != 0 && (e[i] & ~CHILD) >= lpm->chunk_count) {
+            return DNSASM_ERR_FORMAT;
+        }
+    }
+
+    *out = lpm;
+    return DNSASM_OK;
+}
+
+uint32_t dnsasm_lpm_lookup4(const dnsasm_lpm_t *lpm, const uint8_t addr[4]) {
+    uint32_t e = root4(lpm)[(size_t)addr[0] << 8 | addr[1]];
+    if (e & CHILD) {
+        e = chunk(lpm, e & ~CHILD)[addr[2]];
+        if (e & CHILD) {
+            e = chunk(lpm, e & ~CHILD)[addr[3]];
+        }
+    }
+    return (e & CHILD) ? DNSASM_LPM_NONE : e;
+}
+
+uint32_t dnsasm_lpm_lookup6(const dnsasm_lpm_t *lpm, const uint8_t addr[16]) {
+    uint32_t e = root6(lpm)[(size_t)addr[0] << 8 | addr[1]];
+    for (int i = 2; i < 16 && (e & CHILD); i++) {
+        e = chunk(lpm, e & ~CHILD)[addr[i]];
+    }
+    return (e & CHILD) ? DNSASM_LPM_NONE : e;
+}
+
+uint32_t dnsasm_lpm_lookup_sockaddr(const dnsasm_lpm_t *lpm, const void *sa, size_t len) {
+    static const uint8_t mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+    if (len >= sizeof(struct sockaddr_in) &&
+        ((const struct sockaddr *)sa)->sa_family == AF_INET) {
+        const struct sockaddr_in *in = sa;
+        return dnsasm_lpm_lookup4(lpm, (const uint8_t *)&in->sin_addr);
+    }
+    if (len >= sizeof(struct sockaddr_in6) &&
+        ((const struct sockaddr *)sa)->sa_family == AF_INET6) {
+        const uint8_t *a = ((const struct sockaddr_in6 *)sa)->sin6_addr.s6_addr;
+        if (memcmp(a, mapped, sizeof(mapped)) == 0) {
+            return dnsasm_lpm_lookup4(lpm, a + 12);
+        }
+        return dnsasm_lpm_lookup6(lpm, a);
+    }
+    return DNSASM_LPM_NONE;
+}
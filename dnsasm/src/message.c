@@ -0,0 +1,80 @@
+/*
+ * DNSASM - Message Index
+ *
+ * Single-pass walker that records where every question and RR lives in
+ * a wire-format message. Nothing is copied; owner names stay compressed
+ * until a caller asks for one with dnsasm_decompress_name.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+int dnsasm_parse_message(const uint8_t *packet, size_t len, dnsasm_msg_t *msg,
+                          dnsasm_rr_index_t *rr, size_t max_rr) {
+    memset(msg, 0, sizeof(*msg));
+
+    if (len < DNS_HEADER_SIZE) {
+        return stats_error(DNSASM_ERR_SHORT);
+    }
+
+    size_t pos = DNS_HEADER_SIZE;
+    size_t n = 0;
+    msg->end = (uint32_t)pos;
+
+    for (int s = 0; s < DNSASM_SECTION_COUNT; s++) {
+        uint16_t want = load16(packet + 4 + 2 * s);
+
+        msg->start[s] = (uint16_t)n;
+
+        for (uint16_t i = 0; i < want; i++) {
+            size_t name_len;
+            int err = skip_name(packet, len, pos, &name_len);
+            if (err != DNSASM_OK) {
+                return err;
+            }
+            if (n >= max_rr) {
+                return stats_error(DNSASM_ERR_SPACE);
+            }
+
+            dnsasm_rr_index_t *e = &rr[n];
+            size_t p = pos + name_len;
+
+            e->name_off = (uint16_t)pos;
+
+            if (s == DNSASM_SECTION_QUESTION) {
+                if (p + 4 > len) {
+                    return stats_error(DNSASM_ERR_SHORT);
+                }
+                e->type = load16(packet + p);
+                e->rclass = load16(packet + p + 2);
+                stats_qtype(e->type);
+                e->ttl_off = 0;
+                e->rdata_off = 0;
+                e->rdlength = 0;
+                p += 4;
+            } else {
+                if (p + DNS_RR_FIXED_LEN > len) {
+                    return stats_error(DNSASM_ERR_SHORT);
+                }
+                uint16_t rdlength = load16(packet + p + 8);
+                if (p + DNS_RR_FIXED_LEN + rdlength > len) {
+                    return stats_error(DNSASM_ERR_SHORT);
+                }
+                e->type = load16(packet + p);
+                e->rclass = load16(packet + p + 2);
+                e->ttl_off = (uint16_t)(p + 4);
+                e->rdata_off = (uint16_t)(p + DNS_RR_FIXED_LEN);
+                e->rdlength = rdlength;
+                p += DNS_RR_FIXED_LEN + rdlength;
+            }
+
+            pos = p;
+            n++;
+            msg->count[s]++;
+            msg->total = (uint16_t)n;
+            msg->end = (uint32_t)pos;
+        }
+    }
+
+    return DNSASM_OK;
+}
@@ -0,0 +1,252 @@
+/*
+ * DNSASM - Hashed Name Set
+ *
+ * An immutable set of wire names in one flat buffer: a header, a table
+ * of cache-line buckets and the lowercased names. There are no
+ * pointers, so the buffer is also the serialized form and can be
+ * written to disk or mapped back as is.
+ *
+ * Each bucket holds 8 slots of 16-bit fingerprint, name length and
+ * name offset. A lookup hashes the name once, matches all 8
+ * fingerprints of a bucket in one vector compare and touches the name
+ * store only for a fingerprint and length hit. Buckets are probed
+ * linearly; a bucket with a free slot ends the probe.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SLOTS           8
+
+typedef struct {
+    uint16_t fp[SLOTS];        /* Fingerprint, 0 = free slot */
+    uint32_t off[SLOTS];       /* Name offset from the start of the set */
+    uint8_t  len[SLOTS];       /* Name length */
+    uint8_t  _pad[8];
+} bucket_t;
+
+_Static_assert(sizeof(bucket_t) == 64, "bucket must be one cache line");
+_Static_assert(sizeof(dnsasm_nameset_t) == 64, "header must be one cache line");
+
+static inline bucket_t *buckets(const dnsasm_nameset_t *set) {
+    return (bucket_t *)(set + 1);
+}
+
+static inline uint16_t fingerprint(uint64_t hash) {
+    uint16_t fp = (uint16_t)(hash >> 48);
+    return fp != 0 ? fp : 1;
+}
+
+/* Bit i set where fp[i] == x, for the 8 slots of a bucket */
+static inline unsigned match_fp(const bucket_t *b, uint16_t x) {
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *)b->fp);
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi16(v, _mm_set1_epi16((short)x)));
+    /* One bit per slot: keep the low bit of each 16-bit lane and pack */
+    m &= 0x5555;
+    m = (m | (m >> 1)) & 0x3333;
+    m = (m | (m >> 2)) & 0x0f0f;
+    m = (m | (m >> 4)) & 0x00ff;
+    return m;
+#elif defined(__ARM_NEON)
+    uint16x8_t eq = vceqq_u16(vld1q_u16(b->fp), vdupq_n_u16(x));
+    static const uint16_t bit[SLOTS] = {1, 2, 4, 8, 16, 32, 64, 128};
+    return vaddvq_u16(vandq_u16(eq, vld1q_u16(bit)));
+#else
+    unsigned m = 0;
+    for (int i = 0; i < SLOTS; i++) {
+        m |= (unsigned)(b->fp[i] == x) << i;
+    }
+    return m;
+#endif
+}
+
+static inline uint64_t set_hash(const dnsasm_nameset_t *set, const uint8_t *name, size_t len) {
+    return dnsasm_hash_name(&set->key, name, len, 0, 0, 0);
+}
+
+/* Table shape for count names: at most 6 of 8 slots used on average */
+static size_t bucket_count(size_t count) {
+    size_t want = (count + 5) / 6;
+    size_t n = 1;
+    while (n < want) {
+        n <<= 1;
+    }
+    return n;
+}
+
+/* Count and validate the names; 0 on success */
+static int scan_names(const uint8_t *names, size_t names_len, size_t *count) {
+    size_t pos = 0;
+    *count = 0;
+    while (pos < names_len) {
+        size_t n = plain_name_len(names, names_len, pos);
+        if (n == 0) {
+            return DNSASM_ERR_NAME;
+        }
+        pos += n;
+        (*count)++;
+    }
+    return DNSASM_OK;
+}
+
+size_t dnsasm_nameset_size(const uint8_t *names, size_t names_len) {
+    size_t count;
+    if (scan_names(names, names_len, &count) != DNSASM_OK) {
+        return 0;
+    }
+    size_t size = sizeof(dnsasm_nameset_t) + bucket_count(count) * sizeof(bucket_t) + names_len;
+    return size <= UINT32_MAX ? size : 0;
+}
+
+int dnsasm_nameset_build(const uint8_t *names, size_t names_len,
+                          const dnsasm_hash_key_t *key,
+                          uint8_t *out, size_t out_size) {
+    size_t count;
+    int err = scan_names(names, names_len, &count);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    if (((uintptr_t)out & 7) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    size_t nb = bucket_count(count);
+    size_t store = sizeof(dnsasm_nameset_t) + nb * sizeof(bucket_t);
+    if (store + names_len > UINT32_MAX) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    if (store + names_len > out_size) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    dnsasm_nameset_t *set = (dnsasm_nameset_t *)out;
+    memset(out, 0, store);
+    set->magic = DNSASM_NAMESET_MAGIC;
+    set->version = DNSASM_NAMESET_VERSION;
+    set->bucket_mask = (uint32_t)(nb - 1);
+    set->key = *key;
+
+    bucket_t *table = buckets(set);
+    size_t cursor = store;
+    size_t pos = 0;
+
+    while (pos < names_len) {
+        size_t n = plain_name_len(names, names_len, pos);
+        const uint8_t *name = names + pos;
+        pos += n;
+
+        uint64_t h = set_hash(set, name, n);
+        uint16_t fp = fingerprint(h);
+        size_t b = h & set->bucket_mask;
+        int dup = 0;
+
+        for (;;) {
+            bucket_t *bk = &table[b];
+            for (unsigned m = match_fp(bk, fp); m != 0; m &= m - 1) {
+                int i = __builtin_ctz(m);
+                if (bk->len[i] == n && dnsasm_name_equal(out + bk->off[i], n, name, n) == 0) {
+                    dup = 1;
+                    break;
+                }
+            }
+            if (dup) {
+                break;
+            }
+
+            unsigned free_slots = match_fp(bk, 0);
+            if (free_slots != 0) {
+                int i = __builtin_ctz(free_slots);
+                uint8_t *dst = out + cursor;
+                for (size_t j = 0; j < n; j++) {
+                    uint8_t c = name[j];
+                    dst[j] = c | (uint8_t)(((uint8_t)(c - 'A') < 26) << 5);
+                }
+                bk->fp[i] = fp;
+                bk->len[i] = (uint8_t)n;
+                bk->off[i] = (uint32_t)cursor;
+                cursor += n;
+                set->count++;
+                break;
+            }
+            b = (b + 1) & set->bucket_mask;
+        }
+    }
+
+    set->size = (uint32_t)cursor;
+    return DNSASM_OK;
+}
+
+int dnsasm_nameset_open(const uint8_t *buf, size_t len, const dnsasm_nameset_t **out) {
+    *out = NULL;
+    if (len < sizeof(dnsasm_nameset_t)) {
+        return DNSASM_ERR_SHORT;
+    }
+    if (((uintptr_t)buf & 7) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    const dnsasm_nameset_t *set = (const dnsasm_nameset_t *)buf;
+    if (set->magic != DNSASM_NAMESET_MAGIC || set->version != DNSASM_NAMESET_VERSION ||
+        (set->bucket_mask & (set->bucket_mask + 1)) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+    size_t store = sizeof(dnsasm_nameset_t) + ((size_t)set->bucket_mask + 1) * sizeof(bucket_t);
+    if (set->size < store || set->size > len) {
+        return set->size > len ? DNSASM_ERR_SHORT : DNSASM_ERR_FORMAT;
+    }
+
+    /* Every slot must point into the name store, and some slot be free */
+    const bucket_t *table = buckets(set);
+    size_t used = 0;
+    for (size_t b = 0; b <= set->bucket_mask; b++) {
+        for (int i = 0; i < SLOTS; i++) {
+            if (table[b].fp[i] == 0) {
+                continue;
+            }
+            if (table[b].off[i] < store || table[b].len[i] == 0 ||
+                (size_t)table[b].off[i] + table[b].len[i] > set->size) {
+                return DNSASM_ERR_FORMAT;
+            }
+            used++;
+        }
+    }
+    if (used != set->count || used == ((size_t)set->bucket_mask + 1) * SLOTS) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    *out = set;
+    return DNSASM_OK;
+}
+
+int dnsasm_nameset_contains(const dnsasm_nameset_t *set, const uint8_t *name, size_t len) {
+    if (len == 0 || len > DNS_MAX_NAME_LEN) {
+        return 0;
+    }
+
+    const uint8_t *base = (const uint8_t *)set;
+    const bucket_t *table = buckets(set);
+    uint64_t h = set_hash(set, name, len);
+    uint16_t fp = fingerprint(h);
+    size_t b = h & set->bucket_mask;
+
+    for (;;) {
+        const bucket_t *bk = &table[b];
+        for (unsigned m = match_fp(bk, fp); m != 0; m &= m - 1) {
+            int i = __builtin_ctz(m);
+            if (bk->len[i] == len && dnsasm_name_equal(base + bk->off[i], len, name, len) == 0) {
+                return 1;
+            }
+        }
+        if (match_fp(bk, 0) != 0) {
+            return 0;
+        }
+        b = (b + 1) & set->bucket_mask;
+    }
+}
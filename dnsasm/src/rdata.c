@@ -0,0 +1,213 @@
+/*
+ * DNSASM - Typed RDATA Decoders
+ *
+ * Fixed-struct views of the record types a resolver inspects on every
+ * upstream response (referrals, glue, CNAME chains, SOA minimums,
+ * DNSSEC headers) without unpacking the whole message.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+static inline int rdata_fits(size_t len, size_t off, uint16_t rdlength) {
+    return off + rdlength <= len;
+}
+
+/*
+ * Decompress the name at *pos, which must end inside the RDATA, and
+ * advance *pos past its wire form.
+ */
+static int rdata_name(const uint8_t *packet, size_t len, size_t *pos,
+                      size_t end, uint8_t *out, uint16_t *out_len) {
+    dnsasm_result_t r = dnsasm_decompress_name(packet, len, *pos, out, out_len);
+    if (r.error != DNSASM_OK) {
+        return r.error;
+    }
+    if (*pos + r.offset > end) {
+        return DNSASM_ERR_RDATA;
+    }
+    *pos += r.offset;
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_a(const uint8_t *packet, size_t len, size_t off,
+                    uint16_t rdlength, uint8_t addr[4]) {
+    if (rdlength != 4 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    memcpy(addr, packet + off, 4);
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_aaaa(const uint8_t *packet, size_t len, size_t off,
+                       uint16_t rdlength, uint8_t addr[16]) {
+    if (rdlength != 16 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    memcpy(addr, packet + off, 16);
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_name(const uint8_t *packet, size_t len, size_t off,
+                       uint16_t rdlength, dnsasm_rdata_name_t *out) {
+    size_t pos = off;
+    size_t end = off + rdlength;
+
+    if (!rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    int err = rdata_name(packet, len, &pos, end, out->name, &out->name_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    return pos == end ? DNSASM_OK : DNSASM_ERR_RDATA;
+}
+
+int dnsasm_rdata_mx(const uint8_t *packet, size_t len, size_t off,
+                     uint16_t rdlength, dnsasm_rdata_mx_t *out) {
+    size_t pos = off + 2;
+    size_t end = off + rdlength;
+
+    if (rdlength < 3 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    out->preference = load16(packet + off);
+    int err = rdata_name(packet, len, &pos, end, out->exchange, &out->exchange_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    return pos == end ? DNSASM_OK : DNSASM_ERR_RDATA;
+}
+
+int dnsasm_rdata_srv(const uint8_t *packet, size_t len, size_t off,
+                      uint16_t rdlength, dnsasm_rdata_srv_t *out) {
+    size_t pos = off + 6;
+    size_t end = off + rdlength;
+
+    if (rdlength < 7 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    out->priority = load16(packet + off);
+    out->weight = load16(packet + off + 2);
+    out->port = load16(packet + off + 4);
+    int err = rdata_name(packet, len, &pos, end, out->target, &out->target_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    return pos == end ? DNSASM_OK : DNSASM_ERR_RDATA;
+}
+
+int dnsasm_rdata_soa(const uint8_t *packet, size_t len, size_t off,
+                      uint16_t rdlength, dnsasm_rdata_soa_t *out) {
+    size_t pos = off;
+    size_t end = off + rdlength;
+
+    if (!rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    int err = rdata_name(packet, len, &pos, end, out->mname, &out->mname_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    err = rdata_name(packet, len, &pos, end, out->rname, &out->rname_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    if (end - pos != 20) {
+        return DNSASM_ERR_RDATA;
+    }
+    out->serial = load32(packet + pos);
+    out->refresh = load32(packet + pos + 4);
+    out->retry = load32(packet + pos + 8);
+    out->expire = load32(packet + pos + 12);
+    out->minimum = load32(packet + pos + 16);
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_ds(const uint8_t *packet, size_t len, size_t off,
+                     uint16_t rdlength, dnsasm_rdata_ds_t *out) {
+    if (rdlength < 5 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    out->key_tag = load16(packet + off);
+    out->algorithm = packet[off + 2];
+    out->digest_type = packet[off + 3];
+    out->digest_off = (uint16_t)(off + 4);
+    out->digest_len = (uint16_t)(rdlength - 4);
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_rrsig(const uint8_t *packet, size_t len, size_t off,
+                        uint16_t rdlength, dnsasm_rdata_rrsig_t *out) {
+    size_t pos = off + 18;
+    size_t end = off + rdlength;
+
+    if (rdlength < 19 || !rdata_fits(len, off, rdlength)) {
+        return DNSASM_ERR_RDATA;
+    }
+    out->type_covered = load16(packet + off);
+    out->algorithm = packet[off + 2];
+    out->labels = packet[off + 3];
+    out->orig_ttl = load32(packet + off + 4);
+    out->expiration = load32(packet + off + 8);
+    out->inception = load32(packet + off + 12);
+    out->key_tag = load16(packet + off + 16);
+
+    /* The signer is never compressed (RFC 4034 3.1.7) but decoding it
+     * through the decompressor costs nothing and tolerates senders that do */
+    int err = rdata_name(packet, len, &pos, end, out->signer, &out->signer_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    out->sig_off = (uint16_t)pos;
+    out->sig_len = (uint16_t)(end - pos);
+    return DNSASM_OK;
+}
+
+int dnsasm_rdata_iter_init(dnsasm_rdata_iter_t *it, size_t len, size_t off,
+                            uint16_t rdlength) {
+    /* The cursor is 16 bits wide, like every offset in a message */
+    if (!rdata_fits(len, off, rdlength) || off + rdlength > UINT16_MAX) {
+        it->pos = it->end = 0;
+        return DNSASM_ERR_RDATA;
+    }
+    it->pos = (uint16_t)off;
+    it->end = (uint16_t)(off + rdlength);
+    return DNSASM_OK;
+}
+
+int dnsasm_txt_next(const uint8_t *packet, dnsasm_rdata_iter_t *it,
+                     uint16_t *str_off, uint8_t *str_len) {
+    if (it->pos >= it->end) {
+        return 0;
+    }
+
+    uint8_t n = packet[it->pos];
+    if ((size_t)it->pos + 1 + n > it->end) {
+        return DNSASM_ERR_RDATA;
+    }
+    *str_off = (uint16_t)(it->pos + 1);
+    *str_len = n;
+    it->pos = (uint16_t)(it->pos + 1 + n);
+    return 1;
+}
+
+int dnsasm_opt_next(const uint8_t *packet, dnsasm_rdata_iter_t *it,
+                     uint16_t *code, uint16_t *data_off, uint16_t *data_len) {
+    if (it->pos >= it->end) {
+        return 0;
+    }
+    if ((size_t)it->pos + 4 > it->end) {
+        return DNSASM_ERR_RDATA;
+    }
+
+    uint16_t n = load16(packet + it->pos + 2);
+    if ((size_t)it->pos + 4 + n > it->end) {
+        return DNSASM_ERR_RDATA;
+    }
+    *code = load16(packet + it->pos);
+    *data_off = (uint16_t)(it->pos + 4);
+    *data_len = n;
+    it->pos = (uint16_t)(it->pos + 4 + n);
+    return 1;
+}
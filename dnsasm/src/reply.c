@@ -0,0 +1,75 @@
+/*
+ * DNSASM - Error Responses
+ *
+ * Builds FORMERR, SERVFAIL, REFUSED, NOTIMP and TC=1 answers straight
+ * from the request bytes: a header, the first question copied as is,
+ * and a bare OPT. Nothing is decompressed, so answering junk costs less
+ * than parsing it.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+/* Root owner, type, class (payload size), TTL (ext-rcode, version, flags), rdlength */
+#define OPT_RR_LEN      11
+
+int dnsasm_reply_error(uint8_t *out, size_t out_size,
+                        const uint8_t *req, size_t req_len,
+                        const dnsasm_query_class_t *qc,
+                        uint16_t rcode, uint16_t flags) {
+    if (req_len < DNS_HEADER_SIZE) {
+        return DNSASM_ERR_SHORT;
+    }
+
+    /* Echo the first question only if it is plain and whole */
+    size_t qlen = 0;
+    if (load16(req + 4) != 0) {
+        size_t n = plain_name_len(req, req_len, DNS_HEADER_SIZE);
+        if (n != 0 && DNS_HEADER_SIZE + n + 4 <= req_len &&
+            (qc == NULL || qc->qname_len == n)) {
+            qlen = n + 4;
+        }
+    }
+
+    int edns = 0, dnssec_ok = 0;
+    if (qc != NULL) {
+        edns = qc->edns.present && !(qc->verdict & DNSASM_CLASS_BAD_OPT);
+        dnssec_ok = qc->edns.dnssec_ok;
+    } else if (qlen != 0 && load16(req + 4) == 1 && load16(req + 10) != 0) {
+        dnsasm_edns_t e;
+        dnsasm_scan_t scan;
+        if (scan_records(req, req_len, DNS_HEADER_SIZE + qlen, &e, &scan) == DNSASM_OK) {
+            edns = e.present;
+            dnssec_ok = e.dnssec_ok;
+        }
+    }
+
+    size_t len = DNS_HEADER_SIZE + qlen + (edns ? OPT_RR_LEN : 0);
+    if (len > out_size) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    uint16_t req_flags = load16(req + 2);
+    uint16_t hdr_flags = DNS_FLAG_QR | (req_flags & (0x7800 | DNS_FLAG_RD | DNS_FLAG_CD)) |
+                         flags | (rcode & 0x0F);
+
+    memcpy(out, req, 2);
+    store16(out + 2, hdr_flags);
+    store16(out + 4, qlen != 0);
+    store16(out + 6, 0);
+    store16(out + 8, 0);
+    store16(out + 10, (uint16_t)edns);
+    memcpy(out + DNS_HEADER_SIZE, req + DNS_HEADER_SIZE, qlen);
+
+    if (edns) {
+        uint8_t *opt = out + DNS_HEADER_SIZE + qlen;
+        opt[0] = 0;
+        store16(opt + 1, DNS_TYPE_OPT);
+        store16(opt + 3, DNSASM_REPLY_UDP_SIZE);
+        opt[5] = (uint8_t)(rcode >> 4);
+        opt[6] = 0;
+        store16(opt + 7, dnssec_ok ? DNS_EDNS_FLAG_DO : 0);
+        store16(opt + 9, 0);
+    }
+    return (int)len;
+}
@@ -0,0 +1,295 @@
+/*
+ * DNSASM - x86_64 SIMD Kernel Variants
+ *
+ * Each variant is compiled with a per-function target attribute rather
+ * than global -m flags, so one object carries SSE4.2, AVX2 and
+ * AVX-512BW code side by side and dispatch.c decides at load time which
+ * one this host can run.
+ *
+ * Name comparison folds case by masking: a byte is an upper-case letter
+ * iff (b - 'A') < 26 unsigned, and only those get 0x20 OR-ed in.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+/* ============================================================================
+ * SSE4.2: 16-byte moves
+ * ============================================================================ */
+
+__attribute__((target("sse4.2")))
+static inline void copy_run_sse42(uint8_t *dst, const uint8_t *src, size_t n) {
+    if (n < 16) {
+        copy_small(dst, src, n);
+        return;
+    }
+
+    /* Whole chunks, then an overlapping final chunk ending at n */
+    __m128i tail = _mm_loadu_si128((const __m128i *)(src + n - 16));
+    for (size_t i = 0; i + 16 < n; i += 16) {
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_loadu_si128((const __m128i *)(src + i)));
+    }
+    _mm_storeu_si128((__m128i *)(dst + n - 16), tail);
+}
+
+__attribute__((target("sse4.2")))
+static dnsasm_result_t decompress_name_sse42(const uint8_t *packet, size_t len,
+                                             size_t offset, uint8_t *out,
+                                             uint16_t *out_len) {
+    return decompress_name_runs(packet, len, offset, out, out_len, copy_run_sse42);
+}
+
+/* Signed compare trick: 'A'..'Z' + 0x3F land on -128..-103 */
+__attribute__((target("sse4.2")))
+static inline __m128i fold_sse42(__m128i x) {
+    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(x, _mm_set1_epi8(0x3F)),
+                                   _mm_set1_epi8(-128 + 26));
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse4.2")))
+static inline int differ_sse42(const uint8_t *a, const uint8_t *b) {
+    __m128i x = fold_sse42(_mm_loadu_si128((const __m128i *)a));
+    __m128i y = fold_sse42(_mm_loadu_si128((const __m128i *)b));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF;
+}
+
+__attribute__((target("sse4.2")))
+static int name_equal_sse42(const uint8_t *a, size_t a_len,
+                            const uint8_t *b, size_t b_len) {
+    if (a_len != b_len) {
+        return 1;
+    }
+    if (a_len < 16) {
+        return name_equal_small(a, b, a_len);
+    }
+
+    /* Whole chunks, then an overlapping final chunk ending at a_len */
+    for (size_t i = 0; i + 16 < a_len; i += 16) {
+        if (differ_sse42(a + i, b + i)) {
+            return 1;
+        }
+    }
+    return differ_sse42(a + a_len - 16, b + a_len - 16);
+}
+
+static int sse42_supported(void) {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+const dnsasm_impl_t dnsasm_impl_sse42 = {
+    "sse42", sse42_supported, decompress_name_sse42, name_equal_sse42,
+    dnsasm_siphash24_x4_c,
+};
+
+/* ============================================================================
+ * AVX2: 32-byte moves (16-byte pair for short runs)
+ * ============================================================================ */
+
+__attribute__((target("avx2")))
+static inline void copy_run_avx2(uint8_t *dst, const uint8_t *src, size_t n) {
+    if (n < 16) {
+        copy_small(dst, src, n);
+        return;
+    }
+    if (n <= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)src);
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + n - 16));
+        _mm_storeu_si128((__m128i *)dst, a);
+        _mm_storeu_si128((__m128i *)(dst + n - 16), b);
+        return;
+    }
+
+    __m256i tail = _mm256_loadu_si256((const __m256i *)(src + n - 32));
+    for (size_t i = 0; i + 32 < n; i += 32) {
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_loadu_si256((const __m256i *)(src + i)));
+    }
+    _mm256_storeu_si256((__m256i *)(dst + n - 32), tail);
+}
+
+__attribute__((target("avx2")))
+static dnsasm_result_t decompress_name_avx2(const uint8_t *packet, size_t len,
+                                            size_t offset, uint8_t *out,
+                                            uint16_t *out_len) {
+    return decompress_name_runs(packet, len, offset, out, out_len, copy_run_avx2);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i fold_avx2(__m256i x) {
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 26),
+                                      _mm256_add_epi8(x, _mm256_set1_epi8(0x3F)));
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+static inline int differ_avx2(const uint8_t *a, const uint8_t *b) {
+    __m256i x = fold_avx2(_mm256_loadu_si256((const __m256i *)a));
+    __m256i y = fold_avx2(_mm256_loadu_si256((const __m256i *)b));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1;
+}
+
+__attribute__((target("avx2")))
+static int name_equal_avx2(const uint8_t *a, size_t a_len,
+                           const uint8_t *b, size_t b_len) {
+    if (a_len != b_len) {
+        return 1;
+    }
+    if (a_len < 16) {
+        return name_equal_small(a, b, a_len);
+    }
+    if (a_len <= 32) {
+        return differ_sse42(a, b) | differ_sse42(a + a_len - 16, b + a_len - 16);
+    }
+
+    for (size_t i = 0; i + 32 < a_len; i += 32) {
+        if (differ_avx2(a + i, b + i)) {
+            return 1;
+        }
+    }
+    return differ_avx2(a + a_len - 32, b + a_len - 32);
+}
+
+/*
+ * Four SipHash-2-4 lanes in one register per state word. AVX2 has no
+ * 64-bit rotate, so rotations are shift pairs, except by 32, which is a
+ * dword shuffle.
+ */
+#define SIPHASH24_X4(suffix, isa, rotl)                                         \
+__attribute__((target(isa)))                                                    \
+static inline void sip_round_##suffix(__m256i *v0, __m256i *v1, __m256i *v2,    \
+                                      __m256i *v3) {                            \
+    *v0 = _mm256_add_epi64(*v0, *v1);                                           \
+    *v1 = _mm256_xor_si256(rotl(*v1, 13), *v0);                                 \
+    *v0 = _mm256_shuffle_epi32(*v0, _MM_SHUFFLE(2, 3, 0, 1));                   \
+    *v2 = _mm256_add_epi64(*v2, *v3);                                           \
+    *v3 = _mm256_xor_si256(rotl(*v3, 16), *v2);                                 \
+    *v0 = _mm256_add_epi64(*v0, *v3);                                           \
+    *v3 = _mm256_xor_si256(rotl(*v3, 21), *v0);                                 \
+    *v2 = _mm256_add_epi64(*v2, *v1);                                           \
+    *v1 = _mm256_xor_si256(rotl(*v1, 17), *v2);                                 \
+    *v2 = _mm256_shuffle_epi32(*v2, _MM_SHUFFLE(2, 3, 0, 1));                   \
+}                                                                               \
+                                                                                \
+__attribute__((target(isa)))                                                    \
+static void siphash24_x4_##suffix(const uint64_t k0[4], const uint64_t k1[4],   \
+                                  const uint64_t *m, size_t words,              \
+                                  uint64_t out[4]) {                            \
+    __m256i a = _mm256_loadu_si256((const __m256i *)k0);                        \
+    __m256i b = _mm256_loadu_si256((const __m256i *)k1);                        \
+    __m256i v0 = _mm256_xor_si256(a, _mm256_set1_epi64x(0x736f6d6570736575LL)); \
+    __m256i v1 = _mm256_xor_si256(b, _mm256_set1_epi64x(0x646f72616e646f6dLL)); \
+    __m256i v2 = _mm256_xor_si256(a, _mm256_set1_epi64x(0x6c7967656e657261LL)); \
+    __m256i v3 = _mm256_xor_si256(b, _mm256_set1_epi64x(0x7465646279746573LL)); \
+    for (size_t w = 0; w < words; w++) {                                        \
+        __m256i x = _mm256_loadu_si256((const __m256i *)(m + 4 * w));           \
+        v3 = _mm256_xor_si256(v3, x);                                           \
+        sip_round_##suffix(&v0, &v1, &v2, &v3);                                 \
+        sip_round_##suffix(&v0, &v1, &v2, &v3);                                 \
+        v0 = _mm256_xor_si256(v0, x);                                           \
+    }                                                                           \
+    v2 = _mm256_xor_si256(v2, _mm256_set1_epi64x(0xff));                        \
+    for (int r = 0; r < 4; r++) {                                               \
+        sip_round_##suffix(&v0, &v1, &v2, &v3);                                 \
+    }                                                                           \
+    _mm256_storeu_si256((__m256i *)out,                                         \
+                        _mm256_xor_si256(_mm256_xor_si256(v0, v1),              \
+                                         _mm256_xor_si256(v2, v3)));            \
+}
+
+#define ROTL_AVX2(x, b) \
+    _mm256_or_si256(_mm256_slli_epi64((x), (b)), _mm256_srli_epi64((x), 64 - (b)))
+
+SIPHASH24_X4(avx2, "avx2", ROTL_AVX2)
+
+static int avx2_supported(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+const dnsasm_impl_t dnsasm_impl_avx2 = {
+    "avx2", avx2_supported, decompress_name_avx2, name_equal_avx2,
+    siphash24_x4_avx2,
+};
+
+/* ============================================================================
+ * AVX-512BW: byte-masked 32-byte moves
+ *
+ * Uses 256-bit registers (AVX-512VL) to avoid the frequency penalty of
+ * 512-bit ops on older parts. The final chunk is a masked load/store,
+ * so neither side touches a byte outside the run.
+ * ============================================================================ */
+
+__attribute__((target("avx512bw,avx512vl")))
+static inline void copy_run_avx512bw(uint8_t *dst, const uint8_t *src, size_t n) {
+    while (n > 32) {
+        _mm256_storeu_si256((__m256i *)dst,
+                            _mm256_loadu_si256((const __m256i *)src));
+        src += 32;
+        dst += 32;
+        n -= 32;
+    }
+
+    __mmask32 mask = (__mmask32)(0xFFFFFFFFu >> (32 - n));
+    _mm256_mask_storeu_epi8(dst, mask, _mm256_maskz_loadu_epi8(mask, src));
+}
+
+__attribute__((target("avx512bw,avx512vl")))
+static dnsasm_result_t decompress_name_avx512bw(const uint8_t *packet, size_t len,
+                                                size_t offset, uint8_t *out,
+                                                uint16_t *out_len) {
+    return decompress_name_runs(packet, len, offset, out, out_len, copy_run_avx512bw);
+}
+
+/* Masked loads cover every length, short names included, in one shape */
+__attribute__((target("avx512bw,avx512vl")))
+static inline int differ_avx512bw(const uint8_t *a, const uint8_t *b, __mmask32 mask) {
+    __m256i x = _mm256_maskz_loadu_epi8(mask, a);
+    __m256i y = _mm256_maskz_loadu_epi8(mask, b);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    const __m256i base = _mm256_set1_epi8('A');
+    const __m256i span = _mm256_set1_epi8(26);
+    __mmask32 ux = _mm256_cmplt_epu8_mask(_mm256_sub_epi8(x, base), span);
+    __mmask32 uy = _mm256_cmplt_epu8_mask(_mm256_sub_epi8(y, base), span);
+    x = _mm256_mask_add_epi8(x, ux, x, bit);
+    y = _mm256_mask_add_epi8(y, uy, y, bit);
+    return _mm256_cmpneq_epi8_mask(x, y) != 0;
+}
+
+__attribute__((target("avx512bw,avx512vl")))
+static int name_equal_avx512bw(const uint8_t *a, size_t a_len,
+                               const uint8_t *b, size_t b_len) {
+    if (a_len != b_len) {
+        return 1;
+    }
+    while (a_len > 32) {
+        if (differ_avx512bw(a, b, 0xFFFFFFFFu)) {
+            return 1;
+        }
+        a += 32;
+        b += 32;
+        a_len -= 32;
+    }
+    if (a_len == 0) {
+        return 0;
+    }
+    return differ_avx512bw(a, b, (__mmask32)(0xFFFFFFFFu >> (32 - a_len)));
+}
+
+/* AVX-512VL has the 64-bit rotate AVX2 lacks */
+SIPHASH24_X4(avx512bw, "avx512bw,avx512vl", _mm256_rol_epi64)
+
+static int avx512bw_supported(void) {
+    return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+}
+
+const dnsasm_impl_t dnsasm_impl_avx512bw = {
+    "avx512bw", avx512bw_supported, decompress_name_avx512bw, name_equal_avx512bw,
+    siphash24_x4_avx512bw,
+};
+
+#endif /* __x86_64__ */
@@ -0,0 +1,112 @@
+/*
+ * DNSASM - Hot-Path Statistics
+ *
+ * Slot registry behind the STATS=1 counters in internal.h. A thread
+ * attaches a slot the first time it counts and hands it back when it
+ * exits; the next new thread reuses it and counts on top, so totals
+ * never go backwards and a server that churns threads (cgo callers
+ * run on whatever OS thread Go picks) keeps a bounded set of slots.
+ * The lock is only taken on attach, detach and snapshot.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#ifdef DNSASM_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+
+__thread stats_slot_t *dnsasm_stats_tls __attribute__((tls_model("initial-exec")));
+
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static int have_key;
+static stats_slot_t *slots;         /* Every slot ever attached */
+static stats_slot_t *free_slots;    /* Detached, ready for reuse */
+static uint64_t live;
+
+/* Shared by threads that could not get a slot of their own; may lose counts */
+static stats_slot_t overflow_slot;
+
+static void detach(void *arg) {
+    stats_slot_t *s = arg;
+    pthread_mutex_lock(&slots_lock);
+    s->next_free = free_slots;
+    free_slots = s;
+    live--;
+    pthread_mutex_unlock(&slots_lock);
+    dnsasm_stats_tls = NULL;
+}
+
+static void make_key(void) {
+    have_key = pthread_key_create(&slot_key, detach) == 0;
+}
+
+stats_slot_t *dnsasm_stats_attach(void) {
+    pthread_once(&key_once, make_key);
+
+    pthread_mutex_lock(&slots_lock);
+    stats_slot_t *s = free_slots;
+    if (s != NULL) {
+        free_slots = s->next_free;
+    } else {
+        s = aligned_alloc(_Alignof(stats_slot_t), sizeof(*s));
+        if (s != NULL) {
+            memset(s, 0, sizeof(*s));
+            s->next = slots;
+            slots = s;
+        }
+    }
+    if (s != NULL) {
+        live++;
+    }
+    pthread_mutex_unlock(&slots_lock);
+
+    /* Without a destructor the slot would leak at thread exit */
+    if (s != NULL && (!have_key || pthread_setspecific(slot_key, s) != 0)) {
+        detach(s);
+        s = NULL;
+    }
+    if (s == NULL) {
+        return &overflow_slot;      /* Not cached: retry on the next count */
+    }
+    dnsasm_stats_tls = s;
+    return s;
+}
+
+static void add_slot(dnsasm_stats_t *out, const stats_slot_t *s) {
+    const uint64_t *src = (const uint64_t *)&s->c;
+    uint64_t *dst = (uint64_t *)out;
+    for (size_t i = 1; i < sizeof(*out) / sizeof(uint64_t); i++) {
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+int dnsasm_stats_enabled(void) {
+    return 1;
+}
+
+void dnsasm_stats_snapshot(dnsasm_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&slots_lock);
+    for (const stats_slot_t *s = slots; s != NULL; s = s->next) {
+        add_slot(out, s);
+    }
+    out->threads = live;
+    pthread_mutex_unlock(&slots_lock);
+    add_slot(out, &overflow_slot);
+}
+
+#else
+
+int dnsasm_stats_enabled(void) {
+    return 0;
+}
+
+void dnsasm_stats_snapshot(dnsasm_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+}
+
+#endif /* DNSASM_STATS */
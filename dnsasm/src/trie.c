@@ -0,0 +1,326 @@
+/*
+ * DNSASM - Reverse-Label Suffix Trie
+ *
+ * Answers "which configured name is the closest ancestor of this one"
+ * in one walk from the root label down, instead of one subdomain test
+ * per configured name. The trie is flat like the name set: a header,
+ * an array of nodes and a store of lowercased labels, with no pointers.
+ *
+ * Nodes are laid out level by level from sorted input, so the children
+ * of a node are contiguous and in canonical label order; a lookup
+ * binary-searches them.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+typedef struct {
+    uint32_t label;            /* Label offset from the start of the trie */
+    uint32_t first_child;      /* Index of the first child */
+    uint32_t child_count;
+    uint32_t value;            /* DNSASM_TRIE_NONE if no name ends here */
+} node_t;
+
+_Static_assert(sizeof(node_t) == 16, "node must be 16 bytes");
+_Static_assert(sizeof(dnsasm_trie_t) == 64, "header must be one cache line");
+
+static inline node_t *nodes(const dnsasm_trie_t *trie) {
+    return (node_t *)(trie + 1);
+}
+
+static inline uint8_t fold(uint8_t c) {
+    return c | (uint8_t)(((uint8_t)(c - 'A') < 26) << 5);
+}
+
+/* Canonical order of a label against a stored (lowercased) one */
+static inline int label_cmp(const uint8_t *a, const uint8_t *stored) {
+    unsigned la = a[0], lb = stored[0];
+    unsigned n = la < lb ? la : lb;
+    for (unsigned i = 1; i <= n; i++) {
+        int d = (int)fold(a[i]) - (int)stored[i];
+        if (d != 0) {
+            return d;
+        }
+    }
+    return (int)la - (int)lb;
+}
+
+static inline int label_eq(const uint8_t *a, const uint8_t *b) {
+    if (a[0] != b[0]) {
+        return 0;
+    }
+    for (unsigned i = 1; i <= a[0]; i++) {
+        if (fold(a[i]) != fold(b[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Trailing labels two names have in common */
+static int common_suffix(const uint8_t *a, const uint8_t *a_off, int na,
+                         const uint8_t *b, const uint8_t *b_off, int nb) {
+    int k = 0;
+    while (k < na && k < nb && label_eq(a + a_off[na - 1 - k], b + b_off[nb - 1 - k])) {
+        k++;
+    }
+    return k;
+}
+
+/* Validate the names and their order; count labels and the deepest name */
+static int scan_names(const uint8_t *names, size_t names_len,
+                      size_t *labels, int *depth) {
+    size_t pos = 0, prev = 0, prev_len = 0;
+    *labels = 0;
+    *depth = 0;
+    while (pos < names_len) {
+        size_t n = plain_name_len(names, names_len, pos);
+        if (n == 0) {
+            return DNSASM_ERR_NAME;
+        }
+        if (prev_len != 0 && dnsasm_name_compare(names + prev, prev_len, names + pos, n) > 0) {
+            return DNSASM_ERR_FORMAT;
+        }
+        uint8_t off[128];
+        int nl = label_offsets(names + pos, n, off, NULL);
+        *labels += (size_t)nl;
+        if (nl > *depth) {
+            *depth = nl;
+        }
+        prev = pos;
+        prev_len = n;
+        pos += n;
+    }
+    return DNSASM_OK;
+}
+
+static size_t bound(size_t labels, size_t names_len) {
+    return sizeof(dnsasm_trie_t) + (labels + 1) * sizeof(node_t) + names_len;
+}
+
+size_t dnsasm_trie_size(const uint8_t *names, size_t names_len) {
+    size_t labels;
+    int depth;
+    if (scan_names(names, names_len, &labels, &depth) != DNSASM_OK) {
+        return 0;
+    }
+    size_t size = bound(labels, names_len);
+    return size <= UINT32_MAX ? size : 0;
+}
+
+int dnsasm_trie_build(const uint8_t *names, size_t names_len, const uint32_t *values,
+                       uint8_t *out, size_t out_size) {
+    size_t labels;
+    int depth;
+    int err = scan_names(names, names_len, &labels, &depth);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    if (((uintptr_t)out & 7) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+    size_t need = bound(labels, names_len);
+    if (need > UINT32_MAX) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    if (need > out_size) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    dnsasm_trie_t *trie = (dnsasm_trie_t *)out;
+    memset(trie, 0, sizeof(*trie));
+    trie->magic = DNSASM_TRIE_MAGIC;
+    trie->version = DNSASM_TRIE_VERSION;
+
+    /* Labels go past the worst-case node array and are moved down at the end */
+    node_t *node = nodes(trie);
+    size_t store = sizeof(dnsasm_trie_t) + (labels + 1) * sizeof(node_t);
+    size_t cursor = store;
+    uint32_t next = 1;
+    node[0] = (node_t){0, 0, 0, DNSASM_TRIE_NONE};
+
+    /*
+     * One pass per depth d creates the nodes for the distinct d-label
+     * suffixes. Sorted input makes them appear in the order the nodes
+     * of depth d - 1 were created, so the parent is a running cursor,
+     * and the common suffix of neighbours tells when a new one starts.
+     */
+    uint32_t level = 0;
+    for (int d = 1; d <= depth || d == 1; d++) {
+        uint32_t level_end = next;
+        uint32_t parent = level;
+        int first = 1, have_child = 0;
+        int run_parent = 128, run_child = 128;
+        uint8_t off[2][128];
+        int nl[2] = {0, 0};
+        int cur = 0;
+        const uint8_t *prev = NULL;
+        size_t pos = 0;
+
+        for (uint32_t i = 0; pos < names_len; i++) {
+            const uint8_t *name = names + pos;
+            size_t n = plain_name_len(names, names_len, pos);
+            uint32_t v = values != NULL ? values[i] : i;
+            pos += n;
+
+            nl[cur] = label_offsets(name, n, off[cur], NULL);
+            if (prev != NULL) {
+                int common = common_suffix(prev, off[cur ^ 1], nl[cur ^ 1],
+                                           name, off[cur], nl[cur]);
+                run_parent = common < run_parent ? common : run_parent;
+                run_child = common < run_child ? common : run_child;
+            }
+            prev = name;
+            int labels_here = nl[cur];
+            const uint8_t *label = labels_here >= d ? name + off[cur][labels_here - d] : NULL;
+            cur ^= 1;
+
+            if (d == 1 && labels_here == 0) {
+                node[0].value = v;
+            }
+            if (labels_here < d - 1) {
+                continue;
+            }
+            if (!first && run_parent < d - 1) {
+                parent++;
+                have_child = 0;
+            }
+            first = 0;
+            run_parent = 128;
+            if (labels_here < d) {
+                continue;
+            }
+
+            if (!have_child || run_child < d) {
+                node_t *p = &node[parent];
+                if (p->child_count == 0) {
+                    p->first_child = next;
+                }
+                p->child_count++;
+
+                uint8_t *dst = out + cursor;
+                dst[0] = label[0];
+                for (unsigned j = 1; j <= label[0]; j++) {
+                    dst[j] = fold(label[j]);
+                }
+                node[next++] = (node_t){(uint32_t)cursor, 0, 0, DNSASM_TRIE_NONE};
+                cursor += 1 + label[0];
+                have_child = 1;
+            }
+            run_child = 128;
+            if (labels_here == d) {
+                node[next - 1].value = v;
+            }
+        }
+        level = level_end;
+    }
+
+    size_t label_off = sizeof(dnsasm_trie_t) + (size_t)next * sizeof(node_t);
+    size_t shift = store - label_off;
+    memmove(out + label_off, out + store, cursor - store);
+    for (uint32_t i = 0; i < next; i++) {
+        if (i != 0) {
+            node[i].label -= (uint32_t)shift;
+        }
+        trie->count += node[i].value != DNSASM_TRIE_NONE;
+    }
+    trie->node_count = next;
+    trie->label_off = (uint32_t)label_off;
+    trie->size = (uint32_t)(cursor - shift);
+    return DNSASM_OK;
+}
+
+int dnsasm_trie_open(const uint8_t *buf, size_t len, const dnsasm_trie_t **out) {
+    *out = NULL;
+    if (len < sizeof(dnsasm_trie_t)) {
+        return DNSASM_ERR_SHORT;
+    }
+    if (((uintptr_t)buf & 7) != 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    const dnsasm_trie_t *trie = (const dnsasm_trie_t *)buf;
+    if (trie->magic != DNSASM_TRIE_MAGIC || trie->version != DNSASM_TRIE_VERSION ||
+        trie->node_count == 0) {
+        return DNSASM_ERR_FORMAT;
+    }
+    if (trie->size > len) {
+        return DNSASM_ERR_SHORT;
+    }
+    if ((size_t)trie->label_off != sizeof(dnsasm_trie_t) + (size_t)trie->node_count * sizeof(node_t) ||
+        trie->label_off > trie->size) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    /* Children follow their parent, so every walk moves forward and ends */
+    const node_t *node = nodes(trie);
+    size_t valued = 0;
+    for (uint32_t i = 0; i < trie->node_count; i++) {
+        if (node[i].child_count != 0 &&
+            (node[i].first_child <= i ||
+             (uint64_t)node[i].first_child + node[i].child_count > trie->node_count)) {
+            return DNSASM_ERR_FORMAT;
+        }
+        if (i != 0) {
+            size_t l = node[i].label;
+            if (l < trie->label_off || l >= trie->size || buf[l] == 0 || buf[l] > 63 ||
+                l + 1 + buf[l] > trie->size) {
+                return DNSASM_ERR_FORMAT;
+            }
+        }
+        valued += node[i].value != DNSASM_TRIE_NONE;
+    }
+    if (valued != trie->count) {
+        return DNSASM_ERR_FORMAT;
+    }
+
+    *out = trie;
+    return DNSASM_OK;
+}
+
+int dnsasm_trie_match(const dnsasm_trie_t *trie, const uint8_t *name, size_t len,
+                       uint32_t *value) {
+    uint8_t off[128];
+    size_t end;
+    int n = label_offsets(name, len, off, &end);
+    if (end >= len || name[end] != 0) {
+        return -1;
+    }
+
+    const uint8_t *base = (const uint8_t *)trie;
+    const node_t *node = nodes(trie);
+    const node_t *at = &node[0];
+    int best = -1;
+
+    if (at->value != DNSASM_TRIE_NONE) {
+        best = (int)end;
+        *value = at->value;
+    }
+    for (int k = n - 1; k >= 0; k--) {
+        const uint8_t *label = name + off[k];
+        uint32_t lo = at->first_child, hi = at->first_child + at->child_count;
+        const node_t *hit = NULL;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int c = label_cmp(label, base + node[mid].label);
+            if (c == 0) {
+                hit = &node[mid];
+                break;
+            }
+            if (c < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        if (hit == NULL) {
+            break;
+        }
+        at = hit;
+        if (at->value != DNSASM_TRIE_NONE) {
+            best = off[k];
+            *value = at->value;
+        }
+    }
+    return best;
+}
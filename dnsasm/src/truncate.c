@@ -0,0 +1,182 @@
+/*
+ * DNSASM - RRset-Aware Truncation
+ *
+ * Cuts an oversized response down to a UDP limit without repacking it.
+ * Only a prefix of the message is kept, so every compression pointer in
+ * it stays valid; the OPT record is the one piece moved.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+/* Locate the OPT record in the additional section, if any */
+static int find_opt(const uint8_t *buf, size_t len, size_t pos,
+                    const uint16_t count[DNSASM_SECTION_COUNT],
+                    size_t *opt_off, size_t *opt_len) {
+    *opt_off = 0;
+    *opt_len = 0;
+
+    for (int s = DNSASM_SECTION_ANSWER; s < DNSASM_SECTION_COUNT; s++) {
+        for (uint16_t i = 0; i < count[s]; i++) {
+            size_t name_len;
+            int err = skip_name(buf, len, pos, &name_len);
+            if (err != DNSASM_OK) {
+                return err;
+            }
+            size_t p = pos + name_len;
+            if (p + DNS_RR_FIXED_LEN > len) {
+                return DNSASM_ERR_SHORT;
+            }
+            size_t end = p + DNS_RR_FIXED_LEN + load16(buf + p + 8);
+            if (end > len) {
+                return DNSASM_ERR_SHORT;
+            }
+            if (s == DNSASM_SECTION_ADDITIONAL && load16(buf + p) == DNS_TYPE_OPT &&
+                *opt_len == 0) {
+                *opt_off = pos;
+                *opt_len = end - pos;
+            }
+            pos = end;
+        }
+    }
+    return DNSASM_OK;
+}
+
+/* Case-insensitive compare of two decompressed names */
+static int same_name(const uint8_t *a, uint16_t a_len, const uint8_t *b, uint16_t b_len) {
+    if (a_len != b_len) {
+        return 0;
+    }
+    for (uint16_t i = 0; i < a_len; i++) {
+        uint8_t x = a[i], y = b[i];
+        x |= (uint8_t)(((uint8_t)(x - 'A') < 26) << 5);
+        y |= (uint8_t)(((uint8_t)(y - 'A') < 26) << 5);
+        if (x != y) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int dnsasm_truncate(uint8_t *buf, size_t len, size_t limit) {
+    if (len < DNS_HEADER_SIZE) {
+        return DNSASM_ERR_SHORT;
+    }
+    if (len > DNS_MAX_PACKET_SIZE) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    if (len <= limit) {
+        return (int)len;
+    }
+
+    uint16_t count[DNSASM_SECTION_COUNT];
+    for (int s = 0; s < DNSASM_SECTION_COUNT; s++) {
+        count[s] = load16(buf + 4 + 2 * s);
+    }
+
+    size_t pos = DNS_HEADER_SIZE;
+    for (uint16_t i = 0; i < count[DNSASM_SECTION_QUESTION]; i++) {
+        size_t name_len;
+        int err = skip_name(buf, len, pos, &name_len);
+        if (err != DNSASM_OK) {
+            return err;
+        }
+        pos += name_len + 4;
+        if (pos > len) {
+            return DNSASM_ERR_SHORT;
+        }
+    }
+
+    size_t opt_off, opt_len;
+    int err = find_opt(buf, len, pos, count, &opt_off, &opt_len);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+
+    /* The questions alone are the first cut; drop OPT only as a last resort */
+    if (pos > limit) {
+        return DNSASM_ERR_SPACE;
+    }
+    if (pos + opt_len > limit) {
+        opt_len = 0;
+    }
+
+    /*
+     * Walk the RRs; every RRset start is a candidate cut. The kept size
+     * (prefix plus OPT if it lies beyond the prefix) never shrinks as
+     * the cut moves on, so stop at the first candidate that fails.
+     */
+    size_t cut = pos;
+    uint16_t kept[DNSASM_SECTION_COUNT] = {count[0], 0, 0, 0};
+    uint16_t seen[DNSASM_SECTION_COUNT] = {count[0], 0, 0, 0};
+    uint8_t names[2][DNS_MAX_NAME_LEN + 1];
+    uint16_t name_len[2] = {0, 0};
+    int cur = 0;
+    uint16_t prev_type = 0, prev_class = 0;
+    int prev_section = -1;
+    int done = 0;
+
+    for (int s = DNSASM_SECTION_ANSWER; s < DNSASM_SECTION_COUNT && !done; s++) {
+        for (uint16_t i = 0; i < count[s] && !done; i++) {
+            size_t owner_len;
+            if (skip_name(buf, len, pos, &owner_len) != DNSASM_OK) {
+                return DNSASM_ERR_NAME;   /* find_opt already walked it */
+            }
+            const uint8_t *rr = buf + pos + owner_len;
+            uint16_t type = load16(rr), rclass = load16(rr + 2);
+            size_t end = pos + owner_len + DNS_RR_FIXED_LEN + load16(rr + 8);
+
+            int boundary = s != prev_section || type != prev_type || rclass != prev_class;
+            if (!boundary) {
+                /* Same type and class: a new RRset only if the owner differs */
+                dnsasm_result_t r = dnsasm_decompress_name(buf, len, pos, names[cur ^ 1],
+                                                           &name_len[cur ^ 1]);
+                if (r.error != DNSASM_OK) {
+                    return r.error;
+                }
+                boundary = !same_name(names[cur], name_len[cur],
+                                      names[cur ^ 1], name_len[cur ^ 1]);
+                cur ^= 1;
+            } else {
+                dnsasm_result_t r = dnsasm_decompress_name(buf, len, pos, names[cur],
+                                                           &name_len[cur]);
+                if (r.error != DNSASM_OK) {
+                    return r.error;
+                }
+            }
+
+            if (boundary) {
+                size_t size = pos + (opt_off >= pos ? opt_len : 0);
+                if (size > limit) {
+                    done = 1;
+                    break;
+                }
+                cut = pos;
+                memcpy(kept, seen, sizeof(kept));
+            }
+
+            prev_section = s;
+            prev_type = type;
+            prev_class = rclass;
+            seen[s]++;
+            pos = end;
+        }
+    }
+
+    /* OPT sits beyond the cut (it always does unless nothing was cut) */
+    size_t out = cut;
+    if (opt_len > 0 && opt_off >= cut) {
+        memmove(buf + cut, buf + opt_off, opt_len);
+        out += opt_len;
+        kept[DNSASM_SECTION_ADDITIONAL]++;
+    }
+
+    if (kept[DNSASM_SECTION_ANSWER] < count[DNSASM_SECTION_ANSWER] ||
+        kept[DNSASM_SECTION_AUTHORITY] < count[DNSASM_SECTION_AUTHORITY]) {
+        store16(buf + 2, load16(buf + 2) | DNS_FLAG_TC);
+    }
+    for (int s = DNSASM_SECTION_ANSWER; s < DNSASM_SECTION_COUNT; s++) {
+        store16(buf + 4 + 2 * s, kept[s]);
+    }
+    return (int)out;
+}
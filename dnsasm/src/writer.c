@@ -0,0 +1,403 @@
+/*
+ * DNSASM - Compressing Response Writer
+ *
+ * Renders whole messages into a caller's buffer without an intermediate
+ * object model. Every label suffix written is remembered in a small
+ * open-addressed table keyed by a hash of the lowercased suffix, so a
+ * later name finds its longest already-written suffix with one probe
+ * per label and a byte compare against the buffer.
+ */
+
+#include "dnsasm.h"
+#include "internal.h"
+
+#define WRITER_MASK         (DNSASM_WRITER_SLOTS - 1)
+#define WRITER_MAX_USED     (DNSASM_WRITER_SLOTS * 3 / 4)
+#define POINTER_MAX         0x3FFF
+
+static inline uint8_t fold(uint8_t c) {
+    return c | (uint8_t)(((uint8_t)(c - 'A') < 26) << 5);
+}
+
+/* Hash one label onto the hash of the suffix that follows it */
+static inline uint32_t label_hash(const uint8_t *label, uint32_t h) {
+    uint8_t n = label[0];
+    h = (h ^ n) * 0x01000193u;
+    for (uint8_t i = 1; i <= n; i++) {
+        h = (h ^ fold(label[i])) * 0x01000193u;
+    }
+    return h ^ (h >> 15);
+}
+
+/*
+ * Check an uncompressed name and record where each label starts.
+ * Returns the label count (root excluded) or a negative error.
+ */
+static int name_labels(const uint8_t *name, size_t name_len,
+                       uint8_t starts[DNS_MAX_NAME_LEN / 2]) {
+    size_t pos = 0;
+    int n = 0;
+
+    if (name_len == 0 || name_len > DNS_MAX_NAME_LEN) {
+        return DNSASM_ERR_NAME;
+    }
+    while (pos < name_len) {
+        uint8_t l = name[pos];
+        if (l == 0) {
+            return pos + 1 == name_len ? n : DNSASM_ERR_NAME;
+        }
+        if (l > 63) {
+            return DNSASM_ERR_NAME;
+        }
+        starts[n++] = (uint8_t)pos;
+        pos += 1 + l;
+    }
+    return DNSASM_ERR_NAME;
+}
+
+/* Does the (possibly compressed) name at buf[off] equal suffix? */
+static int suffix_equal(const uint8_t *buf, size_t off, const uint8_t *suffix) {
+    size_t j = 0;
+
+    for (int hops = 0; hops < DNS_MAX_NAME_LEN; hops++) {
+        uint8_t l = buf[off];
+        if ((l & 0xC0) == 0xC0) {
+            off = ((size_t)(l & 0x3F) << 8) | buf[off + 1];
+            continue;
+        }
+        if (l != suffix[j]) {
+            return 0;
+        }
+        if (l == 0) {
+            return 1;
+        }
+        for (uint8_t k = 1; k <= l; k++) {
+            if (fold(buf[off + k]) != fold(suffix[j + k])) {
+                return 0;
+            }
+        }
+        off += 1 + l;
+        j += 1 + l;
+    }
+    return 0;
+}
+
+static void remember(dnsasm_writer_t *w, uint32_t hash, size_t off) {
+    if (off > POINTER_MAX || w->used >= WRITER_MAX_USED) {
+        return;
+    }
+    size_t slot = hash & WRITER_MASK;
+    while (w->table[slot].off != 0) {
+        slot = (slot + 1) & WRITER_MASK;
+    }
+    w->table[slot].hash = hash;
+    w->table[slot].off = (uint16_t)off;
+    w->used++;
+}
+
+/* Forget everything from mark on, after a record did not fit */
+static void rollback(dnsasm_writer_t *w, size_t mark) {
+    w->len = mark;
+    for (size_t i = 0; i < DNSASM_WRITER_SLOTS; i++) {
+        if (w->table[i].off >= mark) {
+            w->table[i].off = 0;
+            w->used--;
+        }
+    }
+}
+
+static int write_name(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      int compress) {
+    uint8_t starts[DNS_MAX_NAME_LEN / 2];
+    uint32_t hashes[DNS_MAX_NAME_LEN / 2];
+    int n = name_labels(name, name_len, starts);
+    if (n < 0) {
+        return n;
+    }
+
+    uint32_t h = 0x811c9dc5u;
+    for (int i = n - 1; i >= 0; i--) {
+        h = label_hash(name + starts[i], h);
+        hashes[i] = h;
+    }
+
+    /* Leftmost (longest) suffix already in the buffer */
+    int match = n;
+    size_t target = 0;
+    for (int i = 0; compress && i < n && match == n; i++) {
+        size_t slot = hashes[i] & WRITER_MASK;
+        while (w->table[slot].off != 0) {
+            if (w->table[slot].hash == hashes[i] &&
+                suffix_equal(w->buf, w->table[slot].off, name + starts[i])) {
+                match = i;
+                target = w->table[slot].off;
+                break;
+            }
+            slot = (slot + 1) & WRITER_MASK;
+        }
+    }
+
+    size_t literal = match < n ? starts[match] : name_len;
+    size_t need = literal + (match < n ? 2 : 0);
+    if (w->len + need > w->limit) {
+        return DNSASM_ERR_SPACE;
+    }
+
+    memcpy(w->buf + w->len, name, literal);
+    for (int i = 0; i < match; i++) {
+        remember(w, hashes[i], w->len + starts[i]);
+    }
+    if (match < n) {
+        store16(w->buf + w->len + literal, (uint16_t)(0xC000 | target));
+    }
+    w->len += need;
+    return DNSASM_OK;
+}
+
+static inline int put(dnsasm_writer_t *w, const void *data, size_t n) {
+    if (w->len + n > w->limit) {
+        return DNSASM_ERR_SPACE;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+    return DNSASM_OK;
+}
+
+static inline int put16(dnsasm_writer_t *w, uint16_t v) {
+    uint8_t b[2];
+    store16(b, v);
+    return put(w, b, 2);
+}
+
+static inline int put32(dnsasm_writer_t *w, uint32_t v) {
+    uint8_t b[4];
+    store32(b, v);
+    return put(w, b, 4);
+}
+
+/*
+ * Owner name and fixed fields; *rdata_at receives where RDATA starts.
+ * The first record after the questions opens the answer section.
+ */
+static int rr_begin(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                    uint16_t type, uint16_t rclass, uint32_t ttl,
+                    size_t *rdata_at) {
+    if (w->section == DNSASM_SECTION_QUESTION) {
+        w->section = DNSASM_SECTION_ANSWER;
+    }
+
+    int err = write_name(w, name, name_len, 1);
+    if (err != DNSASM_OK) {
+        return err;
+    }
+    if (w->len + DNS_RR_FIXED_LEN > w->limit) {
+        return DNSASM_ERR_SPACE;
+    }
+    store16(w->buf + w->len, type);
+    store16(w->buf + w->len + 2, rclass);
+    store32(w->buf + w->len + 4, ttl);
+    w->len += DNS_RR_FIXED_LEN;
+    *rdata_at = w->len;
+    return DNSASM_OK;
+}
+
+static int rr_end(dnsasm_writer_t *w, size_t mark, size_t rdata_at, int err) {
+    if (err == DNSASM_OK && w->len - rdata_at > 0xFFFF) {
+        err = DNSASM_ERR_SPACE;
+    }
+    if (err != DNSASM_OK) {
+        rollback(w, mark);
+        return err;
+    }
+    store16(w->buf + rdata_at - 2, (uint16_t)(w->len - rdata_at));
+    w->count[w->section]++;
+    return DNSASM_OK;
+}
+
+void dnsasm_writer_init(dnsasm_writer_t *w, uint8_t *buf, size_t limit) {
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->limit = limit > DNS_MAX_PACKET_SIZE ? DNS_MAX_PACKET_SIZE : limit;
+    w->section = DNSASM_SECTION_QUESTION;
+    w->rclass = DNS_CLASS_IN;
+}
+
+int dnsasm_writer_header(dnsasm_writer_t *w, uint16_t id, uint16_t flags) {
+    if (w->limit < DNS_HEADER_SIZE) {
+        return DNSASM_ERR_SPACE;
+    }
+    memset(w->buf, 0, DNS_HEADER_SIZE);
+    store16(w->buf, id);
+    store16(w->buf + 2, flags);
+    if (w->len < DNS_HEADER_SIZE) {
+        w->len = DNS_HEADER_SIZE;
+    }
+    return DNSASM_OK;
+}
+
+int dnsasm_writer_question(dnsasm_writer_t *w, const uint8_t *name,
+                            size_t name_len, uint16_t qtype, uint16_t qclass) {
+    if (w->section != DNSASM_SECTION_QUESTION) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+
+    size_t mark = w->len;
+    int err = write_name(w, name, name_len, 1);
+    if (err == DNSASM_OK) {
+        err = put16(w, qtype);
+    }
+    if (err == DNSASM_OK) {
+        err = put16(w, qclass);
+    }
+    if (err != DNSASM_OK) {
+        rollback(w, mark);
+        return err;
+    }
+    w->count[DNSASM_SECTION_QUESTION]++;
+    return DNSASM_OK;
+}
+
+int dnsasm_writer_section(dnsasm_writer_t *w, int section) {
+    if (section < w->section || section >= DNSASM_SECTION_COUNT) {
+        return DNSASM_ERR_OVERFLOW;
+    }
+    w->section = section;
+    return DNSASM_OK;
+}
+
+int dnsasm_writer_rr(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      uint16_t type, uint16_t rclass, uint32_t ttl,
+                      const uint8_t *rdata, uint16_t rdlength) {
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, type, rclass, ttl, &at);
+    if (err == DNSASM_OK && rdlength > 0) {
+        err = put(w, rdata, rdlength);
+    }
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_a(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                     uint32_t ttl, const uint8_t addr[4]) {
+    return dnsasm_writer_rr(w, name, name_len, DNS_TYPE_A, w->rclass, ttl, addr, 4);
+}
+
+int dnsasm_writer_aaaa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                        uint32_t ttl, const uint8_t addr[16]) {
+    return dnsasm_writer_rr(w, name, name_len, DNS_TYPE_AAAA, w->rclass, ttl, addr, 16);
+}
+
+int dnsasm_writer_name_rr(dnsasm_writer_t *w, const uint8_t *name,
+                           size_t name_len, uint16_t type, uint32_t ttl,
+                           const uint8_t *target, size_t target_len) {
+    int compress = type == DNS_TYPE_CNAME || type == DNS_TYPE_NS ||
+                   type == DNS_TYPE_PTR;
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, type, w->rclass, ttl, &at);
+    if (err == DNSASM_OK) {
+        err = write_name(w, target, target_len, compress);
+    }
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_mx(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                      uint32_t ttl, uint16_t preference,
+                      const uint8_t *exchange, size_t exchange_len) {
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, DNS_TYPE_MX, w->rclass, ttl, &at);
+    if (err == DNSASM_OK) {
+        err = put16(w, preference);
+    }
+    if (err == DNSASM_OK) {
+        err = write_name(w, exchange, exchange_len, 1);
+    }
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_srv(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, uint16_t priority, uint16_t weight,
+                       uint16_t port, const uint8_t *target, size_t target_len) {
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, DNS_TYPE_SRV, w->rclass, ttl, &at);
+    if (err == DNSASM_OK) {
+        err = put16(w, priority);
+    }
+    if (err == DNSASM_OK) {
+        err = put16(w, weight);
+    }
+    if (err == DNSASM_OK) {
+        err = put16(w, port);
+    }
+    if (err == DNSASM_OK) {
+        err = write_name(w, target, target_len, 0);
+    }
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_soa(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, const dnsasm_rdata_soa_t *soa) {
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, DNS_TYPE_SOA, w->rclass, ttl, &at);
+    if (err == DNSASM_OK) {
+        err = write_name(w, soa->mname, soa->mname_len, 1);
+    }
+    if (err == DNSASM_OK) {
+        err = write_name(w, soa->rname, soa->rname_len, 1);
+    }
+    if (err == DNSASM_OK && w->len + 20 > w->limit) {
+        err = DNSASM_ERR_SPACE;
+    }
+    if (err == DNSASM_OK) {
+        uint8_t *p = w->buf + w->len;
+        store32(p, soa->serial);
+        store32(p + 4, soa->refresh);
+        store32(p + 8, soa->retry);
+        store32(p + 12, soa->expire);
+        store32(p + 16, soa->minimum);
+        w->len += 20;
+    }
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_txt(dnsasm_writer_t *w, const uint8_t *name, size_t name_len,
+                       uint32_t ttl, const uint8_t *text, size_t text_len) {
+    size_t mark = w->len, at;
+    int err = rr_begin(w, name, name_len, DNS_TYPE_TXT, w->rclass, ttl, &at);
+
+    /* An empty TXT is one empty character-string */
+    size_t done = 0;
+    do {
+        size_t n = text_len - done > 255 ? 255 : text_len - done;
+        uint8_t n8 = (uint8_t)n;
+        if (err == DNSASM_OK) {
+            err = put(w, &n8, 1);
+        }
+        if (err == DNSASM_OK && n > 0) {
+            err = put(w, text + done, n);
+        }
+        done += n;
+    } while (err == DNSASM_OK && done < text_len);
+
+    return rr_end(w, mark, at, err);
+}
+
+int dnsasm_writer_opt(dnsasm_writer_t *w, uint16_t udp_size,
+                       uint8_t ext_rcode, uint8_t version, uint16_t flags,
+                       const uint8_t *options, uint16_t options_len) {
+    static const uint8_t root = 0;
+
+    if (w->section < DNSASM_SECTION_ADDITIONAL) {
+        w->section = DNSASM_SECTION_ADDITIONAL;
+    }
+    uint32_t ttl = ((uint32_t)ext_rcode << 24) | ((uint32_t)version << 16) | flags;
+    return dnsasm_writer_rr(w, &root, 1, DNS_TYPE_OPT, udp_size, ttl,
+                            options, options_len);
+}
+
+size_t dnsasm_writer_finish(dnsasm_writer_t *w) {
+    if (w->len >= DNS_HEADER_SIZE) {
+        for (int s = 0; s < DNSASM_SECTION_COUNT; s++) {
+            store16(w->buf + 4 + 2 * s, w->count[s]);
+        }
+    }
+    return w->len;
+}
@@ -177,3 +177,8 @@ dnsasm_build_header:
 
     mov     eax, 12                 ; Return 12 bytes written
     ret
+
+%ifdef LINUX
+    ; Non-executable stack
+    section .note.GNU-stack noalloc noexec nowrite progbits
+%endif
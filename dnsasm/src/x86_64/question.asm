@@ -8,6 +8,8 @@ default rel
 
 section .data
     align 16
+    ; AVX2 availability for copy_run: 0 = not probed, 1 = no, 2 = yes
+    avx2_state: db 0
 
 section .rodata
     align 16
@@ -18,12 +20,12 @@ section .bss
     align 16
 
 section .text
-    global dnsasm_parse_question
-    global dnsasm_decompress_name
+    global dnsasm_parse_question_asm
+    global dnsasm_decompress_name_asm
 
 ; ============================================================================
-; dnsasm_result_t dnsasm_parse_question(const uint8_t *packet, size_t len,
-;                                        size_t offset, dnsasm_question_t *out)
+; dnsasm_result_t dnsasm_parse_question_asm(const uint8_t *packet, size_t len,
+;                                            size_t offset, dnsasm_question_t *out)
 ;
 ; Arguments:
 ;   rdi = packet pointer
@@ -36,7 +38,7 @@ section .text
 ;
 ; Performance: ~50 cycles for typical names (e.g., "www.example.com")
 ; ============================================================================
-dnsasm_parse_question:
+dnsasm_parse_question_asm:
     push    rbx
     push    r12
     push    r13
@@ -126,6 +128,11 @@ dnsasm_parse_question:
 ; Returns:
 ;   eax = decompressed name length (negative on error)
 ;   edx = wire bytes consumed (for first name only, not following pointers)
+;
+; Uncompressed stretches of a name are already in output format (length
+; byte followed by label bytes), so the labels are only walked to find
+; where a stretch ends and validate it. The stretch is then copied in one
+; go by .copy_run with 16/32-byte vector loads and stores.
 ; ============================================================================
 .decompress_name_internal:
     push    rbx
@@ -144,6 +151,9 @@ dnsasm_parse_question:
     xor     r14d, r14d              ; pointer_count = 0 (loop detection)
     mov     r15d, 1                 ; counting_wire = 1 (stop after first pointer)
     
+.run_start:
+    mov     rbx, r11                ; start of the current uncompressed run
+
 .label_loop:
     ; Check offset bounds
     cmp     r11, r10
@@ -152,59 +162,39 @@ dnsasm_parse_question:
     ; Read label length byte
     movzx   eax, byte [r9 + r11]
     
-    ; Check for compression pointer (top 2 bits = 11)
-    mov     ecx, eax
-    and     ecx, 0xC0
-    cmp     ecx, 0xC0
-    je      .compression_pointer
+    ; Top two bits select pointer (11), reserved (01/10) or label (00)
+    test    al, 0xC0
+    jnz     .label_type
     
     ; Check for end of name (length = 0)
     test    eax, eax
     jz      .end_of_name
     
-    ; Regular label
-    ; Check label length is valid (1-63)
-    cmp     eax, 63
-    ja      .bad_name
+    ; Regular label, 1-63 by the mask test above.
+    ; Advance past it and check we have enough packet data
+    lea     r11, [r11 + rax + 1]
+    cmp     r11, r10
+    ja      .name_too_short
     
     ; Check we won't overflow output buffer
-    mov     ecx, r12d
-    add     ecx, eax
-    add     ecx, 1                  ; out_len + label_len + 1 (for length byte)
-    cmp     ecx, 255
+    ; (out_len + run length so far, which includes this label)
+    mov     rcx, r11
+    sub     rcx, rbx
+    add     rcx, r12
+    cmp     rcx, 255
     ja      .name_overflow
     
-    ; Check we have enough packet data
-    lea     rcx, [r11 + rax + 1]
-    cmp     rcx, r10
-    ja      .name_too_short
-    
-    ; Copy label length byte
-    mov     byte [r8 + r12], al
-    inc     r12d
-    
-    ; Update wire length if still counting
-    test    r15d, r15d
-    jz      .skip_wire_count
-    add     r13d, eax
-    inc     r13d                    ; +1 for length byte
-.skip_wire_count:
-    
-    ; Copy label bytes
-    inc     r11                     ; skip length byte
-    mov     ecx, eax                ; label length
-    
-.copy_label:
-    movzx   eax, byte [r9 + r11]
-    mov     byte [r8 + r12], al
-    inc     r11
-    inc     r12d
-    dec     ecx
-    jnz     .copy_label
-    
     jmp     .label_loop
 
-.compression_pointer:
+.label_type:
+    mov     ecx, eax
+    and     ecx, 0xC0
+    cmp     ecx, 0xC0
+    jne     .bad_name               ; 0x40 / 0x80 label types
+    
+    ; Flush the run that ends at this pointer
+    call    .flush_run
+
     ; Compression pointer detected
     ; Format: 11xxxxxx xxxxxxxx (14-bit offset)
     
@@ -236,9 +226,11 @@ dnsasm_parse_question:
     
     ; Follow the pointer
     mov     r11d, eax
-    jmp     .label_loop
+    jmp     .run_start
 
 .end_of_name:
+    call    .flush_run
+
     ; Add null terminator
     mov     byte [r8 + r12], 0
     inc     r12d
@@ -286,10 +278,152 @@ dnsasm_parse_question:
     ret
 
 
+; ----------------------------------------------------------------------------
+; Internal: flush_run
+;
+; Copies the validated run [rbx, r11) of the packet to out + out_len and
+; advances out_len (and wire_len while still counting).
+;
+; Clobbers: rax, rcx, rdx, rsi, rdi, xmm0-xmm1 (ymm0-ymm1 on AVX2 hosts)
+; ----------------------------------------------------------------------------
+.flush_run:
+    mov     rcx, r11
+    sub     rcx, rbx                ; run length (0..255)
+    jz      .flush_done
+    
+    lea     rsi, [r9 + rbx]         ; src = packet + run start
+    lea     rdi, [r8 + r12]         ; dst = out + out_len
+    add     r12, rcx                ; out_len += run length
+    test    r15d, r15d
+    jz      .copy_run
+    add     r13d, ecx               ; wire_len += run length
+    
+    ; Fall through into copy_run (tail call)
+
+; ----------------------------------------------------------------------------
+; Internal: copy_run
+;
+; Copies rcx bytes (1..255) from rsi to rdi. Every load and store stays
+; inside [src, src + n) and [dst, dst + n): tails are handled by an
+; overlapping final vector instead of a byte loop, so nothing past the
+; end of the packet is read and nothing past the name is written.
+; ----------------------------------------------------------------------------
+.copy_run:
+    cmp     rcx, 16
+    jb      .copy_lt16
+    cmp     rcx, 32
+    ja      .copy_gt32
+    
+    ; 16..32 bytes: two overlapping 16-byte moves
+    movdqu  xmm0, [rsi]
+    movdqu  xmm1, [rsi + rcx - 16]
+    movdqu  [rdi], xmm0
+    movdqu  [rdi + rcx - 16], xmm1
+    ret
+
+.copy_gt32:
+    ; Long CDN/tracking names: use 32-byte moves when AVX2 is usable
+    movzx   eax, byte [avx2_state]
+    test    eax, eax
+    jz      .detect_avx2
+.copy_gt32_dispatch:
+    cmp     eax, 2
+    je      .copy_avx2
+
+    ; SSE2: 16-byte chunks, then an overlapping 16-byte tail
+    lea     rdx, [rsi + rcx - 16]   ; last chunk source
+.copy_sse2_loop:
+    movdqu  xmm0, [rsi]
+    movdqu  [rdi], xmm0
+    add     rsi, 16
+    add     rdi, 16
+    sub     rcx, 16
+    cmp     rcx, 16
+    ja      .copy_sse2_loop
+    movdqu  xmm1, [rdx]
+    movdqu  [rdi + rcx - 16], xmm1
+    ret
+
+.copy_avx2:
+    ; AVX2: 32-byte chunks, then an overlapping 32-byte tail
+    lea     rdx, [rsi + rcx - 32]   ; last chunk source
+.copy_avx2_loop:
+    vmovdqu ymm0, [rsi]
+    vmovdqu [rdi], ymm0
+    add     rsi, 32
+    add     rdi, 32
+    sub     rcx, 32
+    cmp     rcx, 32
+    ja      .copy_avx2_loop
+    vmovdqu ymm1, [rdx]
+    vmovdqu [rdi + rcx - 32], ymm1
+    vzeroupper
+    ret
+
+.copy_lt16:
+    cmp     rcx, 8
+    jb      .copy_lt8
+    ; 8..15 bytes
+    mov     rax, [rsi]
+    mov     rdx, [rsi + rcx - 8]
+    mov     [rdi], rax
+    mov     [rdi + rcx - 8], rdx
+    ret
+
+.copy_lt8:
+    cmp     rcx, 4
+    jb      .copy_lt4
+    ; 4..7 bytes
+    mov     eax, [rsi]
+    mov     edx, [rsi + rcx - 4]
+    mov     [rdi], eax
+    mov     [rdi + rcx - 4], edx
+    ret
+
+.copy_lt4:
+    ; 1..3 bytes (a run is never empty here)
+    movzx   eax, byte [rsi]
+    movzx   edx, byte [rsi + rcx - 1]
+    mov     [rdi], al
+    mov     [rdi + rcx - 1], dl
+    cmp     rcx, 3
+    jne     .flush_done
+    movzx   eax, byte [rsi + 1]
+    mov     [rdi + 1], al
+.flush_done:
+    ret
+
+.detect_avx2:
+    ; One-time check: CPUID.7.0:EBX.AVX2 plus OS-enabled YMM state
+    push    rbx
+    push    rcx
+    mov     byte [avx2_state], 1    ; assume no AVX2
+    xor     ecx, ecx
+    mov     eax, 1
+    cpuid
+    bt      ecx, 27                 ; OSXSAVE
+    jnc     .detect_done
+    xor     ecx, ecx
+    xgetbv
+    and     eax, 6                  ; XMM | YMM state enabled
+    cmp     eax, 6
+    jne     .detect_done
+    mov     eax, 7
+    xor     ecx, ecx
+    cpuid
+    bt      ebx, 5                  ; AVX2
+    jnc     .detect_done
+    mov     byte [avx2_state], 2
+.detect_done:
+    pop     rcx
+    pop     rbx
+    movzx   eax, byte [avx2_state]
+    jmp     .copy_gt32_dispatch
+
 ; ============================================================================
-; dnsasm_result_t dnsasm_decompress_name(const uint8_t *packet, size_t len,
-;                                         size_t offset, uint8_t *out,
-;                                         uint16_t *out_len)
+; dnsasm_result_t dnsasm_decompress_name_asm(const uint8_t *packet, size_t len,
+;                                             size_t offset, uint8_t *out,
+;                                             uint16_t *out_len)
 ;
 ; Public wrapper for name decompression.
 ;
@@ -303,7 +437,7 @@ dnsasm_parse_question:
 ; Returns:
 ;   rax = result (error in low 32, wire_len in high 32)
 ; ============================================================================
-dnsasm_decompress_name:
+dnsasm_decompress_name_asm:
     push    rbx
     push    r12
     
@@ -318,7 +452,7 @@ dnsasm_decompress_name:
     
     ; Call internal
     push    r12
-    call    dnsasm_parse_question.decompress_name_internal
+    call    dnsasm_parse_question_asm.decompress_name_internal
     pop     r12
     
     ; Store out_len if successful
@@ -342,3 +476,8 @@ dnsasm_decompress_name:
     pop     r12
     pop     rbx
     ret
+
+%ifdef LINUX
+    ; Non-executable stack
+    section .note.GNU-stack noalloc noexec nowrite progbits
+%endif
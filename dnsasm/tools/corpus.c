@@ -0,0 +1,435 @@
+/*
+ * DNSASM Tools - Packet Corpus Loader
+ *
+ * Frames are decoded just far enough to find the DNS message: link
+ * header, IPv4 or IPv6 (extension headers skipped, fragments dropped),
+ * then UDP, or TCP with its two-byte length prefix. A TCP segment may
+ * carry several messages; a message split across segments is dropped,
+ * since reassembly would make the loader a stream tracker.
+ */
+
+#include "corpus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PCAP_MAGIC_US       0xa1b2c3d4u
+#define PCAP_MAGIC_NS       0xa1b23c4du
+#define PCAPNG_MAGIC        0x0a0d0d0au
+
+/* Link types (tcpdump.org/linktypes.html) */
+#define LINK_NULL           0
+#define LINK_ETHERNET       1
+#define LINK_RAW            101
+#define LINK_LOOP           108
+#define LINK_LINUX_SLL      113
+#define LINK_IPV4           228
+#define LINK_IPV6           229
+#define LINK_LINUX_SLL2     276
+
+#define ETHERTYPE_IPV4      0x0800
+#define ETHERTYPE_IPV6      0x86dd
+#define ETHERTYPE_VLAN      0x8100
+#define ETHERTYPE_QINQ      0x88a8
+
+#define IPPROTO_TCP_        6
+#define IPPROTO_UDP_        17
+
+static uint16_t be16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t swap32(uint32_t x) {
+    return __builtin_bswap32(x);
+}
+
+void corpus_init(corpus_t *c, uint16_t port) {
+    memset(c, 0, sizeof(*c));
+    c->port = port;
+}
+
+int corpus_add(corpus_t *c, const uint8_t *data, size_t len, uint8_t source) {
+    if (len > UINT32_MAX) {
+        return -1;
+    }
+    if (c->count == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 1024;
+        corpus_packet_t *p = realloc(c->packets, cap * sizeof(*p));
+        if (p == NULL) {
+            return -1;
+        }
+        c->packets = p;
+        c->cap = cap;
+    }
+    corpus_packet_t *p = &c->packets[c->count++];
+    memset(p, 0, sizeof(*p));
+    p->data = data;
+    p->len = (uint32_t)len;
+    p->source = source;
+    return 0;
+}
+
+static int add_region(corpus_t *c, void *base, size_t len, int mapped) {
+    corpus_region_t *r = realloc(c->regions, (c->region_count + 1) * sizeof(*r));
+    if (r == NULL) {
+        return -1;
+    }
+    c->regions = r;
+    r[c->region_count++] = (corpus_region_t){base, len, mapped};
+    return 0;
+}
+
+int corpus_adopt(corpus_t *c, void *buf, size_t len) {
+    return add_region(c, buf, len, 0);
+}
+
+void corpus_free(corpus_t *c) {
+    for (size_t i = 0; i < c->region_count; i++) {
+        if (c->regions[i].mapped) {
+            munmap(c->regions[i].base, c->regions[i].len);
+        } else {
+            free(c->regions[i].base);
+        }
+    }
+    free(c->regions);
+    free(c->packets);
+    memset(c, 0, sizeof(*c));
+}
+
+/* ============================================================================
+ * Captures
+ * ============================================================================ */
+
+static int port_match(const corpus_t *c, const uint8_t *l4) {
+    return c->port == 0 || be16(l4) == c->port || be16(l4 + 2) == c->port;
+}
+
+static int take_udp(corpus_t *c, const uint8_t *p, size_t len) {
+    if (len < 8 || !port_match(c, p)) {
+        c->skipped_other++;
+        return 0;
+    }
+    size_t ulen = be16(p + 4);
+    if (ulen < 8 || ulen > len) {
+        ulen = len;                 /* Checksum offload leaves zeroes here */
+    }
+    return corpus_add(c, p + 8, ulen - 8, CORPUS_UDP);
+}
+
+static int take_tcp(corpus_t *c, const uint8_t *p, size_t len) {
+    if (len < 20 || !port_match(c, p) || (size_t)(p[12] >> 4) * 4 > len) {
+        c->skipped_other++;
+        return 0;
+    }
+    size_t off = (size_t)(p[12] >> 4) * 4;
+    if (off == len) {
+        return 0;                   /* Handshake or bare ACK */
+    }
+    while (off + 2 <= len) {
+        size_t n = be16(p + off);
+        if (n == 0 || off + 2 + n > len) {
+            break;
+        }
+        if (corpus_add(c, p + off + 2, n, CORPUS_TCP) != 0) {
+            return -1;
+        }
+        off += 2 + n;
+    }
+    if (off != len) {
+        c->skipped_other++;
+    }
+    return 0;
+}
+
+static int take_l4(corpus_t *c, int proto, const uint8_t *p, size_t len) {
+    switch (proto) {
+    case IPPROTO_UDP_:
+        return take_udp(c, p, len);
+    case IPPROTO_TCP_:
+        return take_tcp(c, p, len);
+    default:
+        c->skipped_other++;
+        return 0;
+    }
+}
+
+static int take_ipv4(corpus_t *c, const uint8_t *p, size_t len) {
+    if (len < 20 || (p[0] >> 4) != 4 || (size_t)(p[0] & 0x0f) * 4 < 20) {
+        c->skipped_other++;
+        return 0;
+    }
+    size_t hlen = (size_t)(p[0] & 0x0f) * 4;
+    size_t total = be16(p + 2);
+    if (total < hlen || total > len) {
+        total = len;                /* TSO captures report 0 */
+    }
+    if (hlen > total) {
+        c->skipped_other++;
+        return 0;
+    }
+    if ((be16(p + 6) & 0x3fff) != 0) {
+        c->skipped_fragment++;      /* MF set or non-zero offset */
+        return 0;
+    }
+    return take_l4(c, p[9], p + hlen, total - hlen);
+}
+
+static int take_ipv6(corpus_t *c, const uint8_t *p, size_t len) {
+    if (len < 40 || (p[0] >> 4) != 6) {
+        c->skipped_other++;
+        return 0;
+    }
+    size_t total = 40 + (size_t)be16(p + 4);
+    if (total > len) {
+        total = len;
+    }
+    int next = p[6];
+    size_t off = 40;
+    for (;;) {
+        switch (next) {
+        case 0:                     /* Hop-by-hop */
+        case 43:                    /* Routing */
+        case 60:                    /* Destination options */
+            if (off + 8 > total) {
+                c->skipped_other++;
+                return 0;
+            }
+            next = p[off];
+            off += ((size_t)p[off + 1] + 1) * 8;
+            continue;
+        case 44:                    /* Fragment */
+            c->skipped_fragment++;
+            return 0;
+        }
+        break;
+    }
+    if (off > total) {
+        c->skipped_other++;
+        return 0;
+    }
+    return take_l4(c, next, p + off, total - off);
+}
+
+static int take_ip(corpus_t *c, const uint8_t *p, size_t len) {
+    if (len > 0 && (p[0] >> 4) == 6) {
+        return take_ipv6(c, p, len);
+    }
+    return take_ipv4(c, p, len);
+}
+
+static int take_ethertype(corpus_t *c, uint16_t type, const uint8_t *p, size_t len) {
+    switch (type) {
+    case ETHERTYPE_IPV4:
+        return take_ipv4(c, p, len);
+    case ETHERTYPE_IPV6:
+        return take_ipv6(c, p, len);
+    default:
+        c->skipped_other++;
+        return 0;
+    }
+}
+
+static int take_frame(corpus_t *c, uint32_t link, const uint8_t *p, size_t len) {
+    c->frames++;
+    switch (link) {
+    case LINK_ETHERNET: {
+        size_t off = 12;
+        while (off + 2 <= len &&
+               (be16(p + off) == ETHERTYPE_VLAN || be16(p + off) == ETHERTYPE_QINQ)) {
+            off += 4;
+        }
+        if (off + 2 > len) {
+            break;
+        }
+        return take_ethertype(c, be16(p + off), p + off + 2, len - off - 2);
+    }
+    case LINK_LINUX_SLL:
+        if (len < 16) {
+            break;
+        }
+        return take_ethertype(c, be16(p + 14), p + 16, len - 16);
+    case LINK_LINUX_SLL2:
+        if (len < 20) {
+            break;
+        }
+        return take_ethertype(c, be16(p), p + 20, len - 20);
+    case LINK_NULL:
+    case LINK_LOOP:
+        /* Address family in host (NULL) or network (LOOP) order; the
+           IP version nibble settles it either way */
+        if (len < 4) {
+            break;
+        }
+        return take_ip(c, p + 4, len - 4);
+    case LINK_RAW:
+        return take_ip(c, p, len);
+    case LINK_IPV4:
+        return take_ipv4(c, p, len);
+    case LINK_IPV6:
+        return take_ipv6(c, p, len);
+    }
+    c->skipped_other++;
+    return 0;
+}
+
+static int load_pcap(corpus_t *c, const uint8_t *buf, size_t len, char *err, size_t err_len) {
+    uint32_t magic = le32(buf);
+    int swap = magic == swap32(PCAP_MAGIC_US) || magic == swap32(PCAP_MAGIC_NS);
+    uint32_t link = le32(buf + 20);
+    if (swap) {
+        link = swap32(link);
+    }
+    link &= 0x0fffffff;             /* Upper bits carry FCS flags */
+
+    size_t off = 24;
+    while (off < len) {
+        /* A capture still being written, or whose writer was killed,
+           ends inside a record: keep every complete one before it */
+        if (len - off < 16) {
+            c->truncated++;
+            break;
+        }
+        uint32_t incl = le32(buf + off + 8);
+        if (swap) {
+            incl = swap32(incl);
+        }
+        if (incl > len - off - 16) {
+            c->truncated++;
+            break;
+        }
+        off += 16;
+        if (take_frame(c, link, buf + off, incl) != 0) {
+            snprintf(err, err_len, "out of memory");
+            return -1;
+        }
+        off += incl;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Hex files
+ * ============================================================================ */
+
+static int hex_digit(int ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+/*
+ * One message per line; spaces, tabs and colons between digits are
+ * ignored, '#' starts a comment running to the end of the line, and
+ * blank lines are skipped.
+ * Messages are decoded in place over the file's own bytes.
+ */
+static int load_hex(corpus_t *c, uint8_t *buf, size_t len, char *err, size_t err_len) {
+    size_t in = 0, line = 1;
+    while (in < len) {
+        size_t start = in, out = in;
+        int hi = -1;
+        while (in < len && buf[in] != '\n') {
+            int ch = buf[in++];
+            if (ch == '#' && hi < 0) {
+                while (in < len && buf[in] != '\n') {
+                    in++;
+                }
+                break;
+            }
+            if (ch == ' ' || ch == '\t' || ch == ':' || ch == '\r') {
+                continue;
+            }
+            int d = hex_digit(ch);
+            if (d < 0) {
+                snprintf(err, err_len, "line %zu: bad hex digit '%c'", line, ch);
+                return -1;
+            }
+            if (hi < 0) {
+                hi = d;
+            } else {
+                buf[out++] = (uint8_t)(hi << 4 | d);
+                hi = -1;
+            }
+        }
+        if (hi >= 0) {
+            snprintf(err, err_len, "line %zu: odd number of hex digits", line);
+            return -1;
+        }
+        if (out > start && corpus_add(c, buf + start, out - start, CORPUS_HEX) != 0) {
+            snprintf(err, err_len, "out of memory");
+            return -1;
+        }
+        in++;                       /* Newline */
+        line++;
+    }
+    return 0;
+}
+
+int corpus_load(corpus_t *c, const char *path, char *err, size_t err_len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(err, err_len, "%s", strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        snprintf(err, err_len, "%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    if (len == 0) {
+        close(fd);
+        return 0;
+    }
+
+    /* Captures stay read-only and shared; hex is decoded in a private copy */
+    uint8_t head[4] = {0};
+    if (pread(fd, head, sizeof(head), 0) != (ssize_t)sizeof(head) && len >= sizeof(head)) {
+        snprintf(err, err_len, "%s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    uint32_t magic = le32(head);
+    int pcap = magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+               magic == swap32(PCAP_MAGIC_US) || magic == swap32(PCAP_MAGIC_NS);
+    if (magic == PCAPNG_MAGIC) {
+        snprintf(err, err_len, "pcapng is not supported; convert with editcap -F pcap");
+        close(fd);
+        return -1;
+    }
+    if (pcap && len < 24) {
+        snprintf(err, err_len, "truncated pcap header");
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, len, pcap ? PROT_READ : PROT_READ | PROT_WRITE,
+                     pcap ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        snprintf(err, err_len, "mmap: %s", strerror(errno));
+        return -1;
+    }
+    if (add_region(c, map, len, 1) != 0) {
+        munmap(map, len);
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    if (pcap) {
+        madvise(map, len, MADV_SEQUENTIAL);
+        return load_pcap(c, map, len, err, err_len);
+    }
+    return load_hex(c, map, len, err, err_len);
+}
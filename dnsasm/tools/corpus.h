@@ -0,0 +1,87 @@
+/*
+ * DNSASM Tools - Packet Corpus Loader
+ *
+ * Shared by dnsasm-bench and dnsasm-console. Loads DNS messages from
+ * classic pcap captures (Ethernet, Linux cooked, raw IP and loopback
+ * link types) or from hex text files, one message per line. Captures
+ * are mapped, not read: a message points straight into its frame, so
+ * multi-gigabyte files cost address space, not memory.
+ */
+
+#ifndef DNSASM_CORPUS_H
+#define DNSASM_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where a message came from */
+#define CORPUS_UDP      1
+#define CORPUS_TCP      2
+#define CORPUS_HEX      3
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t len;
+    uint8_t  source;            /* CORPUS_* */
+    uint8_t  _pad[3];
+} corpus_packet_t;
+
+typedef struct {
+    void    *base;
+    size_t   len;
+    int      mapped;            /* munmap rather than free */
+} corpus_region_t;
+
+typedef struct {
+    corpus_packet_t *packets;
+    size_t count;
+    size_t cap;
+
+    corpus_region_t *regions;   /* Backing memory, one per file */
+    size_t region_count;
+
+    uint16_t port;              /* Capture filter: 0 takes any port */
+
+    /* Capture frames not turned into messages */
+    size_t frames;
+    size_t skipped_fragment;    /* IP fragments */
+    size_t skipped_other;       /* Non-DNS port, non-UDP/TCP, short or
+                                   partial TCP messages */
+    size_t truncated;           /* Captures cut off inside a record, e.g.
+                                   by a killed tcpdump; the part record
+                                   is dropped */
+} corpus_t;
+
+/*
+ * Start an empty corpus taking messages to or from port (53 for DNS).
+ */
+void corpus_init(corpus_t *c, uint16_t port);
+
+/*
+ * Append the messages of a capture or hex file.
+ *
+ * @param c         Corpus
+ * @param path      pcap file (any byte order, usec or nsec) or hex text
+ * @param err       Output: reason on failure
+ * @param err_len   Capacity of err
+ * @return          0 on success, -1 on failure
+ */
+int corpus_load(corpus_t *c, const char *path, char *err, size_t err_len);
+
+/*
+ * Append one message the caller keeps alive.
+ */
+int corpus_add(corpus_t *c, const uint8_t *data, size_t len, uint8_t source);
+
+/*
+ * Hand a malloc'd buffer to the corpus, to be freed with it. For
+ * messages built in memory rather than loaded.
+ */
+int corpus_adopt(corpus_t *c, void *buf, size_t len);
+
+/*
+ * Release the messages and every mapping or buffer behind them.
+ */
+void corpus_free(corpus_t *c);
+
+#endif /* DNSASM_CORPUS_H */
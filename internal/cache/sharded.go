@@ -75,6 +75,21 @@ func (e *Entry) IsStale(maxStale time.Duration) bool {
 	return time.Since(e.ExpiresAt) < maxStale
 }
 
+// Age returns the whole seconds the stored response has aged, i.e. how
+// far its TTLs should be lowered when served (dnsasm.AgeTTLs).
+func (e *Entry) Age() uint32 {
+	left := time.Until(e.ExpiresAt)
+	if left <= 0 {
+		return e.OrigTTL
+	}
+	// Round the remaining time up so a fresh entry has aged 0 seconds
+	remaining := uint32((left + time.Second - 1) / time.Second)
+	if remaining >= e.OrigTTL {
+		return 0
+	}
+	return e.OrigTTL - remaining
+}
+
 // shard represents a single cache shard with its own lock
 type shard struct {
 	mu      sync.RWMutex
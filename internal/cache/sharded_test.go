@@ -80,3 +80,20 @@ func TestValidationModes(t *testing.T) {
 		}
 	})
 }
+
+func TestEntryAge(t *testing.T) {
+	e := &Entry{OrigTTL: 300, ExpiresAt: time.Now().Add(300 * time.Second)}
+	if age := e.Age(); age != 0 {
+		t.Errorf("fresh entry Age() = %d, want 0", age)
+	}
+
+	e.ExpiresAt = time.Now().Add(199500 * time.Millisecond)
+	if age := e.Age(); age != 100 {
+		t.Errorf("Age() = %d, want 100", age)
+	}
+
+	e.ExpiresAt = time.Now().Add(-time.Second)
+	if age := e.Age(); age != 300 {
+		t.Errorf("expired entry Age() = %d, want 300", age)
+	}
+}
@@ -4,10 +4,13 @@ import (
 	"crypto/rand"
 	"encoding/binary"
 	"errors"
+	"net/netip"
 	"sync"
+	"sync/atomic"
 	"time"
 
 	"github.com/dchest/siphash"
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 )
 
 // RFC 7873: Domain Name System (DNS) Cookies
@@ -17,8 +20,10 @@ import (
 // off-path attacks by allowing clients and servers to verify their
 // communication partner's identity.
 //
-// Implementation follows BIND 9's SipHash 2-4 based approach:
-// https://kb.isc.org/docs/aa-01387
+// Server cookies are the RFC 9018 interoperable format (version,
+// timestamp and SipHash-2-4), computed by libdnsasm straight from the
+// COOKIE option bytes, so a check costs no allocation and hashes under
+// both secrets in one pass.
 
 var (
 	ErrInvalidCookie       = errors.New("invalid cookie format")
@@ -31,35 +36,31 @@ var (
 const (
 	// Cookie sizes per RFC 7873
 	clientCookieSize = 8  // 64 bits
-	serverCookieSize = 8  // 64 bits (can be 8-32 bytes, we use minimum)
-	cookieTotalSize  = 16 // client + server
+	serverCookieSize = 16 // RFC 9018: version, reserved, timestamp, hash
+	cookieTotalSize  = 24 // client + server
 
 	// Version field
 	cookieVersion = 1
 
-	// Server cookie validity period (per BIND 9 default)
-	serverCookieValidFor = 1 * time.Hour
-
 	// Secret rotation interval
 	secretRotationInterval = 24 * time.Hour
 )
 
 // Manager handles DNS cookie generation and validation
 type Manager struct {
-	mu sync.RWMutex
+	mu sync.Mutex // Serializes rotation
 
-	// Current and previous secrets for rotation
-	currentSecret  [16]byte
-	previousSecret [16]byte
-	secretTime     time.Time
+	// Current and previous secrets, swapped whole on rotation so
+	// checks never take a lock
+	secrets    atomic.Pointer[dnsasm.CookieSecrets]
+	secretTime time.Time
 
 	// Configuration
 	enabled      bool
 	requireValid bool // Require valid cookie for responses
 
-	// Secret for cookie-secret sharing across cluster
-	clusterSecret [16]byte
-	useCluster    bool
+	// Secret shared across a cluster; never rotated
+	useCluster bool
 }
 
 // Config holds cookie manager configuration
@@ -84,9 +85,8 @@ func NewManager(cfg Config) (*Manager, error) {
 
 	if cfg.ClusterSecret != nil && len(cfg.ClusterSecret) >= 16 {
 		// Use provided cluster secret
-		copy(m.clusterSecret[:], cfg.ClusterSecret)
 		m.useCluster = true
-		m.currentSecret = m.clusterSecret
+		m.secrets.Store(&dnsasm.CookieSecrets{Current: secretKey(cfg.ClusterSecret)})
 	} else {
 		// Generate random secret
 		if err := m.rotateSecret(); err != nil {
@@ -107,19 +107,39 @@ func (m *Manager) rotateSecret() error {
 		return nil
 	}
 
-	// Move current to previous
-	m.previousSecret = m.currentSecret
-
-	// Generate new current
-	_, err := rand.Read(m.currentSecret[:])
-	if err != nil {
+	var secret [16]byte
+	if _, err := rand.Read(secret[:]); err != nil {
 		return err
 	}
 
+	// Move current to previous
+	next := &dnsasm.CookieSecrets{Current: secretKey(secret[:])}
+	if old := m.secrets.Load(); old != nil {
+		next.Previous, next.HasPrevious = old.Current, true
+	}
+	m.secrets.Store(next)
+
 	m.secretTime = time.Now()
 	return nil
 }
 
+// secretKey reads a 16-byte secret as RFC 9018 keys SipHash with it
+func secretKey(b []byte) dnsasm.HashKey {
+	return dnsasm.HashKey{K0: binary.LittleEndian.Uint64(b), K1: binary.LittleEndian.Uint64(b[8:])}
+}
+
+// Check checks the COOKIE option data of a request, exactly as it came
+// off the wire, from the client at ip. It returns the outcome and the
+// server cookie to answer with: the request's own when it is valid, a
+// fresh one otherwise. It does not allocate or lock.
+func (m *Manager) Check(option, ip []byte) (dnsasm.CookieStatus, [16]byte) {
+	addr, ok := netip.AddrFromSlice(ip)
+	if !ok {
+		return dnsasm.CookieBad, [16]byte{}
+	}
+	return dnsasm.CheckCookie(m.secrets.Load(), option, addr, uint32(time.Now().Unix()))
+}
+
 // RotateSecretPeriodically runs secret rotation in background
 func (m *Manager) RotateSecretPeriodically(stop <-chan struct{}) {
 	ticker := time.NewTicker(secretRotationInterval)
@@ -158,80 +178,39 @@ func GenerateClientCookie(clientIP, serverIP []byte) [8]byte {
 	return cookie
 }
 
-// GenerateServerCookie generates an 8-byte server cookie
-// Server cookie = SipHash-2-4(secret, client-cookie || client-IP || timestamp)
-// This follows RFC 9018 and BIND 9's implementation
-func (m *Manager) GenerateServerCookie(clientCookie [8]byte, clientIP []byte) ([8]byte, error) {
-	m.mu.RLock()
-	secret := m.currentSecret
-	m.mu.RUnlock()
-
-	var serverCookie [8]byte
-
-	// Construct input: client-cookie || client-IP || version || timestamp
-	timestamp := uint32(time.Now().Unix())
-
-	h := siphash.New(secret[:])
-	h.Write(clientCookie[:])
-	h.Write(clientIP)
-	h.Write([]byte{cookieVersion, 0, 0, 0}) // version + reserved
-	binary.Write(h, binary.BigEndian, timestamp)
-
-	binary.LittleEndian.PutUint64(serverCookie[:], h.Sum64())
-	return serverCookie, nil
+// GenerateServerCookie generates a 16-byte server cookie
+// Server cookie = version || reserved || timestamp ||
+// SipHash-2-4(secret, client-cookie || version || reserved || timestamp || client-IP)
+// This follows RFC 9018, so servers of other implementations sharing
+// the secret accept it
+func (m *Manager) GenerateServerCookie(clientCookie [8]byte, clientIP []byte) ([16]byte, error) {
+	addr, ok := netip.AddrFromSlice(clientIP)
+	if !ok {
+		return [16]byte{}, ErrInvalidCookie
+	}
+	return dnsasm.MakeServerCookie(m.secrets.Load().Current, clientCookie, addr, uint32(time.Now().Unix())), nil
 }
 
 // ValidateServerCookie validates a server cookie
-// Returns true if cookie is valid and fresh
-func (m *Manager) ValidateServerCookie(clientCookie [8]byte, serverCookie [8]byte, clientIP []byte) error {
+// Returns nil if the cookie is ours (current or previous secret) and
+// its timestamp is within the last hour
+func (m *Manager) ValidateServerCookie(clientCookie [8]byte, serverCookie [16]byte, clientIP []byte) error {
 	if !m.enabled {
 		return nil // Cookies disabled
 	}
 
-	// Try with current secret
-	expected, err := m.computeServerCookie(m.currentSecret, clientCookie, clientIP, time.Now())
-	if err != nil {
-		return err
-	}
-
-	if subtle_compare(serverCookie[:], expected[:]) {
-		return nil // Valid with current secret
-	}
-
-	// Try with previous secret (for rotation period)
-	m.mu.RLock()
-	prevSecret := m.previousSecret
-	m.mu.RUnlock()
-
-	expected, err = m.computeServerCookie(prevSecret, clientCookie, clientIP, time.Now())
-	if err != nil {
-		return err
-	}
+	var option [cookieTotalSize]byte
+	copy(option[:clientCookieSize], clientCookie[:])
+	copy(option[clientCookieSize:], serverCookie[:])
 
-	if subtle_compare(serverCookie[:], expected[:]) {
-		return nil // Valid with previous secret
+	switch status, _ := m.Check(option[:], clientIP); status {
+	case dnsasm.CookieValid, dnsasm.CookieRenew:
+		return nil
+	case dnsasm.CookieExpired:
+		return ErrExpiredCookie
+	default:
+		return ErrInvalidServerCookie
 	}
-
-	// Check if cookie is too old
-	// We need to extract timestamp and verify
-	// This is a simplified check - full implementation would parse cookie
-	return ErrInvalidServerCookie
-}
-
-// computeServerCookie computes what the server cookie should be
-func (m *Manager) computeServerCookie(secret [16]byte, clientCookie [8]byte, clientIP []byte, t time.Time) ([8]byte, error) {
-	var serverCookie [8]byte
-
-	timestamp := uint32(t.Unix())
-
-	h := siphash.New(secret[:])
-	h.Write(clientCookie[:])
-	h.Write(clientIP)
-	h.Write([]byte{cookieVersion, 0, 0, 0})
-	binary.Write(h, binary.BigEndian, timestamp)
-
-	binary.LittleEndian.PutUint64(serverCookie[:], h.Sum64())
-	return serverCookie, nil
 }
 
 // ParseCookie extracts client and server cookies from EDNS0 COOKIE option
@@ -267,19 +246,6 @@ func FormatCookie(clientCookie [8]byte, serverCookie []byte) []byte {
 	return data
 }
 
-// subtle_compare does constant-time comparison
-// Note: We should use crypto/subtle.ConstantTimeCompare in production
-func subtle_compare(a, b []byte) bool {
-	if len(a) != len(b) {
-		return false
-	}
-	var result byte
-	for i := 0; i < len(a); i++ {
-		result |= a[i] ^ b[i]
-	}
-	return result == 0
-}
-
 // ValidateQueryCookie validates the cookie in a DNS query
 // Returns whether to send BADCOOKIE response
 func (m *Manager) ValidateQueryCookie(clientCookie [8]byte, serverCookie []byte, clientIP []byte) (bool, error) {
@@ -300,7 +266,7 @@ func (m *Manager) ValidateQueryCookie(clientCookie [8]byte, serverCookie []byte,
 		return false, nil // Accept but don't require
 	}
 
-	var sc [8]byte
+	var sc [serverCookieSize]byte
 	copy(sc[:], serverCookie)
 
 	err := m.ValidateServerCookie(clientCookie, sc, clientIP)
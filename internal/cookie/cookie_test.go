@@ -2,8 +2,12 @@ package cookie
 
 import (
 	"bytes"
+	"encoding/binary"
 	"net"
 	"testing"
+	"time"
+
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 )
 
 func TestGenerateClientCookie(t *testing.T) {
@@ -79,8 +83,8 @@ func TestValidateServerCookie(t *testing.T) {
 	}
 
 	// Invalid cookie should fail
-	var invalidCookie [8]byte
-	copy(invalidCookie[:], []byte("invalid!"))
+	var invalidCookie [16]byte
+	copy(invalidCookie[:], []byte("invalid!invalid!"))
 
 	err = m.ValidateServerCookie(clientCookie, invalidCookie, clientIP)
 	if err == nil {
@@ -135,6 +139,55 @@ func TestValidateServerCookie_Rotation(t *testing.T) {
 	}
 }
 
+func TestCheck(t *testing.T) {
+	m, err := NewManager(Config{Enabled: true})
+	if err != nil {
+		t.Fatalf("NewManager() error: %v", err)
+	}
+
+	clientIP := net.ParseIP("192.0.2.1")
+	clientCookie := [8]byte{'t', 'e', 's', 't', 'c', 'o', 'o', 'k'}
+
+	// First query: client cookie only
+	status, reply := m.Check(clientCookie[:], clientIP)
+	if status != dnsasm.CookieClient {
+		t.Fatalf("Check(client only) = %d, want CookieClient", status)
+	}
+	option := FormatCookie(clientCookie, reply[:])
+
+	// Second query echoes the cookie back, from the 4-byte form of the IP
+	status, reply = m.Check(option, clientIP.To4())
+	if status != dnsasm.CookieValid || !bytes.Equal(reply[:], option[8:]) {
+		t.Errorf("Check(echo) = %d, %x; want CookieValid echoing %x", status, reply, option[8:])
+	}
+
+	if err := m.rotateSecret(); err != nil {
+		t.Fatalf("rotateSecret() error: %v", err)
+	}
+	if status, _ = m.Check(option, clientIP); status != dnsasm.CookieRenew {
+		t.Errorf("Check after rotation = %d, want CookieRenew", status)
+	}
+	if err := m.rotateSecret(); err != nil {
+		t.Fatalf("rotateSecret() error: %v", err)
+	}
+	if status, _ = m.Check(option, clientIP); status != dnsasm.CookieBad {
+		t.Errorf("Check after two rotations = %d, want CookieBad", status)
+	}
+
+	// A timestamp two hours old is expired before it is hashed
+	binary.BigEndian.PutUint32(option[12:], uint32(time.Now().Add(-2*time.Hour).Unix()))
+	if status, _ = m.Check(option, clientIP); status != dnsasm.CookieExpired {
+		t.Errorf("Check(old timestamp) = %d, want CookieExpired", status)
+	}
+	if status, _ = m.Check(option[:12], clientIP); status != dnsasm.CookieFormErr {
+		t.Errorf("Check(12 bytes) = %d, want CookieFormErr", status)
+	}
+
+	if allocs := testing.AllocsPerRun(100, func() { m.Check(option, clientIP) }); allocs != 0 {
+		t.Errorf("Check allocates %.0f times", allocs)
+	}
+}
+
 func TestParseCookie(t *testing.T) {
 	tests := []struct {
 		name           string
@@ -2,7 +2,11 @@ package engine
 
 import (
 	"net"
+	"net/netip"
 	"sync"
+	"sync/atomic"
+
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 )
 
 // ACL represents an Access Control List for DNS queries.
@@ -12,6 +16,51 @@ type ACL struct {
 	allowedNets  []*net.IPNet
 	deniedNets   []*net.IPNet
 	defaultAllow bool // If true, allow by default; if false, deny by default
+
+	// Allow then deny list painted into one prefix table, so a deny
+	// wins; nil after a change until the next lookup rebuilds it
+	table atomic.Pointer[netTable]
+}
+
+// netTable holds lists of networks painted into one prefix table in
+// order, each with its list index as the value: where networks of two
+// lists overlap, the later list wins.
+type netTable struct {
+	prefixes *dnsasm.PrefixTable // nil if the lists are empty
+}
+
+// newNetTable returns nil if a network can't be put in a prefix table;
+// networks parsed from CIDR notation always can.
+func newNetTable(lists ...[]*net.IPNet) *netTable {
+	var prefixes []netip.Prefix
+	var values []uint32
+	for i, list := range lists {
+		for _, n := range list {
+			p, ok := dnsasm.PrefixFromIPNet(n)
+			if !ok {
+				return nil
+			}
+			prefixes = append(prefixes, p)
+			values = append(values, uint32(i))
+		}
+	}
+	if len(prefixes) == 0 {
+		return &netTable{}
+	}
+	t, err := dnsasm.BuildPrefixTable(prefixes, values)
+	if err != nil {
+		return nil
+	}
+	return &netTable{prefixes: t}
+}
+
+// lookup returns the index of the last list with a network containing ip.
+func (t *netTable) lookup(ip net.IP) (int, bool) {
+	if t.prefixes == nil {
+		return 0, false
+	}
+	v, ok := t.prefixes.LookupIP(ip)
+	return int(v), ok
 }
 
 // NewACL creates a new ACL with a default policy.
@@ -45,6 +94,7 @@ func (a *ACL) AllowNet(cidr string) error {
 	a.mu.Lock()
 	defer a.mu.Unlock()
 	a.allowedNets = append(a.allowedNets, ipnet)
+	a.table.Store(nil)
 	return nil
 }
 
@@ -65,12 +115,40 @@ func (a *ACL) DenyNet(cidr string) error {
 	a.mu.Lock()
 	defer a.mu.Unlock()
 	a.deniedNets = append(a.deniedNets, ipnet)
+	a.table.Store(nil)
 	return nil
 }
 
 // IsAllowed checks if the given IP is allowed by the ACL.
 // The evaluation order is: deny list first, then allow list, then default policy.
 func (a *ACL) IsAllowed(ip net.IP) bool {
+	t := a.table.Load()
+	if t == nil {
+		if t = a.index(); t == nil {
+			return a.scan(ip)
+		}
+	}
+	if list, ok := t.lookup(ip); ok {
+		return list == 0
+	}
+	return a.defaultAllow
+}
+
+// index rebuilds the prefix table after a change. Lookups that find it
+// stale wait here for the first of them to rebuild it.
+func (a *ACL) index() *netTable {
+	a.mu.Lock()
+	defer a.mu.Unlock()
+	if t := a.table.Load(); t != nil {
+		return t
+	}
+	t := newNetTable(a.allowedNets, a.deniedNets)
+	a.table.Store(t)
+	return t
+}
+
+// scan checks the lists one network at a time.
+func (a *ACL) scan(ip net.IP) bool {
 	a.mu.RLock()
 	defer a.mu.RUnlock()
 
@@ -107,4 +185,5 @@ func (a *ACL) Clear() {
 	defer a.mu.Unlock()
 	a.allowedNets = make([]*net.IPNet, 0)
 	a.deniedNets = make([]*net.IPNet, 0)
+	a.table.Store(nil)
 }
@@ -62,6 +62,22 @@ func TestACL_DenyOverridesAllow(t *testing.T) {
 	assert.False(t, acl.IsAllowedString("10.0.1.254"))
 }
 
+func TestACL_BroadDenyOverridesNarrowAllow(t *testing.T) {
+	acl := NewACL(true)
+
+	require.NoError(t, acl.AllowNet("10.0.1.0/24"))
+	assert.True(t, acl.IsAllowedString("10.0.1.1"))
+
+	// A later, shorter deny still wins over the longer allow
+	require.NoError(t, acl.DenyNet("10.0.0.0/8"))
+	assert.False(t, acl.IsAllowedString("10.0.1.1"))
+	assert.False(t, acl.IsAllowed(net.ParseIP("::ffff:10.0.1.1")))
+	assert.True(t, acl.IsAllowedString("11.0.0.1"))
+
+	acl.Clear()
+	assert.True(t, acl.IsAllowedString("10.0.1.1"))
+}
+
 func TestACL_SingleIP(t *testing.T) {
 	acl := NewACL(false)
 
@@ -3,6 +3,7 @@ package engine
 import (
 	"net"
 	"sync"
+	"sync/atomic"
 	"time"
 
 	"golang.org/x/time/rate"
@@ -18,6 +19,10 @@ type RateLimiter struct {
 	cleanupInterval time.Duration
 	lastCleanup     time.Time
 	exemptNets      []*net.IPNet
+
+	// exemptNets as a prefix table; nil after a change until the next
+	// lookup rebuilds it
+	exempt atomic.Pointer[netTable]
 }
 
 // RateLimiterConfig holds configuration for the rate limiter.
@@ -102,11 +107,21 @@ func (rl *RateLimiter) AddExempt(cidr string) error {
 	rl.mu.Lock()
 	defer rl.mu.Unlock()
 	rl.exemptNets = append(rl.exemptNets, ipnet)
+	rl.exempt.Store(nil)
 	return nil
 }
 
 // isExempt checks if an IP is in the exempt list.
 func (rl *RateLimiter) isExempt(ip net.IP) bool {
+	t := rl.exempt.Load()
+	if t == nil {
+		t = rl.indexExempt()
+	}
+	if t != nil {
+		_, ok := t.lookup(ip)
+		return ok
+	}
+
 	rl.mu.RLock()
 	defer rl.mu.RUnlock()
 	for _, exempt := range rl.exemptNets {
@@ -117,6 +132,18 @@ func (rl *RateLimiter) isExempt(ip net.IP) bool {
 	return false
 }
 
+// indexExempt rebuilds the exempt prefix table after a change.
+func (rl *RateLimiter) indexExempt() *netTable {
+	rl.mu.Lock()
+	defer rl.mu.Unlock()
+	if t := rl.exempt.Load(); t != nil {
+		return t
+	}
+	t := newNetTable(rl.exemptNets)
+	rl.exempt.Store(t)
+	return t
+}
+
 // cleanup removes limiters that haven't been used recently.
 // Must be called with lock held.
 func (rl *RateLimiter) cleanup() {
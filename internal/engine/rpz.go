@@ -1,9 +1,13 @@
 package engine
 
 import (
+	"crypto/rand"
+	"encoding/binary"
 	"strings"
 	"sync"
+	"sync/atomic"
 
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 	"github.com/miekg/dns"
 )
 
@@ -55,18 +59,85 @@ type RPZ struct {
 	wildcards map[string]*RPZRule // Wildcard rules (*.domain)
 	name      string              // Zone name for identification
 	enabled   bool
+
+	// Bloom filter over every trigger, probed before taking mu so that
+	// names no rule covers skip the maps entirely. nil while empty.
+	filter    atomic.Pointer[dnsasm.NameFilter]
+	filterKey dnsasm.HashKey
 }
 
+// minFilterCap is the smallest trigger filter; it doubles as rules grow.
+const minFilterCap = 1024
+
+// wireBufs holds scratch space for packing query names. Pooling the
+// array pointer, not a slice, keeps Put from allocating.
+var wireBufs = sync.Pool{New: func() any { return new([256]byte) }}
+
 // NewRPZ creates a new RPZ instance.
 func NewRPZ(name string) *RPZ {
+	var b [16]byte
+	if _, err := rand.Read(b[:]); err != nil {
+		panic("rpz: cannot seed trigger filter key: " + err.Error())
+	}
 	return &RPZ{
 		rules:     make(map[string]*RPZRule),
 		wildcards: make(map[string]*RPZRule),
 		name:      name,
 		enabled:   true,
+		filterKey: dnsasm.HashKey{
+			K0: binary.LittleEndian.Uint64(b[0:8]),
+			K1: binary.LittleEndian.Uint64(b[8:16]),
+		},
 	}
 }
 
+// packQuery packs name into buf for a filter probe, or returns nil for
+// names the filter cannot answer for: ones that do not pack, and
+// non-ASCII ones, which Check lowercases as Unicode rather than ASCII.
+func packQuery(name string, buf []byte) []byte {
+	for i := 0; i < len(name); i++ {
+		if name[i] >= 0x80 {
+			return nil
+		}
+	}
+	n, err := dns.PackDomainName(name, buf, 0, nil, false)
+	if err != nil {
+		return nil
+	}
+	return buf[:n]
+}
+
+// indexTrigger adds a trigger to the filter, rebuilding it twice as big
+// when full. Triggers that do not pack cannot cover a name that does,
+// so they are left out. Call with mu held.
+func (r *RPZ) indexTrigger(trigger string) {
+	var buf [256]byte
+	wire := packQuery(trigger, buf[:])
+	if wire == nil {
+		return
+	}
+	if f := r.filter.Load(); f != nil && f.Add(wire) != dnsasm.ErrSpace {
+		return
+	}
+
+	capacity := 2 * (len(r.rules) + len(r.wildcards))
+	if capacity < minFilterCap {
+		capacity = minFilterCap
+	}
+	f, err := dnsasm.NewNameFilter(capacity, r.filterKey)
+	if err != nil {
+		panic("rpz: cannot size trigger filter: " + err.Error())
+	}
+	for _, m := range []map[string]*RPZRule{r.rules, r.wildcards} {
+		for t := range m {
+			if w := packQuery(t, buf[:]); w != nil {
+				f.Add(w)
+			}
+		}
+	}
+	r.filter.Store(f)
+}
+
 // AddRule adds an exact match rule to the RPZ.
 func (r *RPZ) AddRule(trigger string, action RPZAction, reason string) {
 	trigger = dns.Fqdn(strings.ToLower(trigger))
@@ -77,6 +148,7 @@ func (r *RPZ) AddRule(trigger string, action RPZAction, reason string) {
 		Action:  action,
 		Reason:  reason,
 	}
+	r.indexTrigger(trigger)
 }
 
 // AddWildcard adds a wildcard rule to the RPZ.
@@ -90,6 +162,7 @@ func (r *RPZ) AddWildcard(trigger string, action RPZAction, reason string) {
 		Action:  action,
 		Reason:  reason,
 	}
+	r.indexTrigger(trigger)
 }
 
 // AddRewriteRule adds a rule that rewrites queries to a different target.
@@ -104,6 +177,7 @@ func (r *RPZ) AddRewriteRule(trigger, target, reason string) {
 		RewriteTarget: target,
 		Reason:        reason,
 	}
+	r.indexTrigger(trigger)
 }
 
 // AddPassthru adds a passthru (whitelist) rule that overrides blocking rules.
@@ -116,14 +190,32 @@ func (r *RPZ) AddPassthru(trigger, reason string) {
 		Action:  RPZActionPassthru,
 		Reason:  reason,
 	}
+	r.indexTrigger(trigger)
 }
 
 // Check evaluates a query name against the RPZ rules.
 // Returns the matching rule and action, or nil/RPZActionNone if no match.
 func (r *RPZ) Check(name string) (*RPZRule, RPZAction) {
+	buf := wireBufs.Get().(*[256]byte)
+	defer wireBufs.Put(buf)
+	return r.checkWire(name, packQuery(name, buf[:]))
+}
+
+// checkWire is Check with the name also in wire form, or nil if it
+// could not be packed. The filter answers most names without mu.
+func (r *RPZ) checkWire(name string, wire []byte) (*RPZRule, RPZAction) {
 	if !r.enabled {
 		return nil, RPZActionNone
 	}
+	if wire != nil {
+		f := r.filter.Load()
+		if f == nil {
+			return nil, RPZActionNone
+		}
+		if _, ok := f.Match(wire); !ok {
+			return nil, RPZActionNone
+		}
+	}
 
 	name = dns.Fqdn(strings.ToLower(name))
 
@@ -213,6 +305,7 @@ func (r *RPZ) Clear() {
 	defer r.mu.Unlock()
 	r.rules = make(map[string]*RPZRule)
 	r.wildcards = make(map[string]*RPZRule)
+	r.filter.Store(nil)
 }
 
 // Stats returns statistics about the RPZ.
@@ -261,8 +354,13 @@ func (a *RPZAggregate) Check(name string) (*RPZRule, RPZAction) {
 	a.mu.RLock()
 	defer a.mu.RUnlock()
 
+	// Pack the name once for every zone's filter
+	buf := wireBufs.Get().(*[256]byte)
+	defer wireBufs.Put(buf)
+	wire := packQuery(name, buf[:])
+
 	for _, rpz := range a.zones {
-		if rule, action := rpz.Check(name); action != RPZActionNone {
+		if rule, action := rpz.checkWire(name, wire); action != RPZActionNone {
 			return rule, action
 		}
 	}
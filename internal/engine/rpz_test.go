@@ -1,6 +1,7 @@
 package engine
 
 import (
+	"fmt"
 	"testing"
 
 	"github.com/miekg/dns"
@@ -141,3 +142,29 @@ func TestRPZAggregate(t *testing.T) {
 	assert.Nil(t, rule)
 	assert.Equal(t, RPZActionNone, action)
 }
+
+func TestRPZ_FilterGrowsAndClears(t *testing.T) {
+	rpz := NewRPZ("feed")
+
+	// Enough triggers to outgrow the first filter several times
+	for i := 0; i < 5*minFilterCap; i++ {
+		rpz.AddWildcard(fmt.Sprintf("bad%d.example.", i), RPZActionNXDomain, "feed")
+	}
+	for i := 0; i < 5*minFilterCap; i += 97 {
+		_, action := rpz.Check(fmt.Sprintf("WWW.Bad%d.example.", i))
+		assert.Equal(t, RPZActionNXDomain, action, "trigger %d", i)
+	}
+	_, action := rpz.Check("good.example.")
+	assert.Equal(t, RPZActionNone, action)
+
+	// Names the filter cannot speak for still reach the rules
+	_, action = rpz.Check("bad7.example")
+	assert.Equal(t, RPZActionNXDomain, action)
+
+	rpz.Clear()
+	_, action = rpz.Check("bad7.example.")
+	assert.Equal(t, RPZActionNone, action)
+	rpz.AddRule("bad7.example", RPZActionDrop, "again")
+	_, action = rpz.Check("bad7.example.")
+	assert.Equal(t, RPZActionDrop, action)
+}
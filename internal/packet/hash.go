@@ -0,0 +1,136 @@
+package packet
+
+import (
+	"crypto/rand"
+	"encoding/binary"
+	"math/bits"
+	"strings"
+)
+
+// Request bits folded into the query hash; they select different answers.
+const (
+	HashDO = 0x01 // EDNS DNSSEC OK
+	HashCD = 0x02 // Checking Disabled
+)
+
+// queryKey is the per-process SipHash key behind HashQuery. Clients that
+// cannot see it cannot pick names that collide in the cache.
+var queryKey [2]uint64
+
+func init() {
+	var b [16]byte
+	if _, err := rand.Read(b[:]); err != nil {
+		panic("packet: cannot seed query hash key: " + err.Error())
+	}
+	queryKey[0] = binary.LittleEndian.Uint64(b[0:8])
+	queryKey[1] = binary.LittleEndian.Uint64(b[8:16])
+}
+
+// QueryHashKey returns the per-process key so that wire-format fast
+// paths (dnsasm.QueryHash) produce the same cache keys as HashQuery.
+func QueryHashKey() (k0, k1 uint64) {
+	return queryKey[0], queryKey[1]
+}
+
+// HashQuery creates a cache key hash for a query (DOS-resistant).
+// Equivalent to HashQuestion with no request bits.
+func HashQuery(qname string, qtype, qclass uint16) uint64 {
+	return HashQuestion(qname, qtype, qclass, 0)
+}
+
+// HashQuestion hashes (qname, qtype, qclass, flags) with keyed SipHash-1-3.
+//
+// The input is the lowercased wire form of qname followed by qtype and
+// qclass in network order and one byte of HashDO/HashCD bits, the same
+// bytes libdnsasm hashes, so both sides agree on every cache key. The
+// wire form is streamed straight from the string without allocating.
+func HashQuestion(qname string, qtype, qclass uint16, flags uint8) uint64 {
+	s := newSip13(queryKey[0], queryKey[1])
+
+	for len(qname) > 0 && qname != "." {
+		n := strings.IndexByte(qname, '.')
+		if n < 0 {
+			n = len(qname)
+		}
+		s.writeByte(byte(n))
+		for i := 0; i < n; i++ {
+			c := qname[i]
+			if c >= 'A' && c <= 'Z' {
+				c |= 0x20
+			}
+			s.writeByte(c)
+		}
+		if n == len(qname) {
+			break
+		}
+		qname = qname[n+1:]
+	}
+	s.writeByte(0)
+
+	s.writeByte(byte(qtype >> 8))
+	s.writeByte(byte(qtype))
+	s.writeByte(byte(qclass >> 8))
+	s.writeByte(byte(qclass))
+	s.writeByte(flags)
+	return s.sum()
+}
+
+// sip13 is a byte-at-a-time SipHash-1-3 (one compression round, three
+// finalization rounds) for short keys.
+type sip13 struct {
+	v0, v1, v2, v3 uint64
+	m              uint64 // Pending little-endian word
+	n              uint64 // Bytes written
+}
+
+func newSip13(k0, k1 uint64) sip13 {
+	return sip13{
+		v0: k0 ^ 0x736f6d6570736575,
+		v1: k1 ^ 0x646f72616e646f6d,
+		v2: k0 ^ 0x6c7967656e657261,
+		v3: k1 ^ 0x7465646279746573,
+	}
+}
+
+func (s *sip13) round() {
+	s.v0 += s.v1
+	s.v1 = bits.RotateLeft64(s.v1, 13) ^ s.v0
+	s.v0 = bits.RotateLeft64(s.v0, 32)
+	s.v2 += s.v3
+	s.v3 = bits.RotateLeft64(s.v3, 16) ^ s.v2
+	s.v0 += s.v3
+	s.v3 = bits.RotateLeft64(s.v3, 21) ^ s.v0
+	s.v2 += s.v1
+	s.v1 = bits.RotateLeft64(s.v1, 17) ^ s.v2
+	s.v2 = bits.RotateLeft64(s.v2, 32)
+}
+
+func (s *sip13) absorb(m uint64) {
+	s.v3 ^= m
+	s.round()
+	s.v0 ^= m
+}
+
+// writeByte is small enough to inline; the round runs once per word.
+func (s *sip13) writeByte(c byte) {
+	s.m |= uint64(c) << (8 * (s.n & 7))
+	s.n++
+	if s.n&7 == 0 {
+		s.flush()
+	}
+}
+
+//go:noinline
+func (s *sip13) flush() {
+	s.absorb(s.m)
+	s.m = 0
+}
+
+func (s *sip13) sum() uint64 {
+	s.absorb(s.m | s.n<<56)
+	s.v2 ^= 0xff
+	s.round()
+	s.round()
+	s.round()
+	return s.v0 ^ s.v1 ^ s.v2 ^ s.v3
+}
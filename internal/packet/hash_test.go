@@ -0,0 +1,51 @@
+package packet
+
+import "testing"
+
+func TestHashQuestion(t *testing.T) {
+	h := HashQuestion("www.example.com.", 1, 1, 0)
+
+	if HashQuestion("WWW.Example.COM.", 1, 1, 0) != h {
+		t.Error("hash should ignore ASCII case")
+	}
+	if HashQuestion("www.example.com", 1, 1, 0) != h {
+		t.Error("trailing dot should not matter")
+	}
+	if HashQuestion("www.example.com.", 1, 1, HashDO) == h {
+		t.Error("DO bit should change the hash")
+	}
+	if HashQuestion("www.example.com.", 28, 1, 0) == h {
+		t.Error("qtype should change the hash")
+	}
+	if HashQuestion("wwwexample.com.", 1, 1, 0) == h {
+		t.Error("label boundaries should change the hash")
+	}
+	if HashQuestion(".", 2, 1, 0) != HashQuestion("", 2, 1, 0) {
+		t.Error("root should hash the same with or without the dot")
+	}
+
+	allocs := testing.AllocsPerRun(100, func() {
+		HashQuestion("www.example.com.", 1, 1, 0)
+	})
+	if allocs != 0 {
+		t.Errorf("HashQuestion allocates %.0f times", allocs)
+	}
+}
+
+// Known answer shared with libdnsasm's keyed hash (dnsasm-console --test),
+// so Go and wire-format cache keys stay interchangeable.
+func TestHashQuestionMatchesDnsasm(t *testing.T) {
+	saved := queryKey
+	defer func() { queryKey = saved }()
+	queryKey = [2]uint64{0x0706050403020100, 0x0f0e0d0c0b0a0908}
+
+	if h := HashQuestion("www.example.com.", 1, 1, 0); h != 0x7aededfcb247961e {
+		t.Errorf("HashQuestion = %016x, want 7aededfcb247961e", h)
+	}
+}
+
+func BenchmarkHashQuery(b *testing.B) {
+	for i := 0; i < b.N; i++ {
+		HashQuery("www.example.com.", 1, 1)
+	}
+}
@@ -4,7 +4,6 @@ import (
 	"encoding/binary"
 	"errors"
 	"fmt"
-	"hash/fnv"
 )
 
 var (
@@ -360,13 +359,3 @@ func (p *Parser) parseName() (string, error) {
 
 	return name, nil
 }
-
-// HashQuery creates a cache key hash for a query (DOS-resistant)
-// Uses FNV-1a which is fast and has good distribution
-func HashQuery(qname string, qtype, qclass uint16) uint64 {
-	h := fnv.New64a()
-	h.Write([]byte(qname))
-	binary.Write(h, binary.BigEndian, qtype)
-	binary.Write(h, binary.BigEndian, qclass)
-	return h.Sum64()
-}
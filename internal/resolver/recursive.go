@@ -7,6 +7,7 @@ import (
 	"net"
 	"time"
 
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 	"github.com/dnsscience/dnsscienced/internal/cache"
 	"github.com/dnsscience/dnsscienced/internal/cookie"
 	"github.com/dnsscience/dnsscienced/internal/packet"
@@ -126,14 +127,25 @@ func (r *Recursive) Resolve(ctx context.Context, q *dns.Msg, clientIP net.IP) (*
 
 	question := q.Question[0]
 
-	// Check cache first
-	cacheKey := packet.HashQuery(question.Name, question.Qtype, question.Qclass)
+	// Check cache first; DO and CD select different answers, so they
+	// are part of the key
+	cacheKey := packet.HashQuestion(question.Name, question.Qtype, question.Qclass, queryFlags(q))
 	if entry, ok := r.cache.Get(cacheKey); ok && !entry.IsExpired() {
 		// Cache hit!
 		resp := pool.GetMessage()
 		defer pool.PutMessage(resp)
 
-		if err := resp.Unpack(entry.Data); err == nil {
+		// Age a private copy of the stored wire so the client sees the
+		// remaining TTLs rather than the ones we cached
+		buf := pool.GetBuffer(len(entry.Data))
+		wire := buf[:len(entry.Data)]
+		copy(wire, entry.Data)
+		err := dnsasm.AgeTTLs(wire, entry.Age(), 0)
+		if err == nil {
+			err = resp.Unpack(wire)
+		}
+		pool.PutBuffer(buf)
+		if err == nil {
 			resp.Id = q.Id // Use query's transaction ID
 			return resp.Copy(), nil
 		}
@@ -163,6 +175,18 @@ func (r *Recursive) Resolve(ctx context.Context, q *dns.Msg, clientIP net.IP) (*
 	return resp, nil
 }
 
+// queryFlags returns the packet.HashDO and packet.HashCD bits of q
+func queryFlags(q *dns.Msg) uint8 {
+	var flags uint8
+	if opt := q.IsEdns0(); opt != nil && opt.Do() {
+		flags |= packet.HashDO
+	}
+	if q.CheckingDisabled {
+		flags |= packet.HashCD
+	}
+	return flags
+}
+
 // resolveIterative performs iterative resolution starting from root
 func (r *Recursive) resolveIterative(ctx context.Context, qname string, qtype, qclass uint16) (*dns.Msg, error) {
 	nameservers := rootServers
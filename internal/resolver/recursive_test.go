@@ -8,6 +8,7 @@ import (
 
 	"github.com/dnsscience/dnsscienced/internal/cache"
 	"github.com/dnsscience/dnsscienced/internal/cookie"
+	"github.com/dnsscience/dnsscienced/internal/packet"
 	"github.com/dnsscience/dnsscienced/internal/rrl"
 	"github.com/miekg/dns"
 )
@@ -414,16 +415,58 @@ func TestResolve_ContextCancellation(t *testing.T) {
 	}
 }
 
+func TestResolve_CacheKeyFlags(t *testing.T) {
+	r, err := NewRecursive(Config{QueryTimeout: 10 * time.Second})
+	if err != nil {
+		t.Fatalf("NewRecursive() error = %v", err)
+	}
+	defer r.Close()
+
+	cachedResp := new(dns.Msg)
+	cachedResp.SetQuestion("example.com.", dns.TypeA)
+	cachedResp.Response = true
+	packed, err := cachedResp.Pack()
+	if err != nil {
+		t.Fatalf("Pack() error = %v", err)
+	}
+	r.cache.Set(hashQuery("example.com.", dns.TypeA, dns.ClassINET), &cache.Entry{
+		Data:      packed,
+		ExpiresAt: time.Now().Add(1 * time.Hour),
+		OrigTTL:   3600,
+		QName:     "example.com.",
+		QType:     dns.TypeA,
+		QClass:    dns.ClassINET,
+	})
+
+	// A cancelled context fails every lookup that misses the cache
+	ctx, cancel := context.WithCancel(context.Background())
+	cancel()
+	clientIP := net.ParseIP("192.0.2.1")
+
+	plain := new(dns.Msg)
+	plain.SetQuestion("example.com.", dns.TypeA)
+	if _, err := r.Resolve(ctx, plain, clientIP); err != nil {
+		t.Fatalf("plain query missed the cache: %v", err)
+	}
+
+	do := new(dns.Msg)
+	do.SetQuestion("example.com.", dns.TypeA)
+	do.SetEdns0(4096, true)
+	if _, err := r.Resolve(ctx, do, clientIP); err == nil {
+		t.Error("DO query answered from the non-DNSSEC entry")
+	}
+
+	cd := new(dns.Msg)
+	cd.SetQuestion("example.com.", dns.TypeA)
+	cd.CheckingDisabled = true
+	if _, err := r.Resolve(ctx, cd, clientIP); err == nil {
+		t.Error("CD query answered from the validated entry")
+	}
+}
+
 // Helper function that matches the one in recursive.go
 func hashQuery(name string, qtype, qclass uint16) uint64 {
-	// Simple hash for testing - matches packet.HashQuery
-	hash := uint64(0)
-	for _, c := range name {
-		hash = hash*31 + uint64(c)
-	}
-	hash = hash*31 + uint64(qtype)
-	hash = hash*31 + uint64(qclass)
-	return hash
+	return packet.HashQuery(name, qtype, qclass)
 }
 
 // Benchmark recursive resolver (end-to-end)
@@ -1,11 +1,12 @@
 package rrl
 
 import (
-	"hash/fnv"
 	"net"
-	"sync"
+	"net/netip"
 	"sync/atomic"
 	"time"
+
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 )
 
 // Response Rate Limiting (RRL) prevents DNS amplification attacks
@@ -31,6 +32,9 @@ const (
 	CategoryAll
 )
 
+// DefaultTableSize is the default number of bucket slots (8 bytes each)
+const DefaultTableSize = 1 << 18
+
 // Config holds RRL configuration
 type Config struct {
 	// Per-category limits (queries per second)
@@ -55,6 +59,10 @@ type Config struct {
 	IPv4PrefixLen int // Default: 24
 	IPv6PrefixLen int // Default: 56
 
+	// Bucket slots, rounded up to a power of two. This is the whole
+	// memory of the limiter: when it fills, idle buckets are evicted
+	TableSize int
+
 	// Enable/disable
 	Enabled bool
 }
@@ -72,6 +80,7 @@ func DefaultConfig() Config {
 		Slip:               DefaultSlip,
 		IPv4PrefixLen:      24,
 		IPv6PrefixLen:      56,
+		TableSize:          DefaultTableSize,
 		Enabled:            true,
 	}
 }
@@ -98,28 +107,24 @@ func (a Action) String() string {
 	}
 }
 
-// bucket tracks rate for a specific (client, qname, qtype) tuple
-type bucket struct {
-	tokens    int32
-	lastCheck int64 // Unix timestamp
-}
-
 // Limiter implements Response Rate Limiting
 type Limiter struct {
 	cfg Config
 
-	// Buckets: map[hash]*bucket
-	// Hash = fnv(client-prefix || qname || qtype || category)
-	buckets sync.Map
+	// Exempt prefixes as a prefix table, plus any the table can't hold
+	// (non-contiguous masks), which are still scanned
+	exempt      *dnsasm.PrefixTable
+	exemptOther []*net.IPNet
+
+	// Token buckets, one per (client-prefix, qname, qtype, category)
+	// hash, in a fixed-size table
+	buckets *bucketTable
+	epoch   int64 // Unix time the bucket clock counts from
 
 	// Statistics
 	allowed atomic.Uint64
 	dropped atomic.Uint64
 	slipped atomic.Uint64
-
-	// Cleanup
-	stopCleanup chan struct{}
-	cleanupDone sync.WaitGroup
 }
 
 // NewLimiter creates a new RRL limiter
@@ -130,15 +135,16 @@ func NewLimiter(cfg Config) *Limiter {
 	if cfg.Slip == 0 {
 		cfg.Slip = DefaultSlip
 	}
+	if cfg.TableSize == 0 {
+		cfg.TableSize = DefaultTableSize
+	}
 
 	l := &Limiter{
-		cfg:         cfg,
-		stopCleanup: make(chan struct{}),
+		cfg:     cfg,
+		buckets: newBucketTable(cfg.TableSize),
+		epoch:   time.Now().Unix(),
 	}
-
-	// Start background cleanup
-	l.cleanupDone.Add(1)
-	go l.cleanup()
+	l.indexExempt()
 
 	return l
 }
@@ -166,47 +172,14 @@ func (l *Limiter) Check(clientIP net.IP, qname string, qtype uint16, category in
 	// Calculate bucket hash
 	hash := l.bucketHash(clientIP, qname, qtype, category)
 
-	// Get or create bucket
-	now := time.Now().Unix()
-	bucketInterface, _ := l.buckets.LoadOrStore(hash, &bucket{
-		tokens:    int32(limit * l.cfg.Window),
-		lastCheck: now,
-	})
-	b := bucketInterface.(*bucket)
-
-	// Refill tokens based on elapsed time (token bucket algorithm)
-	lastCheck := atomic.LoadInt64(&b.lastCheck)
-	elapsed := now - lastCheck
-
-	if elapsed > 0 {
-		// Refill tokens: (elapsed seconds) * (tokens per second)
-		refill := int32(elapsed * int64(limit))
-		maxTokens := int32(limit * l.cfg.Window)
-
-		// Add tokens, capped at max
-		currentTokens := atomic.LoadInt32(&b.tokens)
-		newTokens := currentTokens + refill
-		if newTokens > maxTokens {
-			newTokens = maxTokens
-		}
-
-		atomic.StoreInt32(&b.tokens, newTokens)
-		atomic.StoreInt64(&b.lastCheck, now)
-	}
-
-	// Try to consume a token
-	tokens := atomic.AddInt32(&b.tokens, -1)
-
-	if tokens >= 0 {
-		// Token available - allow
+	// Refill and take a token; a new bucket starts full
+	now := uint32(time.Now().Unix() - l.epoch)
+	if l.buckets.take(hash, now, int64(limit), int64(limit)*int64(l.cfg.Window)) {
 		l.allowed.Add(1)
 		return ActionAllow
 	}
 
 	// No tokens - rate limited!
-	// Restore the token we tried to consume
-	atomic.AddInt32(&b.tokens, 1)
-
 	// Apply slip: 1 in N get TC bit, rest are dropped
 	if l.cfg.Slip > 0 && (hash%uint64(l.cfg.Slip)) == 0 {
 		l.slipped.Add(1)
@@ -217,9 +190,35 @@ func (l *Limiter) Check(clientIP net.IP, qname string, qtype uint16, category in
 	return ActionDrop
 }
 
+// indexExempt builds the exempt prefix table from the config
+func (l *Limiter) indexExempt() {
+	if len(l.cfg.ExemptPrefixes) == 0 {
+		return
+	}
+	var prefixes []netip.Prefix
+	for _, n := range l.cfg.ExemptPrefixes {
+		if p, ok := dnsasm.PrefixFromIPNet(n); ok {
+			prefixes = append(prefixes, p)
+		} else {
+			l.exemptOther = append(l.exemptOther, n)
+		}
+	}
+	t, err := dnsasm.BuildPrefixTable(prefixes, make([]uint32, len(prefixes)))
+	if err != nil {
+		l.exemptOther = l.cfg.ExemptPrefixes
+		return
+	}
+	l.exempt = t
+}
+
 // isExempt checks if client IP is in exempt list
 func (l *Limiter) isExempt(ip net.IP) bool {
-	for _, prefix := range l.cfg.ExemptPrefixes {
+	if l.exempt != nil {
+		if _, ok := l.exempt.LookupIP(ip); ok {
+			return true
+		}
+	}
+	for _, prefix := range l.exemptOther {
 		if prefix.Contains(ip) {
 			return true
 		}
@@ -249,96 +248,80 @@ func (l *Limiter) getLimitForCategory(category int) int {
 
 // bucketHash creates a hash for bucket identification
 // Hash includes: client prefix + qname + qtype + category
+// (FNV-1a, written out so that nothing escapes to the heap)
 func (l *Limiter) bucketHash(ip net.IP, qname string, qtype uint16, category int) uint64 {
-	h := fnv.New64a()
+	const (
+		offset64 = 14695981039346656037
+		prime64  = 1099511628211
+	)
+	h := uint64(offset64)
 
 	// Write client prefix (not full IP for privacy/efficiency)
-	prefix := l.getPrefix(ip)
-	h.Write(prefix)
+	var buf [16]byte
+	for _, c := range l.getPrefix(ip, &buf) {
+		h = (h ^ uint64(c)) * prime64
+	}
 
 	// Write query name
-	h.Write([]byte(qname))
+	for i := 0; i < len(qname); i++ {
+		h = (h ^ uint64(qname[i])) * prime64
+	}
 
 	// Write query type and category
-	var buf [4]byte
-	buf[0] = byte(qtype >> 8)
-	buf[1] = byte(qtype)
-	buf[2] = byte(category >> 8)
-	buf[3] = byte(category)
-	h.Write(buf[:])
-
-	return h.Sum64()
+	for _, c := range [4]byte{byte(qtype >> 8), byte(qtype), byte(category >> 8), byte(category)} {
+		h = (h ^ uint64(c)) * prime64
+	}
+
+	return h
 }
 
-// getPrefix returns the prefix of an IP for bucketing
-func (l *Limiter) getPrefix(ip net.IP) []byte {
-	ip = ip.To4()
-	if ip != nil {
+// getPrefix writes the prefix of an IP for bucketing into buf
+func (l *Limiter) getPrefix(ip net.IP, buf *[16]byte) []byte {
+	if ip4 := ip.To4(); ip4 != nil {
 		// IPv4: use /24 prefix (default)
 		prefixLen := l.cfg.IPv4PrefixLen
 		if prefixLen == 0 {
 			prefixLen = 24
 		}
-		mask := net.CIDRMask(prefixLen, 32)
-		return ip.Mask(mask)
+		return maskPrefix(buf[:4], ip4, prefixLen)
 	}
 
 	// IPv6: use /56 prefix (default)
-	ip = ip.To16()
 	prefixLen := l.cfg.IPv6PrefixLen
 	if prefixLen == 0 {
 		prefixLen = 56
 	}
-	mask := net.CIDRMask(prefixLen, 128)
-	return ip.Mask(mask)
+	return maskPrefix(buf[:], ip.To16(), prefixLen)
 }
 
-// cleanup periodically removes expired buckets
-func (l *Limiter) cleanup() {
-	defer l.cleanupDone.Done()
-
-	ticker := time.NewTicker(60 * time.Second)
-	defer ticker.Stop()
-
-	for {
-		select {
-		case <-ticker.C:
-			l.performCleanup()
-		case <-l.stopCleanup:
-			return
+// maskPrefix copies the first bits of ip into dst and zeroes the rest
+func maskPrefix(dst, ip net.IP, bits int) []byte {
+	copy(dst, ip)
+	for i := range dst {
+		switch {
+		case bits >= 8:
+			bits -= 8
+		case bits > 0:
+			dst[i] &= byte(0xff << (8 - bits))
+			bits = 0
+		default:
+			dst[i] = 0
 		}
 	}
+	return dst
 }
 
-// performCleanup removes old buckets
-func (l *Limiter) performCleanup() {
-	now := time.Now().Unix()
-	cutoff := now - int64(l.cfg.Window*2) // Keep buckets for 2x window
-
-	l.buckets.Range(func(key, value interface{}) bool {
-		b := value.(*bucket)
-		lastCheck := atomic.LoadInt64(&b.lastCheck)
-
-		if lastCheck < cutoff {
-			l.buckets.Delete(key)
-		}
-
-		return true
-	})
-}
-
-// Close stops background goroutines
-func (l *Limiter) Close() {
-	close(l.stopCleanup)
-	l.cleanupDone.Wait()
-}
+// Close releases the limiter. Buckets are refilled and evicted in
+// place, so there is no background sweep left to stop.
+func (l *Limiter) Close() {}
 
 // Stats returns RRL statistics
 type Stats struct {
-	Allowed uint64
-	Dropped uint64
-	Slipped uint64
-	Total   uint64
+	Allowed  uint64
+	Dropped  uint64
+	Slipped  uint64
+	Evicted  uint64 // Buckets pushed out of a full table
+	Total    uint64
 	DropRate float64
 }
 
@@ -358,6 +341,7 @@ func (l *Limiter) GetStats() Stats {
 		Allowed:  allowed,
 		Dropped:  dropped,
 		Slipped:  slipped,
+		Evicted:  l.buckets.evicted.Load(),
 		Total:    total,
 		DropRate: dropRate,
 	}
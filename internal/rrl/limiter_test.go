@@ -117,6 +117,32 @@ func TestCheck_Exempt(t *testing.T) {
 	}
 }
 
+func TestCheck_ExemptMixed(t *testing.T) {
+	_, v6Net, _ := net.ParseCIDR("2001:db8::/48")
+	oddNet := &net.IPNet{IP: net.IPv4(198, 51, 0, 7).To4(), Mask: net.IPMask{255, 255, 0, 255}}
+
+	cfg := DefaultConfig()
+	cfg.ResponsesPerSecond = 1
+	cfg.ExemptPrefixes = []*net.IPNet{v6Net, oddNet}
+	limiter := NewLimiter(cfg)
+	defer limiter.Close()
+
+	for _, c := range []struct {
+		ip     string
+		exempt bool
+	}{
+		{"2001:db8::53", true},
+		{"2001:db8:1::53", false},
+		{"198.51.9.7", true}, // Matched through the non-contiguous mask
+		{"198.51.9.8", false},
+		{"::ffff:198.51.1.7", true},
+	} {
+		if got := limiter.isExempt(net.ParseIP(c.ip)); got != c.exempt {
+			t.Errorf("isExempt(%s) = %v, want %v", c.ip, got, c.exempt)
+		}
+	}
+}
+
 func TestCheck_DifferentCategories(t *testing.T) {
 	cfg := DefaultConfig()
 	cfg.ResponsesPerSecond = 2
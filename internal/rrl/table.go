@@ -0,0 +1,129 @@
+package rrl
+
+import "sync/atomic"
+
+// bucketTable is a fixed-size, open-addressed table of token buckets.
+// Memory is set once at construction and never grows, however many
+// distinct tuples an attacker sends: a new tuple takes a free slot in
+// its probe window or evicts the slot there that carries least state.
+//
+// Each slot is one 64-bit word holding a key fingerprint, the token
+// count and the second of the last refill, so a bucket is read and
+// updated with a single compare-and-swap and no lock. Refill is lazy:
+// tokens for the seconds since the last refill are added on the next
+// take, and there is no background sweep.
+type bucketTable struct {
+	slots   []atomic.Uint64
+	mask    uint64
+	evicted atomic.Uint64
+}
+
+const (
+	// A probe window is one 64-byte cache line of slots
+	probeWindow = 8
+
+	fpBits    = 20
+	tokenBits = 20
+	timeBits  = 24
+
+	tokenMax = 1<<tokenBits - 1
+	timeMask = 1<<timeBits - 1
+
+	// CAS retries before giving up on a contended window
+	maxAttempts = 4
+)
+
+// newBucketTable returns a table of size slots, rounded up to a power
+// of two and at least one probe window.
+func newBucketTable(size int) *bucketTable {
+	n := probeWindow
+	for n < size {
+		n <<= 1
+	}
+	return &bucketTable{
+		slots: make([]atomic.Uint64, n),
+		mask:  uint64(n - 1),
+	}
+}
+
+func packSlot(fp uint64, tokens int64, ts uint32) uint64 {
+	return fp<<(tokenBits+timeBits) | uint64(tokens)<<timeBits | uint64(ts&timeMask)
+}
+
+func unpackSlot(s uint64) (fp uint64, tokens int64, ts uint32) {
+	return s >> (tokenBits + timeBits), int64(s>>timeBits) & tokenMax, uint32(s) & timeMask
+}
+
+// take consumes a token from the bucket for hash, refilling it first at
+// rate tokens per second up to burst. now is in seconds on any clock
+// that wraps at 2^24. A bucket seen for the first time starts full.
+func (t *bucketTable) take(hash uint64, now uint32, rate, burst int64) bool {
+	if burst > tokenMax {
+		burst = tokenMax
+	} else if burst < 1 {
+		burst = 1
+	}
+	fp := hash >> (64 - fpBits)
+	if fp == 0 {
+		fp = 1 // Zero marks a free slot
+	}
+	base := hash & t.mask &^ (probeWindow - 1)
+	line := t.slots[base : base+probeWindow]
+
+retry:
+	for attempt := 0; attempt < maxAttempts; attempt++ {
+		victim, victimScore := 0, int64(-1)
+		var victimOld uint64
+
+		for i := range line {
+			s := line[i].Load()
+			if s == 0 {
+				if victimScore < 1<<62 {
+					victim, victimScore, victimOld = i, 1<<62, 0
+				}
+				continue
+			}
+			sfp, tokens, ts := unpackSlot(s)
+			age := int64((now - ts) & timeMask)
+			tokens += age * rate
+			if tokens > burst {
+				tokens = burst
+			}
+
+			if sfp == fp {
+				allowed := tokens > 0
+				if allowed {
+					tokens--
+				}
+				if age > 0 {
+					ts = now
+				}
+				if line[i].CompareAndSwap(s, packSlot(fp, tokens, ts)) {
+					return allowed
+				}
+				continue retry
+			}
+
+			// A full bucket is the same as no bucket, so it goes first;
+			// then the one idle longest, then the one limiting least.
+			// Churn can't cheaply flush a bucket that is holding a
+			// client back.
+			score := age<<(tokenBits+1) | tokens
+			if tokens == burst {
+				score += 1 << 50
+			}
+			if score > victimScore {
+				victim, victimScore, victimOld = i, score, s
+			}
+		}
+
+		if line[victim].CompareAndSwap(victimOld, packSlot(fp, burst-1, now)) {
+			if victimOld != 0 {
+				t.evicted.Add(1)
+			}
+			return true
+		}
+	}
+	// Contended past the retry limit: answer as a fresh bucket would
+	return true
+}
@@ -0,0 +1,66 @@
+package rrl
+
+import (
+	"net"
+	"testing"
+)
+
+func TestBucketTable_FixedMemory(t *testing.T) {
+	tbl := newBucketTable(1000)
+	if len(tbl.slots) != 1024 {
+		t.Fatalf("slots = %d, want 1024", len(tbl.slots))
+	}
+
+	// A flood of distinct tuples evicts instead of growing
+	for i := uint64(0); i < 100000; i++ {
+		if !tbl.take(i*0x9e3779b97f4a7c15, 0, 5, 10) {
+			t.Fatal("a new bucket must start with tokens")
+		}
+	}
+	if len(tbl.slots) != 1024 {
+		t.Errorf("slots = %d after the flood, want 1024", len(tbl.slots))
+	}
+	if ev := tbl.evicted.Load(); ev < 100000-1024 {
+		t.Errorf("evicted = %d, want at least %d", ev, 100000-1024)
+	}
+}
+
+func TestBucketTable_LimitedBucketSurvivesChurn(t *testing.T) {
+	tbl := newBucketTable(probeWindow)
+	const hot = 0xdeadbeef << 32
+
+	// Exhaust the hot bucket
+	for i := 0; i < 3; i++ {
+		tbl.take(hot, 0, 1, 2)
+	}
+	// Churn the same window within the same second
+	for i := uint64(1); i < 1000; i++ {
+		tbl.take(i*0x9e3779b97f4a7c15, 0, 1, 2)
+	}
+	if tbl.take(hot, 0, 1, 2) {
+		t.Error("churn reset a limited bucket")
+	}
+
+	// Lazy refill: one token per second, capped at burst
+	if !tbl.take(hot, 1, 1, 2) || tbl.take(hot, 1, 1, 2) {
+		t.Error("refill after one second should give exactly one token")
+	}
+	if !tbl.take(hot, 100, 1, 2) || !tbl.take(hot, 100, 1, 2) || tbl.take(hot, 100, 1, 2) {
+		t.Error("refill should be capped at burst")
+	}
+}
+
+func TestCheck_NoAllocs(t *testing.T) {
+	cfg := DefaultConfig()
+	limiter := NewLimiter(cfg)
+	defer limiter.Close()
+
+	v4, v6 := net.ParseIP("192.0.2.1"), net.ParseIP("2001:db8::1")
+	allocs := testing.AllocsPerRun(100, func() {
+		limiter.Check(v4, "example.com", 1, CategoryResponse)
+		limiter.Check(v6, "example.com", 1, CategoryResponse)
+	})
+	if allocs != 0 {
+		t.Errorf("Check allocates %.0f times", allocs)
+	}
+}
@@ -2,6 +2,7 @@ package server
 
 import (
 	"context"
+	"encoding/hex"
 	"fmt"
 	"net"
 	"runtime"
@@ -9,6 +10,7 @@ import (
 	"sync/atomic"
 	"time"
 
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
 	"github.com/dnsscience/dnsscienced/internal/cache"
 	"github.com/dnsscience/dnsscienced/internal/cookie"
 	"github.com/dnsscience/dnsscienced/internal/pool"
@@ -100,6 +102,9 @@ type Server struct {
 	cookies   *cookie.Manager
 	rrl       *rrl.Limiter
 
+	// Closest-enclosing-zone index over cfg.Zones
+	zoneIndex atomic.Pointer[zoneIndex]
+
 	// DNS servers (one per listener for SO_REUSEPORT)
 	udpServers []*dns.Server
 	tcpServer  *dns.Server
@@ -116,6 +121,14 @@ type Server struct {
 	wg     sync.WaitGroup
 }
 
+// zoneIndex maps a query name to its closest enclosing zone in one
+// walk over the name's labels. It is rebuilt whenever the zone set
+// changes and swapped in whole, so lookups never see a partial update.
+type zoneIndex struct {
+	trie  *dnsasm.SuffixTrie
+	zones []*zone.Zone // Indexed by trie value
+}
+
 // New creates a new DNS server
 func New(cfg Config) (*Server, error) {
 	ctx, cancel := context.WithCancel(context.Background())
@@ -151,6 +164,11 @@ func New(cfg Config) (*Server, error) {
 		s.rrl = rrl.NewLimiter(cfg.RRLConfig)
 	}
 
+	if err := s.indexZones(); err != nil {
+		cancel()
+		return nil, fmt.Errorf("index zones: %w", err)
+	}
+
 	// Create UDP servers (SO_REUSEPORT)
 	for i := 0; i < cfg.UDPListeners; i++ {
 		udpServer := &dns.Server{
@@ -279,46 +297,37 @@ func (s *Server) handleDNS(w dns.ResponseWriter, r *dns.Msg) {
 
 	// Check DNS cookies if enabled
 	if s.cfg.EnableCookies && s.cookies != nil {
-		// Extract cookies from request
-		var clientCookie [8]byte
-		var serverCookie [8]byte
-
-		opt := r.IsEdns0()
-		if opt != nil {
-			for _, option := range opt.Option {
-				if cookie, ok := option.(*dns.EDNS0_COOKIE); ok {
-					copy(clientCookie[:], cookie.Cookie[:8])
-					if len(cookie.Cookie) >= 16 {
-						copy(serverCookie[:], cookie.Cookie[8:16])
-					}
+		// Extract the COOKIE option; miekg/dns carries it hex-encoded
+		var option []byte
+		if opt := r.IsEdns0(); opt != nil {
+			for _, o := range opt.Option {
+				if c, ok := o.(*dns.EDNS0_COOKIE); ok {
+					option, _ = hex.DecodeString(c.Cookie)
 					break
 				}
 			}
 		}
 
-		// Validate if we have a server cookie
-		valid := false
-		if serverCookie != [8]byte{} {
-			valid = s.cookies.ValidateServerCookie(clientCookie, serverCookie, clientIP) == nil
-		}
-
-		if !valid && s.cfg.CookieConfig.RequireValid && serverCookie != [8]byte{} {
-			// Send BADCOOKIE response
-			m.Rcode = dns.RcodeBadCookie
-
-			// Generate new server cookie
-			newServerCookie, _ := s.cookies.GenerateServerCookie(clientCookie, clientIP)
-			s.addCookieToResponse(m, clientCookie, newServerCookie)
+		if option != nil {
+			status, serverCookie := s.cookies.Check(option, clientIP)
+			switch {
+			case status == dnsasm.CookieFormErr:
+				m.Rcode = dns.RcodeFormatError
+				s.errors.Add(1)
+				w.WriteMsg(m)
+				return
 
-			s.errors.Add(1)
-			w.WriteMsg(m)
-			return
-		}
+			case status != dnsasm.CookieClient && !status.Good() && s.cfg.CookieConfig.RequireValid:
+				// Send BADCOOKIE response with a fresh server cookie
+				m.Rcode = dns.RcodeBadCookie
+				s.addCookieToResponse(m, option[:8], serverCookie)
+				s.errors.Add(1)
+				w.WriteMsg(m)
+				return
+			}
 
-		// Add cookies to response
-		if clientCookie != [8]byte{} {
-			newServerCookie, _ := s.cookies.GenerateServerCookie(clientCookie, clientIP)
-			s.addCookieToResponse(m, clientCookie, newServerCookie)
+			// Echo a valid cookie, or hand out a fresh one
+			s.addCookieToResponse(m, option[:8], serverCookie)
 		}
 	}
 
@@ -389,22 +398,23 @@ func (s *Server) handleAuthoritative(r *dns.Msg, clientIP net.IP) (*dns.Msg, boo
 	qname := question.Name
 	qtype := question.Qtype
 
-	// Find matching zone
-	var matchedZone *zone.Zone
-	matchedName := ""
-
-	for zoneName, z := range s.cfg.Zones {
-		if dns.IsSubDomain(zoneName, qname) {
-			if len(zoneName) > len(matchedName) {
-				matchedZone = z
-				matchedName = zoneName
-			}
-		}
+	// Find the closest enclosing zone
+	idx := s.zoneIndex.Load()
+	if idx == nil {
+		return nil, false
 	}
-
-	if matchedZone == nil {
+	wire := pool.GetSmallBuffer()
+	n, err := dns.PackDomainName(qname, wire, 0, nil, false)
+	if err != nil {
+		pool.PutSmallBuffer(wire)
 		return nil, false
 	}
+	i, _, found := idx.trie.Match(wire[:n])
+	pool.PutSmallBuffer(wire)
+	if !found {
+		return nil, false
+	}
+	matchedZone := idx.zones[i]
 
 	// Build response
 	m := pool.GetMessage()
@@ -519,7 +529,9 @@ func (s *Server) LoadZone(filename, format string) error {
 	}
 
 	// Add to server
-	s.cfg.Zones[z.Origin] = z
+	if err := s.putZone(z); err != nil {
+		return err
+	}
 
 	fmt.Printf("Loaded zone: %s (%d records)\n", z.Name, z.GetStats().Records)
 
@@ -536,13 +548,60 @@ func (s *Server) AddZone(z *zone.Zone) error {
 		return fmt.Errorf("zone validation failed: %w", err)
 	}
 
+	return s.putZone(z)
+}
+
+// putZone adds or replaces a zone and reindexes
+func (s *Server) putZone(z *zone.Zone) error {
+	old, had := s.cfg.Zones[z.Origin]
 	s.cfg.Zones[z.Origin] = z
+	if err := s.indexZones(); err != nil {
+		if had {
+			s.cfg.Zones[z.Origin] = old
+		} else {
+			delete(s.cfg.Zones, z.Origin)
+		}
+		return err
+	}
 	return nil
 }
 
-// RemoveZone removes a zone from the server
-func (s *Server) RemoveZone(origin string) {
+// RemoveZone removes a zone from the server and reindexes; the zone
+// stays if the index cannot be rebuilt
+func (s *Server) RemoveZone(origin string) error {
+	old, had := s.cfg.Zones[origin]
+	if !had {
+		return nil
+	}
 	delete(s.cfg.Zones, origin)
+	if err := s.indexZones(); err != nil {
+		s.cfg.Zones[origin] = old
+		return err
+	}
+	return nil
+}
+
+// indexZones rebuilds the zone index from cfg.Zones
+func (s *Server) indexZones() error {
+	idx := &zoneIndex{zones: make([]*zone.Zone, 0, len(s.cfg.Zones))}
+	names := make([][]byte, 0, len(s.cfg.Zones))
+	for origin, z := range s.cfg.Zones {
+		wire := make([]byte, 256)
+		n, err := dns.PackDomainName(dns.Fqdn(origin), wire, 0, nil, false)
+		if err != nil {
+			return fmt.Errorf("zone %s: %w", origin, err)
+		}
+		names = append(names, wire[:n])
+		idx.zones = append(idx.zones, z)
+	}
+
+	trie, err := dnsasm.BuildSuffixTrie(names, nil)
+	if err != nil {
+		return err
+	}
+	idx.trie = trie
+	s.zoneIndex.Store(idx)
+	return nil
 }
 
 // GetZone returns a zone by origin
@@ -551,7 +610,7 @@ func (s *Server) GetZone(origin string) *zone.Zone {
 }
 
 // addCookieToResponse adds DNS cookie to response
-func (s *Server) addCookieToResponse(m *dns.Msg, clientCookie, serverCookie [8]byte) {
+func (s *Server) addCookieToResponse(m *dns.Msg, clientCookie []byte, serverCookie [16]byte) {
 	opt := m.IsEdns0()
 	if opt == nil {
 		opt = &dns.OPT{
@@ -565,12 +624,12 @@ func (s *Server) addCookieToResponse(m *dns.Msg, clientCookie, serverCookie [8]b
 	}
 
 	// Combine client and server cookies
-	fullCookie := make([]byte, 16)
-	copy(fullCookie[0:8], clientCookie[:])
-	copy(fullCookie[8:16], serverCookie[:])
+	fullCookie := make([]byte, 0, 24)
+	fullCookie = append(fullCookie, clientCookie...)
+	fullCookie = append(fullCookie, serverCookie[:]...)
 
 	opt.Option = append(opt.Option, &dns.EDNS0_COOKIE{
 		Code:   dns.EDNS0COOKIE,
-		Cookie: string(fullCookie),
+		Cookie: hex.EncodeToString(fullCookie),
 	})
 }
@@ -0,0 +1,94 @@
+package transport
+
+import (
+	"net"
+	"os"
+	"sync"
+
+	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
+)
+
+// batchListener is a net.Listener over a libdnsasm TCP listener: one
+// Accept call into C collects every connection that is ready (from a
+// multishot io_uring accept where the kernel has it), and the rest are
+// handed out without going back to the kernel. Accepted connections are
+// ordinary net.Conns on Go's poller.
+type batchListener struct {
+	l    *dnsasm.Listener
+	addr net.Addr
+
+	mu      sync.Mutex // Serializes Accept; Close waits for it
+	fds     []int
+	pending []int
+	closed  bool
+	once    sync.Once
+}
+
+// batchAcceptMax is how many connections one Accept call into C takes.
+const batchAcceptMax = 64
+
+func listenBatched(address string, uring bool) (*batchListener, error) {
+	addr, err := net.ResolveTCPAddr("tcp", address)
+	if err != nil {
+		return nil, err
+	}
+	l, err := dnsasm.ListenTCP(addr.AddrPort(), dnsasm.IOConfig{URing: uring})
+	if err != nil {
+		return nil, &net.OpError{Op: "listen", Net: "tcp", Addr: addr, Err: err}
+	}
+	return &batchListener{
+		l:    l,
+		addr: &net.TCPAddr{IP: addr.IP, Port: l.Port(), Zone: addr.Zone},
+		fds:  make([]int, batchAcceptMax),
+	}, nil
+}
+
+// Accept returns the next connection, waiting for a batch if none is
+// left from the last one.
+func (b *batchListener) Accept() (net.Conn, error) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+
+	for len(b.pending) == 0 {
+		if b.closed {
+			return nil, net.ErrClosed
+		}
+		n, err := b.l.Accept(b.fds)
+		if err == dnsasm.ErrIOShutdown {
+			return nil, net.ErrClosed
+		}
+		if err != nil {
+			return nil, &net.OpError{Op: "accept", Net: "tcp", Addr: b.addr, Err: err}
+		}
+		b.pending = b.fds[:n]
+	}
+
+	fd := b.pending[0]
+	b.pending = b.pending[1:]
+	f := os.NewFile(uintptr(fd), "")
+	conn, err := net.FileConn(f) // Dups the descriptor onto the poller
+	f.Close()
+	return conn, err
+}
+
+// Close wakes a pending Accept, then closes the socket and any
+// connection accepted but not handed out.
+func (b *batchListener) Close() error {
+	b.once.Do(func() {
+		b.l.Shutdown()
+		b.mu.Lock()
+		defer b.mu.Unlock()
+		for _, fd := range b.pending {
+			f := os.NewFile(uintptr(fd), "")
+			f.Close()
+		}
+		b.pending = nil
+		b.closed = true
+		b.l.Close()
+	})
+	return nil
+}
+
+func (b *batchListener) Addr() net.Addr {
+	return b.addr
+}
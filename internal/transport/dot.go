@@ -34,6 +34,7 @@ type DoTListener struct {
 	listener net.Listener
 	handler  Handler
 	running  bool
+	uring    bool
 	wg       sync.WaitGroup
 }
 
@@ -44,6 +45,7 @@ type DoTConfig struct {
 	CertFile  string        // Path to TLS certificate (if TLSConfig not provided)
 	KeyFile   string        // Path to TLS private key (if TLSConfig not provided)
 	Timeout   time.Duration // Connection timeout
+	IOUring   bool          // Accept in batches via io_uring (Linux 6.0+, else accept4)
 }
 
 // NewDoTListener creates a new DNS-over-TLS listener.
@@ -75,6 +77,7 @@ func NewDoTListener(cfg DoTConfig, handler Handler) (*DoTListener, error) {
 		addr:    cfg.Address,
 		config:  tlsConfig,
 		handler: handler,
+		uring:   cfg.IOUring,
 	}, nil
 }
 
@@ -87,9 +90,20 @@ func (l *DoTListener) Start() error {
 		return fmt.Errorf("listener already running")
 	}
 
-	listener, err := tls.Listen("tcp", l.addr, l.config)
-	if err != nil {
-		return fmt.Errorf("failed to start TLS listener: %w", err)
+	var listener net.Listener
+	if l.uring {
+		// Only accepting is batched; TLS and the connections stay in Go
+		bl, err := listenBatched(l.addr, true)
+		if err != nil {
+			return fmt.Errorf("failed to start TLS listener: %w", err)
+		}
+		listener = tls.NewListener(bl, l.config)
+	} else {
+		var err error
+		listener, err = tls.Listen("tcp", l.addr, l.config)
+		if err != nil {
+			return fmt.Errorf("failed to start TLS listener: %w", err)
+		}
 	}
 
 	l.listener = listener
@@ -2,11 +2,18 @@ package transport
 
 import (
 	"context"
+	"encoding/binary"
+	"fmt"
 	"net"
+	"net/netip"
+	"sync"
 	"sync/atomic"
+	"time"
 
 	dnsasm "github.com/dnsscience/dnsscienced/dnsasm/go"
+	"github.com/dnsscience/dnsscienced/internal/cookie"
 	"github.com/dnsscience/dnsscienced/internal/engine"
+	"github.com/dnsscience/dnsscienced/internal/pool"
 	"github.com/miekg/dns"
 )
 
@@ -19,23 +26,89 @@ type FastUDPServer struct {
 	workerPool int // Number of generic listeners is handled by OS via SO_REUSEPORT
 	done       chan struct{}
 
+	// Interned query names, shared by all readers
+	names *dnsasm.NameCache
+
+	// Server cookies for cookie-only requests (RFC 7873 5.4); the
+	// server's own secret is rotated while it runs
+	cookies       *cookie.Manager
+	rotateCookies bool
+
+	// Batched I/O (SetBatch, SetIOUring): one libdnsasm socket per worker
+	batch    dnsasm.IOConfig
+	uring    bool
+	ios      []*dnsasm.IO
+	ioMu     sync.Mutex // Guards ios against Stop while Stats reads them
+	ioTotals dnsasm.IOCounters
+	wg       sync.WaitGroup
+
 	// Statistics (Atomic)
 	packetsRecv   uint64
 	packetsSent   uint64
 	packErrors    uint64
 	backendErrors uint64
+	slowPath      uint64
+	recvErrors    uint64
 
 	// Stats mutex removed in favor of atomics
 }
 
+// fastNameCacheSize is the number of interned query names; popular names
+// resolve to the same string without allocating.
+const fastNameCacheSize = 4096
+
 // NewFastUDPServer creates a new optimized UDP server
-func NewFastUDPServer(addr string, resolver *engine.Resolver, workers int) *FastUDPServer {
-	return &FastUDPServer{
-		addr:       addr,
-		resolver:   resolver,
-		workerPool: workers,
-		done:       make(chan struct{}),
+func NewFastUDPServer(addr string, resolver *engine.Resolver, workers int) (*FastUDPServer, error) {
+	cookies, err := cookie.NewManager(cookie.Config{Enabled: true})
+	if err != nil {
+		return nil, fmt.Errorf("init cookies: %w", err)
 	}
+	return &FastUDPServer{
+		addr:          addr,
+		resolver:      resolver,
+		workerPool:    workers,
+		done:          make(chan struct{}),
+		names:         dnsasm.NewNameCache(fastNameCacheSize),
+		cookies:       cookies,
+		rotateCookies: true,
+	}, nil
+}
+
+// SetBatch makes Start give every worker its own SO_REUSEPORT socket,
+// read with recvmmsg and answered with sendmmsg by libdnsasm, size
+// datagrams at a time (at most 64). A worker waits up to timeout for
+// the first datagram of a batch, or indefinitely if it is 0; Stop wakes
+// it either way on Linux. Answers that need the resolver hold up the
+// rest of their batch, so this suits cache-heavy traffic. Call before
+// Start; size 0 restores the single shared socket unless SetIOUring is
+// on.
+func (s *FastUDPServer) SetBatch(size int, timeout time.Duration) {
+	s.batch.Batch = size
+	s.batch.Timeout = timeout
+}
+
+// SetIOUring runs the batched sockets on io_uring: a multishot receive
+// into kernel-selected buffers and answers submitted with the next
+// wait, so a busy worker mostly skips the system calls altogether.
+// Turning it on implies batching (64 datagrams unless SetBatch says
+// otherwise). Kernels before 6.0 keep recvmmsg; the io_uring_sockets
+// stat counts the sockets that got it. Call before Start.
+func (s *FastUDPServer) SetIOUring(on bool) {
+	s.uring = on
+}
+
+// SetCookies replaces the server's own random cookie secret with m's,
+// so cookies it hands out hold across a cluster sharing the secret.
+// The server does not rotate m; that is up to its owner. Call before
+// Start.
+func (s *FastUDPServer) SetCookies(m *cookie.Manager) {
+	s.cookies = m
+	s.rotateCookies = false
+}
+
+// batched reports whether Start opens per-worker libdnsasm sockets.
+func (s *FastUDPServer) batched() bool {
+	return s.batch.Batch > 0 || s.uring
 }
 
 // Start spawns multiple listeners (SO_REUSEPORT must be enabled in listener config if multiple processes,
@@ -50,7 +123,28 @@ func (s *FastUDPServer) Start() error {
 	if err != nil {
 		return err
 	}
+	if s.batched() {
+		err = s.startBatch(addr.AddrPort())
+	} else {
+		err = s.startShared(addr)
+	}
+	if err != nil {
+		return err
+	}
+
+	if s.rotateCookies {
+		// Stop ends the rotation along with the workers
+		s.wg.Add(1)
+		go func() {
+			defer s.wg.Done()
+			s.cookies.RotateSecretPeriodically(s.done)
+		}()
+	}
+	return nil
+}
 
+// startShared opens the single socket all workers read from.
+func (s *FastUDPServer) startShared(addr *net.UDPAddr) error {
 	conn, err := net.ListenUDP("udp", addr)
 	if err != nil {
 		return err
@@ -72,21 +166,116 @@ func (s *FastUDPServer) Start() error {
 	return nil
 }
 
+// startBatch opens the per-worker sockets, all on the port the first
+// one gets when addr asks for an ephemeral port.
+func (s *FastUDPServer) startBatch(addr netip.AddrPort) error {
+	cfg := s.batch
+	cfg.SockBuf = 4 * 1024 * 1024
+	cfg.ReusePort = true
+	cfg.URing = s.uring
+
+	ios := make([]*dnsasm.IO, 0, s.workerPool)
+	for i := 0; i < s.workerPool; i++ {
+		io, err := dnsasm.OpenIO(addr, cfg)
+		if err != nil {
+			for _, io := range ios {
+				io.Close()
+			}
+			return err
+		}
+		if addr.Port() == 0 {
+			addr = netip.AddrPortFrom(addr.Addr(), uint16(io.Port()))
+		}
+		ios = append(ios, io)
+	}
+
+	s.ioMu.Lock()
+	s.ios = ios
+	s.ioMu.Unlock()
+	for _, io := range ios {
+		s.wg.Add(1)
+		go s.batchWorker(io)
+	}
+	return nil
+}
+
 func (s *FastUDPServer) Stop() {
 	close(s.done)
 	if s.conn != nil {
 		s.conn.Close()
 	}
+
+	// Batch workers exit once their socket is shut down; close the
+	// sockets only after that, keeping their totals for Stats
+	s.ioMu.Lock()
+	defer s.ioMu.Unlock()
+	for _, io := range s.ios {
+		io.Shutdown()
+	}
+	s.wg.Wait()
+	for _, io := range s.ios {
+		addIOCounters(&s.ioTotals, io.Counters())
+		io.Close()
+	}
+	s.ios = nil
+}
+
+func addIOCounters(dst *dnsasm.IOCounters, c dnsasm.IOCounters) {
+	dst.RecvCalls += c.RecvCalls
+	dst.Received += c.Received
+	dst.Truncated += c.Truncated
+	dst.SendCalls += c.SendCalls
+	dst.Sent += c.Sent
+	dst.SendErrors += c.SendErrors
 }
 
-// Stats returns current statistics safely
+// Stats returns current statistics safely. With a libdnsasm built with
+// STATS=1, err_fmt is broken down by parser error and the compression
+// pointer hops are reported too; the counters are process-wide. Batched
+// servers add their system call counts; with SetBatch "sent" counts
+// answers queued, "io_sent" those the kernel took. io_uring_sockets is
+// how many live sockets run on io_uring.
 func (s *FastUDPServer) Stats() map[string]uint64 {
-	return map[string]uint64{
-		"recv":    atomic.LoadUint64(&s.packetsRecv),
-		"sent":    atomic.LoadUint64(&s.packetsSent),
-		"err_fmt": atomic.LoadUint64(&s.packErrors),
-		"err_res": atomic.LoadUint64(&s.backendErrors),
+	stats := map[string]uint64{
+		"recv":     atomic.LoadUint64(&s.packetsRecv),
+		"sent":     atomic.LoadUint64(&s.packetsSent),
+		"err_fmt":  atomic.LoadUint64(&s.packErrors),
+		"err_res":  atomic.LoadUint64(&s.backendErrors),
+		"slow":     atomic.LoadUint64(&s.slowPath),
+		"err_recv": atomic.LoadUint64(&s.recvErrors),
+	}
+	if dnsasm.StatsEnabled() {
+		var st dnsasm.Stats
+		dnsasm.ReadStats(&st)
+		stats["asm_err_short"] = st.ErrorCount(dnsasm.ErrShort)
+		stats["asm_err_name"] = st.ErrorCount(dnsasm.ErrName)
+		stats["asm_err_pointer"] = st.ErrorCount(dnsasm.ErrPointer)
+		stats["asm_err_loop"] = st.ErrorCount(dnsasm.ErrLoop)
+		stats["asm_err_overflow"] = st.ErrorCount(dnsasm.ErrOverflow)
+		stats["asm_err_edns"] = st.ErrorCount(dnsasm.ErrEDNS)
+		stats["asm_names"] = st.Names
+		stats["asm_pointer_hops"] = st.PointerHops
+	}
+
+	s.ioMu.Lock()
+	io := s.ioTotals
+	uring := 0
+	for _, h := range s.ios {
+		addIOCounters(&io, h.Counters())
+		if h.Backend() == "io_uring" {
+			uring++
+		}
 	}
+	s.ioMu.Unlock()
+	if s.batched() {
+		stats["io_uring_sockets"] = uint64(uring)
+		stats["io_recv_calls"] = io.RecvCalls
+		stats["io_send_calls"] = io.SendCalls
+		stats["io_truncated"] = io.Truncated
+		stats["io_sent"] = io.Sent
+		stats["io_send_errors"] = io.SendErrors
+	}
+	return stats
 }
 
 func (s *FastUDPServer) worker() {
@@ -113,100 +302,234 @@ func (s *FastUDPServer) worker() {
 
 		// Process packet synchronously in worker to avoid goroutine churn
 		// "Zero-Copy": pass slice of buffer.
-		s.handlePacket(ctx, buf[:n], addr)
+		var qc dnsasm.QueryClass
+		dnsasm.ClassifyQuery(buf[:n], &qc)
+		s.handlePacket(ctx, buf[:n], &qc, nil, replyTo{addr: addr})
 	}
 }
 
-func (s *FastUDPServer) handlePacket(ctx context.Context, packet []byte, addr *net.UDPAddr) {
-	// 1. Fast parse header using DNSASM (Assembly optimized)
-	// Returns parsed header struct
-	header, err := dnsasm.ParseHeader(packet)
-	if err != nil {
+// maxRecvBackoff caps the pause of a batch worker whose socket keeps
+// failing, e.g. with ENOMEM or ENOBUFS.
+const maxRecvBackoff = time.Second
+
+// batchWorker serves one batched socket: each Recv sends the answers
+// queued for the previous batch and takes the next one, which is
+// classified and parsed with a single dnsasm call.
+func (s *FastUDPServer) batchWorker(io *dnsasm.IO) {
+	defer s.wg.Done()
+	ctx := context.Background()
+
+	var qc [dnsasm.BatchMax]dnsasm.QueryClass
+	var batch dnsasm.Batch
+
+	var backoff time.Duration
+	for {
+		n, err := io.Recv()
+		if err == dnsasm.ErrIOShutdown {
+			return
+		}
+		if err != nil {
+			// Count it and wait, doubling the pause while errors
+			// persist, instead of spinning on the failing call
+			atomic.AddUint64(&s.recvErrors, 1)
+			backoff = min(max(2*backoff, time.Millisecond), maxRecvBackoff)
+			select {
+			case <-s.done:
+				return
+			case <-time.After(backoff):
+			}
+			continue
+		}
+		backoff = 0
+
+		atomic.AddUint64(&s.packetsRecv, uint64(n))
+		io.Classify(qc[:], &batch)
+		for i := 0; i < n; i++ {
+			// The packet lives in the receive ring until the next Recv
+			packet := io.Packet(i)
+			var qname []byte
+			if batch.Err(i) == nil {
+				qname = batch.QName(packet, i)
+			}
+			s.handlePacket(ctx, packet, &qc[i], qname, replyTo{io: io, slot: i})
+		}
+	}
+}
+
+// replyTo is where an answer goes: back through the shared socket, or
+// into the send queue of a batched one for the sender of a slot.
+type replyTo struct {
+	addr *net.UDPAddr
+	io   *dnsasm.IO
+	slot int
+}
+
+// peer is the address the request came from.
+func (to replyTo) peer() netip.Addr {
+	if to.io != nil {
+		return to.io.Peer(to.slot).Addr()
+	}
+	return to.addr.AddrPort().Addr().Unmap()
+}
+
+func (s *FastUDPServer) send(to replyTo, resp []byte) error {
+	if to.io != nil {
+		return to.io.Queue(to.slot, resp)
+	}
+	_, err := s.conn.WriteToUDP(resp, to.addr)
+	return err
+}
+
+// handlePacket answers one request. qc is its classification and qname
+// its question name in wire format when a batch parse already found it
+// uncompressed, else nil.
+func (s *FastUDPServer) handlePacket(ctx context.Context, packet []byte, qc *dnsasm.QueryClass, qname []byte, to replyTo) {
+	// 1. Route on the classifier's verdict. Malformed packets are answered
+	// or dropped here, so floods of them never reach miekg/dns.
+	switch qc.Action() {
+	case dnsasm.ClassDrop:
+		// Responses are dropped silently; only runts count as errors
+		if qc.Verdict&dnsasm.ClassShort != 0 {
+			atomic.AddUint64(&s.packErrors, 1)
+		}
+		return
+	case dnsasm.ClassFormErr:
 		atomic.AddUint64(&s.packErrors, 1)
+		s.sendError(packet, qc, dnsasm.RCodeFormErr, to)
+		return
+	case dnsasm.ClassNotImp:
+		s.sendError(packet, qc, dnsasm.RCodeNotImp, to)
 		return
+	case dnsasm.ClassSlow:
+		if qc.Verdict&dnsasm.ClassBadVers != 0 {
+			// RFC 6891 6.1.3: we only speak EDNS version 0
+			s.sendError(packet, qc, dns.RcodeBadVers, to)
+			return
+		}
+		atomic.AddUint64(&s.slowPath, 1)
+		s.handleSlowPacket(ctx, packet, qc, to)
+		return
+	}
+
+	// 2. Fast path: plain QUERY with one question, already validated.
+	// Only the name still needs decompressing for the resolver, unless the
+	// batch parse has it in place.
+	var name string
+	if qname != nil {
+		name = s.names.String(qname)
+	} else {
+		var question dnsasm.Question
+		var wire dnsasm.WireName
+		_, _, err := dnsasm.ParseQuestionInto(packet, 12, &question, &wire, s.names) // Header is always 12 bytes
+		if err != nil {
+			s.sendError(packet, qc, dnsasm.RCodeFormErr, to)
+			return
+		}
+		name = question.Name
 	}
 
-	// Only process queries
-	if header.QR {
+	s.resolveAndSend(ctx, packet, qc, name, qc.QType, qc.QClass,
+		udpLimit(qc.EDNS.Present, qc.EDNS.UDPSize), qc.EDNS.Present, to)
+}
+
+// handleSlowPacket takes legal but unusual requests (multiple questions,
+// records in answer/authority, TSIG, trailing bytes) through miekg/dns.
+// NOTIFY and UPDATE, which nothing here serves, get NOTIMP, and a
+// cookie-only request gets a server cookie.
+func (s *FastUDPServer) handleSlowPacket(ctx context.Context, packet []byte, qc *dnsasm.QueryClass, to replyTo) {
+	if qc.Verdict&dnsasm.ClassOpcode != 0 {
+		s.sendError(packet, qc, dnsasm.RCodeNotImp, to)
+		return
+	}
+	if qc.Verdict&dnsasm.ClassNoQD != 0 {
+		// The classifier only lets these through with a COOKIE option
+		s.sendCookie(packet, qc, to)
 		return
 	}
 
-	// 2. Parse Question
-	// dnsasm.ParseQuestion parses the question section and returns the Question struct and new offset
-	question, offset, err := dnsasm.ParseQuestion(packet, 12) // Header is always 12 bytes
-	if err != nil {
-		s.sendFormatError(packet, header.ID, addr)
+	req := new(dns.Msg)
+	if err := req.Unpack(packet); err != nil || len(req.Question) == 0 {
+		atomic.AddUint64(&s.packErrors, 1)
+		s.sendError(packet, qc, dnsasm.RCodeFormErr, to)
 		return
 	}
 
-	// 3. Fast Check for EDNS0 (Opt Record)
-	// We avoid miekg/dns.Unpack here.
-	hasEDNS0 := false
-
-	// If Additional Records exist, scan for OPT (Type 41)
-	// We assume standard query structure: Header + Question + [Authority] + [Additional]
-	// If ANCount or NSCount > 0, we might strictly need to skip them, but usually they are 0 for queries.
-	if header.ARCount > 0 && header.ANCount == 0 && header.NSCount == 0 {
-		// Scan from 'offset'
-		// OPT record Name is usually root (0).
-		// We peek at the next bytes.
-		current := offset
-		if current < len(packet) {
-			// Simple scanner: expect root label (0)
-			if packet[current] == 0 {
-				current++
-				// Next 2 bytes are Type
-				if current+2 <= len(packet) {
-					// OPT is type 41 (0x0029)
-					// Big endian check
-					if packet[current] == 0x00 && packet[current+1] == 0x29 {
-						hasEDNS0 = true
-					}
-				}
-			}
-			// If not root, it might be TSIG or something else. We assume standard EDNS Opt is first
-		}
-	} else if (header.ANCount > 0 || header.NSCount > 0) && header.ARCount > 0 {
-		// Fallback to slow path if structure is complex (rare for queries)
-		dnsReq := new(dns.Msg)
-		if err := dnsReq.Unpack(packet); err == nil {
-			if dnsReq.IsEdns0() != nil {
-				hasEDNS0 = true
-			}
-		}
+	opt := req.IsEdns0()
+	limit := udpLimit(false, 0)
+	if opt != nil {
+		limit = udpLimit(true, opt.UDPSize())
 	}
+	q := req.Question[0]
+	s.resolveAndSend(ctx, packet, qc, q.Name, q.Qtype, q.Qclass, limit, opt != nil, to)
+}
+
+// maxUDPPayload caps UDP answers even for clients advertising more, so
+// responses are never fragmented on the path (DNS Flag Day 2020).
+const maxUDPPayload = 1232
+
+// udpLimit is the largest UDP answer a client may be sent: 512 bytes
+// without EDNS, else its advertised payload size within [512, 1232].
+func udpLimit(hasEDNS0 bool, size uint16) int {
+	switch {
+	case !hasEDNS0 || size < 512:
+		return 512
+	case size > maxUDPPayload:
+		return maxUDPPayload
+	}
+	return int(size)
+}
 
+// resolveAndSend resolves one question and writes the answer back under
+// the ID and question casing of query, truncated to limit bytes.
+func (s *FastUDPServer) resolveAndSend(ctx context.Context, query []byte, qc *dnsasm.QueryClass, name string, qtype, qclass uint16, limit int, hasEDNS0 bool, to replyTo) {
 	// 4. Resolve using Resolver.ResolveRaw (Zero-Copy-ish)
 	result, err := s.resolver.ResolveRaw(
 		ctx,
-		question.Name, // Pre-parsed string from dnsasm
-		question.Type,
-		question.Class,
+		name, // Pre-parsed string from dnsasm
+		qtype,
+		qclass,
 		hasEDNS0,
 	)
 
 	if err != nil {
 		atomic.AddUint64(&s.backendErrors, 1)
-		s.sendServerFailure(header.ID, addr)
+		s.sendError(query, qc, dnsasm.RCodeServFail, to)
 		return
 	}
 
 	// 5. Send Response
-	// The result.Wire contains the packed response bytes from upstream/cache
-	// We just rewrite the ID to match the request ID
-	// Note: ResolveRaw returns bytes ready to send, but we must ensure ID matches.
-	// We assume upstream preserves ID or we patch it.
-	// Since we use miekg/dns client, it might change ID? No, client handles matching.
-	// But valid response to CLIENT needs CLIENT's ID.
-	// ResolveRaw returns 'in.Unpack() -> ...'. ID is from upstream response.
-	// We MUST patch the ID.
+	// result.Wire is the upstream (or cached) answer, carrying the
+	// upstream's ID and our 0x20-randomized question name. Give it the
+	// client's ID and exact question casing before it goes back, and cut
+	// it to what the client accepts. A batched socket does both and
+	// queues the answer in one call.
+	if to.io != nil {
+		if err := to.io.Answer(to.slot, result.Wire, limit); err != nil {
+			atomic.AddUint64(&s.packErrors, 1)
+			s.sendError(query, qc, dnsasm.RCodeServFail, to)
+			return
+		}
+		atomic.AddUint64(&s.packetsSent, 1)
+		return
+	}
+	// An answer that cannot be patched (runt, or a question other than
+	// the client's) never goes out as is.
+	if err := dnsasm.PatchResponse(result.Wire, query); err != nil {
+		atomic.AddUint64(&s.packErrors, 1)
+		s.sendError(query, qc, dnsasm.RCodeServFail, to)
+		return
+	}
 
-	if len(result.Wire) >= 2 {
-		result.Wire[0] = byte(header.ID >> 8)
-		result.Wire[1] = byte(header.ID)
+	// Upstream answers can exceed what this client accepts; cut them at
+	// an RRset boundary and set TC so it retries over TCP.
+	wire, err := dnsasm.Truncate(result.Wire, limit)
+	if err != nil {
+		atomic.AddUint64(&s.packErrors, 1)
+		s.sendError(query, qc, dnsasm.RCodeServFail, to)
+		return
 	}
 
-	if _, err := s.conn.WriteToUDP(result.Wire, addr); err != nil {
+	if err := s.send(to, wire); err != nil {
 		atomic.AddUint64(&s.packErrors, 1)
 		return
 	}
@@ -214,19 +537,48 @@ func (s *FastUDPServer) handlePacket(ctx context.Context, packet []byte, addr *n
 	atomic.AddUint64(&s.packetsSent, 1)
 }
 
-func (s *FastUDPServer) sendFormatError(req []byte, id uint16, addr *net.UDPAddr) {
-	// Minimal error response
-	resp := new(dns.Msg)
-	resp.SetRcodeFormatError(&dns.Msg{MsgHdr: dns.MsgHdr{Id: id}})
-	buf, _ := resp.Pack()
-	s.conn.WriteToUDP(buf, addr)
+// sendError answers req with an empty rcode response built by dnsasm
+// straight from the request bytes (ID, question and a bare OPT echoed),
+// so error answers cost no miekg/dns work or allocation.
+func (s *FastUDPServer) sendError(req []byte, qc *dnsasm.QueryClass, rcode int, to replyTo) {
+	buf := pool.GetSmallBuffer()
+	defer pool.PutSmallBuffer(buf)
+
+	if resp, err := dnsasm.Reply(buf, req, qc, rcode, 0); err == nil {
+		s.send(to, resp)
+	}
 }
 
-func (s *FastUDPServer) sendServerFailure(id uint16, addr *net.UDPAddr) {
-	resp := new(dns.Msg)
-	resp.Id = id
-	resp.Response = true
-	resp.Rcode = dns.RcodeServerFailure
-	buf, _ := resp.Pack()
-	s.conn.WriteToUDP(buf, addr)
+// sendCookie answers a request without a question (RFC 7873 5.4):
+// NOERROR and an OPT carrying the client cookie and our server cookie,
+// which is the request's own while it is still valid.
+func (s *FastUDPServer) sendCookie(req []byte, qc *dnsasm.QueryClass, to replyTo) {
+	option := qc.EDNS.Cookie(req)
+	if s.cookies == nil {
+		s.sendError(req, qc, dnsasm.RCodeNoError, to)
+		return
+	}
+	status, server := s.cookies.Check(option, to.peer().AsSlice())
+	if status == dnsasm.CookieFormErr || len(option) < 8 {
+		atomic.AddUint64(&s.packErrors, 1)
+		s.sendError(req, qc, dnsasm.RCodeFormErr, to)
+		return
+	}
+
+	buf := pool.GetSmallBuffer()
+	defer pool.PutSmallBuffer(buf)
+
+	resp, err := dnsasm.Reply(buf, req, qc, dnsasm.RCodeNoError, 0)
+	if err != nil || len(resp)+4+8+len(server) > len(buf) {
+		return
+	}
+	// Reply ends with a bare OPT; give it the option and its RDLENGTH
+	n := len(resp)
+	resp = buf[:n+4+8+len(server)]
+	binary.BigEndian.PutUint16(resp[n-2:], uint16(4+8+len(server)))
+	binary.BigEndian.PutUint16(resp[n:], dnsasm.EDNSOptionCookie)
+	binary.BigEndian.PutUint16(resp[n+2:], uint16(8+len(server)))
+	copy(resp[n+4:], option[:8])
+	copy(resp[n+12:], server[:])
+	s.send(to, resp)
 }
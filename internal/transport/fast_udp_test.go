@@ -206,3 +206,144 @@ func TestQPSRate(t *testing.T) {
 	t.Logf("  Per-Query:      %.2f µs", 1_000_000/qps)
 	t.Logf("═══════════════════════════════════════════════════════════")
 }
+
+// exchange sends query to the server at addr and returns its answer.
+func exchange(t *testing.T, addr string, query []byte) []byte {
+	t.Helper()
+	c, err := net.Dial("udp", addr)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer c.Close()
+
+	if _, err := c.Write(query); err != nil {
+		t.Fatal(err)
+	}
+	c.SetReadDeadline(time.Now().Add(2 * time.Second))
+	buf := make([]byte, 1500)
+	n, err := c.Read(buf)
+	if err != nil {
+		t.Fatalf("no answer: %v", err)
+	}
+	return buf[:n]
+}
+
+// TestSlowPathReplies checks the requests the slow path answers itself:
+// NOTIFY gets NOTIMP, and a cookie-only query (RFC 7873 5.4) a server
+// cookie that holds when sent back.
+func TestSlowPathReplies(t *testing.T) {
+	// The resolver is never reached
+	s, err := NewFastUDPServer("127.0.0.1:0", engine.NewResolver("127.0.0.1:1"), 1)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := s.Start(); err != nil {
+		t.Fatal(err)
+	}
+	defer s.Stop()
+	addr := s.conn.LocalAddr().String()
+
+	notify := append([]byte(nil), benchmarkQuery...)
+	notify[2] = 0x20 // Opcode 4
+	resp := exchange(t, addr, notify)
+	if resp[2]&0x78 != 0x20 || resp[3]&0x0F != dnsasm.RCodeNotImp {
+		t.Errorf("NOTIFY answered % x, want NOTIMP", resp[:4])
+	}
+
+	cookieQuery := []byte{
+		0xab, 0xcd, 0x00, 0x00, 0, 0, 0, 0, 0, 0, 0, 1, // No question, one OPT
+		0x00, 0x00, 0x29, 0x04, 0xd0, 0, 0, 0, 0, 0, 12, // OPT, 12 bytes of options
+		0x00, 0x0a, 0x00, 0x08, 1, 2, 3, 4, 5, 6, 7, 8, // Client cookie only
+	}
+	var server []byte
+	for round := 0; round < 2; round++ {
+		resp := exchange(t, addr, cookieQuery)
+		if resp[3]&0x0F != dnsasm.RCodeNoError || len(resp) != 12+11+4+8+16 {
+			t.Fatalf("cookie query answered % x", resp)
+		}
+		cookie := resp[len(resp)-24:]
+		if string(cookie[:8]) != "\x01\x02\x03\x04\x05\x06\x07\x08" {
+			t.Fatalf("client cookie not echoed: % x", cookie)
+		}
+		if round == 1 && string(cookie[8:]) != string(server) {
+			t.Errorf("valid server cookie replaced: % x, sent % x", cookie[8:], server)
+		}
+		server = append([]byte(nil), cookie[8:]...)
+
+		// Send the server cookie back with the client's
+		cookieQuery = append(cookieQuery[:21], 0, 28, 0x00, 0x0a, 0x00, 0x18, 1, 2, 3, 4, 5, 6, 7, 8)
+		cookieQuery = append(cookieQuery, server...)
+	}
+}
+
+// echoUpstream runs a resolver stand-in that answers every query with
+// its own bytes and QR set: an empty NOERROR answer.
+func echoUpstream(t *testing.T) string {
+	t.Helper()
+	pc, err := net.ListenPacket("udp", "127.0.0.1:0")
+	if err != nil {
+		t.Fatal(err)
+	}
+	t.Cleanup(func() { pc.Close() })
+
+	go func() {
+		buf := make([]byte, 1500)
+		for {
+			n, addr, err := pc.ReadFrom(buf)
+			if err != nil {
+				return
+			}
+			buf[2] |= 0x80
+			pc.WriteTo(buf[:n], addr)
+		}
+	}()
+	return pc.LocalAddr().String()
+}
+
+// TestBatchLoopback serves a burst of queries through the
+// recvmmsg/sendmmsg sockets of SetBatch and checks every answer.
+func TestBatchLoopback(t *testing.T) {
+	s, err := NewFastUDPServer("127.0.0.1:0", engine.NewResolver(echoUpstream(t)), 2)
+	if err != nil {
+		t.Fatal(err)
+	}
+	s.SetBatch(16, 0)
+	if err := s.Start(); err != nil {
+		t.Fatal(err)
+	}
+	defer s.Stop()
+
+	c, err := net.DialUDP("udp", nil, &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1), Port: s.ios[0].Port()})
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer c.Close()
+
+	const queries = 32
+	for i := 0; i < queries; i++ {
+		q := append([]byte(nil), benchmarkQuery...)
+		q[0], q[1] = 0x50, byte(i)
+		if _, err := c.Write(q); err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	seen := make(map[byte]bool)
+	buf := make([]byte, 1500)
+	for len(seen) < queries {
+		c.SetReadDeadline(time.Now().Add(2 * time.Second))
+		n, err := c.Read(buf)
+		if err != nil {
+			t.Fatalf("%d of %d answers: %v", len(seen), queries, err)
+		}
+		resp := buf[:n]
+		if n != len(benchmarkQuery) || resp[0] != 0x50 || resp[2]&0x80 == 0 ||
+			resp[3]&0x0F != dnsasm.RCodeNoError || string(resp[12:]) != string(benchmarkQuery[12:]) {
+			t.Fatalf("bad answer % x", resp)
+		}
+		seen[resp[1]] = true
+	}
+	if got := s.Stats()["recv"]; got != queries {
+		t.Errorf("recv = %d, want %d", got, queries)
+	}
+}